@@ -0,0 +1,483 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "pfm2chrtr2.h"
+
+
+
+/*  Allocate the buffers for one row of bins.  */
+
+void allocate_row_buffer (ROW_BUFFER *row, int32_t width)
+{
+  row->width = width;
+  row->bin_row = (BIN_RECORD *) malloc (width * sizeof (BIN_RECORD));
+  row->chrtr2_row = (CHRTR2_RECORD *) malloc (width * sizeof (CHRTR2_RECORD));
+  row->populated = (uint8_t *) malloc (width * sizeof (uint8_t));
+  row->offset = (int64_t *) calloc (width, sizeof (int64_t));
+  row->numrecs = (int32_t *) calloc (width, sizeof (int32_t));
+  row->sums = (BIN_SUMS *) malloc (width * sizeof (BIN_SUMS));
+  memset (&row->depths, 0, sizeof (DEPTH_SOA));
+
+  if (row->bin_row == NULL || row->chrtr2_row == NULL || row->populated == NULL || row->offset == NULL ||
+      row->numrecs == NULL || row->sums == NULL)
+    {
+      perror ("Allocating row buffer in allocate_row_buffer");
+      exit (-1);
+    }
+}
+
+
+
+void free_row_buffer (ROW_BUFFER *row)
+{
+  free (row->bin_row);
+  free (row->chrtr2_row);
+  free (row->populated);
+  free (row->offset);
+  free (row->numrecs);
+  free (row->sums);
+  free_depth_soa (&row->depths);
+
+  row->bin_row = NULL;
+  row->chrtr2_row = NULL;
+  row->populated = NULL;
+  row->offset = NULL;
+  row->numrecs = NULL;
+  row->sums = NULL;
+}
+
+
+
+/*  Set the H/V uncertainty fields of the CHRTR2 header for an output that does or doesn't store them.  */
+
+void uncertainty_header (uint8_t uncertainty, PFM_OPEN_ARGS *open_args, CHRTR2_HEADER *chrtr2_header)
+{
+  if (uncertainty)
+    {
+      chrtr2_header->min_horizontal_uncertainty = 0.0;
+      chrtr2_header->max_horizontal_uncertainty = 20000.0;
+      chrtr2_header->horizontal_uncertainty_scale = open_args->head.horizontal_error_scale;
+      chrtr2_header->min_vertical_uncertainty = 0.0;
+      chrtr2_header->max_vertical_uncertainty = 10000.0;
+      chrtr2_header->vertical_uncertainty_scale = open_args->head.vertical_error_scale;
+    }
+  else
+    {
+      chrtr2_header->min_horizontal_uncertainty = 0.0;
+      chrtr2_header->max_horizontal_uncertainty = 0.0;
+      chrtr2_header->horizontal_uncertainty_scale = 0.0;
+      chrtr2_header->min_vertical_uncertainty = 0.0;
+      chrtr2_header->max_vertical_uncertainty = 0.0;
+      chrtr2_header->vertical_uncertainty_scale = 0.0;
+    }
+}
+
+
+
+/*  Set the grid type in the CHRTR2 header for an output gridded with grid_type.  CHRTR2 has no grid type for inverse
+    distance gridding so --grid_type G is marked undefined rather than MISP.  Ungridded outputs have always been
+    marked MISP and still are.  */
+
+void grid_type_header (int32_t grid_type, CHRTR2_HEADER *chrtr2_header)
+{
+  if (grid_type == 2)
+    {
+      chrtr2_header->grid_type = CHRTR2_UNDEFINED;
+    }
+  else
+    {
+      chrtr2_header->grid_type = CHRTR2_MISP;
+    }
+}
+
+
+
+/*  Set the total uncertainty from the bin standard deviation and apply the null rules for uncertainty and Z.  The Z
+    value must already be set in the record.  */
+
+static void set_total_uncertainty (BIN_RECORD *bin_record, OPTIONS *options, CHRTR2_RECORD *chrtr2_record)
+{
+  chrtr2_record->uncertainty = bin_record->standard_dev * 2.0;
+
+
+  /*  SJ - 02/08/2013 - establish bound for uncertainty as a percent of depth  */
+
+  if ((bin_record->standard_dev * 2.0) > (chrtr2_record->z * ((float) options->ubound / 100.0)))
+    {
+      chrtr2_record->uncertainty = CHRTR2_NULL_Z_VALUE;
+    }
+
+
+  //  SJ - 01/29/2013 0.0 is not a valid uncertainty.
+
+  if (chrtr2_record->uncertainty == 0.0) chrtr2_record->uncertainty = CHRTR2_NULL_Z_VALUE;
+
+
+  //  SJ - 02/14/2013 0.0 is not a valid depth, so set to NULL.
+
+  if (chrtr2_record->z == 0.0) chrtr2_record->z = CHRTR2_NULL_Z_VALUE;
+}
+
+
+
+/*  Compute the CHRTR2 record for one PFM bin from the sums of its valid depth records.  This is separate from
+    aggregate_bin so that the --variant outputs can make their own records from the same sums.  Returns the number
+    of valid points that went into the record.  If it's zero the record shouldn't be written.  */
+
+int32_t bin_sums_record (BIN_SUMS *sums, BIN_RECORD *bin_record, OPTIONS *options, CHRTR2_HEADER *chrtr2_header,
+                         CHRTR2_RECORD *chrtr2_record)
+{
+  memset (chrtr2_record, 0, sizeof (CHRTR2_RECORD));
+
+
+  /*  Just to be on the safe side let's make sure we got at least one valid point.  */
+
+  if (!sums->count) return (0);
+
+
+  if (options->uncertainty)
+    {
+      chrtr2_record->vertical_uncertainty = (float) (sums->v_sum / (double) sums->count);
+
+
+      /*  SJ - 02/12/2013 - temporarily set h to NULL when it exceeds the bounds  */
+
+      if (((float) (sums->h_sum / (double) sums->count)) >= chrtr2_header->max_horizontal_uncertainty)
+        {
+          chrtr2_record->horizontal_uncertainty = chrtr2_header->max_horizontal_uncertainty - 1;
+        }
+      else
+        {
+          chrtr2_record->horizontal_uncertainty = (float) (sums->h_sum / (double) sums->count);
+        }
+    }
+
+  chrtr2_record->number_of_points = sums->count;
+  chrtr2_record->z = (sums->sum / (double) sums->count);
+
+  set_total_uncertainty (bin_record, options, chrtr2_record);
+
+
+  if (sums->drawn)
+    {
+      chrtr2_record->status = CHRTR2_DIGITIZED_CONTOUR;
+    }
+  else
+    {
+      chrtr2_record->status = CHRTR2_REAL;
+    }
+
+  return (sums->count);
+}
+
+
+
+/*  Compute the CHRTR2 record for one PFM bin from its depth records.  The sums are left in sums.  The H/V
+    uncertainty is summed if this output or any --variant needs it.  */
+
+int32_t aggregate_bin (DEPTH_SOA *depths, BIN_RECORD *bin_record, OPTIONS *options, CHRTR2_HEADER *chrtr2_header,
+                       BIN_SUMS *sums, CHRTR2_RECORD *chrtr2_record)
+{
+  sum_depths (depths, options->uncertainty || options->sum_uncertainty, sums);
+
+  return (bin_sums_record (sums, bin_record, options, chrtr2_header, chrtr2_record));
+}
+
+
+
+/*  Compute the CHRTR2 record for one PFM bin from the precomputed values in the bin record only (--bin_layer).  The
+    depth is the average filtered depth and the point count is the number of soundings in the bin.  H/V uncertainty
+    and hand-drawn contours can't be determined without the depth records so we don't set them.  */
+
+int32_t aggregate_bin_record (BIN_RECORD *bin_record, OPTIONS *options, CHRTR2_RECORD *chrtr2_record)
+{
+  memset (chrtr2_record, 0, sizeof (CHRTR2_RECORD));
+
+  if (!(bin_record->validity & PFM_DATA) || !bin_record->num_soundings) return (0);
+
+  chrtr2_record->number_of_points = bin_record->num_soundings;
+  chrtr2_record->z = bin_record->avg_filtered_depth;
+
+  set_total_uncertainty (bin_record, options, chrtr2_record);
+
+  chrtr2_record->status = CHRTR2_REAL;
+
+  return (bin_record->num_soundings);
+}
+
+
+
+/*  Return the column of the first bin with data in a row at or after col, or the row width if there isn't one.  If
+    the occupancy bitmap is being built as we go (see defer_occupancy) we look at the bin records, which read_row
+    has read for the whole row.  */
+
+static int32_t next_bin (OCCUPANCY *occupancy, ROW_BUFFER *row, int32_t col)
+{
+  if (!occupancy->deferred) return (next_occupied (occupancy, row->row, col));
+
+  while (col < row->width && !(row->bin_row[col].validity & PFM_DATA)) col++;
+
+  return (col);
+}
+
+
+
+/*  Read one row of bins and the depth arrays for all populated bins from the PFM file.  Only the bins between the
+    first and last occupied bin in the row are read and empty rows aren't read at all, unless the occupancy bitmap
+    is being built as we go, in which case the whole row is read.  The bin records for the row come in with a
+    single read_bin_row call.  The PFM library has no bulk depth reader so the depth arrays are read per occupied
+    bin, in row order, into the row's reusable depth buffers.  In --bin_layer mode only the bin records are read.
+    Rows and columns are offset by pfm_row0 and pfm_col0 when only part of the PFM is being converted.  */
+
+void read_row (int32_t pfm_handle, int32_t row_num, OPTIONS *options, OCCUPANCY *occupancy, ROW_BUFFER *row)
+{
+  int32_t             j, first, last;
+  NV_I32_COORD2       coord;
+
+
+  row->row = row_num;
+  row->depths.count = 0;
+
+  if (occupancy->deferred)
+    {
+      first = 0;
+      last = row->width - 1;
+    }
+  else
+    {
+      if (!occupancy->row_count[row_num]) return;
+
+      first = next_occupied (occupancy, row_num, 0);
+      last = last_occupied (occupancy, row_num);
+    }
+
+  count_calls (CALL_READ_BIN_ROW, 1);
+  if (read_bin_row (pfm_handle, last - first + 1, options->pfm_row0 + row_num, options->pfm_col0 + first,
+                    &row->bin_row[first])) pfm_error_exit (pfm_error);
+
+  if (options->bin_layer) return;
+
+
+  coord.y = options->pfm_row0 + row_num;
+
+  for (j = next_bin (occupancy, row, first) ; j < row->width ; j = next_bin (occupancy, row, j + 1))
+    {
+      coord.x = options->pfm_col0 + j;
+
+      row->offset[j] = read_depths (pfm_handle, coord, &row->depths, &row->numrecs[j]);
+    }
+}
+
+
+
+/*  Aggregate the occupied bins in a row that has been read with read_row into CHRTR2 records.  */
+
+void reduce_row (OPTIONS *options, OCCUPANCY *occupancy, CHRTR2_HEADER *chrtr2_header, ROW_BUFFER *row)
+{
+  int32_t             j, count;
+  DEPTH_SOA           slice;
+
+
+  row->min_z = 9999999999.0;
+  row->max_z = -9999999999.0;
+  row->valid = 0;
+
+  memset (row->populated, 0, row->width * sizeof (uint8_t));
+
+  for (j = next_bin (occupancy, row, 0) ; j < row->width ; j = next_bin (occupancy, row, j + 1))
+    {
+      if (options->bin_layer)
+        {
+          count = aggregate_bin_record (&row->bin_row[j], options, &row->chrtr2_row[j]);
+        }
+      else
+        {
+          depth_soa_slice (&row->depths, row->offset[j], row->numrecs[j], &slice);
+
+          count = aggregate_bin (&slice, &row->bin_row[j], options, chrtr2_header, &row->sums[j],
+                                 &row->chrtr2_row[j]);
+
+          row->valid += count;
+        }
+
+      if (count)
+        {
+          row->populated[j] = NVTrue;
+
+          row->min_z = MIN (row->chrtr2_row[j].z, row->min_z);
+          row->max_z = MAX (row->chrtr2_row[j].z, row->max_z);
+        }
+    }
+}
+
+
+
+/*  Read and aggregate one row of bins.  */
+
+void aggregate_row (int32_t pfm_handle, int32_t row_num, OPTIONS *options, OCCUPANCY *occupancy,
+                    CHRTR2_HEADER *chrtr2_header, ROW_BUFFER *row)
+{
+  read_row (pfm_handle, row_num, options, occupancy, row);
+
+  reduce_row (options, occupancy, chrtr2_header, row);
+}
+
+
+
+/*  Write each contiguous run of populated bins in the row with one call.  Empty bins are never written so they
+    retain the null values that chrtr2_create_file put there.  Occupied bins that didn't produce a record are
+    cleared from the occupancy bitmap (or, if it's being built as we go, the ones that did are set).  If we're
+    keeping the grid in memory the Z and status of every bin in the row are saved as well, and the row is added to
+    the --overviews, written to the --variant outputs, and streamed (--stream) if there are any.  */
+
+void write_row (OUTPUT *output, ROW_BUFFER *row)
+{
+  int32_t             j, end_col, tile;
+  int64_t             index;
+
+
+  for (j = 0 ; j < row->width ; j = end_col)
+    {
+      if (!row->populated[j])
+        {
+          end_col = j + 1;
+          continue;
+        }
+
+      for (end_col = j + 1 ; end_col < row->width && row->populated[end_col] ; end_col++);
+
+      count_calls (CALL_CHRTR2_WRITE_ROW, 1);
+      if (chrtr2_write_row (output->chrtr2_handle, row->row, j, end_col - j, &row->chrtr2_row[j]))
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+    }
+
+
+  if (output->occupancy->deferred)
+    {
+      add_occupancy_row (output->occupancy, row->row, row->bin_row, row->populated);
+    }
+  else
+    {
+      for (j = next_occupied (output->occupancy, row->row, 0) ; j < row->width ;
+           j = next_occupied (output->occupancy, row->row, j + 1))
+        {
+          if (!row->populated[j]) clear_occupied (output->occupancy, row->row, j);
+        }
+    }
+
+
+  if (output->grid != NULL)
+    {
+      index = (int64_t) row->row * row->width;
+
+      for (j = 0 ; j < row->width ; j++)
+        {
+          if (row->populated[j])
+            {
+              output->grid->z[index + j] = row->chrtr2_row[j].z;
+              output->grid->status[index + j] = row->chrtr2_row[j].status;
+            }
+          else
+            {
+              output->grid->z[index + j] = output->grid->null_record.z;
+              output->grid->status[index + j] = CHRTR2_NULL;
+            }
+        }
+    }
+
+
+  if (output->tile_min_z != NULL)
+    {
+      for (j = next_occupied (output->occupancy, row->row, 0) ; j < row->width ;
+           j = next_occupied (output->occupancy, row->row, j + 1))
+        {
+          tile = (row->row / OCCUPANCY_TILE) * output->occupancy->tiles_x + j / OCCUPANCY_TILE;
+          output->tile_min_z[tile] = MIN (row->chrtr2_row[j].z, output->tile_min_z[tile]);
+          output->tile_max_z[tile] = MAX (row->chrtr2_row[j].z, output->tile_max_z[tile]);
+        }
+    }
+
+
+  output->min_z = MIN (row->min_z, output->min_z);
+  output->max_z = MAX (row->max_z, output->max_z);
+  output->soundings += row->depths.count;
+  output->rejected += row->depths.count - row->valid;
+
+
+  if (output->overviews) add_overview_row (output, row);
+
+  if (output->variants) add_variant_row (output, row);
+
+  if (output->stream != NULL) stream_row (output->stream, row->chrtr2_row, row->populated);
+
+
+  if (output->checkpoint != NULL) checkpoint_row (output, row->row + 1);
+}
+
+
+
+/*  Allocate the in-memory Z/status grid.  */
+
+void allocate_grid (GRID *grid, int32_t width, int32_t height)
+{
+  grid->width = width;
+  grid->height = height;
+  grid->z = (float *) malloc ((int64_t) width * height * sizeof (float));
+  grid->status = (uint16_t *) malloc ((int64_t) width * height * sizeof (uint16_t));
+
+  if (grid->z == NULL || grid->status == NULL)
+    {
+      perror ("Allocating in-memory grid in allocate_grid");
+      exit (-1);
+    }
+}
+
+
+
+void free_grid (GRID *grid)
+{
+  free (grid->z);
+  free (grid->status);
+
+  grid->z = NULL;
+  grid->status = NULL;
+}
@@ -0,0 +1,221 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include <pthread.h>
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    Pipelined bin aggregation (--read_ahead).
+
+    A reader thread reads bin rows and their depth arrays up to read_ahead rows ahead of the writer.  A compute
+    thread does the validity filtering and averaging and the calling thread writes the finished rows.  The three
+    stages share a ring of row buffers.  Each slot moves from EMPTY to READ to REDUCED and back to EMPTY, so the
+    ring acts as the bounded queue between each pair of stages and no stage can get more than read_ahead rows
+    ahead of the writer.
+
+*/
+
+
+#define         SLOT_EMPTY   0
+#define         SLOT_READ    1
+#define         SLOT_REDUCED 2
+
+
+typedef struct
+{
+  pthread_mutex_t     mutex;
+  pthread_cond_t      cond;
+  OPTIONS             *options;
+  OCCUPANCY           *occupancy;
+  CHRTR2_HEADER       *chrtr2_header;
+  int32_t             pfm_handle;
+  int32_t             first_row;               /*  Row to start at (after --resume)  */
+  int32_t             height;
+  int32_t             slots;
+  ROW_BUFFER          *ring;
+  uint8_t             *state;
+} PIPELINE_SHARED;
+
+
+
+/*  Wait for a ring slot to reach the requested state.  */
+
+static void wait_for_slot (PIPELINE_SHARED *shared, int32_t slot, uint8_t state)
+{
+  pthread_mutex_lock (&shared->mutex);
+  while (shared->state[slot] != state) pthread_cond_wait (&shared->cond, &shared->mutex);
+  pthread_mutex_unlock (&shared->mutex);
+}
+
+
+
+static void set_slot (PIPELINE_SHARED *shared, int32_t slot, uint8_t state)
+{
+  pthread_mutex_lock (&shared->mutex);
+  shared->state[slot] = state;
+  pthread_cond_broadcast (&shared->cond);
+  pthread_mutex_unlock (&shared->mutex);
+}
+
+
+
+static void *reader_stage (void *arg)
+{
+  PIPELINE_SHARED     *shared = (PIPELINE_SHARED *) arg;
+  int32_t             i, slot;
+
+
+  for (i = shared->first_row ; i < shared->height ; i++)
+    {
+      slot = i % shared->slots;
+
+      wait_for_slot (shared, slot, SLOT_EMPTY);
+
+      read_row (shared->pfm_handle, i, shared->options, shared->occupancy, &shared->ring[slot]);
+
+      set_slot (shared, slot, SLOT_READ);
+    }
+
+  return (NULL);
+}
+
+
+
+static void *compute_stage (void *arg)
+{
+  PIPELINE_SHARED     *shared = (PIPELINE_SHARED *) arg;
+  int32_t             i, slot;
+
+
+  for (i = shared->first_row ; i < shared->height ; i++)
+    {
+      slot = i % shared->slots;
+
+      wait_for_slot (shared, slot, SLOT_READ);
+
+      reduce_row (shared->options, shared->occupancy, shared->chrtr2_header, &shared->ring[slot]);
+
+      set_slot (shared, slot, SLOT_REDUCED);
+    }
+
+  return (NULL);
+}
+
+
+
+void aggregate_pipelined (OPTIONS *options, int32_t pfm_handle, PFM_OPEN_ARGS *open_args, CHRTR2_HEADER *chrtr2_header,
+                          OUTPUT *output)
+{
+  PIPELINE_SHARED     shared;
+  pthread_t           reader, compute;
+  int32_t             i, slot, percent = 0, old_percent = -1;
+
+
+  memset (&shared, 0, sizeof (PIPELINE_SHARED));
+
+  pthread_mutex_init (&shared.mutex, NULL);
+  pthread_cond_init (&shared.cond, NULL);
+
+  shared.options = options;
+  shared.occupancy = output->occupancy;
+  shared.chrtr2_header = chrtr2_header;
+  shared.pfm_handle = pfm_handle;
+  shared.first_row = output->first_row;
+  shared.height = open_args->head.bin_height;
+
+
+  /*  One slot for each row being read ahead plus one each for the row being reduced and the row being written.  */
+
+  shared.slots = options->read_ahead + 2;
+
+  shared.ring = (ROW_BUFFER *) calloc (shared.slots, sizeof (ROW_BUFFER));
+  shared.state = (uint8_t *) calloc (shared.slots, sizeof (uint8_t));
+
+  if (shared.ring == NULL || shared.state == NULL)
+    {
+      perror ("Allocating pipeline buffers in aggregate_pipelined");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < shared.slots ; i++) allocate_row_buffer (&shared.ring[i], open_args->head.bin_width);
+
+
+  if (pthread_create (&reader, NULL, reader_stage, &shared) || pthread_create (&compute, NULL, compute_stage, &shared))
+    {
+      perror ("Starting pipeline threads");
+      exit (-1);
+    }
+
+
+  /*  This thread is the writer stage.  */
+
+  for (i = shared.first_row ; i < shared.height ; i++)
+    {
+      slot = i % shared.slots;
+
+      wait_for_slot (&shared, slot, SLOT_REDUCED);
+
+      write_row (output, &shared.ring[slot]);
+
+      set_slot (&shared, slot, SLOT_EMPTY);
+
+
+      percent = ((float) i / (float) shared.height) * 100.0;
+      if (percent != old_percent)
+        {
+          fprintf (stderr, "Processing - %03d%%\r", percent);
+          fflush (stderr);
+          old_percent = percent;
+        }
+    }
+
+
+  pthread_join (reader, NULL);
+  pthread_join (compute, NULL);
+
+  for (i = 0 ; i < shared.slots ; i++) free_row_buffer (&shared.ring[i]);
+
+  free (shared.ring);
+  free (shared.state);
+
+  pthread_mutex_destroy (&shared.mutex);
+  pthread_cond_destroy (&shared.cond);
+}
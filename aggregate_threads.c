@@ -0,0 +1,222 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include <pthread.h>
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    Multithreaded bin aggregation (--threads).
+
+    Each worker thread opens its own handle on the PFM file and repeatedly takes the next small band of rows from
+    a shared band counter.  Bands are handed out in ascending row order and are small enough that a worker that
+    gets stuck in a dense band doesn't leave the others idle.  Finished rows go into a ring of row buffers and the
+    calling thread is the single writer.  It writes the rows to the CHRTR2 file in row order and merges the min/max Z
+    so the output is identical to the serial run.  Because bands are issued in order, the band holding the lowest
+    unwritten row is always being worked on, so workers can safely wait for ring space without deadlocking.
+
+*/
+
+
+typedef struct
+{
+  pthread_mutex_t     mutex;
+  pthread_cond_t      cond;
+  OPTIONS             *options;
+  OCCUPANCY           *occupancy;
+  PFM_OPEN_ARGS       *open_args;
+  CHRTR2_HEADER       *chrtr2_header;
+  int32_t             height;
+  int32_t             band_rows;               /*  Rows per band  */
+  int32_t             next_band_row;           /*  First row of the next band to be handed out  */
+  int32_t             next_write;              /*  Next row the writer is waiting for  */
+  int32_t             window;                  /*  Number of row buffers in the ring  */
+  ROW_BUFFER          *ring;
+  uint8_t             *done;                   /*  NVTrue when ring[row % window] holds a finished row  */
+} AGGREGATE_SHARED;
+
+
+
+static void *aggregate_worker (void *arg)
+{
+  AGGREGATE_SHARED    *shared = (AGGREGATE_SHARED *) arg;
+  PFM_OPEN_ARGS       open_args;
+  int32_t             pfm_handle, start_row, end_row, i, slot;
+
+
+  /*  Every worker gets its own PFM handle so that reads don't share file positions.  */
+
+  memset (&open_args, 0, sizeof (PFM_OPEN_ARGS));
+  strcpy (open_args.list_path, shared->open_args->list_path);
+  open_args.checkpoint = 0;
+
+  pfm_handle = open_existing_pfm_file (&open_args);
+  if (pfm_handle < 0) pfm_error_exit (pfm_error);
+
+
+  while (NVTrue)
+    {
+      pthread_mutex_lock (&shared->mutex);
+
+      if (shared->next_band_row >= shared->height)
+        {
+          pthread_mutex_unlock (&shared->mutex);
+          break;
+        }
+
+      start_row = shared->next_band_row;
+      end_row = MIN (start_row + shared->band_rows, shared->height);
+      shared->next_band_row = end_row;
+
+
+      /*  Wait until the writer has freed up ring slots for every row in the band.  */
+
+      while (end_row > shared->next_write + shared->window) pthread_cond_wait (&shared->cond, &shared->mutex);
+
+      pthread_mutex_unlock (&shared->mutex);
+
+
+      for (i = start_row ; i < end_row ; i++)
+        {
+          slot = i % shared->window;
+
+          aggregate_row (pfm_handle, i, shared->options, shared->occupancy, shared->chrtr2_header, &shared->ring[slot]);
+
+          pthread_mutex_lock (&shared->mutex);
+          shared->done[slot] = NVTrue;
+          pthread_cond_broadcast (&shared->cond);
+          pthread_mutex_unlock (&shared->mutex);
+        }
+    }
+
+  close_pfm_file (pfm_handle);
+
+  return (NULL);
+}
+
+
+
+void aggregate_threaded (OPTIONS *options, PFM_OPEN_ARGS *open_args, CHRTR2_HEADER *chrtr2_header, OUTPUT *output)
+{
+  AGGREGATE_SHARED    shared;
+  pthread_t           *thread;
+  int32_t             i, slot, percent = 0, old_percent = -1;
+
+
+  memset (&shared, 0, sizeof (AGGREGATE_SHARED));
+
+  pthread_mutex_init (&shared.mutex, NULL);
+  pthread_cond_init (&shared.cond, NULL);
+
+  shared.options = options;
+  shared.occupancy = output->occupancy;
+  shared.open_args = open_args;
+  shared.chrtr2_header = chrtr2_header;
+  shared.height = open_args->head.bin_height;
+  shared.next_band_row = output->first_row;
+  shared.next_write = output->first_row;
+  shared.band_rows = options->band_rows ? options->band_rows : MAX (1, BAND_BINS / open_args->head.bin_width);
+  shared.window = shared.band_rows * options->threads * 2;
+
+  shared.ring = (ROW_BUFFER *) calloc (shared.window, sizeof (ROW_BUFFER));
+  shared.done = (uint8_t *) calloc (shared.window, sizeof (uint8_t));
+  thread = (pthread_t *) malloc (options->threads * sizeof (pthread_t));
+
+  if (shared.ring == NULL || shared.done == NULL || thread == NULL)
+    {
+      perror ("Allocating thread data in aggregate_threaded");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < shared.window ; i++) allocate_row_buffer (&shared.ring[i], open_args->head.bin_width);
+
+
+  for (i = 0 ; i < options->threads ; i++)
+    {
+      if (pthread_create (&thread[i], NULL, aggregate_worker, &shared))
+        {
+          perror ("Starting aggregation thread");
+          exit (-1);
+        }
+    }
+
+
+  /*  This thread is the writer.  Rows are written strictly in order.  */
+
+  for (i = output->first_row ; i < shared.height ; i++)
+    {
+      slot = i % shared.window;
+
+      pthread_mutex_lock (&shared.mutex);
+      while (!shared.done[slot]) pthread_cond_wait (&shared.cond, &shared.mutex);
+      pthread_mutex_unlock (&shared.mutex);
+
+
+      write_row (output, &shared.ring[slot]);
+
+
+      pthread_mutex_lock (&shared.mutex);
+      shared.done[slot] = NVFalse;
+      shared.next_write = i + 1;
+      pthread_cond_broadcast (&shared.cond);
+      pthread_mutex_unlock (&shared.mutex);
+
+
+      percent = ((float) i / (float) shared.height) * 100.0;
+      if (percent != old_percent)
+        {
+          fprintf (stderr, "Processing - %03d%%\r", percent);
+          fflush (stderr);
+          old_percent = percent;
+        }
+    }
+
+
+  for (i = 0 ; i < options->threads ; i++) pthread_join (thread[i], NULL);
+
+  for (i = 0 ; i < shared.window ; i++) free_row_buffer (&shared.ring[i]);
+
+  free (shared.ring);
+  free (shared.done);
+  free (thread);
+
+  pthread_mutex_destroy (&shared.mutex);
+  pthread_cond_destroy (&shared.cond);
+}
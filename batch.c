@@ -0,0 +1,619 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfm2chrtr2.h"
+
+#ifndef NVWIN3X
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#define         USE_FORK
+#else
+#include <process.h>
+#endif
+
+
+/*
+
+    Batch conversion (--batch).
+
+    The batch file lists one conversion per line.  Each line is the PFM file followed by the options for that
+    conversion, exactly as they would be given on the command line (including --output_file).  Blank lines and lines
+    starting with # are ignored.  File names can't contain spaces.
+
+    Every conversion runs in its own child process so that the MISP state, the exit on error, and the memory of one
+    conversion can't affect the others.  The --threads and --max_memory given with --batch are the budget for the
+    whole batch.  Each conversion is charged the number of threads it was given (1 by default) and an estimate of the
+    memory it will need, worked out from the PFM header the same way plan_memory does.  A conversion that would need
+    more than the whole memory budget gets --max_memory set to the budget so that it is tiled to fit.  The largest
+    conversions (by bin count) are started first and smaller ones are started whenever they fit in what's left, so
+    the long jobs don't end up running alone at the end.  A conversion is always started if nothing else is running.
+
+    The output of each conversion goes to CHRTR2_FILE.log and a line is printed when each one starts and finishes.  A
+    conversion that fails is reported and the rest of the batch carries on.  On Windows the conversions are run one
+    after another.
+
+*/
+
+
+#define         JOB_PENDING 0
+#define         JOB_RUNNING 1
+#define         JOB_DONE    2
+#define         JOB_FAILED  3
+
+
+typedef struct
+{
+  char            pfm_file[512];
+  char            chrtr2_file[512];
+  char            log_file[512];
+  int32_t         argc;
+  char            **argv;                  /*  Program name, options, and the PFM file, NULL terminated  */
+  int64_t         bins;                    /*  Size of the PFM, for the scheduling  */
+  int32_t         threads;                 /*  Threads charged against the batch budget  */
+  int64_t         memory;                  /*  Bytes charged against the batch budget  */
+  int32_t         state;
+#ifdef USE_FORK
+  pid_t           pid;
+#endif
+  double          start;
+  char            message[640];            /*  Why it failed, with room for the log file name  */
+} BATCH_JOB;
+
+
+
+/*  Find the value of a --name VALUE (or --name=VALUE) option in a job's arguments.  Returns NULL if it isn't there.
+    For options without a value the option itself is returned.  */
+
+static char *job_option (BATCH_JOB *job, char *name)
+{
+  int32_t             i, len;
+
+
+  len = strlen (name);
+
+  for (i = 1 ; i < job->argc ; i++)
+    {
+      if (strncmp (job->argv[i], "--", 2) || strncmp (&job->argv[i][2], name, len)) continue;
+
+      if (job->argv[i][len + 2] == '=') return (&job->argv[i][len + 3]);
+
+      if (job->argv[i][len + 2]) continue;
+
+      if (i + 1 < job->argc && strncmp (job->argv[i + 1], "--", 2)) return (job->argv[i + 1]);
+
+      return (job->argv[i]);
+    }
+
+  return (NULL);
+}
+
+
+
+static void add_job_arg (BATCH_JOB *job, char *arg)
+{
+  job->argv = (char **) realloc (job->argv, (job->argc + 2) * sizeof (char *));
+
+  if (job->argv == NULL || (job->argv[job->argc] = strdup (arg)) == NULL)
+    {
+      perror ("Allocating batch job arguments");
+      exit (-1);
+    }
+
+  job->argc++;
+  job->argv[job->argc] = NULL;
+}
+
+
+
+/*  Set the value of a --name VALUE (or --name=VALUE) option in a job's arguments, adding it ahead of the PFM file if
+    it isn't there.  */
+
+static void set_job_option (BATCH_JOB *job, char *name, char *value)
+{
+  char                string[128];
+  int32_t             i, len;
+
+
+  len = strlen (name);
+
+  for (i = 1 ; i < job->argc - 1 ; i++)
+    {
+      if (strncmp (job->argv[i], "--", 2) || strncmp (&job->argv[i][2], name, len)) continue;
+
+      if (job->argv[i][len + 2] == '=')
+        {
+          snprintf (string, sizeof (string), "--%s=%s", name, value);
+        }
+      else if (!job->argv[i][len + 2] && i + 1 < job->argc - 1)
+        {
+          i++;
+          strcpy (string, value);
+        }
+      else
+        {
+          continue;
+        }
+
+      free (job->argv[i]);
+
+      if ((job->argv[i] = strdup (string)) == NULL)
+        {
+          perror ("Allocating batch job arguments");
+          exit (-1);
+        }
+
+      return;
+    }
+
+  free (job->argv[job->argc - 1]);
+  job->argc--;
+
+  snprintf (string, sizeof (string), "--%s", name);
+  add_job_arg (job, string);
+  add_job_arg (job, value);
+  add_job_arg (job, job->pfm_file);
+}
+
+
+
+/*  Read the batch file.  The PFM file goes last in each job's arguments so that any getopt will find the options.  */
+
+static int32_t read_batch (char *batch_file, char *program, BATCH_JOB **jobs)
+{
+  FILE                *fp;
+  char                string[8192], *token, *value;
+  int32_t             count = 0, line = 0;
+  BATCH_JOB           *job;
+
+
+  if ((fp = fopen (batch_file, "r")) == NULL)
+    {
+      perror (batch_file);
+      exit (-1);
+    }
+
+  *jobs = NULL;
+
+  while (fgets (string, sizeof (string), fp) != NULL)
+    {
+      line++;
+
+      if ((token = strtok (string, " \t\r\n")) == NULL || token[0] == '#') continue;
+
+      if (strlen (token) >= sizeof (job->pfm_file) || !strstr (token, ".pfm"))
+        {
+          fprintf (stderr, "\n\nLine %d of %s doesn't start with a PFM file!\n\n", line, batch_file);
+          exit (-1);
+        }
+
+      *jobs = (BATCH_JOB *) realloc (*jobs, (count + 1) * sizeof (BATCH_JOB));
+      if (*jobs == NULL)
+        {
+          perror ("Allocating batch jobs");
+          exit (-1);
+        }
+
+      job = &(*jobs)[count];
+      memset (job, 0, sizeof (BATCH_JOB));
+
+      strcpy (job->pfm_file, token);
+
+      add_job_arg (job, program);
+
+      while ((token = strtok (NULL, " \t\r\n")) != NULL)
+        {
+          if (!strncmp (token, "--batch", 7))
+            {
+              fprintf (stderr, "\n\nLine %d of %s can't use --batch!\n\n", line, batch_file);
+              exit (-1);
+            }
+
+          add_job_arg (job, token);
+        }
+
+      add_job_arg (job, job->pfm_file);
+
+
+      /*  Work out the output file name the same way the conversion will.  */
+
+      if ((value = job_option (job, "output_file")) != NULL && strlen (value) >= 2)
+        {
+          snprintf (job->chrtr2_file, sizeof (job->chrtr2_file) - 4, "%s", value);
+          if (strlen (job->chrtr2_file) < 4 || strcmp (&job->chrtr2_file[strlen (job->chrtr2_file) - 4], ".ch2"))
+            strcat (job->chrtr2_file, ".ch2");
+        }
+      else
+        {
+          strcpy (job->chrtr2_file, job->pfm_file);
+          sprintf (&job->chrtr2_file[strlen (job->chrtr2_file) - 4], ".ch2");
+        }
+
+      snprintf (job->log_file, sizeof (job->log_file), "%s.log", job->chrtr2_file);
+
+      count++;
+    }
+
+  fclose (fp);
+
+  return (count);
+}
+
+
+
+/*  Work out the size of a job and what it will cost from its PFM header and its options.  The number of bins with
+    data isn't known until the bin scan so, like plan_memory does for the tiles, we assume the worst.  Returns NVFalse
+    if the PFM can't be opened or the job's --threads isn't a number.  */
+
+static uint8_t size_job (BATCH_JOB *job, int32_t budget_threads, int64_t budget_memory)
+{
+  PFM_OPEN_ARGS       open_args;
+  int32_t             pfm_handle, tile, halo = DEFAULT_MISP_HALO;
+  int64_t             window, megabytes;
+  char                *value, string[32];
+
+
+  memset (&open_args, 0, sizeof (PFM_OPEN_ARGS));
+  strcpy (open_args.list_path, job->pfm_file);
+  open_args.checkpoint = 0;
+
+  pfm_handle = open_existing_pfm_file (&open_args);
+
+  if (pfm_handle < 0)
+    {
+      snprintf (job->message, sizeof (job->message), "can't open the PFM file (%s)", pfm_error_str (pfm_error));
+      return (NVFalse);
+    }
+
+  close_pfm_file (pfm_handle);
+
+  job->bins = (int64_t) open_args.head.bin_width * open_args.head.bin_height;
+
+
+  /*  A job asking for more threads than the whole batch has gets them all, and its --threads is cut to match so
+      that it really does use what it's charged.  */
+
+  job->threads = 1;
+  if ((value = job_option (job, "threads")) != NULL && (sscanf (value, "%d", &job->threads) != 1 || job->threads < 1))
+    {
+      snprintf (job->message, sizeof (job->message), "bad --threads value (%s)", value);
+      return (NVFalse);
+    }
+
+  job->threads = MIN (job->threads, budget_threads);
+
+  if (value != NULL)
+    {
+      sprintf (string, "%d", job->threads);
+      set_job_option (job, "threads", string);
+    }
+
+
+  /*  A job with its own --max_memory stays within it.  */
+
+  if ((value = job_option (job, "max_memory")) != NULL && sscanf (value, "%lld", (long long *) &megabytes) == 1)
+    {
+      job->memory = megabytes * 1024 * 1024;
+    }
+  else
+    {
+      /*  Occupancy bitmap and counts.  */
+
+      job->memory = (int64_t) open_args.head.bin_height * ((open_args.head.bin_width + 63) / 64) * sizeof (uint64_t) +
+        (int64_t) open_args.head.bin_height * sizeof (int32_t);
+
+      value = job_option (job, "grid_type");
+
+      if (value == NULL || strchr (value, 'M') || strchr (value, 'm'))
+        {
+          window = job->bins;
+
+          if ((value = job_option (job, "misp_halo")) != NULL) sscanf (value, "%d", &halo);
+
+          if ((value = job_option (job, "misp_tile")) != NULL && sscanf (value, "%d", &tile) == 1)
+            window = MIN (window, (int64_t) (tile + 2 * halo) * (tile + 2 * halo) * job->threads);
+
+          job->memory += window * (MISP_CELL_BYTES + MISP_POINT_BYTES);
+        }
+
+      if (job_option (job, "in_memory") != NULL && (value == NULL || !strchr ("Nn", value[0])))
+        job->memory += job->bins * (sizeof (float) + sizeof (uint16_t));
+    }
+
+
+  /*  Make anything that's too big for the whole budget tile itself to fit.  */
+
+  if (budget_memory && job->memory > budget_memory)
+    {
+      if (job_option (job, "max_memory") == NULL)
+        {
+          sprintf (string, "%lld", (long long) (budget_memory / 1024 / 1024));
+          set_job_option (job, "max_memory", string);
+        }
+
+      job->memory = budget_memory;
+    }
+
+  return (NVTrue);
+}
+
+
+
+/*  Largest first.  */
+
+static int32_t compare_jobs (const void *a, const void *b)
+{
+  BATCH_JOB           *job_a = (BATCH_JOB *) a, *job_b = (BATCH_JOB *) b;
+
+
+  if (job_a->bins > job_b->bins) return (-1);
+  if (job_a->bins < job_b->bins) return (1);
+
+  return (0);
+}
+
+
+
+static void report_job (BATCH_JOB *job)
+{
+  if (job->state == JOB_DONE)
+    {
+      fprintf (stderr, "Finished %s in %.1f seconds\n", job->pfm_file, stage_clock () - job->start);
+    }
+  else
+    {
+      fprintf (stderr, "FAILED   %s - %s\n", job->pfm_file, job->message);
+    }
+
+  fflush (stderr);
+}
+
+
+
+#ifdef USE_FORK
+
+/*  Start a conversion in a child process with its output going to its log file.  */
+
+static void start_job (BATCH_JOB *job)
+{
+  FILE                *fp;
+
+
+  fflush (stdout);
+  fflush (stderr);
+
+  job->start = stage_clock ();
+
+  job->pid = fork ();
+
+  if (job->pid < 0)
+    {
+      snprintf (job->message, sizeof (job->message), "couldn't start a process (%s)", strerror (errno));
+      job->state = JOB_FAILED;
+      report_job (job);
+      return;
+    }
+
+
+  /*  Child process.  Run the conversion as if it had been started from the command line.  */
+
+  if (!job->pid)
+    {
+      if ((fp = freopen (job->log_file, "w", stderr)) == NULL) _exit (1);
+      dup2 (fileno (fp), fileno (stdout));
+
+
+      /*  Start getopt over again on the job's arguments.  */
+
+      optind = 0;
+
+      exit (pfm2chrtr2 (job->argc, job->argv));
+    }
+
+  job->state = JOB_RUNNING;
+
+  fprintf (stderr, "Started  %s (%d thread%s, %lld MB), output in %s\n", job->pfm_file, job->threads,
+           job->threads == 1 ? "" : "s", (long long) (job->memory / 1024 / 1024), job->log_file);
+  fflush (stderr);
+}
+
+
+
+/*  Wait for one conversion to finish.  Returns the job or NULL if it wasn't one of ours.  */
+
+static BATCH_JOB *finish_job (BATCH_JOB *jobs, int32_t count)
+{
+  pid_t               pid;
+  int                 status;
+  int32_t             i;
+
+
+  pid = waitpid (-1, &status, 0);
+
+  if (pid < 0)
+    {
+      perror ("Waiting for batch conversion");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < count ; i++) if (jobs[i].state == JOB_RUNNING && jobs[i].pid == pid) break;
+
+  if (i == count) return (NULL);
+
+  if (WIFEXITED (status) && !WEXITSTATUS (status))
+    {
+      jobs[i].state = JOB_DONE;
+    }
+  else
+    {
+      if (WIFSIGNALED (status))
+        {
+          snprintf (jobs[i].message, sizeof (jobs[i].message), "killed by signal %d, see %s", WTERMSIG (status),
+                    jobs[i].log_file);
+        }
+      else
+        {
+          snprintf (jobs[i].message, sizeof (jobs[i].message), "exit status %d, see %s", WEXITSTATUS (status),
+                    jobs[i].log_file);
+        }
+
+      jobs[i].state = JOB_FAILED;
+    }
+
+  report_job (&jobs[i]);
+
+  return (&jobs[i]);
+}
+
+#endif
+
+
+
+/*  Run all of the conversions in the batch file.  Returns the number that failed.  */
+
+int32_t run_batch (OPTIONS *options, char *program)
+{
+  BATCH_JOB           *jobs, *job;
+  int32_t             count, i, threads = 0, failed = 0;
+  int64_t             memory = 0;
+  double              start;
+
+
+  start = stage_clock ();
+
+  count = read_batch (options->batch_file, program, &jobs);
+
+  fprintf (stderr, "%d conversions with %d threads", count, options->threads);
+  if (options->max_memory) fprintf (stderr, " and %lld MB", (long long) (options->max_memory / 1024 / 1024));
+  fprintf (stderr, "\n\n");
+  fflush (stderr);
+
+
+  /*  A PFM that can't be opened, or a bad --threads, fails right away.  */
+
+  for (i = 0 ; i < count ; i++)
+    {
+      if (!size_job (&jobs[i], options->threads, options->max_memory))
+        {
+          jobs[i].state = JOB_FAILED;
+          report_job (&jobs[i]);
+        }
+    }
+
+  qsort (jobs, count, sizeof (BATCH_JOB), compare_jobs);
+
+
+#ifdef USE_FORK
+  while (NVTrue)
+    {
+      /*  Start everything that fits, biggest first.  */
+
+      for (i = 0 ; i < count ; i++)
+        {
+          job = &jobs[i];
+
+          if (job->state != JOB_PENDING) continue;
+
+          if (threads && (threads + job->threads > options->threads ||
+                          (options->max_memory && memory + job->memory > options->max_memory))) continue;
+
+          start_job (job);
+
+          if (job->state == JOB_RUNNING)
+            {
+              threads += job->threads;
+              memory += job->memory;
+            }
+        }
+
+      if (!threads) break;
+
+      if ((job = finish_job (jobs, count)) != NULL)
+        {
+          threads -= job->threads;
+          memory -= job->memory;
+        }
+    }
+#else
+  for (i = 0 ; i < count ; i++)
+    {
+      job = &jobs[i];
+
+      if (job->state != JOB_PENDING) continue;
+
+      fprintf (stderr, "Started  %s\n", job->pfm_file);
+      fflush (stderr);
+
+      job->start = stage_clock ();
+
+      if (spawnv (P_WAIT, program, (const char * const *) job->argv))
+        {
+          snprintf (job->message, sizeof (job->message), "conversion failed");
+          job->state = JOB_FAILED;
+        }
+      else
+        {
+          job->state = JOB_DONE;
+        }
+
+      report_job (job);
+    }
+#endif
+
+
+  fprintf (stderr, "\n");
+
+  for (i = 0 ; i < count ; i++)
+    {
+      if (jobs[i].state != JOB_DONE)
+        {
+          fprintf (stderr, "FAILED   %s - %s\n", jobs[i].pfm_file, jobs[i].message);
+          failed++;
+        }
+
+      while (jobs[i].argc) free (jobs[i].argv[--jobs[i].argc]);
+      free (jobs[i].argv);
+    }
+
+  fprintf (stderr, "\n%d of %d conversions succeeded in %.1f seconds\n\n", count - failed, count, stage_clock () - start);
+  fflush (stderr);
+
+  free (jobs);
+
+  return (failed);
+}
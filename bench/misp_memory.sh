@@ -0,0 +1,65 @@
+#!/bin/bash
+
+#  Measure the memory that MISP needs per cell and per point for pfm2chrtr2's --max_memory planning.
+#
+#  Usage: misp_memory.sh [-s "SIDES"] [-f "FRACTIONS"]
+#
+#  misp_memory is run on square windows of each of the SIDES (default "200 400 800 1200") cells with each of the
+#  FRACTIONS (default "0.05 0.25 1.0") of the cells holding a point.  Each run is printed and then the bytes per cell
+#  and per point (and a fixed overhead) are fitted to the peak resident sizes by least squares.  Compare the fit with
+#  MISP_CELL_BYTES and MISP_POINT_BYTES in pfm2chrtr2.h.  MISP_MEMORY can be set to use a program that isn't in the
+#  PATH.
+
+
+MISP_MEMORY=${MISP_MEMORY:-misp_memory}
+
+SIDES="200 400 800 1200"
+FRACTIONS="0.05 0.25 1.0"
+
+while getopts "s:f:" opt; do
+    case $opt in
+        s) SIDES=$OPTARG ;;
+        f) FRACTIONS=$OPTARG ;;
+        *) sed -n '3,11p' $0 ; exit 1 ;;
+    esac
+done
+
+
+RUNS=""
+
+echo "rows cols points bytes"
+
+for side in $SIDES; do
+    for fraction in $FRACTIONS; do
+        RUN=$($MISP_MEMORY $side $side $fraction) || exit 1
+        echo "$RUN"
+        RUNS="$RUNS$RUN
+"
+    done
+done
+
+echo -n "$RUNS" | awk '
+    #  Normal equations for bytes = a * cells + b * points + c.
+    {
+        x[1] = $1 * $2; x[2] = $3; x[3] = 1; y = $4
+        for (i = 1 ; i <= 3 ; i++) {
+            for (j = 1 ; j <= 3 ; j++) m[i, j] += x[i] * x[j]
+            m[i, 4] += x[i] * y
+        }
+        n++
+    }
+    END {
+        if (n < 3) { print "Not enough runs to fit" > "/dev/stderr"; exit 1 }
+        for (k = 1 ; k <= 3 ; k++) {
+            for (i = k + 1 ; i <= 3 ; i++) {
+                f = m[i, k] / m[k, k]
+                for (j = k ; j <= 4 ; j++) m[i, j] -= f * m[k, j]
+            }
+        }
+        for (i = 3 ; i >= 1 ; i--) {
+            s = m[i, 4]
+            for (j = i + 1 ; j <= 3 ; j++) s -= m[i, j] * b[j]
+            b[i] = s / m[i, i]
+        }
+        printf ("\n%.1f bytes per cell, %.1f bytes per point, %.0f bytes overhead\n", b[1], b[2], b[3])
+    }'
@@ -0,0 +1,237 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <memory.h>
+#include <errno.h>
+#include <string.h>
+
+#ifdef NVWIN3X
+#define         PSAPI_VERSION 2    /*  GetProcessMemoryInfo from kernel32 so that mk doesn't need to add psapi  */
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "nvutility.h"
+
+#include "misp.h"
+
+#include "version.h"
+
+
+/*
+
+    This program measures how much memory MISP needs to grid one window so that pfm2chrtr2's --max_memory planning
+    (MISP_CELL_BYTES and MISP_POINT_BYTES in pfm2chrtr2.h) can be checked against the library that it is linked
+    with.  It builds the same array of points that pfm2chrtr2 hands to MISP for a ROWS x COLS window with one point
+    in the given fraction of the cells, runs misp_init, misp_load, misp_proc, and misp_rtrv the same way
+    pfm2chrtr2 does, and prints the growth in the peak resident size of the process.  That includes our copy of
+    the points, as MISP_POINT_BYTES does.  Each window has to be measured in a new process since the peak never
+    goes down.  misp_memory.sh runs it over a set of windows and fits the bytes per cell and per point.
+
+*/
+
+
+void usage ()
+{
+  fprintf (stderr, "\nUsage: misp_memory [--seed N] ROWS COLS FRACTION\n\n");
+  fprintf (stderr, "\tWhere:\n\n");
+  fprintf (stderr, "\tROWS and COLS are the size of the window in cells.\n");
+  fprintf (stderr, "\tFRACTION is the fraction of the cells that have a point.\n");
+  fprintf (stderr, "\t--seed seeds the generator.  The default is 1.\n\n");
+  fprintf (stderr, "\tThe output is one line with the rows, columns, points, and\n");
+  fprintf (stderr, "\tthe growth in the peak resident size in bytes.\n\n\n");
+  exit (-1);
+}
+
+
+
+/*  xorshift64* (the same as pfm_bench_gen) so that the window is the same everywhere.  */
+
+static uint64_t next_random (uint64_t *state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+
+  return (*state * 0x2545f4914f6cdd1dLL);
+}
+
+
+
+/*  Uniform in [0, 1).  */
+
+static double uniform (uint64_t *state)
+{
+  return ((double) (next_random (state) >> 11) / 9007199254740992.0);
+}
+
+
+
+/*  Peak resident size of this process in bytes.  */
+
+static int64_t peak_bytes ()
+{
+#ifdef NVWIN3X
+  PROCESS_MEMORY_COUNTERS counters;
+
+
+  if (!GetProcessMemoryInfo (GetCurrentProcess (), &counters, sizeof (counters)))
+    {
+      fprintf (stderr, "\n\nGetProcessMemoryInfo failed!\n\n");
+      exit (-1);
+    }
+
+  return ((int64_t) counters.PeakWorkingSetSize);
+#else
+  struct rusage       usage;
+
+
+  if (getrusage (RUSAGE_SELF, &usage))
+    {
+      perror ("getrusage");
+      exit (-1);
+    }
+
+#ifdef __APPLE__
+  return ((int64_t) usage.ru_maxrss);
+#else
+  return ((int64_t) usage.ru_maxrss * 1024);
+#endif
+#endif
+}
+
+
+
+int32_t main (int32_t argc, char *argv[])
+{
+  NV_F64_COORD3       *xyz_array;
+  NV_F64_XYMBR        mbr;
+  uint64_t            state = 1, start;
+  int64_t             count = 0, before, after;
+  int32_t             rows, cols, i, j, arg = 1;
+  double              fraction;
+  float               *array;
+
+
+  if (argc > 2 && !strcmp (argv[1], "--seed"))
+    {
+      if (sscanf (argv[2], "%llu", (unsigned long long *) &state) != 1 || !state) usage ();
+      arg = 3;
+    }
+
+  if (argc - arg != 3) usage ();
+
+  if (sscanf (argv[arg], "%d", &rows) != 1 || rows < 2) usage ();
+  if (sscanf (argv[arg + 1], "%d", &cols) != 1 || cols < 2) usage ();
+  if (sscanf (argv[arg + 2], "%lf", &fraction) != 1 || fraction <= 0.0 || fraction > 1.0) usage ();
+
+
+  /*  One point in the middle of each cell that has data, on the same smooth surface as pfm_bench_gen's.  The cells
+      are picked twice from the same generator state, once to size the array and once to fill it.  */
+
+  start = state;
+
+  for (i = 0 ; i < rows ; i++)
+    {
+      for (j = 0 ; j < cols ; j++)
+        {
+          if (uniform (&state) < fraction) count++;
+        }
+    }
+
+  before = peak_bytes ();
+
+  xyz_array = (NV_F64_COORD3 *) malloc (MAX (1, count) * sizeof (NV_F64_COORD3));
+  array = (float *) malloc ((cols + 1) * sizeof (float));
+
+  if (xyz_array == NULL || array == NULL)
+    {
+      perror ("Allocating points");
+      exit (-1);
+    }
+
+  state = start;
+  count = 0;
+
+  for (i = 0 ; i < rows ; i++)
+    {
+      for (j = 0 ; j < cols ; j++)
+        {
+          if (uniform (&state) >= fraction) continue;
+
+          xyz_array[count].x = (double) j + 0.5;
+          xyz_array[count].y = (double) i + 0.5;
+          xyz_array[count].z = 100.0 + 0.01 * i + 20.0 * sin (j / (cols * 0.15)) * cos (i / (rows * 0.2)) +
+            5.0 * sin ((i + j) / 37.0);
+          count++;
+        }
+    }
+
+
+  /*  The same calls that run_misp in misp_surface.c makes.  */
+
+  mbr.min_x = 0.0;
+  mbr.min_y = 0.0;
+  mbr.max_x = (double) cols;
+  mbr.max_y = (double) rows;
+
+  misp_init (1.0, 1.0, 0.05, 4, 20.0, 20, 999999.0, -999999.0, 2, mbr);
+
+  for (i = 0 ; i < count ; i++) misp_load (xyz_array[i]);
+
+  misp_proc ();
+
+  for (i = 0 ; i < rows ; i++)
+    {
+      if (!misp_rtrv (array)) break;
+    }
+
+  after = peak_bytes ();
+
+  printf ("%d %d %lld %lld\n", rows, cols, (long long) count, (long long) (after - before));
+
+  free (array);
+  free (xyz_array);
+
+  return (0);
+}
@@ -0,0 +1,540 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <memory.h>
+#include <errno.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "nvutility.h"
+
+#include "pfm.h"
+
+#include "version.h"
+
+
+/*
+
+    This program builds a synthetic PFM for benchmarking pfm2chrtr2.  The size, the fraction of bins that have data
+    (and whether they are scattered or in survey swaths), the number of soundings per bin and how it is distributed,
+    and the fraction of soundings that have been edited out are all set on the command line.  The depths are a
+    smooth surface plus noise.  Everything comes from a seeded generator of our own so the same command line gives
+    the same PFM on every system.
+
+*/
+
+
+#ifndef M_PI
+#define         M_PI 3.14159265358979323846
+#endif
+
+
+#define         DIST_FIXED   0
+#define         DIST_UNIFORM 1
+#define         DIST_POISSON 2
+#define         DIST_HEAVY   3
+
+
+typedef struct
+{
+  int32_t         width;                   /*  Bins  */
+  int32_t         height;
+  double          bin_size;                /*  Meters  */
+  double          sparsity;                /*  Fraction of bins with data  */
+  uint8_t         swaths;                  /*  NVTrue for survey swaths instead of scattered bins  */
+  double          soundings;               /*  Mean soundings per bin  */
+  int32_t         distribution;            /*  DIST_FIXED, DIST_UNIFORM, DIST_POISSON, or DIST_HEAVY  */
+  double          manual;                  /*  Fraction of soundings manually invalidated  */
+  double          filter;                  /*  Fraction of soundings filter invalidated  */
+  double          contours;                /*  Fraction of bins with a hand-drawn contour sounding  */
+  uint64_t        seed;
+} GEN_OPTIONS;
+
+
+
+void usage ()
+{
+  fprintf (stderr, "\nUsage: pfm_bench_gen [--width BINS] [--height BINS] [--bin_size METERS] [--sparsity FRACTION]\n");
+  fprintf (stderr, "\t[--swaths] [--soundings MEAN] [--distribution TYPE] [--manual FRACTION]\n");
+  fprintf (stderr, "\t[--filter FRACTION] [--contours FRACTION] [--seed N] PFM_FILE\n\n");
+  fprintf (stderr, "\tWhere:\n\n");
+  fprintf (stderr, "\t--width and --height set the size of the PFM in bins.  The\n");
+  fprintf (stderr, "\t\tdefault is 1000 x 1000.\n");
+  fprintf (stderr, "\t--bin_size sets the bin size in meters.  The default is 10.\n");
+  fprintf (stderr, "\t--sparsity is the fraction of bins that have data.  The\n");
+  fprintf (stderr, "\t\tdefault is 0.5.\n");
+  fprintf (stderr, "\t--swaths puts the data in north-south survey swaths instead\n");
+  fprintf (stderr, "\t\tof scattering it over the whole area.\n");
+  fprintf (stderr, "\t--soundings is the mean number of soundings per bin with data.\n");
+  fprintf (stderr, "\t\tThe default is 10.\n");
+  fprintf (stderr, "\t--distribution is F, U, P, or H for a fixed number of\n");
+  fprintf (stderr, "\t\tsoundings per bin, uniform, Poisson, or heavy tailed\n");
+  fprintf (stderr, "\t\t(log-normal) counts.  The default is Poisson.\n");
+  fprintf (stderr, "\t--manual is the fraction of soundings that are manually\n");
+  fprintf (stderr, "\t\tinvalidated.  The default is 0.05.\n");
+  fprintf (stderr, "\t--filter is the fraction of soundings that are filter\n");
+  fprintf (stderr, "\t\tinvalidated.  The default is 0.05.\n");
+  fprintf (stderr, "\t--contours is the fraction of bins with data that get a\n");
+  fprintf (stderr, "\t\thand-drawn contour sounding.  The default is 0.\n");
+  fprintf (stderr, "\t--seed seeds the generator.  The default is 1.\n\n");
+  fprintf (stderr, "\tPFM_FILE must not already exist.\n\n\n");
+  exit (-1);
+}
+
+
+
+/*  xorshift64* so that the PFM is the same everywhere.  */
+
+static uint64_t next_random (uint64_t *state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+
+  return (*state * 0x2545f4914f6cdd1dLL);
+}
+
+
+
+/*  Uniform in [0, 1).  */
+
+static double uniform (uint64_t *state)
+{
+  return ((double) (next_random (state) >> 11) / 9007199254740992.0);
+}
+
+
+
+static double gaussian (uint64_t *state)
+{
+  double              u;
+
+
+  u = uniform (state);
+  if (u < 1.0e-300) u = 1.0e-300;
+
+  return (sqrt (-2.0 * log (u)) * cos (2.0 * M_PI * uniform (state)));
+}
+
+
+
+static int32_t bin_soundings (GEN_OPTIONS *options, uint64_t *state)
+{
+  double              limit, product;
+  int32_t             count;
+
+
+  switch (options->distribution)
+    {
+    case DIST_FIXED:
+      count = NINT (options->soundings);
+      break;
+
+    case DIST_UNIFORM:
+      count = 1 + (int32_t) (uniform (state) * (2.0 * options->soundings - 1.0));
+      break;
+
+
+      /*  Knuth's method for small means, the normal approximation for large ones.  */
+
+    case DIST_POISSON:
+    default:
+      if (options->soundings < 30.0)
+        {
+          limit = exp (-options->soundings);
+          product = uniform (state);
+
+          for (count = 0 ; product > limit ; count++) product *= uniform (state);
+        }
+      else
+        {
+          count = NINT (options->soundings + sqrt (options->soundings) * gaussian (state));
+        }
+      break;
+
+
+      /*  Most bins have a few soundings and a few have very many, like the nadir of a multibeam swath.  */
+
+    case DIST_HEAVY:
+      count = NINT (options->soundings * exp (gaussian (state) - 0.5));
+      break;
+    }
+
+  return (MAX (1, count));
+}
+
+
+
+static uint8_t bin_has_data (GEN_OPTIONS *options, int32_t row, int32_t col, uint64_t *state)
+{
+  int32_t             swath_width, period;
+
+
+  if (!options->swaths) return (uniform (state) < options->sparsity);
+
+
+  /*  Swaths 100 bins wide, spaced to give the requested coverage, with ragged edges.  */
+
+  swath_width = MIN (100, options->width);
+  period = MAX (swath_width, (int32_t) (swath_width / options->sparsity));
+
+  return ((col % period) < swath_width - (int32_t) (5.0 * uniform (state)) + (row & 1));
+}
+
+
+
+/*  A smooth surface with some ridges and a slope so that MISP has something to do.  */
+
+static double surface_depth (GEN_OPTIONS *options, double x, double y)
+{
+  return (100.0 + 0.01 * y + 20.0 * sin (x / (options->width * 0.15)) * cos (y / (options->height * 0.2)) +
+          5.0 * sin ((x + y) / 37.0));
+}
+
+
+
+int32_t main (int32_t argc, char *argv[])
+{
+  GEN_OPTIONS         options;
+  PFM_OPEN_ARGS       open_args;
+  DEPTH_RECORD        depth;
+  BIN_RECORD          bin;
+  NV_I32_COORD2       coord;
+  uint64_t            bin_state;
+  int64_t             soundings = 0, bins = 0;
+  int32_t             pfm_handle, i, j, k, count, option_index = 0, percent = 0, old_percent = -1;
+  double              x_bin_size, y_bin_size, u;
+  char                c, type;
+  extern char         *optarg;
+  extern int          optind;
+
+
+  fprintf (stderr, "\n\n %s \n\n", VERSION);
+  fflush (stderr);
+
+
+  memset (&options, 0, sizeof (GEN_OPTIONS));
+  options.width = 1000;
+  options.height = 1000;
+  options.bin_size = 10.0;
+  options.sparsity = 0.5;
+  options.soundings = 10.0;
+  options.distribution = DIST_POISSON;
+  options.manual = 0.05;
+  options.filter = 0.05;
+  options.seed = 1;
+
+  while (NVTrue)
+    {
+      static struct option long_options[] = {{"width", required_argument, 0, 0},
+                                             {"height", required_argument, 0, 0},
+                                             {"bin_size", required_argument, 0, 0},
+                                             {"sparsity", required_argument, 0, 0},
+                                             {"swaths", no_argument, 0, 0},
+                                             {"soundings", required_argument, 0, 0},
+                                             {"distribution", required_argument, 0, 0},
+                                             {"manual", required_argument, 0, 0},
+                                             {"filter", required_argument, 0, 0},
+                                             {"contours", required_argument, 0, 0},
+                                             {"seed", required_argument, 0, 0},
+                                             {0, no_argument, 0, 0}};
+
+      c = (char) getopt_long (argc, argv, "", long_options, &option_index);
+      if (c == -1) break;
+
+      switch (c)
+        {
+        case 0:
+
+          switch (option_index)
+            {
+            case 0:
+              sscanf (optarg, "%d", &options.width);
+              if (options.width < 2) usage ();
+              break;
+
+            case 1:
+              sscanf (optarg, "%d", &options.height);
+              if (options.height < 2) usage ();
+              break;
+
+            case 2:
+              sscanf (optarg, "%lf", &options.bin_size);
+              if (options.bin_size <= 0.0) usage ();
+              break;
+
+            case 3:
+              sscanf (optarg, "%lf", &options.sparsity);
+              if (options.sparsity <= 0.0 || options.sparsity > 1.0) usage ();
+              break;
+
+            case 4:
+              options.swaths = NVTrue;
+              break;
+
+            case 5:
+              sscanf (optarg, "%lf", &options.soundings);
+              if (options.soundings < 1.0) usage ();
+              break;
+
+            case 6:
+              type = optarg[0];
+              if (type == 'F' || type == 'f')
+                {
+                  options.distribution = DIST_FIXED;
+                }
+              else if (type == 'U' || type == 'u')
+                {
+                  options.distribution = DIST_UNIFORM;
+                }
+              else if (type == 'P' || type == 'p')
+                {
+                  options.distribution = DIST_POISSON;
+                }
+              else if (type == 'H' || type == 'h')
+                {
+                  options.distribution = DIST_HEAVY;
+                }
+              else
+                {
+                  usage ();
+                }
+              break;
+
+            case 7:
+              sscanf (optarg, "%lf", &options.manual);
+              if (options.manual < 0.0 || options.manual > 1.0) usage ();
+              break;
+
+            case 8:
+              sscanf (optarg, "%lf", &options.filter);
+              if (options.filter < 0.0 || options.filter > 1.0) usage ();
+              break;
+
+            case 9:
+              sscanf (optarg, "%lf", &options.contours);
+              if (options.contours < 0.0 || options.contours > 1.0) usage ();
+              break;
+
+            case 10:
+              sscanf (optarg, "%llu", (unsigned long long *) &options.seed);
+              if (!options.seed) usage ();
+              break;
+            }
+          break;
+
+        default:
+          usage ();
+          break;
+        }
+    }
+
+
+  if (optind >= argc || !strstr (argv[optind], ".pfm")) usage ();
+
+  if (options.manual + options.filter > 1.0) usage ();
+
+
+  /*  Geographic bins about bin_size meters on a side, near 30N.  */
+
+  y_bin_size = options.bin_size / 111120.0;
+  x_bin_size = y_bin_size / cos (30.0 * M_PI / 180.0);
+
+
+  memset (&open_args, 0, sizeof (PFM_OPEN_ARGS));
+
+  strcpy (open_args.list_path, argv[optind]);
+  strcpy (open_args.image_path, "NONE");
+  strcpy (open_args.target_path, "NONE");
+
+  strcpy (open_args.head.run_time, VERSION);
+  open_args.head.mbr.min_x = -80.0;
+  open_args.head.mbr.min_y = 30.0;
+  open_args.head.mbr.max_x = open_args.head.mbr.min_x + options.width * x_bin_size;
+  open_args.head.mbr.max_y = open_args.head.mbr.min_y + options.height * y_bin_size;
+  open_args.head.bin_size_xy = 0.0;
+  open_args.head.x_bin_size_degrees = x_bin_size;
+  open_args.head.y_bin_size_degrees = y_bin_size;
+  open_args.head.proj_data.projection = 0;
+  open_args.head.num_bin_attr = 0;
+  open_args.head.num_ndx_attr = 0;
+  open_args.head.horizontal_error_scale = 100.0;
+  open_args.head.vertical_error_scale = 100.0;
+  open_args.head.dynamic_reload = NVTrue;
+
+  open_args.max_depth = 1000.0;
+  open_args.offset = 0.0;
+  open_args.scale = 100.0;
+  open_args.checkpoint = 0;
+
+
+  if ((pfm_handle = open_pfm_file (&open_args)) < 0) pfm_error_exit (pfm_error);
+
+  if (open_args.head.bin_width != options.width || open_args.head.bin_height != options.height)
+    {
+      fprintf (stderr, "\n\nThe PFM library made the file %d x %d bins instead of %d x %d!\n\n", open_args.head.bin_width,
+               open_args.head.bin_height, options.width, options.height);
+      exit (-1);
+    }
+
+  write_list_file (pfm_handle, "pfm_bench_gen_synthetic_data", PFM_UNDEFINED_DATA);
+  write_line_file (pfm_handle, "Synthetic line");
+
+
+  /*  Each bin gets its own generator state from the seed and its position so that changing one option (say
+      --manual) doesn't move the soundings around.  */
+
+  memset (&depth, 0, sizeof (DEPTH_RECORD));
+
+  for (i = 0 ; i < options.height ; i++)
+    {
+      coord.y = i;
+
+      for (j = 0 ; j < options.width ; j++)
+        {
+          coord.x = j;
+
+          bin_state = options.seed * 0x9e3779b97f4a7c15LL ^ ((uint64_t) i << 32 | (uint32_t) j);
+          if (!bin_state) bin_state = 1;
+          for (k = 0 ; k < 4 ; k++) next_random (&bin_state);
+
+          if (!bin_has_data (&options, i, j, &bin_state)) continue;
+
+          count = bin_soundings (&options, &bin_state);
+
+          for (k = 0 ; k < count ; k++)
+            {
+              depth.coord = coord;
+              depth.xyz.x = open_args.head.mbr.min_x + (j + uniform (&bin_state)) * x_bin_size;
+              depth.xyz.y = open_args.head.mbr.min_y + (i + uniform (&bin_state)) * y_bin_size;
+              depth.xyz.z = surface_depth (&options, j + 0.5, i + 0.5) + 0.3 * gaussian (&bin_state);
+              depth.file_number = 0;
+              depth.line_number = 0;
+              depth.ping_number = i;
+              depth.beam_number = k;
+              depth.horizontal_error = 1.0 + uniform (&bin_state);
+              depth.vertical_error = 0.2 + 0.3 * uniform (&bin_state);
+
+              u = uniform (&bin_state);
+              if (u < options.manual)
+                {
+                  depth.validity = PFM_MANUALLY_INVAL;
+                }
+              else if (u < options.manual + options.filter)
+                {
+                  depth.validity = PFM_FILTER_INVAL;
+                }
+              else
+                {
+                  depth.validity = 0;
+                }
+
+
+              /*  Hand-drawn contour soundings have PFM_DATA set in the depth record.  */
+
+              if (!k && options.contours > 0.0 && uniform (&bin_state) < options.contours)
+                {
+                  depth.validity = PFM_DATA;
+                  depth.xyz.z = surface_depth (&options, j + 0.5, i + 0.5);
+                }
+
+              if (add_depth_record_index (pfm_handle, &depth)) pfm_error_exit (pfm_error);
+            }
+
+          soundings += count;
+          bins++;
+        }
+
+      percent = ((float) i / (float) options.height) * 100.0;
+      if (percent != old_percent)
+        {
+          fprintf (stderr, "Loading - %03d%%\r", percent);
+          fflush (stderr);
+          old_percent = percent;
+        }
+    }
+
+  fprintf (stderr, "Loading - 100%%\n");
+
+  close_pfm_file (pfm_handle);
+
+
+  /*  Compute the bin values from the depth records just like pfmLoad does at the end of a load.  */
+
+  if ((pfm_handle = open_existing_pfm_file (&open_args)) < 0) pfm_error_exit (pfm_error);
+
+  old_percent = -1;
+
+  for (i = 0 ; i < options.height ; i++)
+    {
+      coord.y = i;
+
+      for (j = 0 ; j < options.width ; j++)
+        {
+          coord.x = j;
+
+          read_bin_record_index (pfm_handle, coord, &bin);
+
+          if (bin.num_soundings) recompute_bin_values_index (pfm_handle, coord, &bin, 0);
+        }
+
+      percent = ((float) i / (float) options.height) * 100.0;
+      if (percent != old_percent)
+        {
+          fprintf (stderr, "Recomputing bins - %03d%%\r", percent);
+          fflush (stderr);
+          old_percent = percent;
+        }
+    }
+
+  fprintf (stderr, "Recomputing bins - 100%%\n\n");
+
+  close_pfm_file (pfm_handle);
+
+
+  fprintf (stderr, "%s - %d x %d bins, %lld bins with data, %lld soundings\n\n", open_args.list_path, options.width,
+           options.height, (long long) bins, (long long) soundings);
+  fflush (stderr);
+
+
+  return (0);
+}
@@ -0,0 +1,18 @@
+INCLUDEPATH += /c/PFM_ABEv7.0.0_Win64/include
+LIBS += -L /c/PFM_ABEv7.0.0_Win64/lib -lpfm -lnvutility -lgdal -lxml2 -lpoppler -lpthread -lm -liconv
+DEFINES += NVWIN3X
+CONFIG += console
+CONFIG -= qt
+QMAKE_LFLAGS += 
+######################################################################
+# Automatically generated by qmake (2.01a) Wed Jan 22 13:46:12 2020
+######################################################################
+
+TEMPLATE = app
+TARGET = pfm_bench_gen
+DEPENDPATH += .
+INCLUDEPATH += .
+
+# Input
+HEADERS += version.h
+SOURCES += main.c
@@ -0,0 +1,122 @@
+#!/bin/bash
+
+#  Benchmark pfm2chrtr2 on a set of synthetic PFM files.
+#
+#  Usage: run_bench.sh [-w WORK_DIR] [-r REPEATS] [-o RESULTS.csv] [-b BASELINE.csv] [-- PFM2CHRTR2_OPTIONS]
+#
+#  The PFM files are built once with pfm_bench_gen and kept in WORK_DIR (default ./bench_work) so later runs only
+#  time pfm2chrtr2.  Each case is run REPEATS times (default 3) with --timing and the fastest run is kept.  The
+#  results go to RESULTS.csv (default WORK_DIR/results.csv).  If a BASELINE.csv from an earlier build is given the
+#  change in each time is printed next to it.  Anything after -- is passed to pfm2chrtr2 (for example
+#  -- --threads 8 --misp_tile 500).  PFM2CHRTR2 and PFM_BENCH_GEN can be set to use programs that aren't in the PATH.
+
+
+PFM2CHRTR2=${PFM2CHRTR2:-pfm2chrtr2}
+PFM_BENCH_GEN=${PFM_BENCH_GEN:-pfm_bench_gen}
+
+WORK_DIR=./bench_work
+REPEATS=3
+RESULTS=""
+BASELINE=""
+
+while getopts "w:r:o:b:" opt; do
+    case $opt in
+        w) WORK_DIR=$OPTARG ;;
+        r) REPEATS=$OPTARG ;;
+        o) RESULTS=$OPTARG ;;
+        b) BASELINE=$OPTARG ;;
+        *) sed -n '3,12p' $0 ; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+if [ "$1" = "--" ]; then
+    shift
+fi
+
+mkdir -p $WORK_DIR || exit 1
+RESULTS=${RESULTS:-$WORK_DIR/results.csv}
+
+
+#  name:pfm_bench_gen options
+
+CASES=(
+    "dense_small:--width 500 --height 500 --sparsity 1.0 --soundings 10"
+    "sparse_scatter:--width 2000 --height 2000 --sparsity 0.05 --soundings 10"
+    "swaths:--width 2000 --height 2000 --sparsity 0.4 --swaths --soundings 20"
+    "heavy_tail:--width 1000 --height 1000 --sparsity 0.5 --soundings 40 --distribution H"
+    "fixed_deep:--width 1000 --height 1000 --sparsity 0.5 --soundings 100 --distribution F"
+    "heavily_edited:--width 1000 --height 1000 --sparsity 0.5 --soundings 20 --manual 0.3 --filter 0.3"
+    "contours:--width 1000 --height 1000 --sparsity 0.2 --soundings 10 --contours 0.05"
+)
+
+
+#  Pull a stage time (and rates) out of the --timing report.
+
+stage_seconds ()
+{
+    awk -v stage="$1" 'index ($0, stage) == 1 {print substr ($0, length (stage) + 1)}' $2 | awk '{print $1}'
+}
+
+
+echo "case,bins,soundings,scan,aggregation,gridding_load,gridding_solve,gridding_writeback,elapsed,bins_per_sec,soundings_per_sec" >$RESULTS
+
+printf "\n%-16s %10s %12s %9s %9s %9s %9s %9s %9s %12s %14s\n" case bins soundings scan aggregate load solve writeback elapsed "bins/s" "soundings/s"
+
+for entry in "${CASES[@]}"; do
+    name=${entry%%:*}
+    gen_options=${entry#*:}
+    pfm=$WORK_DIR/$name.pfm
+
+    if [ ! -f $pfm ]; then
+        echo "Building $pfm" >&2
+        $PFM_BENCH_GEN $gen_options $pfm 2>$WORK_DIR/$name.gen.log || { echo "pfm_bench_gen failed for $name" >&2 ; exit 1 ; }
+    fi
+
+    best=""
+    for ((run = 0 ; run < REPEATS ; run++)); do
+        rm -f $WORK_DIR/$name.ch2
+        $PFM2CHRTR2 "$@" --timing --output_file $WORK_DIR/$name.ch2 $pfm >/dev/null 2>$WORK_DIR/$name.log ||
+            { echo "pfm2chrtr2 failed for $name, see $WORK_DIR/$name.log" >&2 ; exit 1 ; }
+
+        elapsed=$(stage_seconds "Elapsed" $WORK_DIR/$name.log)
+        if [ -z "$best" ] || awk -v a=$elapsed -v b=$best 'BEGIN {exit !(a < b)}'; then
+            best=$elapsed
+            cp $WORK_DIR/$name.log $WORK_DIR/$name.best.log
+        fi
+    done
+
+    log=$WORK_DIR/$name.best.log
+    bins=$(grep "bins with data" $log | awk '{print $1}')
+    soundings=$(grep "bins with data" $log | awk '{print $5}')
+    scan=$(stage_seconds "Bin scan" $log)
+    aggregate=$(stage_seconds "Aggregation" $log)
+    load=$(stage_seconds "Gridding load" $log)
+    solve=$(stage_seconds "Gridding solve" $log)
+    writeback=$(stage_seconds "Gridding writeback" $log)
+    bins_rate=$(awk -v n=$bins -v t=$aggregate 'BEGIN {if (t > 0) printf "%.0f", n / t; else print 0}')
+    soundings_rate=$(awk -v n=$soundings -v t=$aggregate 'BEGIN {if (t > 0) printf "%.0f", n / t; else print 0}')
+
+    echo "$name,$bins,$soundings,$scan,$aggregate,$load,$solve,$writeback,$best,$bins_rate,$soundings_rate" >>$RESULTS
+
+    printf "%-16s %10s %12s %9s %9s %9s %9s %9s %9s %12s %14s\n" $name $bins $soundings $scan $aggregate $load $solve \
+        $writeback $best $bins_rate $soundings_rate
+done
+
+echo
+echo "Results are in $RESULTS"
+
+
+#  Compare with an earlier run.  Negative changes are faster.
+
+if [ -n "$BASELINE" ]; then
+    echo
+    printf "%-16s %12s %12s %12s %12s %12s %12s\n" "change vs" scan aggregate load solve writeback elapsed
+    awk -F, 'NR == FNR {if (FNR > 1) for (i = 4 ; i <= 9 ; i++) base[$1, i] = $i ; next}
+             FNR > 1 {printf "%-16s", $1;
+                      for (i = 4 ; i <= 9 ; i++)
+                        {
+                          if (($1, i) in base && base[$1, i] > 0) printf " %+11.1f%%", 100.0 * ($i - base[$1, i]) / base[$1, i];
+                          else printf " %12s", "-";
+                        }
+                      printf "\n"}' $BASELINE $RESULTS
+fi
@@ -0,0 +1,31 @@
+#!/bin/bash
+
+#  Build pfm2chrtr2, ch2_diff, and misp_memory with the stand-in PFM, CHRTR2, MISP, and GDAL libraries.
+#
+#  Usage: build.sh [BUILD_DIR]
+#
+#  The programs go in BUILD_DIR (default ./standin_build).  The pfm2chrtr2 sources are the ones listed in
+#  pfm2chrtr2.pro.  CC and CFLAGS can be set to use another compiler or flags.
+
+
+STANDIN_DIR=$(cd $(dirname $0) && pwd)
+SOURCE_DIR=$(cd $STANDIN_DIR/../.. && pwd)
+BUILD_DIR=${1:-./standin_build}
+
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:-"-O2 -g -Wall -Wextra"}
+
+mkdir -p $BUILD_DIR || exit 1
+
+SOURCES=""
+for file in $(sed -n 's/^SOURCES += //p' $SOURCE_DIR/pfm2chrtr2.pro); do
+    SOURCES="$SOURCES $SOURCE_DIR/$file"
+done
+
+$CC $CFLAGS -DNVLinux -I$STANDIN_DIR/include -o $BUILD_DIR/pfm2chrtr2 $SOURCES $STANDIN_DIR/standin_pfm.c \
+    $STANDIN_DIR/standin_misp.c $STANDIN_DIR/standin_gdal.c -lpthread -lm || exit 1
+
+$CC $CFLAGS -I$STANDIN_DIR/include -o $BUILD_DIR/ch2_diff $STANDIN_DIR/ch2_diff.c -lm || exit 1
+
+$CC $CFLAGS -DNVLinux -I$STANDIN_DIR/include -I$SOURCE_DIR/bench/misp_memory -o $BUILD_DIR/misp_memory \
+    $SOURCE_DIR/bench/misp_memory/main.c $STANDIN_DIR/standin_misp.c -lm || exit 1
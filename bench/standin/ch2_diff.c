@@ -0,0 +1,475 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "chrtr2.h"
+
+
+/*
+
+    Compare the output of pfm2chrtr2 built with the stand-in libraries.
+
+    ch2_diff A.ch2 B.ch2
+        Every field of every cell must match.  Exits with 1 if any don't.
+
+    ch2_diff --stream A.ch2 STREAM_FILE
+        The --stream output must hold exactly what is in the CHRTR2 file.  Exits with 1 if it doesn't.
+
+    ch2_diff --tiff A.ch2 TIFF_FILE
+        The --geotiff output (as written by the stand-in GDAL) must hold exactly what is in the CHRTR2 file.  Exits with
+        1 if it doesn't.
+
+    ch2_diff --seams SIZE WHOLE.ch2 TILED.ch2
+        Reports how far a --misp_tile SIZE surface is from the untiled one over the cells that were interpolated in
+        both, and how much bigger the steps between neighbouring cells are across the tile edges than elsewhere.
+        The steps are compared with the untiled surface so the slope of the surface itself doesn't count.
+
+*/
+
+
+#define         VALID (CHRTR2_REAL | CHRTR2_DIGITIZED_CONTOUR | CHRTR2_INTERPOLATED)
+#define         GEOTIFF_NULL -999999.0
+
+
+typedef struct
+{
+  CHRTR2_HEADER   header;
+  CHRTR2_RECORD   *record;
+} CH2;
+
+
+typedef struct
+{
+  int64_t         count;
+  double          max;
+  double          sum_squares;
+} ERROR_STATS;
+
+
+
+static void usage ()
+{
+  fprintf (stderr, "\nUsage: ch2_diff [--stream | --tiff | --seams SIZE] CHRTR2_FILE FILE\n\n");
+  exit (-1);
+}
+
+
+
+static FILE *open_file (char *name)
+{
+  FILE                *fp;
+
+
+  if ((fp = fopen (name, "rb")) == NULL)
+    {
+      perror (name);
+      exit (-1);
+    }
+
+  return (fp);
+}
+
+
+
+static void read_ch2 (char *name, CH2 *ch2)
+{
+  FILE                *fp;
+  int64_t             size;
+
+
+  fp = open_file (name);
+
+  if (fread (&ch2->header, sizeof (CHRTR2_HEADER), 1, fp) != 1)
+    {
+      fprintf (stderr, "%s is too short\n", name);
+      exit (-1);
+    }
+
+  size = (int64_t) ch2->header.width * ch2->header.height;
+
+  if ((ch2->record = (CHRTR2_RECORD *) malloc (size * sizeof (CHRTR2_RECORD))) == NULL)
+    {
+      perror ("Allocating records");
+      exit (-1);
+    }
+
+  if (fread (ch2->record, sizeof (CHRTR2_RECORD), size, fp) != (size_t) size)
+    {
+      fprintf (stderr, "%s is too short\n", name);
+      exit (-1);
+    }
+
+  fclose (fp);
+}
+
+
+
+static void add_error (ERROR_STATS *stats, double error)
+{
+  stats->count++;
+  stats->max = MAX (stats->max, fabs (error));
+  stats->sum_squares += error * error;
+}
+
+
+
+static double rms (ERROR_STATS *stats)
+{
+  if (!stats->count) return (0.0);
+
+  return (sqrt (stats->sum_squares / stats->count));
+}
+
+
+
+static int32_t compare (CH2 *a, CH2 *b)
+{
+  int64_t             i, size, diffs = 0, real = 0, interpolated = 0;
+  CHRTR2_RECORD       *ra, *rb;
+
+
+  if (a->header.width != b->header.width || a->header.height != b->header.height)
+    {
+      printf ("sizes differ\n");
+      return (1);
+    }
+
+  size = (int64_t) a->header.width * a->header.height;
+
+  for (i = 0 ; i < size ; i++)
+    {
+      ra = &a->record[i];
+      rb = &b->record[i];
+
+      if (ra->status & CHRTR2_REAL) real++;
+      if (ra->status & CHRTR2_INTERPOLATED) interpolated++;
+
+      if (ra->z != rb->z || ra->status != rb->status || ra->uncertainty != rb->uncertainty ||
+          ra->horizontal_uncertainty != rb->horizontal_uncertainty ||
+          ra->vertical_uncertainty != rb->vertical_uncertainty || ra->number_of_points != rb->number_of_points)
+        {
+          if (diffs < 5) printf ("row %lld column %lld: %f/%d vs %f/%d\n", (long long) (i / a->header.width),
+                                 (long long) (i % a->header.width), ra->z, ra->status, rb->z, rb->status);
+          diffs++;
+        }
+    }
+
+  if (a->header.min_observed_z != b->header.min_observed_z || a->header.max_observed_z != b->header.max_observed_z)
+    {
+      printf ("observed Z range differs: %f %f vs %f %f\n", a->header.min_observed_z, a->header.max_observed_z,
+              b->header.min_observed_z, b->header.max_observed_z);
+      diffs++;
+    }
+
+  if (a->header.grid_type != b->header.grid_type)
+    {
+      printf ("grid type differs: %d vs %d\n", a->header.grid_type, b->header.grid_type);
+      diffs++;
+    }
+
+  printf ("%lld differences (%lld real, %lld interpolated cells)\n", (long long) diffs, (long long) real,
+          (long long) interpolated);
+
+  return (diffs != 0);
+}
+
+
+
+/*  The step from cell i to cell j in the tiled surface, less the same step in the whole one.  */
+
+static void add_step (CH2 *whole, CH2 *tiled, int64_t i, int64_t j, ERROR_STATS *stats)
+{
+  if (!(whole->record[i].status & VALID) || !(whole->record[j].status & VALID) || !(tiled->record[i].status & VALID) ||
+      !(tiled->record[j].status & VALID)) return;
+
+  add_error (stats, (tiled->record[j].z - tiled->record[i].z) - (whole->record[j].z - whole->record[i].z));
+}
+
+
+
+static int32_t seams (int32_t size, CH2 *whole, CH2 *tiled)
+{
+  int32_t             row, col, width = whole->header.width;
+  int64_t             i, only_whole = 0, only_tiled = 0;
+  ERROR_STATS         cells, seam, inside;
+
+
+  memset (&cells, 0, sizeof (ERROR_STATS));
+  memset (&seam, 0, sizeof (ERROR_STATS));
+  memset (&inside, 0, sizeof (ERROR_STATS));
+
+  if (width != tiled->header.width || whole->header.height != tiled->header.height)
+    {
+      printf ("sizes differ\n");
+      return (1);
+    }
+
+  for (row = 0 ; row < whole->header.height ; row++)
+    {
+      for (col = 0 ; col < width ; col++)
+        {
+          i = (int64_t) row * width + col;
+
+          if ((whole->record[i].status & CHRTR2_INTERPOLATED) && (tiled->record[i].status & CHRTR2_INTERPOLATED))
+            add_error (&cells, tiled->record[i].z - whole->record[i].z);
+
+          if ((whole->record[i].status & VALID) && !(tiled->record[i].status & VALID)) only_whole++;
+          if (!(whole->record[i].status & VALID) && (tiled->record[i].status & VALID)) only_tiled++;
+
+          if (col) add_step (whole, tiled, i - 1, i, col % size ? &inside : &seam);
+          if (row) add_step (whole, tiled, i - width, i, row % size ? &inside : &seam);
+        }
+    }
+
+  printf ("%lld interpolated cells: max %.6f RMS %.6f from untiled\n", (long long) cells.count, cells.max, rms (&cells));
+  printf ("%lld steps across tile edges: max %.6f RMS %.6f from untiled\n", (long long) seam.count, seam.max,
+          rms (&seam));
+  printf ("%lld steps inside tiles: max %.6f RMS %.6f from untiled\n", (long long) inside.count, inside.max,
+          rms (&inside));
+  printf ("%lld cells only in the untiled surface, %lld only in the tiled one\n", (long long) only_whole,
+          (long long) only_tiled);
+
+  return (0);
+}
+
+
+
+static int32_t stream (CH2 *ch2, char *name)
+{
+  FILE                *fp;
+  uint8_t             header[64], cell[10];
+  int32_t             width, height, record_size;
+  uint32_t            bom;
+  int64_t             i, size, bad = 0;
+  float               z, uncertainty, null_z;
+  uint16_t            status;
+  CHRTR2_RECORD       *record;
+
+
+  fp = open_file (name);
+
+  if (fread (header, sizeof (header), 1, fp) != 1 || memcmp (header, "CH2GRID1", 8))
+    {
+      printf ("%s doesn't have a stream header\n", name);
+      return (1);
+    }
+
+  memcpy (&bom, &header[8], 4);
+  memcpy (&width, &header[12], 4);
+  memcpy (&height, &header[16], 4);
+  memcpy (&record_size, &header[20], 4);
+  memcpy (&null_z, &header[56], 4);
+
+  if (bom != 0x01020304 || width != ch2->header.width || height != ch2->header.height || record_size != 10)
+    {
+      printf ("stream header doesn't match: %x %d %d %d\n", bom, width, height, record_size);
+      return (1);
+    }
+
+  size = (int64_t) width * height;
+
+  for (i = 0 ; i < size ; i++)
+    {
+      if (fread (cell, sizeof (cell), 1, fp) != 1)
+        {
+          printf ("stream is short at cell %lld\n", (long long) i);
+          return (1);
+        }
+
+      memcpy (&z, &cell[0], 4);
+      memcpy (&uncertainty, &cell[4], 4);
+      memcpy (&status, &cell[8], 2);
+
+      record = &ch2->record[i];
+
+      if (record->status & VALID)
+        {
+          if (z != record->z || status != record->status || uncertainty != MIN (record->uncertainty, null_z)) bad++;
+        }
+      else
+        {
+          if (status || z != null_z || uncertainty != null_z) bad++;
+        }
+    }
+
+  if (fgetc (fp) != EOF)
+    {
+      printf ("stream is too long\n");
+      return (1);
+    }
+
+  fclose (fp);
+
+  printf ("%lld cells differ from the stream\n", (long long) bad);
+
+  return (bad != 0);
+}
+
+
+
+static int32_t tiff (CH2 *ch2, char *name)
+{
+  FILE                *fp;
+  char                magic[8];
+  int32_t             width, height, row, col;
+  double              transform[6], no_data;
+  int64_t             i, k, size, bad = 0;
+  float               *band;
+  CHRTR2_RECORD       *record;
+
+
+  fp = open_file (name);
+
+  if (fread (magic, 8, 1, fp) != 1 || memcmp (magic, "STANDIN1", 8) || fread (&width, 4, 1, fp) != 1 ||
+      fread (&height, 4, 1, fp) != 1 || fread (transform, 8, 6, fp) != 6 || fread (&no_data, 8, 1, fp) != 1)
+    {
+      printf ("%s isn't a stand-in GeoTIFF\n", name);
+      return (1);
+    }
+
+  if (width != ch2->header.width || height != ch2->header.height || no_data != GEOTIFF_NULL ||
+      fabs (transform[0] - (ch2->header.mbr.wlon - ch2->header.lon_grid_size_degrees / 2.0)) > 1.0e-9 ||
+      fabs (transform[1] - ch2->header.lon_grid_size_degrees) > 1.0e-12 ||
+      fabs (transform[3] - (ch2->header.mbr.slat + (height - 0.5) * ch2->header.lat_grid_size_degrees)) > 1.0e-9 ||
+      fabs (transform[5] + ch2->header.lat_grid_size_degrees) > 1.0e-12)
+    {
+      printf ("GeoTIFF size, geotransform, or no data value doesn't match\n");
+      return (1);
+    }
+
+  size = (int64_t) width * height;
+
+  if ((band = (float *) malloc (size * 3 * sizeof (float))) == NULL)
+    {
+      perror ("Allocating bands");
+      exit (-1);
+    }
+
+  if (fread (band, sizeof (float), size * 3, fp) != (size_t) size * 3)
+    {
+      printf ("%s is too short\n", name);
+      return (1);
+    }
+
+  fclose (fp);
+
+
+  /*  The GeoTIFF is north up.  */
+
+  for (row = 0 ; row < height ; row++)
+    {
+      for (col = 0 ; col < width ; col++)
+        {
+          k = (int64_t) row * width + col;
+          i = (int64_t) (height - 1 - row) * width + col;
+          record = &ch2->record[i];
+
+          if (record->status & VALID)
+            {
+              if (band[k] != record->z || band[2 * size + k] != record->status ||
+                  band[size + k] != (record->uncertainty >= CHRTR2_NULL_Z_VALUE ? GEOTIFF_NULL : record->uncertainty))
+                bad++;
+            }
+          else
+            {
+              if (band[k] != GEOTIFF_NULL || band[size + k] != GEOTIFF_NULL || band[2 * size + k] != GEOTIFF_NULL)
+                bad++;
+            }
+        }
+    }
+
+  free (band);
+
+  printf ("%lld cells differ from the GeoTIFF\n", (long long) bad);
+
+  return (bad != 0);
+}
+
+
+
+int32_t main (int32_t argc, char *argv[])
+{
+  int32_t             option_index = 0, mode = 0, size = 0;
+  char                c;
+  CH2                 a, b;
+
+
+  while (NVTrue)
+    {
+      static struct option long_options[] = {{"stream", no_argument, 0, 0},
+                                             {"tiff", no_argument, 0, 0},
+                                             {"seams", required_argument, 0, 0},
+                                             {0, no_argument, 0, 0}};
+
+      c = (char) getopt_long (argc, argv, "", long_options, &option_index);
+      if (c == -1) break;
+
+      if (c) usage ();
+
+      mode = option_index + 1;
+
+      if (mode == 3 && (sscanf (optarg, "%d", &size) != 1 || size < 1)) usage ();
+    }
+
+  if (argc - optind != 2) usage ();
+
+  read_ch2 (argv[optind], &a);
+
+  switch (mode)
+    {
+    case 1:
+      return (stream (&a, argv[optind + 1]));
+
+    case 2:
+      return (tiff (&a, argv[optind + 1]));
+
+    case 3:
+      read_ch2 (argv[optind + 1], &b);
+      return (seams (size, &a, &b));
+    }
+
+  read_ch2 (argv[optind + 1], &b);
+
+  return (compare (&a, &b));
+}
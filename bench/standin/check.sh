@@ -0,0 +1,208 @@
+#!/bin/bash
+
+#  Check pfm2chrtr2 end to end with the stand-in libraries.
+#
+#  Usage: check.sh [-w WORK_DIR] [BUILD_DIR]
+#
+#  BUILD_DIR (default ./standin_build) is where build.sh put pfm2chrtr2 and ch2_diff.  The files are made in WORK_DIR
+#  (default ./standin_work).  Each check prints PASS or FAIL and the exit status is the number that failed.  The
+#  checks are:
+#
+#  update     an --update after an edit gives the same file (and manifest) as converting the edited PFM, and
+#             converting again without --manifest removes the manifest
+#  resume     a run killed part way through and resumed gives the same file as one that wasn't, and it won't
+#             resume if the PFM was changed in between
+#  mosaic     a mosaic of several PFMs comes out the same with --threads as without
+#  variants   each --variant output is the same as converting with its settings on its own
+#  stream     the --stream output holds what's in the CHRTR2 file, from a file, a pipe, or standard output
+#  geotiff    the --geotiff output holds what's in the CHRTR2 file
+#  seams      the RMS error in the steps between cells across the --misp_tile edges is no more than twice the RMS
+#             error in the steps inside the tiles (both against the untiled surface), so there's no visible seam
+
+
+WORK_DIR=./standin_work
+
+while getopts "w:" opt; do
+    case $opt in
+        w) WORK_DIR=$OPTARG ;;
+        *) sed -n '3,21p' $0 ; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+BUILD_DIR=$(cd ${1:-./standin_build} && pwd) || exit 1
+P2C=$BUILD_DIR/pfm2chrtr2
+DIFF=$BUILD_DIR/ch2_diff
+
+mkdir -p $WORK_DIR && cd $WORK_DIR || exit 1
+rm -f *.ch2 *.manifest *.checkpoint *.raw *.tif *.log
+
+
+#  The stand-in PFM is made up but --checkpoint looks at the file.
+
+: >test.pfm
+
+FAILED=0
+
+
+#  Print PASS or FAIL for a check depending on the status of the last command.
+
+result ()
+{
+    if [ $? = 0 ]; then
+        echo "PASS  $1"
+    else
+        echo "FAIL  $1"
+        FAILED=$((FAILED + 1))
+    fi
+}
+
+
+#  update OPTIONS
+
+check_update ()
+{
+    rm -f u.ch2* e.ch2*
+    $P2C "$@" --manifest --output_file u.ch2 test.pfm >/dev/null 2>u1.log &&
+        STANDIN_EDIT=1 $P2C "$@" --manifest --output_file e.ch2 test.pfm >/dev/null 2>e.log &&
+        STANDIN_EDIT=1 $P2C "$@" --update --output_file u.ch2 test.pfm >/dev/null 2>u2.log &&
+        grep -q "tiles changed" u2.log && $DIFF u.ch2 e.ch2 >diff.log && cmp -s u.ch2.manifest e.ch2.manifest &&
+        $P2C "$@" --output_file u.ch2 test.pfm >/dev/null 2>u3.log && [ ! -f u.ch2.manifest ]
+    result "update${*:+ $*}"
+}
+
+
+#  resume WRITES USEC OPTIONS, killing it on write WRITES with each write taking USEC microseconds
+
+check_resume ()
+{
+    local writes=$1 usec=$2
+    shift 2
+
+    rm -f r.ch2* f.ch2*
+    $P2C "$@" --manifest --output_file f.ch2 test.pfm >/dev/null 2>f.log
+    STANDIN_SLOW=$usec STANDIN_KILL_AFTER=$writes $P2C "$@" --manifest --checkpoint 1 --output_file r.ch2 test.pfm \
+        >/dev/null 2>r1.log
+    [ $? = 9 ] && [ -f r.ch2.checkpoint ] && $P2C --resume --manifest --output_file r.ch2 test.pfm >/dev/null 2>r2.log &&
+        $DIFF f.ch2 r.ch2 >diff.log && cmp -s f.ch2.manifest r.ch2.manifest && [ ! -f r.ch2.checkpoint ]
+    result "resume after $writes writes${*:+ $*}"
+}
+
+
+#  resume after the PFM was changed
+
+check_resume_changed ()
+{
+    rm -f r.ch2*
+    STANDIN_SLOW=10000 STANDIN_KILL_AFTER=200 $P2C --checkpoint 1 --output_file r.ch2 test.pfm >/dev/null 2>r1.log
+    [ $? = 9 ] && [ -f r.ch2.checkpoint ] && echo >>test.pfm && ! $P2C --resume --output_file r.ch2 test.pfm >/dev/null 2>r2.log &&
+        grep -q "has changed since the checkpoint" r2.log
+    result "resume refused after the PFM changed"
+    : >test.pfm
+}
+
+
+#  mosaic OPTIONS
+
+check_mosaic ()
+{
+    rm -f o*.ch2
+    $P2C "$@" --output_file o1.ch2 test.pfm other.pfm >/dev/null 2>o1.log &&
+        $P2C "$@" --threads 3 --output_file o3.ch2 test.pfm other.pfm >/dev/null 2>o3.log && $DIFF o1.ch2 o3.ch2 >diff.log
+    result "mosaic --threads 3${*:+ $*}"
+}
+
+
+#  variants OPTIONS
+
+check_variants ()
+{
+    rm -f v*.ch2 s*.ch2
+    $P2C "$@" --output_file v0.ch2 --variant v1.ch2,no_uncertainty --variant v2.ch2,G --variant v3.ch2,N test.pfm \
+        >/dev/null 2>v.log &&
+        $P2C "$@" --output_file s0.ch2 test.pfm >/dev/null 2>s.log &&
+        $P2C "$@" --no_uncertainty --output_file s1.ch2 test.pfm >/dev/null 2>s.log &&
+        $P2C "$@" --grid_type G --output_file s2.ch2 test.pfm >/dev/null 2>s.log &&
+        $P2C "$@" --grid_type N --output_file s3.ch2 test.pfm >/dev/null 2>s.log &&
+        $DIFF v0.ch2 s0.ch2 >diff.log && $DIFF v1.ch2 s1.ch2 >diff.log && $DIFF v2.ch2 s2.ch2 >diff.log &&
+        $DIFF v3.ch2 s3.ch2 >diff.log
+    result "variants${*:+ $*}"
+}
+
+
+#  stream OPTIONS
+
+check_stream ()
+{
+    rm -f t.ch2 t.raw t_pipe.raw t_stdout.raw t.fifo
+    if mkfifo t.fifo; then
+        cat t.fifo >t_pipe.raw &
+        $P2C "$@" --output_file t.ch2 --stream t.fifo test.pfm >/dev/null 2>t.log
+        wait
+        rm -f t.fifo
+    fi
+
+    $DIFF --stream t.ch2 t_pipe.raw >diff.log &&
+        $P2C "$@" --output_file t.ch2 --stream t.raw test.pfm >/dev/null 2>t.log && $DIFF --stream t.ch2 t.raw >diff.log &&
+        $P2C "$@" --output_file t.ch2 --stream - test.pfm 2>t.log | cat >t_stdout.raw &&
+        $DIFF --stream t.ch2 t_stdout.raw >diff.log
+    result "stream${*:+ $*}"
+}
+
+
+#  geotiff OPTIONS
+
+check_geotiff ()
+{
+    rm -f g.ch2 g.tif
+    $P2C "$@" --output_file g.ch2 --geotiff g.tif test.pfm >/dev/null 2>g.log && $DIFF --tiff g.ch2 g.tif >diff.log
+    result "geotiff${*:+ $*}"
+}
+
+
+#  seams SIZE OPTIONS, with --misp_tile SIZE
+
+check_seams ()
+{
+    local size=$1
+    shift
+
+    rm -f w.ch2 m.ch2
+    $P2C --output_file w.ch2 test.pfm >/dev/null 2>w.log &&
+        $P2C "$@" --misp_tile $size --output_file m.ch2 test.pfm >/dev/null 2>m.log &&
+        $DIFF --seams $size w.ch2 m.ch2 >diff.log &&
+        awk '/across tile edges/ {edge = $(NF - 2)} /inside tiles/ {inner = $(NF - 2)} END {exit !(edge <= 2 * inner)}' diff.log
+    result "seams $size${*:+ $*}"
+}
+
+
+check_update
+check_update --misp_tile 64
+check_update --misp_tile 64 --threads 3
+check_update --grid_type G
+
+check_resume 200 10000
+check_resume 5000 1000
+check_resume 4000 3000 --misp_tile 64 --threads 2
+check_resume_changed
+
+check_mosaic --grid_type N
+check_mosaic --bin_layer --grid_type N
+
+check_variants --threads 1
+check_variants --threads 3 --misp_tile 64
+check_variants --threads 8 --misp_tile 64 --max_memory 16
+
+check_stream --grid_type N
+check_stream
+check_stream --misp_tile 64 --threads 2
+check_stream --grid_type G --max_fill_distance 3
+check_stream --max_fill_distance 3 --in_memory
+
+check_geotiff
+check_geotiff --misp_tile 64 --grid_type G
+
+check_seams 64
+check_seams 64 --misp_halo 20 --threads 2
+
+exit $FAILED
@@ -0,0 +1,80 @@
+/*  Stand-in for the parts of the CHRTR2 library interface that pfm2chrtr2 uses.  See ../standin_pfm.c.  */
+
+#ifndef __STANDIN_CHRTR2_H__
+#define __STANDIN_CHRTR2_H__
+
+#include "nvutility.h"
+
+#define         CHRTR2_NULL              0
+#define         CHRTR2_REAL              1
+#define         CHRTR2_DIGITIZED_CONTOUR 2
+#define         CHRTR2_INTERPOLATED      4
+
+#define         CHRTR2_METERS            0
+#define         CHRTR2_UNDEFINED         0
+#define         CHRTR2_MISP              1
+#define         CHRTR2_GMT               2
+
+#define         CHRTR2_UPDATE            0
+#define         CHRTR2_READONLY          1
+
+#define         CHRTR2_NULL_Z_VALUE      9999999.0
+
+
+typedef struct
+{
+  double          slat, wlon, nlat, elon;
+} CHRTR2_MBR;
+
+
+typedef struct
+{
+  char            creation_software[128];
+  int32_t         z_units;
+  CHRTR2_MBR      mbr;
+  int32_t         width;
+  int32_t         height;
+  double          lat_grid_size_degrees;
+  double          lon_grid_size_degrees;
+  float           min_z;
+  float           max_z;
+  float           z_scale;
+  float           min_observed_z;
+  float           max_observed_z;
+  int32_t         grid_type;
+  uint32_t        max_number_of_points;
+  float           min_uncertainty;
+  float           max_uncertainty;
+  float           uncertainty_scale;
+  char            uncertainty_name[128];
+  float           min_horizontal_uncertainty;
+  float           max_horizontal_uncertainty;
+  float           horizontal_uncertainty_scale;
+  float           min_vertical_uncertainty;
+  float           max_vertical_uncertainty;
+  float           vertical_uncertainty_scale;
+} CHRTR2_HEADER;
+
+
+typedef struct
+{
+  float           z;
+  uint32_t        number_of_points;
+  float           uncertainty;
+  float           horizontal_uncertainty;
+  float           vertical_uncertainty;
+  uint16_t        status;
+} CHRTR2_RECORD;
+
+
+int32_t chrtr2_create_file (const char *path, CHRTR2_HEADER *chrtr2_header);
+int32_t chrtr2_open_file (const char *path, CHRTR2_HEADER *chrtr2_header, int32_t mode);
+int32_t chrtr2_close_file (int32_t hnd);
+int32_t chrtr2_update_header (int32_t hnd, CHRTR2_HEADER chrtr2_header);
+int32_t chrtr2_read_record_row_col (int32_t hnd, int32_t row, int32_t col, CHRTR2_RECORD *chrtr2_record);
+int32_t chrtr2_read_row (int32_t hnd, int32_t row, int32_t start_col, int32_t length, CHRTR2_RECORD *chrtr2_record);
+int32_t chrtr2_write_row (int32_t hnd, int32_t row, int32_t start_col, int32_t length, CHRTR2_RECORD *chrtr2_record);
+void chrtr2_perror ();
+char *chrtr2_strerror ();
+
+#endif
@@ -0,0 +1,3 @@
+/*  Stand-in for chrtr2_shared.h.  Everything pfm2chrtr2 uses is in chrtr2.h.  */
+
+#include "chrtr2.h"
@@ -0,0 +1,22 @@
+/*  Stand-in for the parts of the GDAL CPL interface that pfm2chrtr2 uses.  See ../standin_gdal.c.  */
+
+#ifndef __STANDIN_CPL_STRING_H__
+#define __STANDIN_CPL_STRING_H__
+
+#define         CPL_STDCALL
+
+#ifndef FALSE
+#define         FALSE 0
+#endif
+#ifndef TRUE
+#define         TRUE  1
+#endif
+
+typedef enum {CE_None, CE_Debug, CE_Warning, CE_Failure, CE_Fatal} CPLErr;
+
+char **CSLSetNameValue (char **list, const char *name, const char *value);
+void CSLDestroy (char **list);
+const char *CPLGetLastErrorMsg (void);
+void CPLFree (void *data);
+
+#endif
@@ -0,0 +1,35 @@
+/*  Stand-in for the parts of the GDAL interface that pfm2chrtr2 uses.  See ../standin_gdal.c.  */
+
+#ifndef __STANDIN_GDAL_H__
+#define __STANDIN_GDAL_H__
+
+#include "cpl_string.h"
+
+typedef void *GDALDriverH;
+typedef void *GDALDatasetH;
+typedef void *GDALRasterBandH;
+typedef void *GDALMajorObjectH;
+
+typedef enum {GDT_Unknown, GDT_Byte, GDT_UInt16, GDT_Int16, GDT_UInt32, GDT_Int32, GDT_Float32} GDALDataType;
+typedef enum {GF_Read, GF_Write} GDALRWFlag;
+
+typedef int (CPL_STDCALL *GDALProgressFunc) (double complete, const char *message, void *arg);
+
+void GDALAllRegister (void);
+GDALDriverH GDALGetDriverByName (const char *name);
+GDALDatasetH GDALCreate (GDALDriverH driver, const char *name, int width, int height, int bands, GDALDataType type,
+                         char **options);
+GDALDatasetH GDALCreateCopy (GDALDriverH driver, const char *name, GDALDatasetH source, int strict, char **options,
+                             GDALProgressFunc progress, void *progress_arg);
+CPLErr GDALSetGeoTransform (GDALDatasetH dataset, double *transform);
+CPLErr GDALSetProjection (GDALDatasetH dataset, const char *wkt);
+GDALRasterBandH GDALGetRasterBand (GDALDatasetH dataset, int band);
+void GDALSetDescription (GDALMajorObjectH object, const char *description);
+CPLErr GDALSetRasterNoDataValue (GDALRasterBandH band, double value);
+CPLErr GDALDatasetRasterIO (GDALDatasetH dataset, GDALRWFlag flag, int x, int y, int width, int height, void *buffer,
+                            int buffer_width, int buffer_height, GDALDataType type, int bands, int *band_list,
+                            int pixel_space, int line_space, int band_space);
+void GDALClose (GDALDatasetH dataset);
+CPLErr GDALDeleteDataset (GDALDriverH driver, const char *name);
+
+#endif
@@ -0,0 +1 @@
+/*  Stand-in for the PFM ABE globals.hpp, which pfm2chrtr2 doesn't need anything from.  */
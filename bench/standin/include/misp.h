@@ -0,0 +1,14 @@
+/*  Stand-in for the MISP library interface.  See ../standin_misp.c.  */
+
+#ifndef __STANDIN_MISP_H__
+#define __STANDIN_MISP_H__
+
+#include "nvutility.h"
+
+int32_t misp_init (double x_interval, double y_interval, float delta, int32_t reg_factor, float search_radius,
+                   int32_t error_type, float max_value, float min_value, int32_t nibble, NV_F64_XYMBR mbr);
+int32_t misp_load (NV_F64_COORD3 xyz);
+int32_t misp_proc ();
+uint8_t misp_rtrv (float *array);
+
+#endif
@@ -0,0 +1,40 @@
+/*  Stand-in for the parts of nvutility.h that pfm2chrtr2 uses.  See ../README.md.  */
+
+#ifndef __STANDIN_NVUTILITY_H__
+#define __STANDIN_NVUTILITY_H__
+
+#include <stdint.h>
+
+#define         NVTrue  1
+#define         NVFalse 0
+
+#define         NINT(a) ((a) < 0.0 ? (int32_t) ((a) - 0.5) : (int32_t) ((a) + 0.5))
+
+#ifndef MIN
+#define         MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define         MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+
+typedef struct
+{
+  int32_t         x, y;
+} NV_I32_COORD2;
+
+typedef struct
+{
+  double          x, y;
+} NV_F64_COORD2;
+
+typedef struct
+{
+  double          x, y, z;
+} NV_F64_COORD3;
+
+typedef struct
+{
+  double          min_x, min_y, max_x, max_y;
+} NV_F64_XYMBR;
+
+#endif
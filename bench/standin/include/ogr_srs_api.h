@@ -0,0 +1,14 @@
+/*  Stand-in for the parts of the OGR spatial reference interface that pfm2chrtr2 uses.  See ../standin_gdal.c.  */
+
+#ifndef __STANDIN_OGR_SRS_API_H__
+#define __STANDIN_OGR_SRS_API_H__
+
+typedef void *OGRSpatialReferenceH;
+typedef int OGRErr;
+
+OGRSpatialReferenceH OSRNewSpatialReference (const char *wkt);
+OGRErr OSRImportFromEPSG (OGRSpatialReferenceH srs, int epsg);
+OGRErr OSRExportToWkt (OGRSpatialReferenceH srs, char **wkt);
+void OSRDestroySpatialReference (OGRSpatialReferenceH srs);
+
+#endif
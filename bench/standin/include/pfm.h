@@ -0,0 +1,103 @@
+/*  Stand-in for the parts of the PFM library interface that pfm2chrtr2 uses.  See ../standin_pfm.c.  */
+
+#ifndef __STANDIN_PFM_H__
+#define __STANDIN_PFM_H__
+
+#include "nvutility.h"
+
+#define         PFM_UNDEFINED_DATA 0
+
+#define         PFM_DATA           1
+#define         PFM_INVAL          2
+#define         PFM_DELETED        4
+#define         PFM_REFERENCE      8
+#define         PFM_MODIFIED       16
+#define         PFM_CHECKED        32
+#define         PFM_MANUALLY_INVAL 64
+#define         PFM_FILTER_INVAL   128
+#define         PFM_USER           256
+
+
+typedef struct
+{
+  NV_F64_COORD3   xyz;
+  float           vertical_error;
+  float           horizontal_error;
+  uint32_t        validity;
+  NV_I32_COORD2   coord;
+  int16_t         file_number;
+  int32_t         line_number;
+  int32_t         ping_number;
+  int16_t         beam_number;
+} DEPTH_RECORD;
+
+
+typedef struct
+{
+  int32_t         num_soundings;
+  float           standard_dev;
+  float           avg_filtered_depth;
+  float           min_filtered_depth;
+  float           max_filtered_depth;
+  float           avg_depth;
+  float           min_depth;
+  float           max_depth;
+  uint32_t        validity;
+  NV_I32_COORD2   coord;
+  NV_F64_COORD2   xy;
+} BIN_RECORD;
+
+
+typedef struct
+{
+  NV_F64_XYMBR    mbr;
+  double          x_bin_size_degrees;
+  double          y_bin_size_degrees;
+  double          bin_size_xy;
+  int32_t         bin_width;
+  int32_t         bin_height;
+  float           horizontal_error_scale;
+  float           vertical_error_scale;
+  float           min_filtered_depth;
+  float           max_filtered_depth;
+  float           min_depth;
+  float           max_depth;
+  float           null_depth;
+  struct
+  {
+    int32_t       projection;
+  }               proj_data;
+  char            run_time[128];
+  int32_t         max_depth_records;
+  int16_t         num_bin_attr;
+  int16_t         num_ndx_attr;
+  uint8_t         dynamic_reload;
+} PFM_HEADER;
+
+
+typedef struct
+{
+  char            list_path[1024];
+  char            image_path[1024];
+  char            target_path[1024];
+  char            ffile[1024];
+  char            bin_path[1024];
+  char            index_path[1024];
+  PFM_HEADER      head;
+  float           max_depth;
+  float           offset;
+  float           scale;
+  int32_t         checkpoint;
+} PFM_OPEN_ARGS;
+
+
+extern int32_t pfm_error;
+
+int32_t open_existing_pfm_file (PFM_OPEN_ARGS *open_args);
+void close_pfm_file (int32_t hnd);
+void pfm_error_exit (int32_t error);
+char *pfm_error_str (int32_t error);
+int32_t read_bin_row (int32_t hnd, int32_t length, int32_t row, int32_t col, BIN_RECORD *a);
+int32_t read_depth_array_index (int32_t hnd, NV_I32_COORD2 coord, DEPTH_RECORD **depth_array, int32_t *numrecs);
+
+#endif
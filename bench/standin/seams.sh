@@ -0,0 +1,90 @@
+#!/bin/bash
+
+#  Measure how far the tiled MISP surface (--misp_tile) is from the untiled one, and how the tiled gridding time
+#  changes with --threads, using the stand-in libraries.
+#
+#  Usage: seams.sh [-w WORK_DIR] [-s WIDTHxHEIGHT] [-t "TILE:HALO ..."] [-j "THREADS ..."] [BUILD_DIR]
+#
+#  BUILD_DIR (default ./standin_build) is where build.sh put pfm2chrtr2 and ch2_diff.  The stand-in PFM is
+#  WIDTHxHEIGHT bins (default 1000x800).  Each TILE:HALO pair (default "128:40 256:20 256:40 256:80") is run with
+#  each THREADS (default "1 2 4") and compared with an untiled run.  For each you get the elapsed time, the largest
+#  and RMS difference from the untiled surface over the interpolated cells, and the RMS difference in the steps
+#  between neighbouring cells across the tile edges and inside the tiles.  The differences are in the units of Z
+#  and are the same for any THREADS.
+#
+#  The stand-in MISP is a harmonic surface, not MISP's minimum curvature surface, so this shows how the tiling
+#  behaves, not what the numbers will be with the real library.
+
+
+WORK_DIR=./standin_work
+SIZE=1000x800
+TILES="128:40 256:20 256:40 256:80"
+THREADS="1 2 4"
+
+while getopts "w:s:t:j:" opt; do
+    case $opt in
+        w) WORK_DIR=$OPTARG ;;
+        s) SIZE=$OPTARG ;;
+        t) TILES=$OPTARG ;;
+        j) THREADS=$OPTARG ;;
+        *) sed -n '3,17p' $0 ; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+BUILD_DIR=$(cd ${1:-./standin_build} && pwd) || exit 1
+P2C=$BUILD_DIR/pfm2chrtr2
+DIFF=$BUILD_DIR/ch2_diff
+
+mkdir -p $WORK_DIR && cd $WORK_DIR || exit 1
+
+export STANDIN_WIDTH=${SIZE%x*}
+export STANDIN_HEIGHT=${SIZE#*x}
+
+
+#  Grid with OPTIONS into OUTPUT and print the elapsed time.  The gridding stage times add up the time in each of the
+#  --threads processes so they aren't wall clock times.
+
+grid ()
+{
+    local output=$1
+    shift
+
+    rm -f $output
+    $P2C "$@" --timing --output_file $output seams.pfm >/dev/null 2>seams.log ||
+        { echo "pfm2chrtr2 $* failed, see $WORK_DIR/seams.log" >&2 ; exit 1 ; }
+
+    awk 'index ($0, "Elapsed") == 1 {print $2}' seams.log
+}
+
+
+#  Pull a max and RMS pair out of a ch2_diff --seams line.
+
+max_rms ()
+{
+    grep "$1" seams.diff | awk '{for (i = 1 ; i < NF ; i++) {if ($i == "max") m = $(i + 1); if ($i == "RMS") r = $(i + 1)} print m, r}'
+}
+
+
+whole=$(grid whole.ch2)
+
+echo "$SIZE bins, untiled $whole seconds on $(nproc) processor(s)"
+printf "\n%5s %5s %8s %9s %8s %10s %10s %10s %10s\n" tile halo threads seconds speedup "max diff" "RMS diff" \
+    "RMS edge" "RMS inner"
+
+for spec in $TILES; do
+    tile=${spec%:*}
+    halo=${spec#*:}
+
+    for threads in $THREADS; do
+        seconds=$(grid tiled.ch2 --misp_tile $tile --misp_halo $halo --threads $threads)
+
+        $DIFF --seams $tile whole.ch2 tiled.ch2 >seams.diff
+        read cell_max cell_rms <<<$(max_rms "interpolated cells")
+        read edge_max edge_rms <<<$(max_rms "across tile edges")
+        read inner_max inner_rms <<<$(max_rms "inside tiles")
+
+        printf "%5d %5d %8d %9.3f %8.2f %10.6f %10.6f %10.6f %10.6f\n" $tile $halo $threads $seconds \
+            $(awk -v a=$whole -v b=$seconds 'BEGIN {print a / b}') $cell_max $cell_rms $edge_rms $inner_rms
+    done
+done
@@ -0,0 +1,348 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gdal.h"
+#include "ogr_srs_api.h"
+
+
+/*
+
+    Stand-in GDAL library.
+
+    Only the GTiff and COG drivers exist and they don't write TIFF.  GDALCreate keeps the Float32 bands in memory and
+    GDALCreateCopy writes them to a raw file that ch2_diff --tiff reads:
+
+    - "STANDIN1" (8 bytes)
+    - width and height (int32)
+    - the six geotransform values and the no data value (double)
+    - the bands, one after the other, each top row first (float)
+
+    The creation options and the band names are printed to stderr.
+
+*/
+
+
+typedef struct
+{
+  int32_t         width;
+  int32_t         height;
+  int32_t         bands;
+  double          transform[6];
+  double          no_data;
+  char            description[3][32];
+  float           *data;
+} DATASET;
+
+
+typedef struct
+{
+  DATASET         *dataset;
+  int32_t         band;
+} BAND;
+
+
+static char     gtiff_driver, cog_driver;
+static BAND     bands[3];
+
+
+
+void GDALAllRegister (void)
+{
+}
+
+
+
+GDALDriverH GDALGetDriverByName (const char *name)
+{
+  if (!strcmp (name, "GTiff")) return (&gtiff_driver);
+  if (!strcmp (name, "COG")) return (&cog_driver);
+
+  return (NULL);
+}
+
+
+
+GDALDatasetH GDALCreate (GDALDriverH driver, const char *name, int width, int height, int band_count, GDALDataType type,
+                         char **options)
+{
+  DATASET             *dataset;
+  FILE                *fp;
+
+
+  (void) driver;
+  (void) type;
+  (void) options;
+
+  if (band_count > 3 || (dataset = (DATASET *) calloc (1, sizeof (DATASET))) == NULL) return (NULL);
+
+  dataset->width = width;
+  dataset->height = height;
+  dataset->bands = band_count;
+
+  if ((dataset->data = (float *) calloc ((size_t) width * height * band_count, sizeof (float))) == NULL) return (NULL);
+
+
+  /*  Leave a file behind so that GDALDeleteDataset has something to delete.  */
+
+  if ((fp = fopen (name, "w")) == NULL) return (NULL);
+  fclose (fp);
+
+  return (dataset);
+}
+
+
+
+GDALDatasetH GDALCreateCopy (GDALDriverH driver, const char *name, GDALDatasetH source, int strict, char **options,
+                             GDALProgressFunc progress, void *progress_arg)
+{
+  DATASET             *dataset = (DATASET *) source;
+  FILE                *fp;
+  char                **option;
+  size_t              size;
+
+
+  (void) driver;
+  (void) strict;
+
+  for (option = options ; option != NULL && *option != NULL ; option++) fprintf (stderr, "GDAL option %s\n", *option);
+
+  fprintf (stderr, "GDAL bands %s %s %s\n", dataset->description[0], dataset->description[1], dataset->description[2]);
+
+  size = (size_t) dataset->width * dataset->height * dataset->bands;
+
+  if ((fp = fopen (name, "wb")) == NULL || fwrite ("STANDIN1", 8, 1, fp) != 1 ||
+      fwrite (&dataset->width, sizeof (int32_t), 1, fp) != 1 || fwrite (&dataset->height, sizeof (int32_t), 1, fp) != 1 ||
+      fwrite (dataset->transform, sizeof (double), 6, fp) != 6 || fwrite (&dataset->no_data, sizeof (double), 1, fp) != 1 ||
+      fwrite (dataset->data, sizeof (float), size, fp) != size || fclose (fp)) return (NULL);
+
+  if (progress != NULL)
+    {
+      (*progress) (0.0, NULL, progress_arg);
+      (*progress) (1.0, NULL, progress_arg);
+    }
+
+  return (calloc (1, sizeof (DATASET)));
+}
+
+
+
+CPLErr GDALSetGeoTransform (GDALDatasetH dataset, double *transform)
+{
+  memcpy (((DATASET *) dataset)->transform, transform, 6 * sizeof (double));
+
+  return (CE_None);
+}
+
+
+
+CPLErr GDALSetProjection (GDALDatasetH dataset, const char *wkt)
+{
+  (void) dataset;
+
+  fprintf (stderr, "GDAL projection %s\n", wkt);
+
+  return (CE_None);
+}
+
+
+
+GDALRasterBandH GDALGetRasterBand (GDALDatasetH dataset, int band)
+{
+  bands[band - 1].dataset = (DATASET *) dataset;
+  bands[band - 1].band = band - 1;
+
+  return (&bands[band - 1]);
+}
+
+
+
+void GDALSetDescription (GDALMajorObjectH object, const char *description)
+{
+  BAND                *band = (BAND *) object;
+
+
+  snprintf (band->dataset->description[band->band], sizeof (band->dataset->description[0]), "%s", description);
+}
+
+
+
+CPLErr GDALSetRasterNoDataValue (GDALRasterBandH band, double value)
+{
+  ((BAND *) band)->dataset->no_data = value;
+
+  return (CE_None);
+}
+
+
+
+/*  Only whole rows of all of the bands, band interleaved, which is all geotiff.c writes.  */
+
+CPLErr GDALDatasetRasterIO (GDALDatasetH source, GDALRWFlag flag, int x, int y, int width, int height, void *buffer,
+                            int buffer_width, int buffer_height, GDALDataType type, int band_count, int *band_list,
+                            int pixel_space, int line_space, int band_space)
+{
+  DATASET             *dataset = (DATASET *) source;
+  int32_t             k;
+
+
+  (void) flag;
+  (void) buffer_width;
+  (void) buffer_height;
+  (void) type;
+  (void) band_list;
+  (void) pixel_space;
+  (void) line_space;
+
+  if (x || width != dataset->width || y < 0 || y + height > dataset->height || band_count != dataset->bands)
+    {
+      fprintf (stderr, "Stand-in GDAL can't do that RasterIO\n");
+      return (CE_Failure);
+    }
+
+  for (k = 0 ; k < band_count ; k++)
+    memcpy (&dataset->data[((size_t) k * dataset->height + y) * dataset->width], (char *) buffer + (size_t) k * band_space,
+            (size_t) width * height * sizeof (float));
+
+  return (CE_None);
+}
+
+
+
+void GDALClose (GDALDatasetH dataset)
+{
+  free (((DATASET *) dataset)->data);
+  free (dataset);
+}
+
+
+
+CPLErr GDALDeleteDataset (GDALDriverH driver, const char *name)
+{
+  (void) driver;
+
+  return (remove (name) ? CE_Failure : CE_None);
+}
+
+
+
+char **CSLSetNameValue (char **list, const char *name, const char *value)
+{
+  int32_t             count = 0;
+
+
+  while (list != NULL && list[count] != NULL) count++;
+
+  if ((list = (char **) realloc (list, (count + 2) * sizeof (char *))) == NULL ||
+      (list[count] = (char *) malloc (strlen (name) + strlen (value) + 2)) == NULL)
+    {
+      perror ("Allocating stand-in GDAL options");
+      exit (-1);
+    }
+
+  sprintf (list[count], "%s=%s", name, value);
+  list[count + 1] = NULL;
+
+  return (list);
+}
+
+
+
+void CSLDestroy (char **list)
+{
+  char                **item;
+
+
+  for (item = list ; item != NULL && *item != NULL ; item++) free (*item);
+  free (list);
+}
+
+
+
+const char *CPLGetLastErrorMsg (void)
+{
+  return ("stand-in GDAL error");
+}
+
+
+
+void CPLFree (void *data)
+{
+  free (data);
+}
+
+
+
+OGRSpatialReferenceH OSRNewSpatialReference (const char *wkt)
+{
+  (void) wkt;
+
+  return (malloc (1));
+}
+
+
+
+OGRErr OSRImportFromEPSG (OGRSpatialReferenceH srs, int epsg)
+{
+  (void) srs;
+  (void) epsg;
+
+  return (0);
+}
+
+
+
+OGRErr OSRExportToWkt (OGRSpatialReferenceH srs, char **wkt)
+{
+  (void) srs;
+
+  *wkt = strdup ("GEOGCS[\"WGS 84\"]");
+
+  return (0);
+}
+
+
+
+void OSRDestroySpatialReference (OGRSpatialReferenceH srs)
+{
+  free (srs);
+}
@@ -0,0 +1,212 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "misp.h"
+
+
+/*
+
+    Stand-in MISP library.
+
+    This fills the grid with the harmonic surface through the data (Laplace's equation with the data cells held
+    fixed and zero slope at the edges) by successive over-relaxation.  It isn't the minimum curvature surface that
+    MISP makes but, like MISP, every cell depends on all of the data in the area being gridded.  That's what matters
+    for checking the tiling: a tile only sees the data in its halo so the tiled surface differs from the whole one
+    by an amount that depends on the halo, just as it does with the real library.  It is slow enough on big holes
+    to make the timing of the tiled path meaningful, but the absolute times say nothing about the real library.
+
+    Like MISP it keeps its state in static memory, so there can only be one surface per process.
+
+*/
+
+
+#define         TOLERANCE      1.0e-6
+#define         MAX_ITERATIONS 100000
+
+
+static int32_t  rows, cols, next_row;
+static double   *sum, *value;
+static int32_t  *count;
+
+
+
+int32_t misp_init (double x_interval, double y_interval, float delta, int32_t reg_factor, float search_radius,
+                   int32_t error_type, float max_value, float min_value, int32_t nibble, NV_F64_XYMBR mbr)
+{
+  int64_t             size;
+
+
+  (void) x_interval;
+  (void) y_interval;
+  (void) delta;
+  (void) reg_factor;
+  (void) search_radius;
+  (void) error_type;
+  (void) max_value;
+  (void) min_value;
+  (void) nibble;
+
+
+  /*  One more node than cells each way, like MISP's corner posts.  */
+
+  rows = NINT (mbr.max_y - mbr.min_y) + 1;
+  cols = NINT (mbr.max_x - mbr.min_x) + 1;
+  next_row = 0;
+
+  size = (int64_t) rows * cols;
+
+  free (sum);
+  free (value);
+  free (count);
+
+  sum = (double *) calloc (size, sizeof (double));
+  value = (double *) calloc (size, sizeof (double));
+  count = (int32_t *) calloc (size, sizeof (int32_t));
+
+  if (sum == NULL || value == NULL || count == NULL)
+    {
+      perror ("Allocating stand-in MISP grid");
+      exit (-1);
+    }
+
+  return (0);
+}
+
+
+
+int32_t misp_load (NV_F64_COORD3 xyz)
+{
+  int32_t             row, col;
+  int64_t             index;
+
+
+  row = NINT (xyz.y);
+  col = NINT (xyz.x);
+
+  if (row < 0 || row >= rows || col < 0 || col >= cols) return (0);
+
+  index = (int64_t) row * cols + col;
+
+  sum[index] += xyz.z;
+  count[index]++;
+
+  return (0);
+}
+
+
+
+int32_t misp_proc ()
+{
+  int32_t             i, j, iteration;
+  int64_t             index, size, points = 0;
+  double              mean = 0.0, omega, change, max_change, total;
+
+
+  size = (int64_t) rows * cols;
+
+  for (index = 0 ; index < size ; index++)
+    {
+      if (count[index])
+        {
+          value[index] = sum[index] / count[index];
+          mean += value[index];
+          points++;
+        }
+    }
+
+  if (!points) return (0);
+
+  mean /= points;
+
+  for (index = 0 ; index < size ; index++) if (!count[index]) value[index] = mean;
+
+  omega = 2.0 / (1.0 + sin (M_PI / MAX (MAX (rows, cols), 2)));
+
+  for (iteration = 0 ; iteration < MAX_ITERATIONS ; iteration++)
+    {
+      max_change = 0.0;
+
+      for (i = 0 ; i < rows ; i++)
+        {
+          for (j = 0 ; j < cols ; j++)
+            {
+              index = (int64_t) i * cols + j;
+
+              if (count[index]) continue;
+
+              /*  The edges mirror the cell inside them.  */
+
+              total = value[i ? index - cols : index + cols] + value[i < rows - 1 ? index + cols : index - cols] +
+                value[j ? index - 1 : index + 1] + value[j < cols - 1 ? index + 1 : index - 1];
+
+              change = omega * (total / 4.0 - value[index]);
+              value[index] += change;
+
+              max_change = MAX (max_change, fabs (change));
+            }
+        }
+
+      if (max_change < TOLERANCE) break;
+    }
+
+  return (0);
+}
+
+
+
+/*  Hand back the next row, bottom row first.  */
+
+uint8_t misp_rtrv (float *array)
+{
+  int32_t             j;
+
+
+  if (next_row >= rows) return (NVFalse);
+
+  for (j = 0 ; j < cols ; j++) array[j] = value[(int64_t) next_row * cols + j];
+
+  next_row++;
+
+  return (NVTrue);
+}
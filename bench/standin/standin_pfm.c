@@ -0,0 +1,448 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "pfm.h"
+#include "chrtr2.h"
+
+
+/*
+
+    Stand-in PFM and CHRTR2 libraries.
+
+    The PFM is made up on the fly from its size, so the list file doesn't have to exist.  It stands in for the bin
+    and index files too (they're the paths that --checkpoint stamps).  It has scattered bins, a
+    dense block, and a sparse corner over a smooth sloping surface, which leaves big holes for the gridding to fill.
+    Each bin with data has three soundings 0.1 apart.  The size and a few test hooks come from the environment:
+
+    - STANDIN_WIDTH and STANDIN_HEIGHT set the size in bins (default 300 x 250)
+    - STANDIN_EDIT changes a block of bins, removes one and adds one, as an editor would (for --update)
+    - STANDIN_SLOW sleeps that many microseconds in every chrtr2_write_row
+    - STANDIN_KILL_AFTER exits with status 9 on that chrtr2_write_row call (for --checkpoint and --resume)
+
+    A PFM whose name has "bad" in it can't be opened.
+
+    The CHRTR2 file is the header followed by the records, row 0 first.  It is read into memory when it's opened
+    and written back when it's closed.  The cells that haven't been written read back as a NULL record.
+
+*/
+
+
+#define         DEFAULT_WIDTH  300
+#define         DEFAULT_HEIGHT 250
+#define         BIN_SIZE       0.001
+#define         MAX_HANDLES    16
+
+
+int32_t pfm_error;
+
+
+static int32_t  width[MAX_HANDLES], height[MAX_HANDLES], next_pfm;
+
+
+
+static int32_t env_int (char *name, int32_t value)
+{
+  char                *string;
+
+
+  if ((string = getenv (name)) != NULL) value = atoi (string);
+
+  return (value);
+}
+
+
+
+/*  Whether a bin has data in a width x height PFM.  */
+
+static uint8_t has_data (int32_t w, int32_t h, int32_t row, int32_t col)
+{
+  uint8_t             data;
+
+
+  data = ((row * 7 + col * 13) % 397 == 0) ||
+    (row > h * 24 / 100 && row < h * 36 / 100 && col > w * 13 / 100 && col < w * 27 / 100) ||
+    (row > h * 60 / 100 && col > w * 73 / 100 && (row + col) % 3 == 0);
+
+  if (getenv ("STANDIN_EDIT") != NULL)
+    {
+      if (row >= h * 40 / 100 && row <= h * 48 / 100 && col >= w * 67 / 100 && col <= w * 77 / 100)
+        data = ((row + col) % 2 == 0);
+
+      if (row == h * 25 / 100 && col == w * 17 / 100) data = NVFalse;
+
+      if (row == h * 4 / 100 && col == w * 97 / 100) data = NVTrue;
+    }
+
+  return (data);
+}
+
+
+
+static double depth (int32_t w, int32_t h, int32_t row, int32_t col)
+{
+  double              z;
+
+
+  z = 10.0 + 0.05 * row + 0.03 * col + 2.0 * sin (col / 23.0) * cos (row / 31.0);
+
+  if (getenv ("STANDIN_EDIT") != NULL && row >= h * 40 / 100 && row <= h * 48 / 100 && col >= w * 67 / 100 &&
+      col <= w * 77 / 100) z += 5.0;
+
+  return (z);
+}
+
+
+
+int32_t open_existing_pfm_file (PFM_OPEN_ARGS *open_args)
+{
+  int32_t             hnd;
+
+
+  if (strstr (open_args->list_path, "bad") != NULL)
+    {
+      pfm_error = -1;
+      return (-1);
+    }
+
+  hnd = next_pfm++ % MAX_HANDLES;
+
+  width[hnd] = env_int ("STANDIN_WIDTH", DEFAULT_WIDTH);
+  height[hnd] = env_int ("STANDIN_HEIGHT", DEFAULT_HEIGHT);
+
+  memset (&open_args->head, 0, sizeof (PFM_HEADER));
+
+  strcpy (open_args->bin_path, open_args->list_path);
+  strcpy (open_args->index_path, open_args->list_path);
+
+  open_args->head.bin_width = width[hnd];
+  open_args->head.bin_height = height[hnd];
+  open_args->head.x_bin_size_degrees = BIN_SIZE;
+  open_args->head.y_bin_size_degrees = BIN_SIZE;
+  open_args->head.mbr.min_x = 0.0;
+  open_args->head.mbr.min_y = 0.0;
+  open_args->head.mbr.max_x = width[hnd] * BIN_SIZE;
+  open_args->head.mbr.max_y = height[hnd] * BIN_SIZE;
+  open_args->head.max_depth_records = 10;
+  open_args->scale = 100.0;
+
+  return (hnd);
+}
+
+
+
+void close_pfm_file (int32_t hnd)
+{
+  (void) hnd;
+}
+
+
+
+void pfm_error_exit (int32_t error)
+{
+  fprintf (stderr, "PFM error %d\n", error);
+  exit (-1);
+}
+
+
+
+char *pfm_error_str (int32_t error)
+{
+  (void) error;
+
+  return ("stand-in PFM error");
+}
+
+
+
+int32_t read_bin_row (int32_t hnd, int32_t length, int32_t row, int32_t col, BIN_RECORD *a)
+{
+  int32_t             k;
+  double              z;
+
+
+  for (k = 0 ; k < length ; k++)
+    {
+      memset (&a[k], 0, sizeof (BIN_RECORD));
+
+      a[k].coord.x = col + k;
+      a[k].coord.y = row;
+
+      if (has_data (width[hnd], height[hnd], row, col + k))
+        {
+          z = depth (width[hnd], height[hnd], row, col + k);
+
+          a[k].num_soundings = 3;
+          a[k].validity = PFM_DATA;
+          a[k].avg_filtered_depth = z + 0.1;
+          a[k].min_filtered_depth = z;
+          a[k].max_filtered_depth = z + 0.2;
+          a[k].standard_dev = 0.08;
+        }
+    }
+
+  return (0);
+}
+
+
+
+int32_t read_depth_array_index (int32_t hnd, NV_I32_COORD2 coord, DEPTH_RECORD **depth_array, int32_t *numrecs)
+{
+  int32_t             k;
+  double              z;
+
+
+  *depth_array = NULL;
+  *numrecs = 0;
+
+  if (!has_data (width[hnd], height[hnd], coord.y, coord.x)) return (0);
+
+  z = depth (width[hnd], height[hnd], coord.y, coord.x);
+
+  if ((*depth_array = (DEPTH_RECORD *) calloc (3, sizeof (DEPTH_RECORD))) == NULL)
+    {
+      perror ("Allocating depth records");
+      exit (-1);
+    }
+
+  for (k = 0 ; k < 3 ; k++)
+    {
+      (*depth_array)[k].xyz.z = z + k * 0.1;
+      (*depth_array)[k].vertical_error = 0.2;
+      (*depth_array)[k].horizontal_error = 0.3;
+      (*depth_array)[k].coord = coord;
+    }
+
+  *numrecs = 3;
+
+  return (0);
+}
+
+
+
+/*  CHRTR2  */
+
+static CHRTR2_HEADER    chrtr2_header[MAX_HANDLES];
+static CHRTR2_RECORD    *chrtr2_grid[MAX_HANDLES];
+static char             chrtr2_path[MAX_HANDLES][1024];
+static int64_t          writes;
+
+
+
+static int32_t new_handle (const char *path)
+{
+  int32_t             hnd;
+
+
+  for (hnd = 0 ; hnd < MAX_HANDLES ; hnd++)
+    {
+      if (chrtr2_grid[hnd] == NULL)
+        {
+          snprintf (chrtr2_path[hnd], sizeof (chrtr2_path[hnd]), "%s", path);
+          return (hnd);
+        }
+    }
+
+  fprintf (stderr, "Too many stand-in CHRTR2 files open\n");
+  exit (-1);
+}
+
+
+
+int32_t chrtr2_create_file (const char *path, CHRTR2_HEADER *header)
+{
+  int32_t             hnd;
+  int64_t             i, size;
+
+
+  hnd = new_handle (path);
+
+  chrtr2_header[hnd] = *header;
+  size = (int64_t) header->width * header->height;
+
+  if ((chrtr2_grid[hnd] = (CHRTR2_RECORD *) calloc (size, sizeof (CHRTR2_RECORD))) == NULL)
+    {
+      perror ("Allocating stand-in CHRTR2 grid");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < size ; i++)
+    {
+      chrtr2_grid[hnd][i].z = header->max_z + 1.0;
+      chrtr2_grid[hnd][i].uncertainty = header->max_uncertainty;
+    }
+
+  return (hnd);
+}
+
+
+
+int32_t chrtr2_open_file (const char *path, CHRTR2_HEADER *header, int32_t mode)
+{
+  FILE                *fp;
+  int32_t             hnd;
+  int64_t             size;
+
+
+  (void) mode;
+
+  if ((fp = fopen (path, "rb")) == NULL) return (-1);
+
+  hnd = new_handle (path);
+
+  if (fread (&chrtr2_header[hnd], sizeof (CHRTR2_HEADER), 1, fp) != 1)
+    {
+      fclose (fp);
+      return (-1);
+    }
+
+  size = (int64_t) chrtr2_header[hnd].width * chrtr2_header[hnd].height;
+
+  if ((chrtr2_grid[hnd] = (CHRTR2_RECORD *) malloc (size * sizeof (CHRTR2_RECORD))) == NULL)
+    {
+      perror ("Allocating stand-in CHRTR2 grid");
+      exit (-1);
+    }
+
+  if (fread (chrtr2_grid[hnd], sizeof (CHRTR2_RECORD), size, fp) != (size_t) size)
+    {
+      free (chrtr2_grid[hnd]);
+      chrtr2_grid[hnd] = NULL;
+      fclose (fp);
+      return (-1);
+    }
+
+  fclose (fp);
+
+  *header = chrtr2_header[hnd];
+
+  return (hnd);
+}
+
+
+
+int32_t chrtr2_close_file (int32_t hnd)
+{
+  FILE                *fp;
+  int64_t             size;
+
+
+  size = (int64_t) chrtr2_header[hnd].width * chrtr2_header[hnd].height;
+
+  if ((fp = fopen (chrtr2_path[hnd], "wb")) == NULL ||
+      fwrite (&chrtr2_header[hnd], sizeof (CHRTR2_HEADER), 1, fp) != 1 ||
+      fwrite (chrtr2_grid[hnd], sizeof (CHRTR2_RECORD), size, fp) != (size_t) size || fclose (fp))
+    {
+      perror (chrtr2_path[hnd]);
+      exit (-1);
+    }
+
+  free (chrtr2_grid[hnd]);
+  chrtr2_grid[hnd] = NULL;
+
+  return (0);
+}
+
+
+
+int32_t chrtr2_update_header (int32_t hnd, CHRTR2_HEADER header)
+{
+  chrtr2_header[hnd] = header;
+
+  return (0);
+}
+
+
+
+int32_t chrtr2_read_record_row_col (int32_t hnd, int32_t row, int32_t col, CHRTR2_RECORD *chrtr2_record)
+{
+  *chrtr2_record = chrtr2_grid[hnd][(int64_t) row * chrtr2_header[hnd].width + col];
+
+  return (0);
+}
+
+
+
+int32_t chrtr2_read_row (int32_t hnd, int32_t row, int32_t start_col, int32_t length, CHRTR2_RECORD *chrtr2_record)
+{
+  memcpy (chrtr2_record, &chrtr2_grid[hnd][(int64_t) row * chrtr2_header[hnd].width + start_col],
+          length * sizeof (CHRTR2_RECORD));
+
+  return (0);
+}
+
+
+
+int32_t chrtr2_write_row (int32_t hnd, int32_t row, int32_t start_col, int32_t length, CHRTR2_RECORD *chrtr2_record)
+{
+  if (getenv ("STANDIN_SLOW") != NULL) usleep (env_int ("STANDIN_SLOW", 0));
+
+  if (getenv ("STANDIN_KILL_AFTER") != NULL && ++writes >= env_int ("STANDIN_KILL_AFTER", 0)) _exit (9);
+
+  if (row < 0 || row >= chrtr2_header[hnd].height || start_col < 0 || start_col + length > chrtr2_header[hnd].width)
+    {
+      fprintf (stderr, "Stand-in CHRTR2 write outside of the grid at row %d, columns %d-%d\n", row, start_col,
+               start_col + length - 1);
+      exit (-1);
+    }
+
+  memcpy (&chrtr2_grid[hnd][(int64_t) row * chrtr2_header[hnd].width + start_col], chrtr2_record,
+          length * sizeof (CHRTR2_RECORD));
+
+  return (0);
+}
+
+
+
+void chrtr2_perror ()
+{
+  fprintf (stderr, "Stand-in CHRTR2 error\n");
+}
+
+
+
+char *chrtr2_strerror ()
+{
+  return ("stand-in CHRTR2 error");
+}
@@ -0,0 +1,487 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfm2chrtr2.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define         USE_AVX2
+#include <immintrin.h>
+#elif defined (__ARM_NEON) && defined (__aarch64__)
+#define         USE_NEON
+#include <arm_neon.h>
+#endif
+
+
+/*  The kernels are forced inline into their callers and the AVX2 ones are compiled for AVX2 with GCC and Clang.
+    Other compilers get plain inline functions (and only the scalar kernel).  */
+
+#ifdef __GNUC__
+#define         ALWAYS_INLINE inline __attribute__ ((always_inline))
+#define         TARGET_AVX2   __attribute__ ((target ("avx2")))
+#else
+#define         ALWAYS_INLINE inline
+#define         TARGET_AVX2
+#endif
+
+
+/*
+
+    Depth record reading and the per-bin validity filter and sums.
+
+    The depth records for a bin are gathered into structure-of-arrays form (Z, vertical error, horizontal error,
+    and validity in separate contiguous arrays) and then reduced with a masked sum.  On x86 the AVX2 kernel is
+    used if the CPU supports it (checked at run time so the program still runs on older hardware), on 64 bit ARM the
+    NEON kernel is used, and everything else gets the scalar kernel.  Each kernel has two variants, with and
+    without the H/V uncertainty sums, so the uncertainty test isn't made for every record.
+
+    All of the kernels keep SUM_LANES separate partial sums and combine them in the same order at the end.  That
+    way the sums (and therefore the output file) are bit-for-bit the same no matter which kernel was used.
+
+*/
+
+
+#define         SUM_LANES 4
+
+#define         REJECT_FLAGS (PFM_INVAL | PFM_DELETED | PFM_REFERENCE)
+
+
+
+/*  Make sure the structure-of-arrays buffers can hold size records.  The buffers only ever grow, so once a run has
+    seen its densest row no more allocation is done.  */
+
+static void size_depth_soa (DEPTH_SOA *soa, int64_t size)
+{
+  int64_t             new_size;
+
+
+  if (size <= soa->size) return;
+
+  new_size = MAX (size, soa->size * 2);
+
+  soa->z = (double *) realloc (soa->z, new_size * sizeof (double));
+  soa->v = (float *) realloc (soa->v, new_size * sizeof (float));
+  soa->h = (float *) realloc (soa->h, new_size * sizeof (float));
+  soa->validity = (uint32_t *) realloc (soa->validity, new_size * sizeof (uint32_t));
+
+  if (soa->z == NULL || soa->v == NULL || soa->h == NULL || soa->validity == NULL)
+    {
+      perror ("Allocating depth arrays in size_depth_soa");
+      exit (-1);
+    }
+
+  soa->size = new_size;
+}
+
+
+
+void free_depth_soa (DEPTH_SOA *soa)
+{
+  free (soa->z);
+  free (soa->v);
+  free (soa->h);
+  free (soa->validity);
+
+  memset (soa, 0, sizeof (DEPTH_SOA));
+}
+
+
+
+/*  Read the depth records for one bin and append the fields that we need to the caller's buffers.  The array that
+    the PFM library allocates is released right away so only one of them is ever live per thread (rather than a
+    row's worth), and all of the longer lived storage is in the caller's reusable buffers.  Returns the offset of
+    the bin's first record in the buffers and the number of records in numrecs.  */
+
+int64_t read_depths (int32_t pfm_handle, NV_I32_COORD2 coord, DEPTH_SOA *soa, int32_t *numrecs)
+{
+  DEPTH_RECORD        *depth_record = NULL;
+  int64_t             offset;
+  int32_t             k;
+
+
+  offset = soa->count;
+  *numrecs = 0;
+
+  count_calls (CALL_READ_DEPTH_ARRAY, 1);
+  read_depth_array_index (pfm_handle, coord, &depth_record, numrecs);
+
+  if (depth_record == NULL)
+    {
+      *numrecs = 0;
+      return (offset);
+    }
+
+  size_depth_soa (soa, offset + *numrecs);
+
+  for (k = 0 ; k < *numrecs ; k++)
+    {
+      soa->z[offset + k] = depth_record[k].xyz.z;
+      soa->v[offset + k] = depth_record[k].vertical_error;
+      soa->h[offset + k] = depth_record[k].horizontal_error;
+      soa->validity[offset + k] = depth_record[k].validity;
+    }
+
+  free (depth_record);
+
+  soa->count += *numrecs;
+
+  return (offset);
+}
+
+
+
+/*  Point slice at one bin's records in the buffers.  Nothing is copied.  */
+
+void depth_soa_slice (DEPTH_SOA *soa, int64_t offset, int32_t numrecs, DEPTH_SOA *slice)
+{
+  slice->size = numrecs;
+  slice->count = numrecs;
+  slice->z = soa->z + offset;
+  slice->v = soa->v + offset;
+  slice->h = soa->h + offset;
+  slice->validity = soa->validity + offset;
+}
+
+
+
+/*  Append numrecs records starting at offset in one set of buffers to another (for merging bins from several PFM
+    files).  Returns the offset of the first copied record in to.  */
+
+int64_t copy_depths (DEPTH_SOA *from, int64_t offset, int32_t numrecs, DEPTH_SOA *to)
+{
+  int64_t             start;
+
+
+  start = to->count;
+
+  size_depth_soa (to, start + numrecs);
+
+  memcpy (to->z + start, from->z + offset, numrecs * sizeof (double));
+  memcpy (to->v + start, from->v + offset, numrecs * sizeof (float));
+  memcpy (to->h + start, from->h + offset, numrecs * sizeof (float));
+  memcpy (to->validity + start, from->validity + offset, numrecs * sizeof (uint32_t));
+
+  to->count += numrecs;
+
+  return (start);
+}
+
+
+
+/*  Combine the lane partial sums and add the records that didn't fill a full set of lanes.  This is shared by all
+    of the kernels so that they all get the same answer.  */
+
+static void finish_sums (DEPTH_SOA *soa, int64_t start, const uint8_t uncertainty, double *z_lane, double *v_lane,
+                         double *h_lane, int32_t count, uint32_t drawn, BIN_SUMS *sums)
+{
+  int32_t             k;
+
+
+  sums->sum = (z_lane[0] + z_lane[1]) + (z_lane[2] + z_lane[3]);
+
+  if (uncertainty)
+    {
+      sums->v_sum = (v_lane[0] + v_lane[1]) + (v_lane[2] + v_lane[3]);
+      sums->h_sum = (h_lane[0] + h_lane[1]) + (h_lane[2] + h_lane[3]);
+    }
+  else
+    {
+      sums->v_sum = sums->h_sum = 0.0;
+    }
+
+  for (k = start ; k < soa->count ; k++)
+    {
+      if (!(soa->validity[k] & REJECT_FLAGS))
+        {
+          drawn |= soa->validity[k];
+
+          if (uncertainty)
+            {
+              sums->v_sum += soa->v[k];
+              sums->h_sum += soa->h[k];
+            }
+
+          sums->sum += soa->z[k];
+          count++;
+        }
+    }
+
+  sums->count = count;
+
+  //  Check for a hand-drawn contour (PFM_DATA is set in one or more of the valid depth records).
+
+  sums->drawn = (drawn & PFM_DATA) ? NVTrue : NVFalse;
+}
+
+
+
+static ALWAYS_INLINE void sum_depths_scalar_body (DEPTH_SOA *soa, const uint8_t uncertainty, BIN_SUMS *sums)
+{
+  double              z_lane[SUM_LANES] = {0.0, 0.0, 0.0, 0.0}, v_lane[SUM_LANES] = {0.0, 0.0, 0.0, 0.0};
+  double              h_lane[SUM_LANES] = {0.0, 0.0, 0.0, 0.0};
+  int32_t             k, l, count = 0, end;
+  uint32_t            drawn = 0;
+
+
+  end = soa->count - (soa->count % SUM_LANES);
+
+  for (k = 0 ; k < end ; k += SUM_LANES)
+    {
+      for (l = 0 ; l < SUM_LANES ; l++)
+        {
+          if (!(soa->validity[k + l] & REJECT_FLAGS))
+            {
+              drawn |= soa->validity[k + l];
+
+              if (uncertainty)
+                {
+                  v_lane[l] += soa->v[k + l];
+                  h_lane[l] += soa->h[k + l];
+                }
+
+              z_lane[l] += soa->z[k + l];
+              count++;
+            }
+        }
+    }
+
+  finish_sums (soa, end, uncertainty, z_lane, v_lane, h_lane, count, drawn, sums);
+}
+
+
+
+static void sum_depths_scalar_unc (DEPTH_SOA *soa, BIN_SUMS *sums)
+{
+  sum_depths_scalar_body (soa, NVTrue, sums);
+}
+
+
+
+static void sum_depths_scalar_nounc (DEPTH_SOA *soa, BIN_SUMS *sums)
+{
+  sum_depths_scalar_body (soa, NVFalse, sums);
+}
+
+
+
+#ifdef USE_AVX2
+
+static ALWAYS_INLINE TARGET_AVX2 void sum_depths_avx2_body (DEPTH_SOA *soa, const uint8_t uncertainty,
+                                                            BIN_SUMS *sums)
+{
+  double              z_lane[SUM_LANES], v_lane[SUM_LANES], h_lane[SUM_LANES];
+  int32_t             k, count, end, lane_count[SUM_LANES];
+  uint32_t            drawn, lane_drawn[SUM_LANES];
+  __m256d             z_acc, v_acc, h_acc, mask;
+  __m128i             validity, mask32, count_acc, drawn_acc;
+  const __m128i       reject = _mm_set1_epi32 (REJECT_FLAGS), zero = _mm_setzero_si128 ();
+
+
+  z_acc = v_acc = h_acc = _mm256_setzero_pd ();
+  count_acc = drawn_acc = _mm_setzero_si128 ();
+
+  end = soa->count - (soa->count % SUM_LANES);
+
+  for (k = 0 ; k < end ; k += SUM_LANES)
+    {
+      /*  All ones in the lanes that pass the validity test, widened to 64 bits for the double math.  */
+
+      validity = _mm_loadu_si128 ((const __m128i *) &soa->validity[k]);
+      mask32 = _mm_cmpeq_epi32 (_mm_and_si128 (validity, reject), zero);
+      mask = _mm256_castsi256_pd (_mm256_cvtepi32_epi64 (mask32));
+
+      count_acc = _mm_sub_epi32 (count_acc, mask32);
+      drawn_acc = _mm_or_si128 (drawn_acc, _mm_and_si128 (validity, mask32));
+
+      z_acc = _mm256_add_pd (z_acc, _mm256_and_pd (_mm256_loadu_pd (&soa->z[k]), mask));
+
+      if (uncertainty)
+        {
+          v_acc = _mm256_add_pd (v_acc, _mm256_and_pd (_mm256_cvtps_pd (_mm_loadu_ps (&soa->v[k])), mask));
+          h_acc = _mm256_add_pd (h_acc, _mm256_and_pd (_mm256_cvtps_pd (_mm_loadu_ps (&soa->h[k])), mask));
+        }
+    }
+
+  _mm256_storeu_pd (z_lane, z_acc);
+  _mm256_storeu_pd (v_lane, v_acc);
+  _mm256_storeu_pd (h_lane, h_acc);
+  _mm_storeu_si128 ((__m128i *) lane_count, count_acc);
+  _mm_storeu_si128 ((__m128i *) lane_drawn, drawn_acc);
+
+  count = lane_count[0] + lane_count[1] + lane_count[2] + lane_count[3];
+  drawn = lane_drawn[0] | lane_drawn[1] | lane_drawn[2] | lane_drawn[3];
+
+  finish_sums (soa, end, uncertainty, z_lane, v_lane, h_lane, count, drawn, sums);
+}
+
+
+
+static TARGET_AVX2 void sum_depths_avx2_unc (DEPTH_SOA *soa, BIN_SUMS *sums)
+{
+  sum_depths_avx2_body (soa, NVTrue, sums);
+}
+
+
+
+static TARGET_AVX2 void sum_depths_avx2_nounc (DEPTH_SOA *soa, BIN_SUMS *sums)
+{
+  sum_depths_avx2_body (soa, NVFalse, sums);
+}
+
+#endif
+
+
+
+#ifdef USE_NEON
+
+/*  NEON only has two double lanes per register so we use two registers to get the same four lanes.  */
+
+static ALWAYS_INLINE void sum_depths_neon_body (DEPTH_SOA *soa, const uint8_t uncertainty, BIN_SUMS *sums)
+{
+  double              z_lane[SUM_LANES], v_lane[SUM_LANES], h_lane[SUM_LANES];
+  int32_t             k, count, end;
+  uint32_t            drawn;
+  float64x2_t         z_lo, z_hi, v_lo, v_hi, h_lo, h_hi;
+  uint64x2_t          mask_lo, mask_hi;
+  uint32x4_t          validity, mask32, count_acc, drawn_acc;
+  float32x4_t         f;
+  const uint32x4_t    reject = vdupq_n_u32 (REJECT_FLAGS);
+
+
+  z_lo = z_hi = v_lo = v_hi = h_lo = h_hi = vdupq_n_f64 (0.0);
+  count_acc = drawn_acc = vdupq_n_u32 (0);
+
+  end = soa->count - (soa->count % SUM_LANES);
+
+  for (k = 0 ; k < end ; k += SUM_LANES)
+    {
+      validity = vld1q_u32 (&soa->validity[k]);
+      mask32 = vceqq_u32 (vandq_u32 (validity, reject), vdupq_n_u32 (0));
+      mask_lo = vreinterpretq_u64_s64 (vmovl_s32 (vreinterpret_s32_u32 (vget_low_u32 (mask32))));
+      mask_hi = vreinterpretq_u64_s64 (vmovl_s32 (vreinterpret_s32_u32 (vget_high_u32 (mask32))));
+
+      count_acc = vsubq_u32 (count_acc, mask32);
+      drawn_acc = vorrq_u32 (drawn_acc, vandq_u32 (validity, mask32));
+
+      z_lo = vaddq_f64 (z_lo, vreinterpretq_f64_u64 (vandq_u64 (vreinterpretq_u64_f64 (vld1q_f64 (&soa->z[k])), mask_lo)));
+      z_hi = vaddq_f64 (z_hi, vreinterpretq_f64_u64 (vandq_u64 (vreinterpretq_u64_f64 (vld1q_f64 (&soa->z[k + 2])), mask_hi)));
+
+      if (uncertainty)
+        {
+          f = vld1q_f32 (&soa->v[k]);
+          v_lo = vaddq_f64 (v_lo, vreinterpretq_f64_u64 (vandq_u64 (vreinterpretq_u64_f64 (vcvt_f64_f32 (vget_low_f32 (f))), mask_lo)));
+          v_hi = vaddq_f64 (v_hi, vreinterpretq_f64_u64 (vandq_u64 (vreinterpretq_u64_f64 (vcvt_high_f64_f32 (f)), mask_hi)));
+
+          f = vld1q_f32 (&soa->h[k]);
+          h_lo = vaddq_f64 (h_lo, vreinterpretq_f64_u64 (vandq_u64 (vreinterpretq_u64_f64 (vcvt_f64_f32 (vget_low_f32 (f))), mask_lo)));
+          h_hi = vaddq_f64 (h_hi, vreinterpretq_f64_u64 (vandq_u64 (vreinterpretq_u64_f64 (vcvt_high_f64_f32 (f)), mask_hi)));
+        }
+    }
+
+  vst1q_f64 (&z_lane[0], z_lo);
+  vst1q_f64 (&z_lane[2], z_hi);
+  vst1q_f64 (&v_lane[0], v_lo);
+  vst1q_f64 (&v_lane[2], v_hi);
+  vst1q_f64 (&h_lane[0], h_lo);
+  vst1q_f64 (&h_lane[2], h_hi);
+
+  count = vaddvq_u32 (count_acc);
+  drawn = vgetq_lane_u32 (drawn_acc, 0) | vgetq_lane_u32 (drawn_acc, 1) | vgetq_lane_u32 (drawn_acc, 2) |
+    vgetq_lane_u32 (drawn_acc, 3);
+
+  finish_sums (soa, end, uncertainty, z_lane, v_lane, h_lane, count, drawn, sums);
+}
+
+
+
+static void sum_depths_neon_unc (DEPTH_SOA *soa, BIN_SUMS *sums)
+{
+  sum_depths_neon_body (soa, NVTrue, sums);
+}
+
+
+
+static void sum_depths_neon_nounc (DEPTH_SOA *soa, BIN_SUMS *sums)
+{
+  sum_depths_neon_body (soa, NVFalse, sums);
+}
+
+#endif
+
+
+
+/*  Sum the valid depths (and H/V errors if uncertainty is set) in the gathered buffers using the fastest kernel
+    that this CPU supports.  */
+
+void sum_depths (DEPTH_SOA *soa, uint8_t uncertainty, BIN_SUMS *sums)
+{
+#if defined (USE_AVX2)
+  if (__builtin_cpu_supports ("avx2"))
+    {
+      if (uncertainty)
+        {
+          sum_depths_avx2_unc (soa, sums);
+        }
+      else
+        {
+          sum_depths_avx2_nounc (soa, sums);
+        }
+
+      return;
+    }
+#elif defined (USE_NEON)
+  if (uncertainty)
+    {
+      sum_depths_neon_unc (soa, sums);
+    }
+  else
+    {
+      sum_depths_neon_nounc (soa, sums);
+    }
+
+  return;
+#endif
+
+  if (uncertainty)
+    {
+      sum_depths_scalar_unc (soa, sums);
+    }
+  else
+    {
+      sum_depths_scalar_nounc (soa, sums);
+    }
+}
@@ -0,0 +1,573 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "pfm2chrtr2.h"
+
+#include <sys/stat.h>
+
+#ifndef NVWIN3X
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+
+/*
+
+    Checkpoint and resume (--checkpoint and --resume).
+
+    Every --checkpoint seconds we close, sync, and reopen the CHRTR2 file, so that everything written so far is on
+    disk, and then save the progress in CHRTR2_FILE.checkpoint (synced and renamed into place, so a crash leaves
+    either the old checkpoint or the new one).  During aggregation that's the number of rows written (rows are
+    always written in order) along with the running Z ranges.  During gridding it's the MISP tiles (or inverse
+    distance rows) that have been stored.  The settings that affect the output are saved too, along with the size and
+    modification time of the PFM files.
+
+    --resume refuses to go on if the PFM files have changed since the checkpoint (the finished part of the grid would
+    no longer match them).  Otherwise it reopens the CHRTR2 file, takes the settings from the checkpoint, and rebuilds the occupancy bitmap for the
+    finished part of the grid from the CHRTR2 status (the same bins the writer would have cleared).  Aggregation then
+    picks up at the first unwritten row, or gridding skips the tiles that were already stored.  Anything written after
+    the checkpoint is simply done again with the same result, so the output matches an uninterrupted run.  Untiled
+    MISP can only be restarted from the beginning of the gridding stage.  The checkpoint is removed when the
+    conversion finishes.
+
+*/
+
+
+#define         CHECKPOINT_VERSION 2
+
+
+
+static void checkpoint_name (OPTIONS *options, char *name)
+{
+  sprintf (name, "%s.checkpoint", options->chrtr2_file);
+}
+
+
+
+/*  Get the size and modification time of the PFM list, bin, and index files so that we can tell if the PFM has been
+    edited before a --resume.  A file that isn't there gets -1 for both.  */
+
+static void stamp_pfm (PFM_OPEN_ARGS *open_args, int64_t *pfm_stamp)
+{
+  struct stat         st;
+  char                *path[PFM_STAMP_FILES];
+  int32_t             i;
+
+
+  path[0] = open_args->list_path;
+  path[1] = open_args->bin_path;
+  path[2] = open_args->index_path;
+
+  for (i = 0 ; i < PFM_STAMP_FILES ; i++)
+    {
+      if (stat (path[i], &st))
+        {
+          pfm_stamp[i * 2] = -1;
+          pfm_stamp[i * 2 + 1] = -1;
+        }
+      else
+        {
+          pfm_stamp[i * 2] = st.st_size;
+          pfm_stamp[i * 2 + 1] = st.st_mtime;
+        }
+    }
+}
+
+
+
+/*  Make sure a file that has been closed is on disk and not just in the system's cache.  On Windows the file is
+    flushed when it's closed.  */
+
+static void sync_file (char *name)
+{
+#ifndef NVWIN3X
+  int                 fd;
+
+
+  if ((fd = open (name, O_RDONLY)) < 0 || fsync (fd))
+    {
+      perror (name);
+      exit (-1);
+    }
+
+  close (fd);
+#else
+  (void) name;
+#endif
+}
+
+
+
+/*  Set up for a new run.  */
+
+void start_checkpoint (OPTIONS *options, PFM_OPEN_ARGS *open_args, CHRTR2_RECORD *null_record, CHECKPOINT *checkpoint)
+{
+  memset (checkpoint, 0, sizeof (CHECKPOINT));
+
+  checkpoint->options = options;
+  checkpoint->width = open_args->head.bin_width;
+  checkpoint->height = open_args->head.bin_height;
+  stamp_pfm (open_args, checkpoint->pfm_stamp);
+  checkpoint->null_record = *null_record;
+  checkpoint->interval = options->checkpoint;
+  checkpoint->last = time (NULL);
+  checkpoint->stage = CHECKPOINT_AGGREGATE;
+  checkpoint->min_z = 9999999999.0;
+  checkpoint->max_z = -9999999999.0;
+}
+
+
+
+/*  Read the checkpoint left by an interrupted run and take the settings from it.  */
+
+void read_checkpoint (OPTIONS *options, PFM_OPEN_ARGS *open_args, CHECKPOINT *checkpoint)
+{
+  FILE                *fp;
+  char                name[1024], string[1024];
+  int32_t             i, version, check_width, check_height, start, count, width, height;
+  long long           window = 0, stamp[PFM_STAMP_FILES * 2];
+  int64_t             pfm_stamp[PFM_STAMP_FILES * 2];
+  uint8_t             ok = NVTrue;
+
+
+  memset (checkpoint, 0, sizeof (CHECKPOINT));
+
+  width = open_args->head.bin_width;
+  height = open_args->head.bin_height;
+
+  checkpoint_name (options, name);
+
+  if ((fp = fopen (name, "r")) == NULL)
+    {
+      perror (name);
+      fprintf (stderr, "\n\nThere is nothing to resume.\n\n");
+      exit (-1);
+    }
+
+  if (fgets (string, sizeof (string), fp) == NULL ||
+      sscanf (string, "pfm2chrtr2 checkpoint %d %d", &version, &checkpoint->interval) != 2 ||
+      version != CHECKPOINT_VERSION) ok = NVFalse;
+
+  if (ok && (fgets (string, sizeof (string), fp) == NULL ||
+             sscanf (string, "size %d %d %d", &check_width, &check_height, &checkpoint->tiles) != 3)) ok = NVFalse;
+
+  if (ok && (check_width != width || check_height != height))
+    {
+      fprintf (stderr, "\n\nThe PFM is %d x %d bins but the checkpoint is for %d x %d bins!\n\n", width, height,
+               check_width, check_height);
+      exit (-1);
+    }
+
+
+  /*  If the PFM has been edited since the checkpoint the part of the grid that's done doesn't match it anymore.  */
+
+  if (ok && (fgets (string, sizeof (string), fp) == NULL ||
+             sscanf (string, "pfm %lld %lld %lld %lld %lld %lld", &stamp[0], &stamp[1], &stamp[2], &stamp[3], &stamp[4],
+                     &stamp[5]) != PFM_STAMP_FILES * 2)) ok = NVFalse;
+
+  if (ok)
+    {
+      stamp_pfm (open_args, pfm_stamp);
+
+      for (i = 0 ; i < PFM_STAMP_FILES * 2 ; i++)
+        {
+          if (pfm_stamp[i] != stamp[i])
+            {
+              fprintf (stderr, "\n\nThe PFM %s has changed since the checkpoint, run without --resume.\n\n",
+                       open_args->list_path);
+              exit (-1);
+            }
+        }
+    }
+
+  if (ok && !scan_settings (fp, options, &checkpoint->null_record)) ok = NVFalse;
+
+
+  /*  The MISP window was set by plan_memory in the first run.  */
+
+  if (ok && (fgets (string, sizeof (string), fp) == NULL || sscanf (string, "window %lld", &window) != 1)) ok = NVFalse;
+
+  if (ok && (fgets (string, sizeof (string), fp) == NULL ||
+             sscanf (string, "stage %d %d %f %f", &checkpoint->stage, &checkpoint->rows_done, &checkpoint->min_z,
+                     &checkpoint->max_z) != 4)) ok = NVFalse;
+
+  if (ok)
+    {
+      checkpoint->tile_min_z = (float *) malloc (checkpoint->tiles * sizeof (float));
+      checkpoint->tile_max_z = (float *) malloc (checkpoint->tiles * sizeof (float));
+
+      if (checkpoint->tile_min_z == NULL || checkpoint->tile_max_z == NULL)
+        {
+          perror ("Allocating tiles in read_checkpoint");
+          exit (-1);
+        }
+
+      for (i = 0 ; i < checkpoint->tiles ; i++)
+        {
+          if (fgets (string, sizeof (string), fp) == NULL ||
+              sscanf (string, "%f %f", &checkpoint->tile_min_z[i], &checkpoint->tile_max_z[i]) != 2)
+            {
+              ok = NVFalse;
+              break;
+            }
+        }
+    }
+
+  if (ok && (fgets (string, sizeof (string), fp) == NULL || sscanf (string, "units %d", &checkpoint->units) != 1))
+    ok = NVFalse;
+
+  if (ok && checkpoint->units)
+    {
+      checkpoint->done = (uint8_t *) calloc (checkpoint->units, sizeof (uint8_t));
+      if (checkpoint->done == NULL)
+        {
+          perror ("Allocating units in read_checkpoint");
+          exit (-1);
+        }
+
+
+      /*  The finished units are stored as runs.  */
+
+      while (ok)
+        {
+          if (fgets (string, sizeof (string), fp) == NULL)
+            {
+              ok = NVFalse;
+            }
+          else if (!strncmp (string, "end", 3))
+            {
+              break;
+            }
+          else if (sscanf (string, "done %d %d", &start, &count) != 2 || start < 0 || count < 0 ||
+                   start + count > checkpoint->units)
+            {
+              ok = NVFalse;
+            }
+          else
+            {
+              memset (&checkpoint->done[start], 1, count);
+            }
+        }
+    }
+
+  fclose (fp);
+
+  if (!ok)
+    {
+      fprintf (stderr, "\n\nThe checkpoint %s is not valid, run without --resume.\n\n", name);
+      exit (-1);
+    }
+
+  checkpoint->options = options;
+  checkpoint->width = width;
+  checkpoint->height = height;
+  checkpoint->last = time (NULL);
+
+  options->misp_window = window;
+
+
+  /*  The checkpoint was written from the CHRTR2 file so we don't use the in memory grid.  */
+
+  options->in_memory = NVFalse;
+  if (!options->checkpoint) options->checkpoint = checkpoint->interval;
+  checkpoint->interval = options->checkpoint;
+}
+
+
+
+/*  Hook the checkpoint up to the output.  A resumed run gets its Z ranges and starting row from the checkpoint.  */
+
+void attach_checkpoint (CHECKPOINT *checkpoint, OUTPUT *output)
+{
+  if (checkpoint->tile_min_z != NULL)
+    {
+      memcpy (output->tile_min_z, checkpoint->tile_min_z, checkpoint->tiles * sizeof (float));
+      memcpy (output->tile_max_z, checkpoint->tile_max_z, checkpoint->tiles * sizeof (float));
+
+      free (checkpoint->tile_min_z);
+      free (checkpoint->tile_max_z);
+
+      output->min_z = checkpoint->min_z;
+      output->max_z = checkpoint->max_z;
+      output->first_row = checkpoint->rows_done;
+    }
+
+  checkpoint->tiles = output->occupancy->tiles_x * output->occupancy->tiles_y;
+  checkpoint->tile_min_z = output->tile_min_z;
+  checkpoint->tile_max_z = output->tile_max_z;
+
+  output->checkpoint = checkpoint;
+}
+
+
+
+/*  Clear the bins in the first rows that didn't produce a record, as the writer did before we were interrupted.  */
+
+void resume_occupancy (int32_t chrtr2_handle, OCCUPANCY *occupancy, int32_t rows)
+{
+  CHRTR2_RECORD       *chrtr2_row;
+  int32_t             i, j, end_col;
+
+
+  chrtr2_row = (CHRTR2_RECORD *) malloc (occupancy->width * sizeof (CHRTR2_RECORD));
+  if (chrtr2_row == NULL)
+    {
+      perror ("Allocating row buffer in resume_occupancy");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < rows ; i++)
+    {
+      for (j = next_occupied (occupancy, i, 0) ; j < occupancy->width ; j = next_occupied (occupancy, i, end_col))
+        {
+          end_col = next_empty (occupancy, i, j);
+
+          count_calls (CALL_CHRTR2_READ_ROW, 1);
+          if (chrtr2_read_row (chrtr2_handle, i, j, end_col - j, &chrtr2_row[j]))
+            {
+              chrtr2_perror ();
+              exit (-1);
+            }
+
+          for ( ; j < end_col ; j++)
+            {
+              if (!(chrtr2_row[j].status & (CHRTR2_REAL | CHRTR2_DIGITIZED_CONTOUR))) clear_occupied (occupancy, i, j);
+            }
+        }
+    }
+
+  free (chrtr2_row);
+}
+
+
+
+/*  Close, sync, and reopen the CHRTR2 file so that everything we've written is on disk.  Returns the new handle.  */
+
+static int32_t flush_chrtr2 (CHECKPOINT *checkpoint, int32_t chrtr2_handle)
+{
+  CHRTR2_HEADER       chrtr2_header;
+
+
+  chrtr2_close_file (chrtr2_handle);
+
+  sync_file (checkpoint->options->chrtr2_file);
+
+  chrtr2_handle = chrtr2_open_file (checkpoint->options->chrtr2_file, &chrtr2_header, CHRTR2_UPDATE);
+
+  if (chrtr2_handle < 0)
+    {
+      fprintf (stderr, "The file %s is not a CHRTR2 structure or there was an error reading the file.\n",
+               checkpoint->options->chrtr2_file);
+      fprintf (stderr, "The error message returned was: %s\n\n", chrtr2_strerror ());
+
+      exit (-1);
+    }
+
+  return (chrtr2_handle);
+}
+
+
+
+static void save_checkpoint (CHECKPOINT *checkpoint)
+{
+  FILE                *fp;
+  char                name[1024], temp_name[1100], dir_name[1024], *slash;
+  int32_t             i, start;
+
+
+  checkpoint_name (checkpoint->options, name);
+  sprintf (temp_name, "%s.tmp", name);
+
+  strcpy (dir_name, name);
+  if ((slash = strrchr (dir_name, '/')) != NULL)
+    {
+      slash[1] = 0;
+    }
+  else
+    {
+      strcpy (dir_name, ".");
+    }
+
+  if ((fp = fopen (temp_name, "w")) == NULL)
+    {
+      perror (temp_name);
+      exit (-1);
+    }
+
+  fprintf (fp, "pfm2chrtr2 checkpoint %d %d\n", CHECKPOINT_VERSION, checkpoint->interval);
+  fprintf (fp, "size %d %d %d\n", checkpoint->width, checkpoint->height, checkpoint->tiles);
+  fprintf (fp, "pfm %lld %lld %lld %lld %lld %lld\n", (long long) checkpoint->pfm_stamp[0],
+           (long long) checkpoint->pfm_stamp[1], (long long) checkpoint->pfm_stamp[2], (long long) checkpoint->pfm_stamp[3],
+           (long long) checkpoint->pfm_stamp[4], (long long) checkpoint->pfm_stamp[5]);
+  print_settings (fp, checkpoint->options, &checkpoint->null_record);
+  fprintf (fp, "window %lld\n", (long long) checkpoint->options->misp_window);
+  fprintf (fp, "stage %d %d %.9g %.9g\n", checkpoint->stage, checkpoint->rows_done, checkpoint->min_z, checkpoint->max_z);
+
+  for (i = 0 ; i < checkpoint->tiles ; i++)
+    fprintf (fp, "%.9g %.9g\n", checkpoint->tile_min_z[i], checkpoint->tile_max_z[i]);
+
+  fprintf (fp, "units %d\n", checkpoint->units);
+
+  for (i = 0 ; i < checkpoint->units ; i = start)
+    {
+      if (!checkpoint->done[i])
+        {
+          start = i + 1;
+          continue;
+        }
+
+      for (start = i + 1 ; start < checkpoint->units && checkpoint->done[start] ; start++);
+
+      fprintf (fp, "done %d %d\n", i, start - i);
+    }
+
+  fprintf (fp, "end\n");
+
+
+  /*  The new checkpoint has to be on disk before it replaces the old one, and the rename has to be on disk before we
+      write anything that the old checkpoint doesn't cover.  */
+
+  if (fclose (fp))
+    {
+      perror (temp_name);
+      exit (-1);
+    }
+
+  sync_file (temp_name);
+
+  if (rename (temp_name, name))
+    {
+      perror (name);
+      exit (-1);
+    }
+
+  sync_file (dir_name);
+
+  checkpoint->last = time (NULL);
+}
+
+
+
+/*  Called by write_row after each row.  */
+
+void checkpoint_row (OUTPUT *output, int32_t rows_done)
+{
+  CHECKPOINT          *checkpoint = output->checkpoint;
+
+
+  if (time (NULL) - checkpoint->last < checkpoint->interval) return;
+
+  output->chrtr2_handle = flush_chrtr2 (checkpoint, output->chrtr2_handle);
+
+  checkpoint->stage = CHECKPOINT_AGGREGATE;
+  checkpoint->rows_done = rows_done;
+  checkpoint->min_z = output->min_z;
+  checkpoint->max_z = output->max_z;
+
+  save_checkpoint (checkpoint);
+}
+
+
+
+/*  Aggregation is done.  Called when gridding starts.  */
+
+void checkpoint_stage (CHECKPOINT *checkpoint, int32_t *chrtr2_handle, float min_z, float max_z)
+{
+  if (checkpoint->stage == CHECKPOINT_INTERPOLATE) return;
+
+  *chrtr2_handle = flush_chrtr2 (checkpoint, *chrtr2_handle);
+
+  checkpoint->stage = CHECKPOINT_INTERPOLATE;
+  checkpoint->rows_done = checkpoint->height;
+  checkpoint->min_z = min_z;
+  checkpoint->max_z = max_z;
+
+  save_checkpoint (checkpoint);
+}
+
+
+
+/*  Set the number of units of gridding work (MISP tiles or rows).  A resumed run keeps the units it already did.  */
+
+void checkpoint_units (CHECKPOINT *checkpoint, int32_t units)
+{
+  if (checkpoint->units == units && checkpoint->done != NULL) return;
+
+  free (checkpoint->done);
+
+  checkpoint->units = units;
+  checkpoint->done = (uint8_t *) calloc (units, sizeof (uint8_t));
+
+  if (checkpoint->done == NULL)
+    {
+      perror ("Allocating units in checkpoint_units");
+      exit (-1);
+    }
+}
+
+
+
+/*  A unit of gridding work has been stored.  */
+
+void checkpoint_unit (CHECKPOINT *checkpoint, int32_t unit, int32_t *chrtr2_handle)
+{
+  checkpoint->done[unit] = NVTrue;
+
+  if (time (NULL) - checkpoint->last < checkpoint->interval) return;
+
+  *chrtr2_handle = flush_chrtr2 (checkpoint, *chrtr2_handle);
+
+  save_checkpoint (checkpoint);
+}
+
+
+
+/*  The conversion finished.  */
+
+void remove_checkpoint (CHECKPOINT *checkpoint)
+{
+  char                name[1024];
+
+
+  checkpoint_name (checkpoint->options, name);
+  remove (name);
+
+  free (checkpoint->done);
+  checkpoint->done = NULL;
+}
@@ -0,0 +1,176 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    Fill distance mask (--max_fill_distance).
+
+    Marks every cell that is within the fill distance (in cells) of a real or hand-drawn cell, using the two pass
+    linear time Euclidean distance transform of Felzenszwalb and Huttenlocher.  The first pass would normally need a
+    whole grid of column distances, so instead we sweep the rows from bottom to top keeping the last and next
+    occupied row in each column.  That gives the column distance for the current row from two row sized arrays.  The
+    second pass is the 1D lower envelope of parabolas along the row.  Only the mask bits are kept, so the extra
+    memory is one more bitmap the size of the occupancy bitmap.
+
+*/
+
+
+
+void build_fill_mask (OCCUPANCY *occupancy, double distance, OCCUPANCY *mask)
+{
+  int32_t             i, j, k, q, width, height, *prev, *next, *v, percent = 0, old_percent = -1;
+  double              *f, *z, s, d2, max_d2;
+
+
+  width = occupancy->width;
+  height = occupancy->height;
+  max_d2 = distance * distance;
+
+  allocate_occupancy (width, height, mask);
+
+  prev = (int32_t *) malloc (width * sizeof (int32_t));
+  next = (int32_t *) malloc (width * sizeof (int32_t));
+  v = (int32_t *) malloc (width * sizeof (int32_t));
+  f = (double *) malloc (width * sizeof (double));
+  z = (double *) malloc ((width + 1) * sizeof (double));
+
+  if (prev == NULL || next == NULL || v == NULL || f == NULL || z == NULL)
+    {
+      perror ("Allocating distance transform buffers in build_fill_mask");
+      exit (-1);
+    }
+
+  for (j = 0 ; j < width ; j++)
+    {
+      prev[j] = -1;
+      next[j] = -1;
+    }
+
+
+  for (i = 0 ; i < height ; i++)
+    {
+      /*  Squared distance along the column to the nearest occupied cell.  Columns with nothing in range are left out
+          of the envelope (HUGE_VAL).  The next occupied row in a column only moves forward so the search is linear
+          over the whole sweep.  */
+
+      for (j = 0 ; j < width ; j++)
+        {
+          if (is_occupied (occupancy, i, j)) prev[j] = i;
+
+          if (next[j] < i && next[j] != height)
+            {
+              for (k = i ; k < height && !is_occupied (occupancy, k, j) ; k++);
+              next[j] = k;
+            }
+
+          f[j] = HUGE_VAL;
+          if (prev[j] >= 0 && (double) (i - prev[j]) <= distance) f[j] = (double) (i - prev[j]) * (double) (i - prev[j]);
+          if (next[j] < height && (double) (next[j] - i) <= distance)
+            f[j] = MIN (f[j], (double) (next[j] - i) * (double) (next[j] - i));
+        }
+
+
+      /*  Lower envelope of the parabolas (q - j)^2 + f[j].  */
+
+      k = -1;
+      for (q = 0 ; q < width ; q++)
+        {
+          if (f[q] == HUGE_VAL) continue;
+
+          if (k < 0)
+            {
+              k = 0;
+              v[0] = q;
+              z[0] = -HUGE_VAL;
+              z[1] = HUGE_VAL;
+              continue;
+            }
+
+          while (NVTrue)
+            {
+              s = ((f[q] + (double) q * q) - (f[v[k]] + (double) v[k] * v[k])) / (2.0 * (q - v[k]));
+              if (s > z[k]) break;
+              k--;
+            }
+
+          k++;
+          v[k] = q;
+          z[k] = s;
+          z[k + 1] = HUGE_VAL;
+        }
+
+
+      /*  Nothing in range of this row.  */
+
+      if (k >= 0)
+        {
+          k = 0;
+          for (q = 0 ; q < width ; q++)
+            {
+              while (z[k + 1] < (double) q) k++;
+
+              d2 = (double) (q - v[k]) * (double) (q - v[k]) + f[v[k]];
+
+              if (d2 <= max_d2) set_occupied (mask, i, q);
+            }
+        }
+
+
+      percent = ((float) i / (float) height) * 100.0;
+      if (percent != old_percent)
+        {
+          fprintf (stderr, "Computing fill mask - %03d%%\r", percent);
+          fflush (stderr);
+          old_percent = percent;
+        }
+    }
+
+  fprintf (stderr, "Computing fill mask - 100%%, %lld of %lld cells within %.1f cells of data\n",
+           (long long) mask->total, (long long) width * height, distance);
+  fflush (stderr);
+
+  free (prev);
+  free (next);
+  free (v);
+  free (f);
+  free (z);
+}
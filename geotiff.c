@@ -0,0 +1,285 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "gdal.h"
+#include "cpl_string.h"
+#include "ogr_srs_api.h"
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    GeoTIFF output (--geotiff).
+
+    After the CHRTR2 file is finished we copy its Z, total uncertainty, and status into a three band, Float32,
+    Cloud Optimized GeoTIFF so that GIS users don't need a separate export.  The rows are read from the CHRTR2 file
+    one tile row at a time (north to south, since the GeoTIFF starts in the north-west corner) and written to an
+    uncompressed, internally tiled GeoTIFF next to the output.  The COG driver then builds the overviews and
+    compresses the tiles on --threads worker threads as it writes the final file, and the temporary file is
+    deleted.  The overviews use nearest neighbor resampling so that every overview cell is a real grid value and the
+    status band stays a set of flags.  Cells with no value are set to GEOTIFF_NULL in all three bands.
+
+*/
+
+
+#define         GEOTIFF_BLOCK 512
+#define         GEOTIFF_NULL  -999999.0
+
+
+static int32_t  old_percent;
+
+
+
+static int CPL_STDCALL geotiff_progress (double complete, const char *message, void *arg)
+{
+  int32_t             percent;
+
+
+  (void) message;
+  (void) arg;
+
+  percent = complete * 100.0;
+  if (percent != old_percent)
+    {
+      fprintf (stderr, "Writing GeoTIFF - %03d%%\r", percent);
+      fflush (stderr);
+      old_percent = percent;
+    }
+
+  return (TRUE);
+}
+
+
+
+/*  The COG driver's copy is the second half of the work.  */
+
+static int CPL_STDCALL copy_progress (double complete, const char *message, void *arg)
+{
+  return (geotiff_progress (0.5 + complete / 2.0, message, arg));
+}
+
+
+
+static void gdal_error (char *what)
+{
+  fprintf (stderr, "\n%s : %s\n\n", what, CPLGetLastErrorMsg ());
+  exit (-1);
+}
+
+
+
+/*  Write the finished CHRTR2 file as a GeoTIFF.  */
+
+void write_geotiff (OPTIONS *options)
+{
+  int32_t             chrtr2_handle, i, j, k, row, rows;
+  int64_t             cells;
+  CHRTR2_HEADER       chrtr2_header;
+  CHRTR2_RECORD       *chrtr2_row;
+  GDALDriverH         gtiff, cog;
+  GDALDatasetH        temp, geotiff;
+  GDALRasterBandH     band;
+  OGRSpatialReferenceH srs;
+  char                temp_file[512], threads[32], **create_options = NULL, *wkt = NULL;
+  static char         *band_name[3] = {"Z", "Uncertainty", "Status"};
+  float               *strip, *z, *uncertainty, *status;
+  double              transform[6];
+
+
+  chrtr2_handle = chrtr2_open_file (options->chrtr2_file, &chrtr2_header, CHRTR2_READONLY);
+
+  if (chrtr2_handle < 0)
+    {
+      fprintf (stderr, "The file %s is not a CHRTR2 structure or there was an error reading the file.\n", options->chrtr2_file);
+      fprintf (stderr, "The error message returned was: %s\n\n", chrtr2_strerror ());
+      exit (-1);
+    }
+
+
+  GDALAllRegister ();
+
+  if ((gtiff = GDALGetDriverByName ("GTiff")) == NULL || (cog = GDALGetDriverByName ("COG")) == NULL)
+    {
+      fprintf (stderr, "\nThe GDAL library doesn't have the GTiff and COG drivers (GDAL 3.1 or later is needed).\n\n");
+      exit (-1);
+    }
+
+  if (snprintf (temp_file, sizeof (temp_file), "%s.tmp.tif", options->geotiff_file) >= (int32_t) sizeof (temp_file))
+    {
+      fprintf (stderr, "\nThe GeoTIFF file name %s is too long.\n\n", options->geotiff_file);
+      exit (-1);
+    }
+
+  create_options = CSLSetNameValue (create_options, "TILED", "YES");
+  create_options = CSLSetNameValue (create_options, "BLOCKXSIZE", "512");
+  create_options = CSLSetNameValue (create_options, "BLOCKYSIZE", "512");
+  create_options = CSLSetNameValue (create_options, "BIGTIFF", "IF_SAFER");
+
+  temp = GDALCreate (gtiff, temp_file, chrtr2_header.width, chrtr2_header.height, 3, GDT_Float32, create_options);
+  if (temp == NULL) gdal_error (temp_file);
+
+  CSLDestroy (create_options);
+  create_options = NULL;
+
+
+  /*  CHRTR2 is grid registered so the cell edges are half a cell outside the MBR.  */
+
+  transform[0] = chrtr2_header.mbr.wlon - chrtr2_header.lon_grid_size_degrees / 2.0;
+  transform[1] = chrtr2_header.lon_grid_size_degrees;
+  transform[2] = 0.0;
+  transform[3] = chrtr2_header.mbr.slat + ((double) chrtr2_header.height - 0.5) * chrtr2_header.lat_grid_size_degrees;
+  transform[4] = 0.0;
+  transform[5] = -chrtr2_header.lat_grid_size_degrees;
+
+  GDALSetGeoTransform (temp, transform);
+
+  srs = OSRNewSpatialReference (NULL);
+  OSRImportFromEPSG (srs, 4326);
+  OSRExportToWkt (srs, &wkt);
+  GDALSetProjection (temp, wkt);
+  CPLFree (wkt);
+  OSRDestroySpatialReference (srs);
+
+  for (k = 0 ; k < 3 ; k++)
+    {
+      band = GDALGetRasterBand (temp, k + 1);
+      GDALSetDescription ((GDALMajorObjectH) band, band_name[k]);
+      GDALSetRasterNoDataValue (band, GEOTIFF_NULL);
+    }
+
+
+  cells = (int64_t) chrtr2_header.width * GEOTIFF_BLOCK;
+
+  strip = (float *) malloc (3 * cells * sizeof (float));
+  chrtr2_row = (CHRTR2_RECORD *) malloc (chrtr2_header.width * sizeof (CHRTR2_RECORD));
+
+  if (strip == NULL || chrtr2_row == NULL)
+    {
+      perror ("Allocating strip in write_geotiff");
+      exit (-1);
+    }
+
+  z = strip;
+  uncertainty = strip + cells;
+  status = strip + 2 * cells;
+
+
+  /*  One row of tiles at a time so that GDAL only ever has whole tiles to write.  */
+
+  old_percent = -1;
+
+  for (row = 0 ; row < chrtr2_header.height ; row += GEOTIFF_BLOCK)
+    {
+      rows = MIN (GEOTIFF_BLOCK, chrtr2_header.height - row);
+
+      for (i = 0 ; i < rows ; i++)
+        {
+          count_calls (CALL_CHRTR2_READ_ROW, 1);
+          if (chrtr2_read_row (chrtr2_handle, chrtr2_header.height - 1 - (row + i), 0, chrtr2_header.width, chrtr2_row))
+            {
+              chrtr2_perror ();
+              exit (-1);
+            }
+
+          for (j = 0 ; j < chrtr2_header.width ; j++)
+            {
+              k = i * chrtr2_header.width + j;
+
+              if (chrtr2_row[j].status & (CHRTR2_REAL | CHRTR2_DIGITIZED_CONTOUR | CHRTR2_INTERPOLATED))
+                {
+                  z[k] = chrtr2_row[j].z;
+                  status[k] = chrtr2_row[j].status;
+
+                  if (chrtr2_row[j].uncertainty >= CHRTR2_NULL_Z_VALUE)
+                    {
+                      uncertainty[k] = GEOTIFF_NULL;
+                    }
+                  else
+                    {
+                      uncertainty[k] = chrtr2_row[j].uncertainty;
+                    }
+                }
+              else
+                {
+                  z[k] = uncertainty[k] = status[k] = GEOTIFF_NULL;
+                }
+            }
+        }
+
+
+      /*  The strip is band sequential with the bands cells apart.  */
+
+      if (GDALDatasetRasterIO (temp, GF_Write, 0, row, chrtr2_header.width, rows, strip, chrtr2_header.width, rows,
+                               GDT_Float32, 3, NULL, 0, 0, cells * sizeof (float)) != CE_None) gdal_error (temp_file);
+
+      geotiff_progress ((double) (row + rows) / (double) chrtr2_header.height / 2.0, NULL, NULL);
+    }
+
+  free (strip);
+  free (chrtr2_row);
+
+  chrtr2_close_file (chrtr2_handle);
+
+
+  /*  The COG driver builds the overviews and compresses the tiles on the worker threads.  */
+
+  sprintf (threads, "%d", MAX (1, options->threads));
+
+  create_options = CSLSetNameValue (create_options, "BLOCKSIZE", "512");
+  create_options = CSLSetNameValue (create_options, "COMPRESS", "DEFLATE");
+  create_options = CSLSetNameValue (create_options, "PREDICTOR", "YES");
+  create_options = CSLSetNameValue (create_options, "OVERVIEWS", "AUTO");
+  create_options = CSLSetNameValue (create_options, "RESAMPLING", "NEAREST");
+  create_options = CSLSetNameValue (create_options, "BIGTIFF", "IF_SAFER");
+  create_options = CSLSetNameValue (create_options, "NUM_THREADS", threads);
+
+  geotiff = GDALCreateCopy (cog, options->geotiff_file, temp, FALSE, create_options, copy_progress, NULL);
+  if (geotiff == NULL) gdal_error (options->geotiff_file);
+
+  CSLDestroy (create_options);
+
+  GDALClose (geotiff);
+  GDALClose (temp);
+
+  GDALDeleteDataset (gtiff, temp_file);
+
+  fprintf (stderr, "Writing GeoTIFF - 100%%\n");
+  fflush (stderr);
+}
@@ -0,0 +1,425 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include <pthread.h>
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    Inverse distance gridding (--grid_type G).
+
+    This is a quick-look alternative to MISP.  The real and hand-drawn cells are put in a uniform grid index whose
+    buckets are --search_radius cells on a side so that every point within the search radius of a cell is in the
+    3 x 3 buckets around it.  NULL cells with data in range get the inverse distance squared weighted mean of that
+    data and are marked CHRTR2_INTERPOLATED, cells with no data in range (or outside of the --max_fill_distance
+    mask) stay NULL.  Rows are handed out to --threads worker threads in ascending order and the calling thread
+    writes them in row order through a ring of row buffers, the same way the threaded aggregation works.  With
+    --update only the tiles within reach of an edit are gridded again.
+
+*/
+
+
+typedef struct
+{
+  int32_t             radius;                  /*  Search radius and bucket size in cells  */
+  int32_t             buckets_x;
+  int32_t             buckets_y;
+  int64_t             *bucket_start;           /*  buckets_x * buckets_y + 1 offsets into xyz  */
+  NV_F64_COORD3       *xyz;                    /*  Points sorted by bucket  */
+} POINT_INDEX;
+
+
+typedef struct
+{
+  pthread_mutex_t     mutex;
+  pthread_cond_t      cond;
+  SURFACE             *surface;
+  POINT_INDEX         *index;
+  uint8_t             *affected;               /*  Occupancy tiles to grid again for --update, NULL for all  */
+  int32_t             next_row;                /*  Next row to be handed out  */
+  int32_t             next_write;              /*  Next row the writer is waiting for  */
+  int32_t             window;                  /*  Number of rows in the ring  */
+  float               **ring;
+  uint8_t             *done;                   /*  NVTrue when ring[row % window] holds a finished row  */
+} IDW_SHARED;
+
+
+
+/*  Sort the points into buckets (counting sort).  The points are in the zero based bin units that
+    load_surface_points returns.  */
+
+static void build_point_index (NV_F64_COORD3 *xyz, int64_t count, int32_t rows, int32_t cols, int32_t radius,
+                               POINT_INDEX *index)
+{
+  int64_t             i, *next, buckets;
+  int32_t             bucket;
+
+
+  index->radius = radius;
+  index->buckets_x = (cols + radius - 1) / radius;
+  index->buckets_y = (rows + radius - 1) / radius;
+
+  buckets = (int64_t) index->buckets_x * index->buckets_y;
+
+  index->bucket_start = (int64_t *) calloc (buckets + 1, sizeof (int64_t));
+  next = (int64_t *) malloc (buckets * sizeof (int64_t));
+  index->xyz = (NV_F64_COORD3 *) malloc (count * sizeof (NV_F64_COORD3));
+
+  if (index->bucket_start == NULL || next == NULL || index->xyz == NULL)
+    {
+      perror ("Allocating point index in build_point_index");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < count ; i++)
+    {
+      bucket = ((int32_t) xyz[i].y / radius) * index->buckets_x + (int32_t) xyz[i].x / radius;
+      index->bucket_start[bucket + 1]++;
+    }
+
+  for (i = 0 ; i < buckets ; i++)
+    {
+      index->bucket_start[i + 1] += index->bucket_start[i];
+      next[i] = index->bucket_start[i];
+    }
+
+  for (i = 0 ; i < count ; i++)
+    {
+      bucket = ((int32_t) xyz[i].y / radius) * index->buckets_x + (int32_t) xyz[i].x / radius;
+      index->xyz[next[bucket]++] = xyz[i];
+    }
+
+  free (next);
+}
+
+
+
+static void free_point_index (POINT_INDEX *index)
+{
+  free (index->bucket_start);
+  free (index->xyz);
+}
+
+
+
+/*  Inverse distance squared estimate for the NULL cells of a row.  Occupied cells and cells with no data within the
+    search radius are set to NaN so that fill_surface_row leaves them alone.  */
+
+static void idw_row (SURFACE *surface, POINT_INDEX *index, uint8_t *affected, int32_t row, float *values)
+{
+  int32_t             col, bx, by, bucket_row, bucket_col, width;
+  int64_t             i, end;
+  double              dx, dy, d2, r2, weight, sum, weight_sum;
+
+
+  width = surface->chrtr2_header->width;
+  r2 = (double) index->radius * (double) index->radius;
+  by = row / index->radius;
+
+  for (col = 0 ; col < width ; col++)
+    {
+      values[col] = NAN;
+
+      if (is_occupied (surface->occupancy, row, col)) continue;
+
+      if (surface->fill_mask != NULL && !is_occupied (surface->fill_mask, row, col)) continue;
+
+      if (affected != NULL && !affected[(row / OCCUPANCY_TILE) * surface->occupancy->tiles_x + col / OCCUPANCY_TILE]) continue;
+
+      bx = col / index->radius;
+      sum = weight_sum = 0.0;
+
+      for (bucket_row = MAX (0, by - 1) ; bucket_row <= MIN (index->buckets_y - 1, by + 1) ; bucket_row++)
+        {
+          for (bucket_col = MAX (0, bx - 1) ; bucket_col <= MIN (index->buckets_x - 1, bx + 1) ; bucket_col++)
+            {
+              i = index->bucket_start[(int64_t) bucket_row * index->buckets_x + bucket_col];
+              end = index->bucket_start[(int64_t) bucket_row * index->buckets_x + bucket_col + 1];
+
+              for ( ; i < end ; i++)
+                {
+                  dx = index->xyz[i].x - (double) col;
+                  dy = index->xyz[i].y - (double) row;
+                  d2 = dx * dx + dy * dy;
+
+
+                  /*  Data cells are never NULL so d2 can't be 0.  */
+
+                  if (d2 > r2) continue;
+
+                  weight = 1.0 / d2;
+                  sum += weight * index->xyz[i].z;
+                  weight_sum += weight;
+                }
+            }
+        }
+
+      if (weight_sum > 0.0) values[col] = sum / weight_sum;
+    }
+}
+
+
+
+static void *idw_worker (void *arg)
+{
+  IDW_SHARED          *shared = (IDW_SHARED *) arg;
+  CHRTR2_HEADER       *chrtr2_header = shared->surface->chrtr2_header;
+  int32_t             row, slot;
+
+
+  while (NVTrue)
+    {
+      pthread_mutex_lock (&shared->mutex);
+
+      if (shared->next_row >= chrtr2_header->height)
+        {
+          pthread_mutex_unlock (&shared->mutex);
+          break;
+        }
+
+      row = shared->next_row++;
+
+
+      /*  Wait until the writer has freed up the ring slot for this row.  */
+
+      while (row >= shared->next_write + shared->window) pthread_cond_wait (&shared->cond, &shared->mutex);
+
+      pthread_mutex_unlock (&shared->mutex);
+
+
+      slot = row % shared->window;
+
+
+      /*  Rows with nothing to fill are skipped by the writer.  */
+
+      if (fillable_cells (shared->surface, row, 0, 1, chrtr2_header->width))
+        idw_row (shared->surface, shared->index, shared->affected, row, shared->ring[slot]);
+
+
+      pthread_mutex_lock (&shared->mutex);
+      shared->done[slot] = NVTrue;
+      pthread_cond_broadcast (&shared->cond);
+      pthread_mutex_unlock (&shared->mutex);
+    }
+
+  return (NULL);
+}
+
+
+
+void idw_surface (OPTIONS *options, SURFACE *surface)
+{
+  CHRTR2_HEADER       *chrtr2_header = surface->chrtr2_header;
+  OCCUPANCY           *occupancy = surface->occupancy;
+  NV_F64_COORD3       *xyz_array = NULL;
+  POINT_INDEX         index;
+  IDW_SHARED          shared;
+  pthread_t           *thread;
+  int64_t             count;
+  int32_t             i, j, slot, reach, first_row = 0, percent = 0, old_percent = -1;
+  STAGE_MARK          mark;
+
+
+  count = load_surface_points (surface, 0, 0, chrtr2_header->height, chrtr2_header->width, &xyz_array);
+
+  if (!count)
+    {
+      fprintf (stderr, "\n\nNo data points found for gridding!\n\n");
+      exit (-1);
+    }
+
+  start_stage (&mark);
+
+  build_point_index (xyz_array, count, chrtr2_header->height, chrtr2_header->width, options->search_radius, &index);
+
+  end_stage (STAGE_LOAD, &mark);
+
+  free (xyz_array);
+
+
+  memset (&shared, 0, sizeof (IDW_SHARED));
+
+  pthread_mutex_init (&shared.mutex, NULL);
+  pthread_cond_init (&shared.cond, NULL);
+
+  shared.surface = surface;
+  shared.index = &index;
+
+
+  /*  For --update, only the cells within the search radius (and fill distance) of an edit can change.  */
+
+  if (surface->dirty_tile != NULL)
+    {
+      shared.affected = (uint8_t *) malloc ((int64_t) occupancy->tiles_x * occupancy->tiles_y * sizeof (uint8_t));
+      if (shared.affected == NULL)
+        {
+          perror ("Allocating affected tiles in idw_surface");
+          exit (-1);
+        }
+
+      reach = options->search_radius + (int32_t) ceil (options->max_fill_distance);
+
+      for (i = 0 ; i < occupancy->tiles_y ; i++)
+        {
+          for (j = 0 ; j < occupancy->tiles_x ; j++)
+            {
+              shared.affected[i * occupancy->tiles_x + j] = surface_dirty (surface, i * OCCUPANCY_TILE, j * OCCUPANCY_TILE,
+                                                                           OCCUPANCY_TILE, OCCUPANCY_TILE, reach);
+            }
+        }
+    }
+
+
+  /*  Rows are stored in order so a resumed run starts at the first row that wasn't finished.  */
+
+  if (surface->checkpoint != NULL)
+    {
+      checkpoint_units (surface->checkpoint, chrtr2_header->height);
+
+      for (first_row = 0 ; first_row < chrtr2_header->height && surface->checkpoint->done[first_row] ; first_row++);
+
+      shared.next_row = shared.next_write = first_row;
+    }
+
+  shared.window = options->threads * IDW_RING_ROWS;
+
+  shared.ring = (float **) calloc (shared.window, sizeof (float *));
+  shared.done = (uint8_t *) calloc (shared.window, sizeof (uint8_t));
+  thread = (pthread_t *) malloc (options->threads * sizeof (pthread_t));
+
+  if (shared.ring == NULL || shared.done == NULL || thread == NULL)
+    {
+      perror ("Allocating thread data in idw_surface");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < shared.window ; i++)
+    {
+      shared.ring[i] = (float *) malloc (chrtr2_header->width * sizeof (float));
+      if (shared.ring[i] == NULL)
+        {
+          perror ("Allocating row buffers in idw_surface");
+          exit (-1);
+        }
+    }
+
+
+  for (i = 0 ; i < options->threads ; i++)
+    {
+      if (pthread_create (&thread[i], NULL, idw_worker, &shared))
+        {
+          perror ("Starting gridding thread");
+          exit (-1);
+        }
+    }
+
+
+  /*  This thread is the writer.  */
+
+  for (i = first_row ; i < chrtr2_header->height ; i++)
+    {
+      slot = i % shared.window;
+
+
+      /*  The time spent waiting on the workers is the solve time.  */
+
+      start_stage (&mark);
+
+      pthread_mutex_lock (&shared.mutex);
+      while (!shared.done[slot]) pthread_cond_wait (&shared.cond, &shared.mutex);
+      pthread_mutex_unlock (&shared.mutex);
+
+      end_stage (STAGE_SOLVE, &mark);
+
+      start_stage (&mark);
+
+
+      if (shared.affected != NULL)
+        {
+          for (j = 0 ; j < occupancy->tiles_x ; j++)
+            {
+              if (shared.affected[(i / OCCUPANCY_TILE) * occupancy->tiles_x + j])
+                reset_surface (surface, i, j * OCCUPANCY_TILE, 1, MIN (OCCUPANCY_TILE, chrtr2_header->width - j * OCCUPANCY_TILE));
+            }
+        }
+
+      if (fillable_cells (surface, i, 0, 1, chrtr2_header->width))
+        fill_surface_row (surface, i, 0, chrtr2_header->width, shared.ring[slot]);
+
+      end_stage (STAGE_WRITEBACK, &mark);
+
+      if (surface->checkpoint != NULL) checkpoint_unit (surface->checkpoint, i, &surface->chrtr2_handle);
+
+
+      pthread_mutex_lock (&shared.mutex);
+      shared.done[slot] = NVFalse;
+      shared.next_write = i + 1;
+      pthread_cond_broadcast (&shared.cond);
+      pthread_mutex_unlock (&shared.mutex);
+
+
+      percent = ((float) i / (float) chrtr2_header->height) * 100.0;
+      if (percent != old_percent)
+        {
+          fprintf (stderr, "Inverse distance gridding - %03d%%\r", percent);
+          fflush (stderr);
+          old_percent = percent;
+        }
+    }
+
+  fprintf (stderr, "Inverse distance gridding - 100%%\n");
+  fflush (stderr);
+
+
+  for (i = 0 ; i < options->threads ; i++) pthread_join (thread[i], NULL);
+
+  for (i = 0 ; i < shared.window ; i++) free (shared.ring[i]);
+
+  free (shared.ring);
+  free (shared.done);
+  free (shared.affected);
+  free (thread);
+
+  free_point_index (&index);
+
+  pthread_mutex_destroy (&shared.mutex);
+  pthread_cond_destroy (&shared.cond);
+}
@@ -36,21 +36,13 @@
 
 
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <math.h>
-#include <memory.h>
-#include <errno.h>
-#include <string.h>
 #include <getopt.h>
 
-#include "nvutility.h"
-#include "globals.hpp"
+#ifndef NVWIN3X
+#include <unistd.h>
+#endif
 
-#include "pfm.h"
-#include "chrtr2.h"
-#include "chrtr2_shared.h"
-#include "misp.h"
+#include "pfm2chrtr2.h"
 
 #include "version.h"
 
@@ -70,16 +62,124 @@
 
 void usage ()
 {
-  fprintf (stderr, "\nUsage: pfm2chrtr2 uncertainty_bound [--no_uncertainty] [--grid_type GRID_TYPE] [--output_file CHRTR2_FILE] PFM_FILE\n\n");
+  fprintf (stderr, "\nUsage: pfm2chrtr2 uncertainty_bound [--no_uncertainty] [--grid_type GRID_TYPE] [--output_file CHRTR2_FILE]\n");
+  fprintf (stderr, "\t[--threads N] [--read_ahead ROWS] [--in_memory] [--bin_layer] [--misp_tile SIZE]\n");
+  fprintf (stderr, "\t[--misp_halo CELLS] [--max_memory MB]\n");
+  fprintf (stderr, "\t[--search_radius CELLS] [--max_fill_distance CELLS] [--manifest] [--update]\n");
+  fprintf (stderr, "\t[--tile_cache DIR] [--checkpoint SECONDS] [--resume] [--timing]\n");
+  fprintf (stderr, "\t[--stats JSON_FILE] [--mbr W,S,E,N | --window ROW,COL,ROWS,COLS]\n");
+  fprintf (stderr, "\t[--margin CELLS] [--overviews FACTOR,FACTOR,...] [--geotiff TIFF_FILE]\n");
+  fprintf (stderr, "\t[--variant CHRTR2_FILE[,BOUND][,GRID_TYPE][,[no_]uncertainty] ...]\n");
+  fprintf (stderr, "\t[--stream FILE|-]\n");
+  fprintf (stderr, "\tPFM_FILE [PFM_FILE ...]\n");
+  fprintf (stderr, "   or: pfm2chrtr2 --batch BATCH_FILE [--threads N] [--max_memory MB]\n\n");
   fprintf (stderr, "\tWhere:\n\n");
   fprintf (stderr, "\t--no_uncertainty eliminates H/V uncertainty (but not total\n");
   fprintf (stderr, "\t\tuncertainty) from being stored in the output file.\n\n");
   fprintf (stderr, "\t--grid_type specifies the grid type where GRID_TYPE is\n");
-  fprintf (stderr, "\t\tM or N for MISP, or NONE respectively.  If you\n");
-  fprintf (stderr, "\t\tdo not specify the grid type the default is MISP.\n\n");
+  fprintf (stderr, "\t\tM, G, or N for MISP, inverse distance, or NONE\n");
+  fprintf (stderr, "\t\trespectively.  If you do not specify the grid type\n");
+  fprintf (stderr, "\t\tthe default is MISP.  Inverse distance is much faster\n");
+  fprintf (stderr, "\t\tbut is only meant for quick-look grids.\n\n");
   fprintf (stderr, "\t--output_file specifies an output file name.  If you do\n");
   fprintf (stderr, "\t\tnot specify a name the output file will be the same as\n");
   fprintf (stderr, "\t\tthe PFM_FILE with the .pfm extension replaced with .ch2.\n");
+  fprintf (stderr, "\t--threads specifies the number of threads to use for bin\n");
+  fprintf (stderr, "\t\taggregation and the number of tiles to grid at once\n");
+  fprintf (stderr, "\t\twith --misp_tile.  The default is 1 (serial).\n");
+  fprintf (stderr, "\t--read_ahead runs the aggregation as a reader/compute/writer\n");
+  fprintf (stderr, "\t\tpipeline with the reader prefetching up to ROWS rows\n");
+  fprintf (stderr, "\t\tof depth data.  This can't be used with --threads.\n");
+  fprintf (stderr, "\t--in_memory keeps the aggregated Z and status of every bin\n");
+  fprintf (stderr, "\t\tin memory (6 bytes per bin) so that MISP doesn't have to\n");
+  fprintf (stderr, "\t\tread the CHRTR2 file back in.\n");
+  fprintf (stderr, "\t--bin_layer builds the CHRTR2 from the average filtered depth,\n");
+  fprintf (stderr, "\t\tstandard deviation, and sounding count in the PFM bin\n");
+  fprintf (stderr, "\t\trecords without reading any depth records.  Only use\n");
+  fprintf (stderr, "\t\tthis if the bin records are current.  Implies\n");
+  fprintf (stderr, "\t\t--no_uncertainty and hand-drawn contours are not flagged.\n");
+  fprintf (stderr, "\t--misp_tile grids the MISP surface in SIZE x SIZE cell tiles\n");
+  fprintf (stderr, "\t\tinstead of all at once.  Each tile is gridded with\n");
+  fprintf (stderr, "\t\tthe data in a halo around it and neighboring tiles are\n");
+  fprintf (stderr, "\t\tblended across half the halo either side of their edges.\n");
+  fprintf (stderr, "\t--misp_halo sets the width of the tile halo in cells.  The\n");
+  fprintf (stderr, "\t\tdefault is %d.\n", DEFAULT_MISP_HALO);
+  fprintf (stderr, "\t--max_memory keeps the grid sized buffers and MISP within MB\n");
+  fprintf (stderr, "\t\tmegabytes by gridding in tiles that fit (shared by\n");
+  fprintf (stderr, "\t\t--threads processes) and dropping --in_memory if needed.\n");
+  fprintf (stderr, "\t--search_radius sets how far in cells --grid_type G looks for\n");
+  fprintf (stderr, "\t\tdata.  Cells with no data in range are left empty.\n");
+  fprintf (stderr, "\t\tThe default is %d.\n", DEFAULT_SEARCH_RADIUS);
+  fprintf (stderr, "\t--max_fill_distance only fills cells within CELLS cells of\n");
+  fprintf (stderr, "\t\treal or hand-drawn data.  Cells farther away stay NULL.\n");
+  fprintf (stderr, "\t--manifest saves the settings and a hash of the bins of each\n");
+  fprintf (stderr, "\t\tarea in CHRTR2_FILE.manifest so that --update can be\n");
+  fprintf (stderr, "\t\tused on the CHRTR2 file later.  Without it any old\n");
+  fprintf (stderr, "\t\tCHRTR2_FILE.manifest is removed.\n");
+  fprintf (stderr, "\t--update redoes only the parts of an existing CHRTR2 file whose\n");
+  fprintf (stderr, "\t\tbins were edited since it was made, using the settings\n");
+  fprintf (stderr, "\t\tsaved in CHRTR2_FILE.manifest by --manifest (which it\n");
+  fprintf (stderr, "\t\tthen updates).  Use --misp_tile or --grid_type G to\n");
+  fprintf (stderr, "\t\tkeep the regridding local.\n");
+  fprintf (stderr, "\t--tile_cache keeps the gridded --misp_tile tiles in the existing\n");
+  fprintf (stderr, "\t\tdirectory DIR and reuses them when a later run has\n");
+  fprintf (stderr, "\t\texactly the same input data for a tile.\n");
+  fprintf (stderr, "\t--checkpoint saves the progress in CHRTR2_FILE.checkpoint\n");
+  fprintf (stderr, "\t\tevery SECONDS seconds so that an interrupted run can\n");
+  fprintf (stderr, "\t\tbe picked up with --resume.\n");
+  fprintf (stderr, "\t--resume carries on from the last checkpoint of an interrupted\n");
+  fprintf (stderr, "\t\trun, using its settings.  Neither can be used with\n");
+  fprintf (stderr, "\t\t--update.\n");
+  fprintf (stderr, "\t--timing reports the time spent in each stage along with\n");
+  fprintf (stderr, "\t\tthe bins, soundings, and cells processed per second.\n");
+  fprintf (stderr, "\t--stats writes the stage times, counts, I/O, library call\n");
+  fprintf (stderr, "\t\tcounts, and peak memory use to JSON_FILE as JSON.\n");
+  fprintf (stderr, "\t--mbr converts only the bins that overlap the area with west,\n");
+  fprintf (stderr, "\t\tsouth, east, and north bounds W, S, E, and N degrees.\n");
+  fprintf (stderr, "\t--window converts only the ROWS x COLS bins starting at PFM\n");
+  fprintf (stderr, "\t\trow ROW and column COL (row 0 is the south edge).\n");
+  fprintf (stderr, "\t--margin sets how many cells of data around the --mbr or\n");
+  fprintf (stderr, "\t\t--window area are used for the gridding.  The default\n");
+  fprintf (stderr, "\t\tis the --misp_halo or --search_radius.  Neither can be\n");
+  fprintf (stderr, "\t\tused with --manifest, --update, --checkpoint, or\n");
+  fprintf (stderr, "\t\t--resume.\n");
+  fprintf (stderr, "\t--overviews also builds a CHRTR2 file decimated by each FACTOR\n");
+  fprintf (stderr, "\t\t(CHRTR2_FILE with _FACTORx added to the name) from the\n");
+  fprintf (stderr, "\t\tsame read of the PFM and grids it the same way, for\n");
+  fprintf (stderr, "\t\texample --overviews 2,4,8.  This can't be used with\n");
+  fprintf (stderr, "\t\t--update, --checkpoint, --resume, --mbr, or --window.\n");
+  fprintf (stderr, "\t--geotiff also writes the finished Z, total uncertainty, and\n");
+  fprintf (stderr, "\t\tstatus to TIFF_FILE as a three band, tiled, compressed\n");
+  fprintf (stderr, "\t\tCloud Optimized GeoTIFF with overviews.  The tiles are\n");
+  fprintf (stderr, "\t\tcompressed on --threads threads.\n");
+  fprintf (stderr, "\t--variant also writes CHRTR2_FILE from the same read of the\n");
+  fprintf (stderr, "\t\tPFM with its own uncertainty BOUND (percent of depth),\n");
+  fprintf (stderr, "\t\tGRID_TYPE (M, G, or N), and uncertainty or\n");
+  fprintf (stderr, "\t\tno_uncertainty.  Anything not given is the same as the\n");
+  fprintf (stderr, "\t\tmain output.  It can be given up to %d times.  As many\n", MAX_VARIANTS);
+  fprintf (stderr, "\t\toutputs are gridded at once as there are --threads,\n");
+  fprintf (stderr, "\t\tsharing --threads and --max_memory.  This can't be\n");
+  fprintf (stderr, "\t\tused with --update, --checkpoint, --resume, --mbr, or\n");
+  fprintf (stderr, "\t\t--window.\n");
+  fprintf (stderr, "\t--stream also writes the finished Z, total uncertainty, and\n");
+  fprintf (stderr, "\t\tstatus row by row to FILE (which can be a named pipe)\n");
+  fprintf (stderr, "\t\tor to standard output for -, in the raw format\n");
+  fprintf (stderr, "\t\tdescribed in stream.c.  The rows are streamed as soon as\n");
+  fprintf (stderr, "\t\tthey're aggregated (--grid_type N) or gridded, except\n");
+  fprintf (stderr, "\t\twith --update, --resume, --variant, or a margin to crop\n");
+  fprintf (stderr, "\t\twhen they're streamed from the finished file.\n");
+  fprintf (stderr, "\tWith more than one PFM_FILE they are merged into one CHRTR2\n");
+  fprintf (stderr, "\t\tfile covering all of them.  They must have the same\n");
+  fprintf (stderr, "\t\tbin size and overlapping bins are combined.  The name\n");
+  fprintf (stderr, "\t\tof the first is used for the default output file.\n");
+  fprintf (stderr, "\t\t--manifest, --update, --checkpoint, and --resume can't\n");
+  fprintf (stderr, "\t\tbe used.\n");
+  fprintf (stderr, "\t--batch runs every conversion listed in BATCH_FILE, one per\n");
+  fprintf (stderr, "\t\tline as PFM_FILE followed by its options.  They run\n");
+  fprintf (stderr, "\t\tin parallel, largest first, within --threads (default\n");
+  fprintf (stderr, "\t\tall processors) and --max_memory.  The output of each\n");
+  fprintf (stderr, "\t\tgoes to CHRTR2_FILE.log and a failure doesn't stop the\n");
+  fprintf (stderr, "\t\trest.\n");
   fprintf (stderr, "\tuncertainty_bound specifies the maximum uncertainty value\n");
   fprintf (stderr, "\t\tas a percentage of depth.\n\n\n");
   exit (-1);
@@ -87,212 +187,150 @@ void usage ()
 
 
 
-static void add_point (NV_F64_COORD3 **xyz_array, NV_F64_COORD3 xyz, int32_t *count)
+/*  Make sure that a file name from the command line fits in a size byte buffer with room to add the .ch2
+    extension.  */
+
+static void check_name_length (char *name, int32_t size)
 {
-  *xyz_array = (NV_F64_COORD3 *) realloc (*xyz_array, (*count + 1) * sizeof (NV_F64_COORD3));
-  if (*xyz_array == NULL)
+  if (strlen (name) + 4 >= (size_t) size)
     {
-      perror ("Allocating xyz_array in remisp.");
+      fprintf (stderr, "\n\nThe file name %s is too long!\n\n", name);
       exit (-1);
     }
-
-
-  (*xyz_array)[*count] = xyz;
-
-  (*count)++;
 }
 
 
 
-/*  This function runs MISP on the selected area.  */
+/*  Fill in the NULL cells of the CHRTR2 file.  */
 
-static void misp (int32_t weight, int32_t chrtr2_handle, CHRTR2_HEADER chrtr2_header)
+int32_t interpolate (OPTIONS *options, int32_t chrtr2_handle, CHRTR2_HEADER *chrtr2_header, GRID *grid,
+                     OCCUPANCY *occupancy, CHRTR2_RECORD *null_record, uint8_t *dirty_tile, CHECKPOINT *checkpoint,
+                     STREAM *stream)
 {
-  NV_F64_COORD3      *xyz_array = NULL, xyz;
-  int32_t            i, j, out_count = 0, misp_weight;
-  CHRTR2_RECORD      chrtr2_record;
-  NV_F64_XYMBR       new_mbr;
-  int32_t            gridcols, gridrows;
-  float              *array = NULL;
-
-
+  SURFACE             surface;
+  OCCUPANCY           fill_mask;
 
-  misp_weight = weight;
 
+  open_surface (&surface, chrtr2_handle, chrtr2_header, grid, occupancy, null_record);
 
-  /*  Number of rows and columns in the area  */
+  surface.dirty_tile = dirty_tile;
+  surface.checkpoint = checkpoint;
 
-  gridcols = chrtr2_header.width;
-  gridrows = chrtr2_header.height;
+  if (stream != NULL) stream_surface (&surface, stream);
 
 
-  /*  Save the data to memory.  */
+  /*  The occupancy bitmap only marks the real and hand-drawn cells once aggregation is done so the mask has to be
+      built here.  */
 
-  for (i = 0 ; i < gridrows ; i++)
+  if (options->max_fill_distance > 0.0)
     {
-      for (j = 0 ; j < gridcols ; j++)
-        {
-	  chrtr2_read_record_row_col(chrtr2_handle,i,j,&chrtr2_record);
-
-
-	  xyz.y = chrtr2_header.mbr.slat + (((float) i) * chrtr2_header.lat_grid_size_degrees);
-	  xyz.x = chrtr2_header.mbr.wlon + (((float) j) * chrtr2_header.lon_grid_size_degrees);			
-          xyz.z = chrtr2_record.z;
-
-
-          /*  If we have data in the bin, go get it (we want to interpolate over already interpolated data  */
-          /*  so we only load real or drawn data except in the filter border).  */
-
-          if (chrtr2_record.status & (CHRTR2_REAL | CHRTR2_DIGITIZED_CONTOUR))
-            {
-              add_point (&xyz_array, xyz, &out_count);
-            }
-        }
+      build_fill_mask (occupancy, options->max_fill_distance, &fill_mask);
+      surface.fill_mask = &fill_mask;
     }
 
-
-  /*  Don't process if we didn't have any input data (xyz would not have been allocated so we don't need to free it).  */
-
-  if (!out_count)
+  if (options->grid_type == 2)
     {
-      fprintf (stderr, "\n\nNo data points found for gridding!\n\n");
-      exit (-1);
+      idw_surface (options, &surface);
     }
-
-
-  /*  We're going to let MISP handle everything in zero based units of the bin size.  That is, we subtract off the  */
-  /*  west lon from longitudes then divide by the grid size in the X direction.  We do the same with the latitude using  */
-  /*  the south latitude.  This will give us values that range from 0.0 to gridcols in longitude and 0.0 to  */
-  /*  gridrows in latitude.  */
-
-  new_mbr.min_x = 0.0;
-  new_mbr.min_y = 0.0;
-  new_mbr.max_x = (double) gridcols;
-  new_mbr.max_y = (double) gridrows;
-
-
-  /*  Initialize the MISP engine.  */
-
-  misp_init (1.0, 1.0, 0.05, 4, 20.0, 20, 999999.0, -999999.0, misp_weight, new_mbr);
-
-
-  for (i = 0 ; i < out_count ; i++)
+  else if (options->misp_tile)
     {
-      /*  Load the points.  */
-
-      /*  IMPORTANT NOTE:  MISP (by default) grids using corner posts.  That is, the data in a bin is assigned to the 
-          lower left corner of the bin.  Normal gridding/binning systems use the center of the bin.  Because of this we need
-          to lie to MISP and tell it that the point is really half a bin lower and to the left.  This is extremely
-          confusing but it works ;-)  */
-
-      xyz.x = NINT((xyz_array[i].x - chrtr2_header.mbr.wlon) / chrtr2_header.lon_grid_size_degrees);
-      xyz.y = NINT((xyz_array[i].y - chrtr2_header.mbr.slat) / chrtr2_header.lat_grid_size_degrees);
-      xyz.z = xyz_array[i].z;
-      misp_load (xyz);
+      misp_tiled (options, 2, &surface);
     }
-
-
-  fprintf (stderr, "Computing MISP surface\n");
-  fflush (stderr);
-
-
-  misp_proc ();
-
-  fprintf (stderr, "Retrieving MISP data\n");
-  fflush (stderr);
-
-
-  /*  Allocating one more than gridcols due to constraints of old chrtr (see comments in misp_funcs.c)  */
-
-  array = (float *) malloc ((gridcols + 1) * sizeof (float));
-
-  if (array == NULL)
+  else
     {
-      perror ("Allocating array in remisp");
-      exit (-1);
+      misp_surface (2, &surface);
     }
 
 
-  /*  This is where we stuff the new interpolated surface back in to the CHRTR2.  */
+  /*  Stream whatever is left after the last row that was filled in.  */
 
-  for (i = 0 ; i < gridrows ; i++)
-    {
-      if (!misp_rtrv (array)) break;
+  if (stream != NULL) stream_surface_rows (&surface, chrtr2_header->height, 0, 0);
 
+  close_surface (&surface);
 
-      for (j = 0 ; j < gridcols ; j++)
-        {
-          /*  Read the record.  */
-
-	  chrtr2_read_record_row_col(chrtr2_handle,i,j,&chrtr2_record);
-
+  if (surface.fill_mask != NULL) free_occupancy (&fill_mask);
 
-          /*  Only replace NULL values.  */
-
-          if (chrtr2_record.status == CHRTR2_NULL)
-            {
-              /*  Mark the record as interpolated.  */
 
-              chrtr2_record.status |= CHRTR2_INTERPOLATED;
+  /*  Checkpoints reopen the CHRTR2 file.  */
 
-
-              /*  If we exceeded the CHRTR2 limits we have to set it to the null depth (by definition, one greater than the max).  */
-
-              if (array[j] <= chrtr2_header.max_z && array[j] >= chrtr2_header.min_z)
-                {
-                  chrtr2_record.z = array[j];
-                }
-              else
-                {
-                  chrtr2_record.z = chrtr2_header.max_z + 1.0;
-                }
-
-
-              /*  Write the record back out.  */
-
-	      chrtr2_write_record_row_col(chrtr2_handle,i,j,chrtr2_record);
-            }
-        }
-    }
-
-  free (array);
-
-  free (xyz_array);
+  return (surface.chrtr2_handle);
 }
 
 
 
-int32_t main (int32_t argc, char *argv[])
+/*  The whole conversion.  This is separate from main so that --batch can run it in its child processes.  */
+
+int32_t pfm2chrtr2 (int32_t argc, char *argv[])
 {
-  int32_t             i, j, k, numrecs, pfm_handle = 0, chrtr2_handle = 0, percent = 0, old_percent = -1, count, option_index, grid_type, ubound = 50;
-  double              sum = 0.0, v_sum = 0.0, h_sum = 0.0;
-  float               min_z, max_z;
-  NV_I32_COORD2       coord;
-  uint8_t             uncertainty;
+  int32_t             i, pfm_handle = 0, percent = 0, old_percent = -1, option_index, megabytes = 0;
+  OPTIONS             options, level_options;
+  VARIANT_SPEC        *variant;
+  STREAM              stream;
+  OUTPUT              output;
+  GRID                grid;
+  OCCUPANCY           occupancy;
+  MANIFEST            manifest;
+  MOSAIC              mosaic;
+  CHECKPOINT          checkpoint;
+  CHRTR2_RECORD       null_record;
+  uint8_t             *dirty_tile = NULL, crop;
+  RUN_COUNTS          counts;
+  STAGE_MARK          mark;
+  double              start_time;
   PFM_OPEN_ARGS       open_args;
-  BIN_RECORD          bin_record;
-  DEPTH_RECORD        *depth_record;
+  ROW_BUFFER          row;
   CHRTR2_HEADER       chrtr2_header;
-  CHRTR2_RECORD       chrtr2_record;
-  char                c, chrtr2_file[512];
+  char                c, chrtr2_file[512], work_file[512], *factor, *field;
   extern char         *optarg;
   extern int          optind;
 
 
+  start_time = stage_clock ();
+
   fprintf(stderr, "\n\n %s \n\n", VERSION);
   fflush (stderr);
 
 
   option_index = 0;
-  strcpy (chrtr2_file, "");
-  uncertainty = NVTrue;
-  grid_type = 1;
+  memset (&options, 0, sizeof (OPTIONS));
+  strcpy (options.chrtr2_file, "");
+  options.uncertainty = NVTrue;
+  options.grid_type = 1;
+  options.ubound = 50;
+  options.threads = 0;
+  options.misp_halo = DEFAULT_MISP_HALO;
+  options.search_radius = DEFAULT_SEARCH_RADIUS;
+  options.margin = -1;
 
   while (NVTrue) 
     {
       static struct option long_options[] = {{"no_uncertainty", no_argument, 0, 0},
                                              {"grid_type", required_argument, 0, 0},
                                              {"output_file", required_argument, 0, 0},
+                                             {"threads", required_argument, 0, 0},
+                                             {"read_ahead", required_argument, 0, 0},
+                                             {"in_memory", no_argument, 0, 0},
+                                             {"bin_layer", no_argument, 0, 0},
+                                             {"misp_tile", required_argument, 0, 0},
+                                             {"misp_halo", required_argument, 0, 0},
+                                             {"max_memory", required_argument, 0, 0},
+                                             {"search_radius", required_argument, 0, 0},
+                                             {"max_fill_distance", required_argument, 0, 0},
+                                             {"update", no_argument, 0, 0},
+                                             {"tile_cache", required_argument, 0, 0},
+                                             {"checkpoint", required_argument, 0, 0},
+                                             {"resume", no_argument, 0, 0},
+                                             {"timing", no_argument, 0, 0},
+                                             {"stats", required_argument, 0, 0},
+                                             {"batch", required_argument, 0, 0},
+                                             {"mbr", required_argument, 0, 0},
+                                             {"window", required_argument, 0, 0},
+                                             {"margin", required_argument, 0, 0},
+                                             {"overviews", required_argument, 0, 0},
+                                             {"geotiff", required_argument, 0, 0},
+                                             {"variant", required_argument, 0, 0},
+                                             {"stream", required_argument, 0, 0},
+                                             {"manifest", no_argument, 0, 0},
                                              {0, no_argument, 0, 0}};
 
       c = (char) getopt_long (argc, argv, "", long_options, &option_index);
@@ -305,21 +343,21 @@ int32_t main (int32_t argc, char *argv[])
           switch (option_index)
             {
             case 0:
-              uncertainty = NVFalse;
+              options.uncertainty = NVFalse;
               break;
 
             case 1:
               if (strchr (optarg, 'N') || strchr (optarg, 'n'))
                 {
-                  grid_type = 0;
+                  options.grid_type = 0;
                 }
               else if (strchr (optarg, 'M') || strchr (optarg, 'm'))
                 {
-                  grid_type = 1;
+                  options.grid_type = 1;
                 }
               else if (strchr (optarg, 'G') || strchr (optarg, 'g'))
                 {
-                  grid_type = 2;
+                  options.grid_type = 2;
                 }
               else
                 {
@@ -328,12 +366,156 @@ int32_t main (int32_t argc, char *argv[])
               break;
 
             case 2:
-              strcpy (chrtr2_file, optarg);
+              check_name_length (optarg, sizeof (options.chrtr2_file));
+              strcpy (options.chrtr2_file, optarg);
               break;
 
             case 3:
-	      ubound = (100 / atoi (optarg));
-	      break;
+              if (sscanf (optarg, "%d", &options.threads) != 1 || options.threads < 1) usage ();
+              break;
+
+            case 4:
+              if (sscanf (optarg, "%d", &options.read_ahead) != 1 || options.read_ahead < 1) usage ();
+              break;
+
+            case 5:
+              options.in_memory = NVTrue;
+              break;
+
+            case 6:
+              options.bin_layer = NVTrue;
+              break;
+
+            case 7:
+              if (sscanf (optarg, "%d", &options.misp_tile) != 1 || options.misp_tile < 1) usage ();
+              break;
+
+            case 8:
+              if (sscanf (optarg, "%d", &options.misp_halo) != 1 || options.misp_halo < 0) usage ();
+              break;
+
+            case 9:
+              if (sscanf (optarg, "%d", &megabytes) != 1 || megabytes < 1) usage ();
+              options.max_memory = (int64_t) megabytes * 1024 * 1024;
+              break;
+
+            case 10:
+              if (sscanf (optarg, "%d", &options.search_radius) != 1 || options.search_radius < 1) usage ();
+              break;
+
+            case 11:
+              if (sscanf (optarg, "%lf", &options.max_fill_distance) != 1 || options.max_fill_distance <= 0.0) usage ();
+              break;
+
+            case 12:
+              options.update = NVTrue;
+              break;
+
+            case 13:
+              strcpy (options.tile_cache, optarg);
+              break;
+
+            case 14:
+              if (sscanf (optarg, "%d", &options.checkpoint) != 1 || options.checkpoint < 1) usage ();
+              break;
+
+            case 15:
+              options.resume = NVTrue;
+              break;
+
+            case 16:
+              options.timing = NVTrue;
+              break;
+
+            case 17:
+              strcpy (options.stats_file, optarg);
+              break;
+
+            case 18:
+              strcpy (options.batch_file, optarg);
+              break;
+
+            case 19:
+              if (sscanf (optarg, "%lf,%lf,%lf,%lf", &options.mbr.min_x, &options.mbr.min_y, &options.mbr.max_x,
+                          &options.mbr.max_y) != 4 || options.mbr.max_x <= options.mbr.min_x ||
+                  options.mbr.max_y <= options.mbr.min_y) usage ();
+              options.sub_area = SUB_AREA_MBR;
+              break;
+
+            case 20:
+              if (sscanf (optarg, "%d,%d,%d,%d", &options.window[0], &options.window[1], &options.window[2],
+                          &options.window[3]) != 4 || options.window[2] < 1 || options.window[3] < 1) usage ();
+              options.sub_area = SUB_AREA_WINDOW;
+              break;
+
+            case 21:
+              if (sscanf (optarg, "%d", &options.margin) != 1 || options.margin < 0) usage ();
+              break;
+
+            case 22:
+              for (factor = strtok (optarg, ",") ; factor != NULL ; factor = strtok (NULL, ","))
+                {
+                  if (options.overviews == MAX_OVERVIEWS) usage ();
+
+                  if (sscanf (factor, "%d", &options.overview[options.overviews]) != 1 ||
+                      options.overview[options.overviews] < 2) usage ();
+
+                  options.overviews++;
+                }
+              break;
+
+            case 23:
+              strcpy (options.geotiff_file, optarg);
+              break;
+
+            case 24:
+              if (options.variants == MAX_VARIANTS) usage ();
+
+              variant = &options.variant[options.variants];
+              variant->ubound = variant->uncertainty = variant->grid_type = -1;
+
+              if ((field = strtok (optarg, ",")) == NULL) usage ();
+              check_name_length (field, sizeof (variant->chrtr2_file));
+              strcpy (variant->chrtr2_file, field);
+
+              while ((field = strtok (NULL, ",")) != NULL)
+                {
+                  if (!strcmp (field, "uncertainty"))
+                    {
+                      variant->uncertainty = NVTrue;
+                    }
+                  else if (!strcmp (field, "no_uncertainty"))
+                    {
+                      variant->uncertainty = NVFalse;
+                    }
+                  else if (!strcmp (field, "N") || !strcmp (field, "n"))
+                    {
+                      variant->grid_type = 0;
+                    }
+                  else if (!strcmp (field, "M") || !strcmp (field, "m"))
+                    {
+                      variant->grid_type = 1;
+                    }
+                  else if (!strcmp (field, "G") || !strcmp (field, "g"))
+                    {
+                      variant->grid_type = 2;
+                    }
+                  else if (sscanf (field, "%d", &variant->ubound) != 1 || variant->ubound < 0)
+                    {
+                      usage ();
+                    }
+                }
+
+              options.variants++;
+              break;
+
+            case 25:
+              strcpy (options.stream_file, optarg);
+              break;
+
+            case 26:
+              options.manifest = NVTrue;
+              break;
             }
           break;
 
@@ -344,40 +526,134 @@ int32_t main (int32_t argc, char *argv[])
     }
 
 
+  /*  A batch shares all of the processors unless told otherwise.  */
+
+  if (options.batch_file[0])
+    {
+      if (optind < argc) usage ();
+
+#ifdef NVWIN3X
+      if (!options.threads) options.threads = 1;
+#else
+      if (!options.threads) options.threads = MAX (1, sysconf (_SC_NPROCESSORS_ONLN));
+#endif
+
+      return (run_batch (&options, argv[0]) ? -1 : 0);
+    }
+
+  if (!options.threads) options.threads = 1;
+
+
   /*  Make sure we got the mandatory file name.  */
 
   if (optind >= argc) usage ();
 
 
+  /*  The pipeline has its own reader thread so it doesn't mix with the multithreaded aggregation.  */
+
+  if (options.read_ahead && options.threads > 1) usage ();
+
+
+  /*  An update is already incremental.  */
+
+  if ((options.checkpoint || options.resume) && options.update) usage ();
+
+
+  /*  A mosaic has no single PFM to compare with for --update and isn't checkpointed.  */
+
+  if (argc - optind > 1 && (options.manifest || options.update || options.checkpoint || options.resume)) usage ();
+
+
+  /*  Neither does a sub-area, and the whole point of a mosaic is to cover everything.  */
+
+  if (options.sub_area && (argc - optind > 1 || options.manifest || options.update || options.checkpoint || options.resume))
+    usage ();
+
+
+  /*  The overviews are built from every row of the grid as it is written.  */
+
+  if (options.overviews && (options.update || options.checkpoint || options.resume || options.sub_area)) usage ();
+
+
+  /*  So are the variants, and they're written to new files.  */
+
+  if (options.variants && (options.update || options.checkpoint || options.resume || options.sub_area)) usage ();
+
+
+  /*  Nothing else can go to standard output if the grid is being streamed there.  */
+
+  if (!strcmp (options.stream_file, "-")) reserve_stdout ();
+
+
+  /*  The bin records don't carry H/V uncertainty.  */
+
+  if (options.bin_layer) options.uncertainty = NVFalse;
+
+
+  /*  Fill in what the variants didn't set from the main output.  */
+
+  for (i = 0 ; i < options.variants ; i++)
+    {
+      variant = &options.variant[i];
+
+      if (variant->ubound < 0) variant->ubound = options.ubound;
+      if (variant->uncertainty < 0) variant->uncertainty = options.uncertainty;
+      if (options.bin_layer) variant->uncertainty = NVFalse;
+      if (variant->grid_type < 0) variant->grid_type = options.grid_type;
+
+      if (strlen (variant->chrtr2_file) < 4 || strcmp (&variant->chrtr2_file[strlen (variant->chrtr2_file) - 4], ".ch2"))
+        strcat (variant->chrtr2_file, ".ch2");
+
+      if (variant->uncertainty) options.sum_uncertainty = NVTrue;
+    }
+
+
   /*  Make sure it's the correct kind of file.  */
 
   if (!strstr (argv[optind], ".pfm")) usage ();
 
+  check_name_length (argv[optind], sizeof (options.pfm_file));
 
-  strcpy (open_args.list_path, argv[optind]);
+  strcpy (options.pfm_file, argv[optind]);
+  strcpy (open_args.list_path, options.pfm_file);
 
 
   /*  If the output file wasn't named on the command line, create it from the PFM file name.  */
 
-  if (strlen (chrtr2_file) < 2)
+  if (strlen (options.chrtr2_file) < 2)
     {
-      strcpy (chrtr2_file, open_args.list_path);
-      sprintf (&chrtr2_file[strlen (chrtr2_file) - 4], ".ch2");
+      strcpy (options.chrtr2_file, open_args.list_path);
+      sprintf (&options.chrtr2_file[strlen (options.chrtr2_file) - 4], ".ch2");
     }
   else
     {
       /*  Make sure the .ch2 extension was included if the output file was specified on the command line.  */
 
-      if (strcmp (&chrtr2_file[strlen (chrtr2_file) - 4], ".ch2")) strcat (chrtr2_file, ".ch2");
+      if (strlen (options.chrtr2_file) < 4 || strcmp (&options.chrtr2_file[strlen (options.chrtr2_file) - 4], ".ch2"))
+        strcat (options.chrtr2_file, ".ch2");
     }
 
-  fprintf (stderr, "\n\nRejecting any uncertainty values greater than %d percent of depth\n\n", ubound);
+  fprintf (stderr, "\n\nRejecting any uncertainty values greater than %d percent of depth\n\n", options.ubound);
 
-  open_args.checkpoint = 0;
-  pfm_handle = open_existing_pfm_file (&open_args);
+  start_stage (&mark);
 
 
-  if (pfm_handle < 0) pfm_error_exit (pfm_error);
+  /*  With more than one PFM file open_args gets the first file's header resized to cover all of them.  */
+
+  memset (&mosaic, 0, sizeof (MOSAIC));
+
+  if (argc - optind > 1)
+    {
+      open_mosaic (&argv[optind], argc - optind, &mosaic, &open_args);
+    }
+  else
+    {
+      open_args.checkpoint = 0;
+      pfm_handle = open_existing_pfm_file (&open_args);
+
+
+      if (pfm_handle < 0) pfm_error_exit (pfm_error);
+    }
 
 
   /*  Check for projected data - yuck!  */
@@ -389,6 +665,27 @@ int32_t main (int32_t argc, char *argv[])
     }
 
 
+  /*  For --mbr or --window the PFM header is cut down to the area plus the margin.  If there is a margin the grid is
+      built in a working file and the area is cropped out of it at the end.  */
+
+  crop = NVFalse;
+
+  if (options.sub_area && plan_sub_area (&options, &open_args))
+    {
+      crop = NVTrue;
+
+      if (snprintf (work_file, sizeof (work_file), "%.*s.margin.ch2", (int) strlen (options.chrtr2_file) - 4,
+                    options.chrtr2_file) >= (int) sizeof (work_file))
+        {
+          fprintf (stderr, "\n\nThe file name %s is too long for the margin work file!\n\n", options.chrtr2_file);
+          exit (-1);
+        }
+
+      strcpy (chrtr2_file, options.chrtr2_file);
+      strcpy (options.chrtr2_file, work_file);
+    }
+
+
   /*  Populate the chrtr2 header prior to creating the file.  */
 
   memset (&chrtr2_header, 0, sizeof (CHRTR2_HEADER));
@@ -408,7 +705,7 @@ int32_t main (int32_t argc, char *argv[])
   chrtr2_header.max_z = CHRTR2_NULL_Z_VALUE;
   chrtr2_header.z_scale = open_args.scale;
 
-  chrtr2_header.grid_type = CHRTR2_MISP;
+  grid_type_header (options.grid_type, &chrtr2_header);
 
   chrtr2_header.max_number_of_points = 16777215;
   chrtr2_header.min_uncertainty = 0.0;
@@ -416,195 +713,416 @@ int32_t main (int32_t argc, char *argv[])
   chrtr2_header.uncertainty_scale = open_args.scale;
   strcpy (chrtr2_header.uncertainty_name, "Standard Deviation");
 
-  if (uncertainty)
+  uncertainty_header (options.uncertainty, &open_args, &chrtr2_header);
+
+
+  memset (&output, 0, sizeof (OUTPUT));
+
+
+  /*  For --update, open the existing file and take the settings from the last run's manifest.  */
+
+  if (options.update)
     {
-      chrtr2_header.min_horizontal_uncertainty = 0.0;
-      chrtr2_header.max_horizontal_uncertainty = 20000.0;
-      chrtr2_header.horizontal_uncertainty_scale = open_args.head.horizontal_error_scale;
-      chrtr2_header.min_vertical_uncertainty = 0.0;
-      chrtr2_header.max_vertical_uncertainty = 10000.0;
-      chrtr2_header.vertical_uncertainty_scale = open_args.head.vertical_error_scale;
+      read_manifest (&options, open_args.head.bin_width, open_args.head.bin_height, &manifest);
+
+      output.chrtr2_handle = chrtr2_open_file (options.chrtr2_file, &chrtr2_header, CHRTR2_UPDATE);
+
+      if (output.chrtr2_handle < 0)
+        {
+          fprintf (stderr, "The file %s is not a CHRTR2 structure or there was an error reading the file.\n", options.chrtr2_file);
+          fprintf (stderr, "The error message returned was: %s\n\n", chrtr2_strerror ());
+
+          exit (-1);
+        }
+
+      null_record = manifest.null_record;
+    }
+
+
+  /*  For --resume, open the partly written file and take the settings from the checkpoint.  */
+
+  else if (options.resume)
+    {
+      read_checkpoint (&options, &open_args, &checkpoint);
+
+      output.chrtr2_handle = chrtr2_open_file (options.chrtr2_file, &chrtr2_header, CHRTR2_UPDATE);
+
+      if (output.chrtr2_handle < 0)
+        {
+          fprintf (stderr, "The file %s is not a CHRTR2 structure or there was an error reading the file.\n", options.chrtr2_file);
+          fprintf (stderr, "The error message returned was: %s\n\n", chrtr2_strerror ());
+
+          exit (-1);
+        }
+
+      null_record = checkpoint.null_record;
     }
   else
     {
-      chrtr2_header.horizontal_uncertainty_scale = 0.0;
-      chrtr2_header.vertical_uncertainty_scale = 0.0;
+      /*  Try to create and open the chrtr2 file.  */
+
+      output.chrtr2_handle = chrtr2_create_file (options.chrtr2_file, &chrtr2_header);
+      if (output.chrtr2_handle < 0)
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+
+
+      /*  A manifest left by an earlier conversion doesn't match the new file.  With --manifest a new one replaces it
+          at the end, but not if this run fails.  */
+
+      remove_manifest (crop ? chrtr2_file : options.chrtr2_file);
+
+
+      /*  Get a copy of what chrtr2_create_file put in the cells that we never write to so that MISP can fill them
+          in without reading them back.  Nothing has been written yet so any cell will do.  */
+
+      if (chrtr2_read_record_row_col (output.chrtr2_handle, 0, 0, &null_record))
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
     }
 
 
-  /*  Try to create and open the chrtr2 file.  */
+  /*  Find out which bins have data so that the aggregation and MISP can skip the empty ones.  Unless something needs
+      the bitmap before the aggregation is done it is built from the bin rows that the aggregation reads anyway
+      rather than by reading them all an extra time.  A mosaic needs it to combine the files, --update to find the
+      edited tiles, --resume to pick up the rows that are done, and --max_memory to plan.  */
 
-  chrtr2_handle = chrtr2_create_file (chrtr2_file, &chrtr2_header);
-  if (chrtr2_handle < 0)
+  end_stage (STAGE_CREATE, &mark);
+
+  start_stage (&mark);
+
+  if (mosaic.count)
     {
-      chrtr2_perror ();
-      exit (-1);
+      build_mosaic_occupancy (&mosaic, open_args.head.bin_width, open_args.head.bin_height, &occupancy);
+    }
+  else if (!options.update && !options.resume && !options.max_memory)
+    {
+      defer_occupancy (open_args.head.bin_width, open_args.head.bin_height, &occupancy);
+    }
+  else
+    {
+      build_occupancy (pfm_handle, options.pfm_row0, options.pfm_col0, open_args.head.bin_width, open_args.head.bin_height, &occupancy);
     }
 
+  end_stage (STAGE_SCAN, &mark);
+
+  output.occupancy = &occupancy;
 
-  min_z = 9999999999.0;
-  max_z = -9999999999.0;
 
+  memset (&counts, 0, sizeof (RUN_COUNTS));
+  counts.cells = (int64_t) open_args.head.bin_width * open_args.head.bin_height;
 
-  /*  Loop through the PFM file.  */
+  output.tile_min_z = (float *) malloc ((int64_t) occupancy.tiles_x * occupancy.tiles_y * sizeof (float));
+  output.tile_max_z = (float *) malloc ((int64_t) occupancy.tiles_x * occupancy.tiles_y * sizeof (float));
 
-  for (i = 0 ; i < open_args.head.bin_height ; i++)
+  if (output.tile_min_z == NULL || output.tile_max_z == NULL)
     {
-      coord.y = i;
+      perror ("Allocating tile Z ranges");
+      exit (-1);
+    }
 
-      for (j = 0 ; j < open_args.head.bin_width ; j++)
-        {
-          coord.x = j;
+  for (i = 0 ; i < occupancy.tiles_x * occupancy.tiles_y ; i++)
+    {
+      output.tile_min_z[i] = 9999999999.0;
+      output.tile_max_z[i] = -9999999999.0;
+    }
 
-          read_bin_record_index (pfm_handle, coord, &bin_record);
 
-          memset (&chrtr2_record, 0, sizeof (CHRTR2_RECORD));
+  /*  Fit what we keep in memory to --max_memory.  This may turn off --in_memory and set the MISP tile size and the
+      aggregation band size.  An update or a resumed run has to use the tile size from the manifest or the
+      checkpoint.  */
 
-          if (bin_record.validity & PFM_DATA)
-            {
-              read_depth_array_index (pfm_handle, coord, &depth_record, &numrecs);
+  if (!options.update && !options.resume) plan_memory (&options, &occupancy, mosaic.count);
 
-              sum = 0.0;
-              v_sum = 0.0;
-              h_sum = 0.0;
-              count = 0;
 
+  if (options.in_memory && options.grid_type)
+    {
+      allocate_grid (&grid, open_args.head.bin_width, open_args.head.bin_height);
 
-              uint8_t drawn = NVFalse;
-              for (k = 0 ; k < numrecs ; k++)
-                {
-                  if (!(depth_record[k].validity & (PFM_INVAL | PFM_DELETED | PFM_REFERENCE)))
-                    {
-                      //  Check for a hand-drawn contour (PFM_DATA is set in one or more of the depth records).
+      grid.null_record = null_record;
 
-                      if (depth_record[k].validity & PFM_DATA) drawn = NVTrue;
+      output.grid = &grid;
+    }
 
-                      if (uncertainty)
-                        {
-                          v_sum += depth_record[k].vertical_error;
-                          h_sum += depth_record[k].horizontal_error;
-                        }
 
-                      sum += depth_record[k].xyz.z;
-                      count++;
-                    }
-                }
-              free (depth_record);
 
 
-              /*  Just to be on the safe side let's make sure we got at least one valid point.  */
+  output.min_z = 9999999999.0;
+  output.max_z = -9999999999.0;
 
-              if (count)
-                {
-                  if (uncertainty)
-                    {
-                      chrtr2_record.vertical_uncertainty = (float) (v_sum / (double) count);
 
+  /*  Set up the checkpoints.  A resumed run starts after the last checkpoint with the bins that are already done
+      cleared from the bitmap just as the writer would have done.  */
 
-                      /*  SJ - 02/12/2013 - temporarily set h to NULL when it exceeds the bounds  */
+  if (options.checkpoint || options.resume)
+    {
+      if (!options.resume)
+        start_checkpoint (&options, &open_args, &null_record, &checkpoint);
 
-                      if (((float) (h_sum / (double) count)) >= chrtr2_header.max_horizontal_uncertainty)
-			{
-			  chrtr2_record.horizontal_uncertainty=chrtr2_header.max_horizontal_uncertainty-1;
-			}
-		      else
-			{
-			  chrtr2_record.horizontal_uncertainty = (float) (h_sum / (double) count);
-			}
-                    }
+      attach_checkpoint (&checkpoint, &output);
 
-                  chrtr2_record.number_of_points = count;
-                  chrtr2_record.uncertainty = bin_record.standard_dev * 2.0;
-                  chrtr2_record.z = (sum / (double) count);
+      if (output.first_row)
+        {
+          fprintf (stderr, "Resuming at row %d of %d\n", output.first_row, open_args.head.bin_height);
+          fflush (stderr);
 
+          resume_occupancy (output.chrtr2_handle, &occupancy, output.first_row);
+        }
+    }
 
-		  /*  SJ - 02/08/2013 - establish bound for uncertainty as a percent of depth  */
 
-                  if ((bin_record.standard_dev * 2.0) > (chrtr2_record.z * ((float) ubound / 100.0))) 
-		    {
-                      chrtr2_record.uncertainty = CHRTR2_NULL_Z_VALUE;                         
-		    }
+  /*  Without gridding (or anything to crop or to pick up from) the rows are final as they're written so they can
+      be streamed straight away.  */
 
+  if (options.stream_file[0] && !options.grid_type && !crop && !options.update && !output.first_row)
+    {
+      open_stream (&options, &chrtr2_header, &stream);
 
-		  //  SJ - 01/29/2013 0.0 is not a valid uncertainty.
+      output.stream = &stream;
+    }
 
-                  if (chrtr2_record.uncertainty == 0.0) chrtr2_record.uncertainty = CHRTR2_NULL_Z_VALUE;
 
+  if (options.overviews || options.variants)
+    {
+      start_stage (&mark);
 
-		  //  SJ - 02/14/2013 0.0 is not a valid depth, so set to NULL.
+      if (options.overviews) start_overviews (&options, &chrtr2_header, &output);
 
-                  if (chrtr2_record.z == 0.0) chrtr2_record.z = CHRTR2_NULL_Z_VALUE;
+      if (options.variants) start_variants (&options, &open_args, &chrtr2_header, &output);
 
+      end_stage (STAGE_CREATE, &mark);
+    }
 
-                  if (drawn)
-                    {
-                      chrtr2_record.status = CHRTR2_DIGITIZED_CONTOUR;
-                    }
-                  else
-                    {
-                      chrtr2_record.status = CHRTR2_REAL;
-                    }
 
-                  min_z = MIN (chrtr2_record.z, min_z);
-                  max_z = MAX (chrtr2_record.z, max_z);
+  start_stage (&mark);
 
-                  if (chrtr2_write_record (chrtr2_handle, coord, chrtr2_record))
-                    {
-                      chrtr2_perror ();
-                      exit (-1);
-                    }
-                }
-            }
+  if (options.update)
+    {
+      dirty_tile = (uint8_t *) calloc ((int64_t) occupancy.tiles_x * occupancy.tiles_y, sizeof (uint8_t));
+      if (dirty_tile == NULL)
+        {
+          perror ("Allocating dirty tiles");
+          exit (-1);
         }
 
-      percent = ((float) i / (float) open_args.head.bin_height) * 100.0;
-      if (percent != old_percent)
+      update_aggregate (&options, pfm_handle, &chrtr2_header, &output, &manifest, dirty_tile);
+    }
+  else if (mosaic.count)
+    {
+      aggregate_mosaic (&options, &mosaic, &chrtr2_header, &output);
+    }
+  else if (options.threads > 1)
+    {
+      aggregate_threaded (&options, &open_args, &chrtr2_header, &output);
+    }
+  else if (options.read_ahead)
+    {
+      aggregate_pipelined (&options, pfm_handle, &open_args, &chrtr2_header, &output);
+    }
+  else
+    {
+      allocate_row_buffer (&row, open_args.head.bin_width);
+
+
+      /*  Loop through the PFM file a row at a time.  */
+
+      for (i = output.first_row ; i < open_args.head.bin_height ; i++)
         {
-          fprintf (stderr, "Processing - %03d%%\r", percent);
-          fflush (stderr);
-          old_percent = percent;
+          aggregate_row (pfm_handle, i, &options, &occupancy, &chrtr2_header, &row);
+
+          write_row (&output, &row);
+
+          percent = ((float) i / (float) open_args.head.bin_height) * 100.0;
+          if (percent != old_percent)
+            {
+              fprintf (stderr, "Processing - %03d%%\r", percent);
+              fflush (stderr);
+              old_percent = percent;
+            }
         }
+
+      free_row_buffer (&row);
     }
 
+  end_stage (STAGE_AGGREGATE, &mark);
+
+  if (output.stream != NULL) close_stream (output.stream);
+
   printf("\n\n\n");
 
-  chrtr2_header.min_observed_z = min_z;
-  chrtr2_header.max_observed_z = max_z;
+  start_stage (&mark);
 
-  chrtr2_update_header (chrtr2_handle, chrtr2_header);
+  chrtr2_header.min_observed_z = output.min_z;
+  chrtr2_header.max_observed_z = output.max_z;
 
+  chrtr2_update_header (output.chrtr2_handle, chrtr2_header);
 
-  close_pfm_file (pfm_handle);
 
+  /*  Everything up to here is on disk once we checkpoint the start of the gridding.  */
 
-  chrtr2_close_file (chrtr2_handle);
+  if (output.checkpoint != NULL && options.grid_type)
+    checkpoint_stage (output.checkpoint, &output.chrtr2_handle, output.min_z, output.max_z);
+
+
+  if (mosaic.count)
+    {
+      close_mosaic (&mosaic);
+    }
+  else
+    {
+      close_pfm_file (pfm_handle);
+    }
+
+  end_stage (STAGE_REOPEN, &mark);
+
+
+  /*  The gridders fill the rows in order so, with nothing to crop or to pick up from, each row can be streamed as
+      soon as it's filled in.  The main output of a run with --variant is gridded along with the variants so it's
+      still streamed from the finished file.  */
+
+  if (options.stream_file[0] && options.grid_type && !crop && !options.update && !options.resume && !output.variants)
+    {
+      open_stream (&options, &chrtr2_header, &stream);
+
+      output.stream = &stream;
+    }
 
 
   /*  MISP the data if requested.  */
 
-  if (grid_type)
+  if (output.variants)
     {
-      /*  Re-open the file and make sure it is a valid CHRTR2 file.  */
+      /*  The main output is gridded along with the variants.  */
+
+      grid_variants (&options, &chrtr2_header, &output, &null_record);
 
-      chrtr2_handle = chrtr2_open_file (chrtr2_file, &chrtr2_header, CHRTR2_UPDATE);
+      start_stage (&mark);
+
+      if (output.grid != NULL) free_grid (output.grid);
+    }
+  else if (output.grid != NULL)
+    {
+      /*  The CHRTR2 file is still open and everything MISP needs is in memory.  */
 
-      if (chrtr2_handle < 0)
+      output.chrtr2_handle = interpolate (&options, output.chrtr2_handle, &chrtr2_header, output.grid, &occupancy,
+                                          &null_record, dirty_tile, output.checkpoint, output.stream);
+
+      start_stage (&mark);
+
+      chrtr2_close_file (output.chrtr2_handle);
+
+      free_grid (output.grid);
+    }
+  else
+    {
+      start_stage (&mark);
+
+      chrtr2_close_file (output.chrtr2_handle);
+
+      if (options.grid_type)
         {
-          fprintf (stderr, "The file %s is not a CHRTR2 structure or there was an error reading the file.\n", chrtr2_file);
-          fprintf (stderr, "The error message returned was: %s\n\n", chrtr2_strerror ());
+          /*  Re-open the file and make sure it is a valid CHRTR2 file.  */
 
-          exit (-1);
+          output.chrtr2_handle = chrtr2_open_file (options.chrtr2_file, &chrtr2_header, CHRTR2_UPDATE);
+
+          if (output.chrtr2_handle < 0)
+            {
+              fprintf (stderr, "The file %s is not a CHRTR2 structure or there was an error reading the file.\n", options.chrtr2_file);
+              fprintf (stderr, "The error message returned was: %s\n\n", chrtr2_strerror ());
+
+              exit (-1);
+            }
+
+          end_stage (STAGE_REOPEN, &mark);
+
+          output.chrtr2_handle = interpolate (&options, output.chrtr2_handle, &chrtr2_header, NULL, &occupancy,
+                                              &null_record, dirty_tile, output.checkpoint, output.stream);
+
+          start_stage (&mark);
+
+          chrtr2_close_file (output.chrtr2_handle);
         }
+    }
+
+  if (options.grid_type && output.stream != NULL) close_stream (output.stream);
+
+
+  /*  Grid the overviews the same way as the full grid.  */
+
+  for (i = 0 ; i < output.overviews ; i++)
+    {
+      reopen_overview (&output.overview[i]);
+
+      if (options.grid_type)
+        {
+          end_stage (STAGE_REOPEN, &mark);
+
+          fprintf (stderr, "\n%dx overview %s\n", output.overview[i].factor, output.overview[i].chrtr2_file);
+          fflush (stderr);
+
+          overview_options (&options, output.overview[i].factor, &level_options);
+
+          output.overview[i].chrtr2_handle = interpolate (&level_options, output.overview[i].chrtr2_handle,
+                                                          &output.overview[i].chrtr2_header, NULL,
+                                                          &output.overview[i].occupancy,
+                                                          &output.overview[i].null_record, NULL, NULL, NULL);
+
+          start_stage (&mark);
+        }
+
+      chrtr2_close_file (output.overview[i].chrtr2_handle);
+    }
 
-      misp (2, chrtr2_handle, chrtr2_header);
+  if (output.overviews) free_overviews (&output);
 
-      chrtr2_close_file (chrtr2_handle);
+
+  /*  Save what --update needs to know about this run if asked to (an --update run keeps the manifest current).
+      There are no bin hashes for a mosaic and --update always does the whole PFM.  */
+
+  if ((options.manifest || options.update) && occupancy.tile_hash != NULL && !options.sub_area) write_manifest (&options, &null_record, &output);
+
+  if (crop)
+    {
+      strcpy (options.chrtr2_file, chrtr2_file);
+
+      crop_chrtr2 (&options, work_file);
+    }
+
+  if (options.geotiff_file[0]) write_geotiff (&options);
+
+  if (options.stream_file[0] && output.stream == NULL) stream_chrtr2 (&options);
+
+  if (output.checkpoint != NULL) remove_checkpoint (output.checkpoint);
+
+  end_stage (STAGE_FINISH, &mark);
+
+  if (options.update)
+    {
+      free_manifest (&manifest);
+      free (dirty_tile);
     }
 
+  free (output.tile_min_z);
+  free (output.tile_max_z);
+
+  free_occupancy (&occupancy);
+
 
   fprintf (stderr, "\nConversion complete\n\n");
   fflush (stderr);
 
+  counts.bins = occupancy.data_bins;
+  counts.soundings = output.soundings;
+  counts.rejected = output.rejected;
+
+  if (options.timing) report_stage_times (stderr, &counts, stage_clock () - start_time);
+
+  if (options.stats_file[0]) write_stats (&options, &counts, stage_clock () - start_time);
+
 
   /*  Please ignore the following line.  It is useless.  Except...
 
@@ -621,3 +1139,10 @@ int32_t main (int32_t argc, char *argv[])
 
   return (0);
 }
+
+
+
+int32_t main (int32_t argc, char *argv[])
+{
+  return (pfm2chrtr2 (argc, argv));
+}
@@ -0,0 +1,596 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfm2chrtr2.h"
+#include "misp.h"
+
+
+
+/*  Set up the scratch buffers.  The null_record is what chrtr2_create_file stored in the cells we didn't write to.
+    We use that to build the interpolated records so that we never have to read the NULL cells back in.  */
+
+void open_surface (SURFACE *surface, int32_t chrtr2_handle, CHRTR2_HEADER *chrtr2_header, GRID *grid, OCCUPANCY *occupancy,
+                   CHRTR2_RECORD *null_record)
+{
+  memset (surface, 0, sizeof (SURFACE));
+
+  surface->chrtr2_handle = chrtr2_handle;
+  surface->chrtr2_header = chrtr2_header;
+  surface->grid = grid;
+  surface->occupancy = occupancy;
+  surface->null_record = *null_record;
+
+  surface->chrtr2_row = (CHRTR2_RECORD *) malloc (chrtr2_header->width * sizeof (CHRTR2_RECORD));
+  surface->was_null = (uint8_t *) malloc (chrtr2_header->width * sizeof (uint8_t));
+
+  if (surface->chrtr2_row == NULL || surface->was_null == NULL)
+    {
+      perror ("Allocating row buffers in open_surface");
+      exit (-1);
+    }
+}
+
+
+
+void close_surface (SURFACE *surface)
+{
+  free (surface->chrtr2_row);
+  free (surface->was_null);
+  free (surface->stream_row);
+  free (surface->populated);
+
+  surface->chrtr2_row = NULL;
+  surface->was_null = NULL;
+  surface->stream_row = NULL;
+  surface->populated = NULL;
+}
+
+
+
+/*  Load the real and hand-drawn data points in a rectangle of cells.  The occupancy bitmap marks exactly those cells
+    so we know how many points there are up front and only the occupied spans of the CHRTR2 file need to be read (or
+    none of it if the grid is in memory).  The points are returned in zero based units of the bin size relative to
+    the lower left corner of the rectangle, which is what MISP wants.  */
+
+int64_t load_surface_points (SURFACE *surface, int32_t row0, int32_t col0, int32_t rows, int32_t cols, NV_F64_COORD3 **xyz_array)
+{
+  NV_F64_COORD3      xyz;
+  int32_t            i, j, k, end_col, col1;
+  int64_t            count, out_count = 0, index;
+  uint16_t           status;
+  OCCUPANCY          *occupancy = surface->occupancy;
+  STAGE_MARK         mark;
+
+
+  start_stage (&mark);
+
+  count = count_occupied (occupancy, row0, col0, rows, cols);
+
+  *xyz_array = NULL;
+  if (!count) return (0);
+
+  *xyz_array = (NV_F64_COORD3 *) malloc (count * sizeof (NV_F64_COORD3));
+  if (*xyz_array == NULL)
+    {
+      perror ("Allocating xyz_array in load_surface_points");
+      exit (-1);
+    }
+
+  col1 = col0 + cols;
+
+  for (i = row0 ; i < row0 + rows ; i++)
+    {
+      if (!occupancy->row_count[i]) continue;
+
+      for (j = next_occupied (occupancy, i, col0) ; j < col1 ; j = next_occupied (occupancy, i, end_col))
+        {
+          end_col = MIN (next_empty (occupancy, i, j), col1);
+
+          if (surface->grid == NULL)
+            {
+              count_calls (CALL_CHRTR2_READ_ROW, 1);
+              if (chrtr2_read_row (surface->chrtr2_handle, i, j, end_col - j, &surface->chrtr2_row[j]))
+                {
+                  chrtr2_perror ();
+                  exit (-1);
+                }
+            }
+
+          for (k = j ; k < end_col ; k++)
+            {
+              if (surface->grid != NULL)
+                {
+                  index = (int64_t) i * surface->grid->width + k;
+                  status = surface->grid->status[index];
+                  xyz.z = surface->grid->z[index];
+                }
+              else
+                {
+                  status = surface->chrtr2_row[k].status;
+                  xyz.z = surface->chrtr2_row[k].z;
+                }
+
+
+              /*  IMPORTANT NOTE:  MISP (by default) grids using corner posts.  That is, the data in a bin is assigned
+                  to the lower left corner of the bin.  Since CHRTR2 moved to grid registration the row and column
+                  are exactly what MISP wants.  */
+
+              xyz.x = (double) (k - col0);
+              xyz.y = (double) (i - row0);
+
+
+              /*  We want to interpolate over already interpolated data so we only load real or drawn data.  */
+
+              if ((status & (CHRTR2_REAL | CHRTR2_DIGITIZED_CONTOUR)) && out_count < count) (*xyz_array)[out_count++] = xyz;
+            }
+        }
+    }
+
+  end_stage (STAGE_LOAD, &mark);
+
+  return (out_count);
+}
+
+
+
+/*  For --update, returns NVTrue if any edited tile is within reach cells of a rectangle, meaning that the
+    interpolated values in the rectangle may have changed.  Always NVTrue on a full run.  */
+
+uint8_t surface_dirty (SURFACE *surface, int32_t row0, int32_t col0, int32_t rows, int32_t cols, int32_t reach)
+{
+  OCCUPANCY          *occupancy = surface->occupancy;
+  int32_t            i, j, tile_row0, tile_row1, tile_col0, tile_col1;
+
+
+  if (surface->dirty_tile == NULL) return (NVTrue);
+
+  tile_row0 = MAX (0, row0 - reach) / OCCUPANCY_TILE;
+  tile_row1 = MIN (occupancy->height - 1, row0 + rows - 1 + reach) / OCCUPANCY_TILE;
+  tile_col0 = MAX (0, col0 - reach) / OCCUPANCY_TILE;
+  tile_col1 = MIN (occupancy->width - 1, col0 + cols - 1 + reach) / OCCUPANCY_TILE;
+
+  for (i = tile_row0 ; i <= tile_row1 ; i++)
+    {
+      for (j = tile_col0 ; j <= tile_col1 ; j++)
+        {
+          if (surface->dirty_tile[i * occupancy->tiles_x + j]) return (NVTrue);
+        }
+    }
+
+  return (NVFalse);
+}
+
+
+
+/*  Put the null record back in every cell of a rectangle that doesn't have real or hand-drawn data.  This is only
+    needed for --update, where the cells hold the interpolated values from the last run.  */
+
+void reset_surface (SURFACE *surface, int32_t row0, int32_t col0, int32_t rows, int32_t cols)
+{
+  int32_t            i, j, end_col, col1;
+  int64_t            index;
+
+
+  col1 = col0 + cols;
+
+  for (j = col0 ; j < col1 ; j++) surface->chrtr2_row[j] = surface->null_record;
+
+  for (i = row0 ; i < row0 + rows ; i++)
+    {
+      for (j = next_empty (surface->occupancy, i, col0) ; j < col1 ; j = next_empty (surface->occupancy, i, end_col))
+        {
+          end_col = MIN (next_occupied (surface->occupancy, i, j), col1);
+
+          count_calls (CALL_CHRTR2_WRITE_ROW, 1);
+          if (chrtr2_write_row (surface->chrtr2_handle, i, j, end_col - j, &surface->chrtr2_row[j]))
+            {
+              chrtr2_perror ();
+              exit (-1);
+            }
+
+          if (surface->grid != NULL)
+            {
+              for (index = (int64_t) i * surface->grid->width + j ; index < (int64_t) i * surface->grid->width + end_col ; index++)
+                {
+                  surface->grid->z[index] = surface->null_record.z;
+                  surface->grid->status[index] = CHRTR2_NULL;
+                }
+            }
+        }
+    }
+}
+
+
+
+/*  Number of cells in a rectangle that we're allowed to fill and don't already have data.  With a fill mask that's
+    the masked cells less the data cells (every data cell is in the mask), otherwise it's every empty cell.  */
+
+int64_t fillable_cells (SURFACE *surface, int32_t row0, int32_t col0, int32_t rows, int32_t cols)
+{
+  int64_t            cells;
+
+
+  if (surface->fill_mask != NULL)
+    {
+      cells = count_occupied (surface->fill_mask, row0, col0, rows, cols);
+    }
+  else
+    {
+      cells = (int64_t) rows * cols;
+    }
+
+  return (cells - count_occupied (surface->occupancy, row0, col0, rows, cols));
+}
+
+
+
+/*  Put interpolated values into the NULL cells of part of a row.  Cells whose value is NaN are left alone.  Only the
+    NULL cells are written and contiguous runs of them go out with a single call.  */
+
+void fill_surface_row (SURFACE *surface, int32_t row, int32_t col0, int32_t cols, float *values)
+{
+  int32_t            j, end_col, col1;
+  int64_t            index;
+  CHRTR2_HEADER      *chrtr2_header = surface->chrtr2_header;
+
+
+  col1 = col0 + cols;
+
+  for (j = col0 ; j < col1 ; j++)
+    {
+      /*  Only replace NULL values (that are close enough to data if we have a fill mask).  */
+
+      surface->was_null[j] = !is_occupied (surface->occupancy, row, j) && !isnan (values[j - col0]) &&
+        (surface->fill_mask == NULL || is_occupied (surface->fill_mask, row, j));
+
+      if (surface->was_null[j])
+        {
+          surface->chrtr2_row[j] = surface->null_record;
+
+
+          /*  Mark the record as interpolated.  */
+
+          surface->chrtr2_row[j].status |= CHRTR2_INTERPOLATED;
+
+
+          /*  If we exceeded the CHRTR2 limits we have to set it to the null depth (by definition, one greater than the max).  */
+
+          if (values[j - col0] <= chrtr2_header->max_z && values[j - col0] >= chrtr2_header->min_z)
+            {
+              surface->chrtr2_row[j].z = values[j - col0];
+            }
+          else
+            {
+              surface->chrtr2_row[j].z = chrtr2_header->max_z + 1.0;
+            }
+
+
+          if (surface->grid != NULL)
+            {
+              index = (int64_t) row * surface->grid->width + j;
+              surface->grid->z[index] = surface->chrtr2_row[j].z;
+              surface->grid->status[index] = surface->chrtr2_row[j].status;
+            }
+        }
+    }
+
+
+  /*  Write the records back out.  */
+
+  for (j = col0 ; j < col1 ; j = end_col)
+    {
+      if (!surface->was_null[j])
+        {
+          end_col = j + 1;
+          continue;
+        }
+
+      for (end_col = j + 1 ; end_col < col1 && surface->was_null[end_col] ; end_col++);
+
+      count_calls (CALL_CHRTR2_WRITE_ROW, 1);
+      if (chrtr2_write_row (surface->chrtr2_handle, row, j, end_col - j, &surface->chrtr2_row[j]))
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+    }
+
+  if (surface->stream != NULL) stream_surface_rows (surface, row, col0, col1);
+}
+
+
+
+/*  Send the rows to the grid stream as they're filled in.  The gridders fill the rows in order and never go back
+    to one so a row is finished once it has been filled or a later row has.  */
+
+void stream_surface (SURFACE *surface, STREAM *stream)
+{
+  surface->stream = stream;
+  surface->streamed = 0;
+
+  surface->stream_row = (CHRTR2_RECORD *) malloc (surface->chrtr2_header->width * sizeof (CHRTR2_RECORD));
+  surface->populated = (uint8_t *) malloc (surface->chrtr2_header->width * sizeof (uint8_t));
+
+  if (surface->stream_row == NULL || surface->populated == NULL)
+    {
+      perror ("Allocating stream buffers in stream_surface");
+      exit (-1);
+    }
+}
+
+
+
+/*  Stream the rows before row that are still waiting (nothing was filled in them) and then row itself, with the
+    cells from col0 to col1 that fill_surface_row just filled.  Only the occupied spans are read back from the
+    CHRTR2 file.  Calling this with the height and no columns finishes off the stream.  */
+
+void stream_surface_rows (SURFACE *surface, int32_t row, int32_t col0, int32_t col1)
+{
+  int32_t            i, j, end_col, width = surface->chrtr2_header->width;
+  OCCUPANCY          *occupancy = surface->occupancy;
+
+
+  for (i = surface->streamed ; i <= row && i < surface->chrtr2_header->height ; i++)
+    {
+      memset (surface->populated, 0, width);
+
+      if (i == row)
+        {
+          for (j = col0 ; j < col1 ; j++)
+            {
+              if (surface->was_null[j])
+                {
+                  surface->stream_row[j] = surface->chrtr2_row[j];
+                  surface->populated[j] = NVTrue;
+                }
+            }
+        }
+
+      if (occupancy->row_count[i])
+        {
+          for (j = next_occupied (occupancy, i, 0) ; j < width ; j = next_occupied (occupancy, i, end_col))
+            {
+              end_col = next_empty (occupancy, i, j);
+
+              count_calls (CALL_CHRTR2_READ_ROW, 1);
+              if (chrtr2_read_row (surface->chrtr2_handle, i, j, end_col - j, &surface->stream_row[j]))
+                {
+                  chrtr2_perror ();
+                  exit (-1);
+                }
+
+              memset (&surface->populated[j], NVTrue, end_col - j);
+            }
+        }
+
+      stream_row (surface->stream, surface->stream_row, surface->populated);
+    }
+
+  surface->streamed = i;
+}
+
+
+
+/*  Run MISP over a set of points in a rows x cols area.  Rows are handed to put_row (bottom row first) as they are
+    retrieved.  Returns the number of rows retrieved.  */
+
+int32_t run_misp (int32_t weight, NV_F64_COORD3 *xyz_array, int64_t count, int32_t rows, int32_t cols, uint8_t verbose,
+                  void (*put_row) (void *data, int32_t row, float *array), void *data)
+{
+  NV_F64_XYMBR       new_mbr;
+  int64_t            i;
+  int32_t            row;
+  float              *array;
+  STAGE_MARK         mark;
+
+
+  /*  We're going to let MISP handle everything in zero based units of the bin size.  This will give us values that
+      range from 0.0 to cols in longitude and 0.0 to rows in latitude.  */
+
+  new_mbr.min_x = 0.0;
+  new_mbr.min_y = 0.0;
+  new_mbr.max_x = (double) cols;
+  new_mbr.max_y = (double) rows;
+
+
+  /*  Initialize the MISP engine.  */
+
+  start_stage (&mark);
+
+  misp_init (1.0, 1.0, 0.05, 4, 20.0, 20, 999999.0, -999999.0, weight, new_mbr);
+
+
+  /*  Load the points.  */
+
+  for (i = 0 ; i < count ; i++) misp_load (xyz_array[i]);
+
+  count_calls (CALL_MISP_LOAD, count);
+
+  end_stage (STAGE_LOAD, &mark);
+
+
+  if (verbose)
+    {
+      fprintf (stderr, "Computing MISP surface\n");
+      fflush (stderr);
+    }
+
+  start_stage (&mark);
+
+  misp_proc ();
+
+  count_calls (CALL_MISP_PROC, 1);
+
+  end_stage (STAGE_SOLVE, &mark);
+
+  if (verbose)
+    {
+      fprintf (stderr, "Retrieving MISP data\n");
+      fflush (stderr);
+    }
+
+
+  /*  Allocating one more than cols due to constraints of old chrtr (see comments in misp_funcs.c)  */
+
+  array = (float *) malloc ((cols + 1) * sizeof (float));
+
+  if (array == NULL)
+    {
+      perror ("Allocating array in run_misp");
+      exit (-1);
+    }
+
+  start_stage (&mark);
+
+  for (row = 0 ; row < rows ; row++)
+    {
+      count_calls (CALL_MISP_RTRV, 1);
+      if (!misp_rtrv (array)) break;
+
+      (*put_row) (data, row, array);
+    }
+
+  end_stage (STAGE_WRITEBACK, &mark);
+
+  free (array);
+
+  return (row);
+}
+
+
+
+/*  Where the whole surface run goes in the grid.  */
+
+typedef struct
+{
+  SURFACE            *surface;
+  int32_t            row0;
+  int32_t            col0;
+  int32_t            cols;
+} SURFACE_AREA;
+
+
+
+static void put_surface_row (void *data, int32_t row, float *array)
+{
+  SURFACE_AREA       *area = (SURFACE_AREA *) data;
+
+
+  /*  Skip rows with nothing to fill.  */
+
+  if (!fillable_cells (area->surface, area->row0 + row, area->col0, 1, area->cols)) return;
+
+  fill_surface_row (area->surface, area->row0 + row, area->col0, area->cols, array);
+}
+
+
+
+/*  This function runs MISP on the whole area in one go.  With a fill mask the area is cut down to the rectangle
+    around the mask since nothing outside of it will be kept.  All of the data is inside the mask.  */
+
+void misp_surface (int32_t weight, SURFACE *surface)
+{
+  NV_F64_COORD3      *xyz_array = NULL;
+  int64_t            out_count;
+  SURFACE_AREA       area;
+  int32_t            i, row1, col1;
+  OCCUPANCY          *mask = surface->fill_mask;
+
+
+  /*  With --update any edit can change the whole surface.  */
+
+  if (surface->dirty_tile != NULL)
+    {
+      if (!surface_dirty (surface, 0, 0, surface->chrtr2_header->height, surface->chrtr2_header->width, 0)) return;
+
+      reset_surface (surface, 0, 0, surface->chrtr2_header->height, surface->chrtr2_header->width);
+    }
+
+
+  /*  Untiled MISP is a single unit of work for the checkpoint.  */
+
+  if (surface->checkpoint != NULL)
+    {
+      checkpoint_units (surface->checkpoint, 1);
+      if (surface->checkpoint->done[0]) return;
+    }
+
+
+  area.surface = surface;
+  area.row0 = 0;
+  area.col0 = 0;
+  area.cols = surface->chrtr2_header->width;
+  row1 = surface->chrtr2_header->height;
+
+  if (mask != NULL)
+    {
+      area.row0 = row1;
+      area.col0 = area.cols;
+      row1 = col1 = 0;
+
+      for (i = 0 ; i < mask->height ; i++)
+        {
+          if (!mask->row_count[i]) continue;
+
+          area.row0 = MIN (area.row0, i);
+          row1 = i + 1;
+          area.col0 = MIN (area.col0, next_occupied (mask, i, 0));
+          col1 = MAX (col1, last_occupied (mask, i) + 1);
+        }
+
+      area.cols = col1 - area.col0;
+    }
+
+  out_count = load_surface_points (surface, area.row0, area.col0, row1 - area.row0, area.cols, &xyz_array);
+
+
+  /*  Don't process if we didn't have any input data.  */
+
+  if (!out_count)
+    {
+      fprintf (stderr, "\n\nNo data points found for gridding!\n\n");
+      exit (-1);
+    }
+
+
+  run_misp (weight, xyz_array, out_count, row1 - area.row0, area.cols, NVTrue, put_surface_row, &area);
+
+  free (xyz_array);
+
+  if (surface->checkpoint != NULL) checkpoint_unit (surface->checkpoint, 0, &surface->chrtr2_handle);
+}
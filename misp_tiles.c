@@ -0,0 +1,1069 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfm2chrtr2.h"
+
+#ifndef NVWIN3X
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#define         USE_FORK
+#endif
+
+
+/*
+
+    Tiled MISP (--misp_tile).
+
+    The grid is split into square tiles.  Each tile is gridded independently over the tile plus a halo of
+    --misp_halo cells on every side (clipped at the edges of the grid) so each tile sees the same neighboring data
+    that the full surface would.  A tile keeps its core plus a band of half the halo (or half the tile if that's
+    smaller) on every side.  Where the bands of neighboring tiles overlap the two are blended with weights that ramp
+    linearly from one tile to the other, so there's no step where the tiles meet.  The rows are written in order as
+    soon as every tile that covers them is done, and the tiles are always added up in the same order, so the result
+    doesn't depend on --threads.  If a tile and its halo don't contain any data the halo is doubled until they do.
+    Tiles that have no NULL cells in their blend region aren't gridded at all.
+
+    The MISP library keeps its state in static variables so it can't be run on more than one thread at a time.
+    Instead, each tile is gridded in a child process (up to --threads of them at once) that writes the blend region
+    of the tile to a temporary file and exits.  The parent does the blending and all of the CHRTR2 I/O.  On Windows,
+    or if --threads is 1, the tiles are done one after another in this process.  Memory use is proportional to the
+    tile size (and at most two rows of tiles waiting to be blended) rather than the grid size either way.  With
+    --max_fill_distance, tiles with nothing in the fill mask are skipped too.  With --update, only the blend regions
+    of the tiles whose data (or fill mask) may have been changed by an edit are written again, and those tiles and
+    their neighbors are gridded again to blend them.  With --tile_cache, tiles whose inputs match a cached tile
+    aren't gridded at all (see tile_cache.c).
+
+    With --max_memory the tile size is worked out by plan_memory so that all of the MISP processes together stay
+    within the budget.  The only things kept for the whole grid are the occupancy bitmap and, if it fits, the
+    --in_memory grid.  The data points are read back from the CHRTR2 file for each tile and the blended rows go
+    straight back into it (by way of a temporary file from the child processes), so the CHRTR2 file is the spill store.
+
+*/
+
+
+/*  Minimum number of data points that we want in a tile plus its halo.  */
+
+#define         MIN_TILE_POINTS 1
+
+
+/*  How often to check on the tile processes, in microseconds.  */
+
+#define         TILE_POLL_USEC 2000
+
+
+typedef struct
+{
+  int32_t         row0;                    /*  Core of the tile  */
+  int32_t         col0;
+  int32_t         rows;
+  int32_t         cols;
+  int32_t         r0;                      /*  Core plus halo, clipped to the grid  */
+  int32_t         c0;
+  int32_t         nr;
+  int32_t         nc;
+  int32_t         br0;                     /*  Core plus blend band, clipped to the grid  */
+  int32_t         bc0;
+  int32_t         bnr;
+  int32_t         bnc;
+  int32_t         index;                   /*  Tile number, for the checkpoint  */
+} TILE;
+
+
+typedef struct
+{
+  TILE            *tile;
+  float           *result;                 /*  tile->bnr x tile->bnc, bottom row first  */
+} TILE_RESULT;
+
+
+/*  The finished tiles that are waiting for their neighbours so that the rows they share can be blended and
+    written.  */
+
+typedef struct
+{
+  TILE            *tile;                   /*  Every tile, row major  */
+  float           **result;                /*  Blend region of each finished tile, NULL if it wasn't gridded  */
+  int32_t         *waiting;                /*  Tiles in each row of tiles that haven't finished  */
+  uint8_t         *write;                  /*  --update, the tiles whose blend region is written  */
+  uint8_t         *mark;                   /*  --update, the cells of the current row that are written  */
+  int32_t         tiles_x;
+  int32_t         tiles_y;
+  int32_t         size;                    /*  --misp_tile  */
+  int32_t         band;                    /*  Cells each tile reaches past its core  */
+  int32_t         next_row;                /*  Next row of the grid to write  */
+  int32_t         released;                /*  The rows of tiles before this one are written and freed  */
+  double          *sum;                    /*  Weighted sum of the tiles for the current row  */
+  double          *weight;
+  float           *values;
+} BLEND;
+
+
+#ifdef USE_FORK
+
+typedef struct
+{
+  pid_t           pid;                     /*  0 if the slot is free  */
+  TILE            tile;
+  TILE_KEY        key;                     /*  For saving the result in the tile cache  */
+  FILE            *fp;                     /*  Where the child leaves the result  */
+} TILE_JOB;
+
+#endif
+
+
+
+static void set_tile_region (CHRTR2_HEADER *chrtr2_header, int32_t halo, TILE *tile)
+{
+  tile->r0 = MAX (0, tile->row0 - halo);
+  tile->c0 = MAX (0, tile->col0 - halo);
+  tile->nr = MIN (chrtr2_header->height, tile->row0 + tile->rows + halo) - tile->r0;
+  tile->nc = MIN (chrtr2_header->width, tile->col0 + tile->cols + halo) - tile->c0;
+}
+
+
+
+static void set_blend_region (CHRTR2_HEADER *chrtr2_header, int32_t band, TILE *tile)
+{
+  tile->br0 = MAX (0, tile->row0 - band);
+  tile->bc0 = MAX (0, tile->col0 - band);
+  tile->bnr = MIN (chrtr2_header->height, tile->row0 + tile->rows + band) - tile->br0;
+  tile->bnc = MIN (chrtr2_header->width, tile->col0 + tile->cols + band) - tile->bc0;
+}
+
+
+
+/*  Work out the region (core plus halo) for a tile.  */
+
+static void size_tile (OPTIONS *options, SURFACE *surface, TILE *tile)
+{
+  CHRTR2_HEADER       *chrtr2_header = surface->chrtr2_header;
+  int32_t             halo, next_halo;
+  TILE                next;
+
+
+  halo = options->misp_halo;
+
+  while (NVTrue)
+    {
+      set_tile_region (chrtr2_header, halo, tile);
+
+      if (count_occupied (surface->occupancy, tile->r0, tile->c0, tile->nr, tile->nc) >= MIN_TILE_POINTS) break;
+
+      if (tile->nr == chrtr2_header->height && tile->nc == chrtr2_header->width) break;
+
+      next_halo = MAX (halo * 2, options->misp_tile);
+
+
+      /*  Don't grow past the memory budget.  If there's still no data the tile is left NULL.  */
+
+      if (options->misp_window)
+        {
+          next = *tile;
+          set_tile_region (chrtr2_header, next_halo, &next);
+          if ((int64_t) next.nr * next.nc > options->misp_window) break;
+        }
+
+      halo = next_halo;
+    }
+}
+
+
+
+/*  Keep the rows of the MISP output that fall in the blend region of the tile.  */
+
+static void put_tile_row (void *data, int32_t row, float *array)
+{
+  TILE_RESULT         *tile_result = (TILE_RESULT *) data;
+  TILE                *tile = tile_result->tile;
+  int32_t             blend_row;
+
+
+  blend_row = row + tile->r0 - tile->br0;
+
+  if (blend_row < 0 || blend_row >= tile->bnr) return;
+
+  memcpy (&tile_result->result[(int64_t) blend_row * tile->bnc], &array[tile->bc0 - tile->c0], tile->bnc * sizeof (float));
+}
+
+
+
+/*  Grid one tile.  Anything that MISP doesn't return is left as NaN so that it stays NULL.  */
+
+static void solve_tile (int32_t weight, TILE *tile, NV_F64_COORD3 *xyz_array, int64_t count, float *result)
+{
+  TILE_RESULT         tile_result;
+  int64_t             i;
+
+
+  for (i = 0 ; i < (int64_t) tile->bnr * tile->bnc ; i++) result[i] = NAN;
+
+  tile_result.tile = tile;
+  tile_result.result = result;
+
+  run_misp (weight, xyz_array, count, tile->nr, tile->nc, NVFalse, put_tile_row, &tile_result);
+}
+
+
+
+/*  Work out the tile cache key.  The result only depends on the points (in window coordinates), where the blend
+    region is in the window, and the settings.  */
+
+static void tile_key (int32_t weight, TILE *tile, NV_F64_COORD3 *xyz_array, int64_t count, TILE_KEY *key)
+{
+  int32_t             geometry[7];
+
+
+  geometry[0] = weight;
+  geometry[1] = tile->nr;
+  geometry[2] = tile->nc;
+  geometry[3] = tile->br0 - tile->r0;
+  geometry[4] = tile->bc0 - tile->c0;
+  geometry[5] = tile->bnr;
+  geometry[6] = tile->bnc;
+
+  start_tile_key (key);
+  add_tile_key (key, geometry, sizeof (geometry));
+  add_tile_key (key, &count, sizeof (count));
+  add_tile_key (key, xyz_array, count * sizeof (NV_F64_COORD3));
+}
+
+
+
+/*  Weight of a tile at cell x, where its core starts at start and is size cells across.  Across the 2 * band cells
+    that straddle the boundary with the next tile the weight ramps linearly down to 0 so that the weights of the two
+    tiles always add up to 1.  There's nothing to blend with past the first and last tiles.  */
+
+static double blend_weight (int32_t x, int32_t start, int32_t size, int32_t band, uint8_t first, uint8_t last)
+{
+  if (!first && x < start + band) return ((x - start + band + 0.5) / (2.0 * band));
+
+  if (!last && x >= start + size - band) return ((start + size + band - x - 0.5) / (2.0 * band));
+
+  return (1.0);
+}
+
+
+
+/*  Blend the tiles that cover a row and put the result into the NULL cells of the CHRTR2 file.  The tiles are
+    always added up in the same order so the result doesn't depend on the order they were gridded in.  */
+
+static void write_blend_row (SURFACE *surface, BLEND *blend, int32_t row)
+{
+  int32_t             i, j, k, col, width = surface->chrtr2_header->width;
+  double              row_weight, weight;
+  float               value;
+  TILE                *tile;
+  STAGE_MARK          mark;
+
+
+  start_stage (&mark);
+
+  for (col = 0 ; col < width ; col++)
+    {
+      blend->sum[col] = 0.0;
+      blend->weight[col] = 0.0;
+      if (blend->mark != NULL) blend->mark[col] = NVFalse;
+    }
+
+  for (i = MAX (0, row / blend->size - 1) ; i <= MIN (blend->tiles_y - 1, row / blend->size + 1) ; i++)
+    {
+      tile = &blend->tile[i * blend->tiles_x];
+
+      if (row < tile->br0 || row >= tile->br0 + tile->bnr) continue;
+
+      row_weight = blend_weight (row, tile->row0, tile->rows, blend->band, i == 0, i == blend->tiles_y - 1);
+
+      for (j = 0 ; j < blend->tiles_x ; j++)
+        {
+          k = i * blend->tiles_x + j;
+          tile = &blend->tile[k];
+
+          if (blend->mark != NULL && blend->write[k])
+            {
+              for (col = tile->bc0 ; col < tile->bc0 + tile->bnc ; col++) blend->mark[col] = NVTrue;
+            }
+
+          if (blend->result[k] == NULL) continue;
+
+          for (col = tile->bc0 ; col < tile->bc0 + tile->bnc ; col++)
+            {
+              value = blend->result[k][(int64_t) (row - tile->br0) * tile->bnc + col - tile->bc0];
+
+              if (isnan (value)) continue;
+
+              weight = row_weight * blend_weight (col, tile->col0, tile->cols, blend->band, j == 0, j == blend->tiles_x - 1);
+
+              blend->sum[col] += weight * value;
+              blend->weight[col] += weight;
+            }
+        }
+    }
+
+
+  /*  With --update only the cells near an edit are written.  */
+
+  for (col = 0 ; col < width ; col++)
+    {
+      if (blend->weight[col] > 0.0 && (blend->mark == NULL || blend->mark[col]))
+        {
+          blend->values[col] = blend->sum[col] / blend->weight[col];
+        }
+      else
+        {
+          blend->values[col] = NAN;
+        }
+    }
+
+  fill_surface_row (surface, row, 0, width, blend->values);
+
+  end_stage (STAGE_WRITEBACK, &mark);
+}
+
+
+
+/*  Write every row that all of the tiles covering it have finished, and free the tiles that have been completely
+    written.  A tile only counts as stored in the checkpoint once all of its blend region is written.  */
+
+static void flush_blend (SURFACE *surface, BLEND *blend)
+{
+  int32_t             i, j, k, row;
+  TILE                *tile;
+
+
+  while (blend->next_row < surface->chrtr2_header->height)
+    {
+      row = blend->next_row;
+
+      for (i = MAX (0, row / blend->size - 1) ; i <= MIN (blend->tiles_y - 1, row / blend->size + 1) ; i++)
+        {
+          tile = &blend->tile[i * blend->tiles_x];
+
+          if (row >= tile->br0 && row < tile->br0 + tile->bnr && blend->waiting[i]) return;
+        }
+
+      write_blend_row (surface, blend, row);
+
+      blend->next_row++;
+
+      while (blend->released < blend->tiles_y)
+        {
+          tile = &blend->tile[blend->released * blend->tiles_x];
+
+          if (tile->br0 + tile->bnr > blend->next_row) break;
+
+          for (j = 0 ; j < blend->tiles_x ; j++)
+            {
+              k = blend->released * blend->tiles_x + j;
+
+              free (blend->result[k]);
+              blend->result[k] = NULL;
+
+              if (surface->checkpoint != NULL) checkpoint_unit (surface->checkpoint, k, &surface->chrtr2_handle);
+            }
+
+          blend->released++;
+        }
+    }
+}
+
+
+
+/*  A tile is finished.  The result (NULL if it wasn't gridded) is freed once it has been written.  */
+
+static void finish_tile (SURFACE *surface, BLEND *blend, int32_t index, float *result)
+{
+  blend->result[index] = result;
+  blend->waiting[index / blend->tiles_x]--;
+
+  flush_blend (surface, blend);
+}
+
+
+
+static float *tile_buffer (TILE *tile)
+{
+  float               *result;
+
+
+  result = (float *) malloc ((int64_t) tile->bnr * tile->bnc * sizeof (float));
+  if (result == NULL)
+    {
+      perror ("Allocating tile buffer in misp_tiled");
+      exit (-1);
+    }
+
+  return (result);
+}
+
+
+
+static void tile_progress (int32_t done, int32_t total, int32_t *old_percent)
+{
+  int32_t             percent;
+
+
+  percent = ((float) done / (float) total) * 100.0;
+  if (percent != *old_percent)
+    {
+      fprintf (stderr, "MISP tiles - %03d%%\r", percent);
+      fflush (stderr);
+      *old_percent = percent;
+    }
+}
+
+
+
+#ifdef USE_FORK
+
+/*  Wait for one of the tile processes to finish and hand its tile to the blend.  We only wait on our own tile
+    processes so that we never reap some other child of this process (a --variant or --batch job) and lose track of
+    a tile.  There's no way to block on a set of processes so we poll them.  */
+
+static void finish_tile_job (OPTIONS *options, SURFACE *surface, BLEND *blend, TILE_JOB *job, int32_t jobs)
+{
+  pid_t               pid = 0;
+  int                 status;
+  int32_t             i;
+  int64_t             size;
+  float               *result;
+  STAGE_STATS         stats;
+
+
+  while (NVTrue)
+    {
+      for (i = 0 ; i < jobs ; i++)
+        {
+          if (!job[i].pid) continue;
+
+          pid = waitpid (job[i].pid, &status, WNOHANG);
+
+          if (pid < 0)
+            {
+              perror ("Waiting for MISP tile process");
+              exit (-1);
+            }
+
+          if (pid) break;
+        }
+
+      if (i < jobs) break;
+
+      usleep (TILE_POLL_USEC);
+    }
+
+  if (!WIFEXITED (status) || WEXITSTATUS (status))
+    {
+      fprintf (stderr, "\n\nMISP tile process for rows %d-%d, columns %d-%d failed!\n\n", job[i].tile.row0,
+               job[i].tile.row0 + job[i].tile.rows - 1, job[i].tile.col0, job[i].tile.col0 + job[i].tile.cols - 1);
+      exit (-1);
+    }
+
+  size = (int64_t) job[i].tile.bnr * job[i].tile.bnc;
+  result = tile_buffer (&job[i].tile);
+
+  rewind (job[i].fp);
+  if (fread (result, sizeof (float), size, job[i].fp) != (size_t) size ||
+      fread (&stats, sizeof (STAGE_STATS), 1, job[i].fp) != 1)
+    {
+      perror ("Reading MISP tile results");
+      exit (-1);
+    }
+
+  add_stage_stats (&stats);
+
+  fclose (job[i].fp);
+
+  if (options->tile_cache[0])
+    write_cached_tile (options->tile_cache, &job[i].key, job[i].tile.bnr, job[i].tile.bnc, result);
+
+  job[i].pid = 0;
+
+  finish_tile (surface, blend, job[i].tile.index, result);
+}
+
+#endif
+
+
+
+/*  For --update, work out which tiles have an edit within reach of their data or their fill mask (their blend region
+    is written again) and which tiles have to be gridded again to blend them (those and their neighbours).  */
+
+static void plan_update (OPTIONS *options, SURFACE *surface, BLEND *blend, uint8_t *regrid)
+{
+  int32_t             i, j, k, m, n;
+  TILE                *tile;
+
+
+  for (k = 0 ; k < blend->tiles_x * blend->tiles_y ; k++)
+    {
+      tile = &blend->tile[k];
+      blend->write[k] = surface_dirty (surface, tile->r0, tile->c0, tile->nr, tile->nc,
+                                       (int32_t) ceil (options->max_fill_distance));
+      regrid[k] = NVFalse;
+    }
+
+  for (i = 0 ; i < blend->tiles_y ; i++)
+    {
+      for (j = 0 ; j < blend->tiles_x ; j++)
+        {
+          if (!blend->write[i * blend->tiles_x + j]) continue;
+
+          for (m = MAX (0, i - 1) ; m <= MIN (blend->tiles_y - 1, i + 1) ; m++)
+            {
+              for (n = MAX (0, j - 1) ; n <= MIN (blend->tiles_x - 1, j + 1) ; n++) regrid[m * blend->tiles_x + n] = NVTrue;
+            }
+        }
+    }
+}
+
+
+
+void misp_tiled (OPTIONS *options, int32_t weight, SURFACE *surface)
+{
+  CHRTR2_HEADER       *chrtr2_header = surface->chrtr2_header;
+  NV_F64_COORD3       *xyz_array;
+  TILE                *tile;
+  BLEND               blend;
+  int32_t             i, j, k, tiles, first_row, done = 0, old_percent = -1, hits = 0, misses = 0;
+  int64_t             count;
+  float               *result;
+  uint8_t             *regrid = NULL;
+  TILE_KEY            key;
+#ifdef USE_FORK
+  TILE_JOB            *job = NULL;
+  int32_t             m, running = 0;
+  STAGE_STATS         stats;
+  pid_t               pid;
+#endif
+
+
+  if (!surface->occupancy->total)
+    {
+      fprintf (stderr, "\n\nNo data points found for gridding!\n\n");
+      exit (-1);
+    }
+
+  memset (&blend, 0, sizeof (BLEND));
+
+  blend.size = options->misp_tile;
+  blend.band = MIN (options->misp_halo, options->misp_tile) / 2;
+  blend.tiles_x = (chrtr2_header->width + options->misp_tile - 1) / options->misp_tile;
+  blend.tiles_y = (chrtr2_header->height + options->misp_tile - 1) / options->misp_tile;
+
+  tiles = blend.tiles_x * blend.tiles_y;
+
+  blend.tile = (TILE *) malloc (tiles * sizeof (TILE));
+  blend.result = (float **) calloc (tiles, sizeof (float *));
+  blend.waiting = (int32_t *) malloc (blend.tiles_y * sizeof (int32_t));
+  blend.sum = (double *) malloc (chrtr2_header->width * sizeof (double));
+  blend.weight = (double *) malloc (chrtr2_header->width * sizeof (double));
+  blend.values = (float *) malloc (chrtr2_header->width * sizeof (float));
+
+  if (blend.tile == NULL || blend.result == NULL || blend.waiting == NULL || blend.sum == NULL || blend.weight == NULL ||
+      blend.values == NULL)
+    {
+      perror ("Allocating tile blend buffers in misp_tiled");
+      exit (-1);
+    }
+
+  if (surface->dirty_tile != NULL)
+    {
+      blend.write = (uint8_t *) malloc (tiles * sizeof (uint8_t));
+      blend.mark = (uint8_t *) malloc (chrtr2_header->width * sizeof (uint8_t));
+      regrid = (uint8_t *) malloc (tiles * sizeof (uint8_t));
+
+      if (blend.write == NULL || blend.mark == NULL || regrid == NULL)
+        {
+          perror ("Allocating update flags in misp_tiled");
+          exit (-1);
+        }
+    }
+
+#ifdef USE_FORK
+  job = (TILE_JOB *) calloc (options->threads, sizeof (TILE_JOB));
+  if (job == NULL)
+    {
+      perror ("Allocating tile jobs in misp_tiled");
+      exit (-1);
+    }
+#endif
+
+
+  for (i = 0 ; i < blend.tiles_y ; i++)
+    {
+      blend.waiting[i] = blend.tiles_x;
+
+      for (j = 0 ; j < blend.tiles_x ; j++)
+        {
+          tile = &blend.tile[i * blend.tiles_x + j];
+
+          tile->row0 = i * options->misp_tile;
+          tile->col0 = j * options->misp_tile;
+          tile->rows = MIN (options->misp_tile, chrtr2_header->height - tile->row0);
+          tile->cols = MIN (options->misp_tile, chrtr2_header->width - tile->col0);
+          tile->index = i * blend.tiles_x + j;
+
+          size_tile (options, surface, tile);
+          set_blend_region (chrtr2_header, blend.band, tile);
+        }
+    }
+
+  if (regrid != NULL) plan_update (options, surface, &blend, regrid);
+
+
+  fprintf (stderr, "Computing MISP surface in %d tiles\n", tiles);
+  fflush (stderr);
+
+
+  /*  On --resume everything below the first tile that wasn't stored is already written.  The tiles that reach past
+      that are gridded again so that the rows they share with the unfinished ones can be blended.  */
+
+  first_row = 0;
+
+  if (surface->checkpoint != NULL)
+    {
+      checkpoint_units (surface->checkpoint, tiles);
+
+      first_row = chrtr2_header->height;
+
+      for (k = 0 ; k < tiles ; k++)
+        {
+          if (!surface->checkpoint->done[k]) first_row = MIN (first_row, blend.tile[k].br0);
+        }
+
+      blend.next_row = first_row;
+
+      while (blend.released < blend.tiles_y && blend.tile[blend.released * blend.tiles_x].br0 +
+             blend.tile[blend.released * blend.tiles_x].bnr <= first_row) blend.released++;
+    }
+
+
+  for (k = 0 ; k < tiles ; k++)
+    {
+      tile = &blend.tile[k];
+
+
+      /*  Written before the last checkpoint (--resume) or nowhere near an edit (--update).  */
+
+      if (tile->br0 + tile->bnr <= first_row || (regrid != NULL && !regrid[k]))
+        {
+          finish_tile (surface, &blend, k, NULL);
+          tile_progress (++done, tiles, &old_percent);
+          continue;
+        }
+
+
+      /*  With --update, clear out the last run's values where they're going to be replaced.  */
+
+      if (blend.write != NULL && blend.write[k]) reset_surface (surface, tile->br0, tile->bc0, tile->bnr, tile->bnc);
+
+
+      /*  Nothing to fill in this tile.  */
+
+      if (!fillable_cells (surface, tile->br0, tile->bc0, tile->bnr, tile->bnc))
+        {
+          finish_tile (surface, &blend, k, NULL);
+          tile_progress (++done, tiles, &old_percent);
+          continue;
+        }
+
+      count = load_surface_points (surface, tile->r0, tile->c0, tile->nr, tile->nc, &xyz_array);
+
+
+      /*  No data within reach (only possible with --max_memory).  */
+
+      if (!count)
+        {
+          finish_tile (surface, &blend, k, NULL);
+          tile_progress (++done, tiles, &old_percent);
+          continue;
+        }
+
+
+      /*  Use the cached result if this tile's inputs haven't changed.  */
+
+      if (options->tile_cache[0])
+        {
+          tile_key (weight, tile, xyz_array, count, &key);
+
+          result = tile_buffer (tile);
+
+          if (read_cached_tile (options->tile_cache, &key, tile->bnr, tile->bnc, result))
+            {
+              free (xyz_array);
+
+              finish_tile (surface, &blend, k, result);
+
+              hits++;
+              tile_progress (++done, tiles, &old_percent);
+              continue;
+            }
+
+          free (result);
+
+          misses++;
+        }
+
+#ifdef USE_FORK
+      if (options->threads > 1)
+        {
+          /*  Don't get more than two rows of tiles ahead of the rows being written so that the finished tiles
+              waiting for their neighbours stay within what plan_memory allowed for.  */
+
+          while (running && k / blend.tiles_x >= blend.released + 2)
+            {
+              finish_tile_job (options, surface, &blend, job, options->threads);
+              running--;
+
+              tile_progress (++done, tiles, &old_percent);
+            }
+
+          if (running == options->threads)
+            {
+              finish_tile_job (options, surface, &blend, job, options->threads);
+              running--;
+
+              tile_progress (++done, tiles, &old_percent);
+            }
+
+          for (m = 0 ; m < options->threads ; m++) if (!job[m].pid) break;
+
+          job[m].tile = *tile;
+          if (options->tile_cache[0]) job[m].key = key;
+          job[m].fp = tmpfile ();
+          if (job[m].fp == NULL)
+            {
+              perror ("Creating MISP tile file");
+              exit (-1);
+            }
+
+          fflush (stdout);
+          fflush (stderr);
+
+          pid = fork ();
+
+          if (pid < 0)
+            {
+              perror ("Starting MISP tile process");
+              exit (-1);
+            }
+
+
+          /*  Child process.  Grid the tile, leave the result in the temporary file, and get out without flushing
+              any of the parent's buffers.  */
+
+          if (!pid)
+            {
+              get_stage_stats (&stats);
+
+              result = tile_buffer (tile);
+
+              solve_tile (weight, tile, xyz_array, count, result);
+
+
+              /*  The stage times and call counts go after the result.  */
+
+              stage_stats_since (&stats);
+
+              if (fwrite (result, sizeof (float), (int64_t) tile->bnr * tile->bnc, job[m].fp) !=
+                  (size_t) tile->bnr * tile->bnc || fwrite (&stats, sizeof (STAGE_STATS), 1, job[m].fp) != 1 ||
+                  fflush (job[m].fp)) _exit (1);
+
+              _exit (0);
+            }
+
+          job[m].pid = pid;
+          running++;
+
+          free (xyz_array);
+          continue;
+        }
+#endif
+
+      result = tile_buffer (tile);
+
+      solve_tile (weight, tile, xyz_array, count, result);
+
+      if (options->tile_cache[0]) write_cached_tile (options->tile_cache, &key, tile->bnr, tile->bnc, result);
+
+      free (xyz_array);
+
+      finish_tile (surface, &blend, k, result);
+
+      tile_progress (++done, tiles, &old_percent);
+    }
+
+
+#ifdef USE_FORK
+  while (running)
+    {
+      finish_tile_job (options, surface, &blend, job, options->threads);
+      running--;
+    }
+
+  free (job);
+#endif
+
+  fprintf (stderr, "MISP tiles - 100%%\n");
+
+  if (options->tile_cache[0]) fprintf (stderr, "MISP tile cache - %d hits, %d misses\n", hits, misses);
+
+  fflush (stderr);
+
+  free (blend.tile);
+  free (blend.result);
+  free (blend.waiting);
+  free (blend.write);
+  free (blend.mark);
+  free (blend.sum);
+  free (blend.weight);
+  free (blend.values);
+  free (regrid);
+}
+
+
+
+/*  Memory for the finished tiles that are waiting to be blended with their neighbours (no more than two rows of
+    tiles, see misp_tiled) and the row being blended.  */
+
+static int64_t blend_bytes (OPTIONS *options, int32_t width, int32_t size)
+{
+  int64_t             side;
+
+
+  side = size + 2 * (MIN (options->misp_halo, size) / 2);
+
+  return (2 * ((width + size - 1) / size) * side * side * (int64_t) sizeof (float) +
+          (int64_t) width * (2 * sizeof (double) + sizeof (float) + sizeof (uint8_t)));
+}
+
+
+
+/*  Set the MISP window that each process can afford out of budget and return the largest tile core that fits in it
+    with its halo.  Each process could be gridding a window that is all data.  */
+
+static int32_t tile_core (OPTIONS *options, OCCUPANCY *occupancy, int64_t budget)
+{
+  double              side;
+
+
+  options->misp_window = budget / options->threads / (MISP_CELL_BYTES + MISP_POINT_BYTES);
+
+  side = sqrt ((double) options->misp_window);
+
+  if (side - 2.0 * options->misp_halo < 1.0)
+    {
+      fprintf (stderr, "\n\n--max_memory is too small for a MISP tile with a %d cell halo!\n\n", options->misp_halo);
+      exit (-1);
+    }
+
+  return ((int32_t) MIN (side - 2.0 * options->misp_halo, (double) MAX (occupancy->width, occupancy->height)));
+}
+
+
+
+/*  Bytes in one ROW_BUFFER.  The depth buffers only ever grow, by doubling, so they can get to twice the densest
+    row.  */
+
+static int64_t row_buffer_bytes (OPTIONS *options, OCCUPANCY *occupancy)
+{
+  int64_t             bytes;
+
+
+  bytes = (int64_t) occupancy->width * (sizeof (BIN_RECORD) + sizeof (CHRTR2_RECORD) + sizeof (uint8_t) + sizeof (int64_t) +
+                                        sizeof (int32_t) + sizeof (BIN_SUMS));
+
+  if (!options->bin_layer)
+    bytes += 2 * occupancy->row_soundings * (sizeof (double) + 2 * sizeof (float) + sizeof (uint32_t));
+
+  return (bytes);
+}
+
+
+
+/*  Memory for the row buffers that the aggregation has at once.  These are the rings that aggregate_mosaic (files is
+    the number of mosaic inputs, 0 for a single PFM), aggregate_threaded, and aggregate_pipelined allocate.  */
+
+static int64_t aggregate_bytes (OPTIONS *options, OCCUPANCY *occupancy, int32_t files)
+{
+  int64_t             rows;
+
+
+  if (files)
+    {
+      rows = (int64_t) files * (MAX (1, options->read_ahead) + 1) + 1;
+
+      if (options->threads > 1) rows += options->threads * 2;
+    }
+  else if (options->threads > 1)
+    {
+      rows = (int64_t) (options->band_rows ? options->band_rows : MAX (1, BAND_BINS / occupancy->width)) *
+        options->threads * 2;
+    }
+  else if (options->read_ahead)
+    {
+      rows = options->read_ahead + 2;
+    }
+  else
+    {
+      rows = 1;
+    }
+
+  return (rows * row_buffer_bytes (options, occupancy));
+}
+
+
+
+/*  Work out how to stay within --max_memory.  The occupancy bitmap and the --in_memory grid (if we can afford it)
+    come off the top and what's left is shared by the MISP processes and the tiles waiting to be blended.  If the
+    whole surface fits in one go we leave it alone, otherwise we pick the largest tiles that, with their halos, fit
+    in each process's share.  The inverse distance gridding isn't tiled so all we can do is check that it fits.  */
+
+void plan_memory (OPTIONS *options, OCCUPANCY *occupancy, int32_t files)
+{
+  int64_t             cells, budget, grid_bytes, window_bytes, blend, rings;
+  int32_t             core;
+
+
+  if (!options->max_memory) return;
+
+  cells = (int64_t) occupancy->width * occupancy->height;
+
+  budget = options->max_memory - (int64_t) occupancy->height * occupancy->words_per_row * sizeof (uint64_t) -
+    (int64_t) occupancy->height * sizeof (int32_t) - (int64_t) occupancy->tiles_x * occupancy->tiles_y * sizeof (int32_t);
+
+  /*  The fill mask is the same size as the occupancy bitmap.  */
+
+  if (options->max_fill_distance > 0.0 && options->grid_type)
+    budget -= (int64_t) occupancy->height * occupancy->words_per_row * sizeof (uint64_t);
+
+  if (budget <= 0)
+    {
+      fprintf (stderr, "\n\n--max_memory is too small to hold the occupancy map for this PFM!\n\n");
+      exit (-1);
+    }
+
+
+  /*  The aggregation row buffers are freed before the gridding so they only have to fit next to the grid.  If the
+      threaded aggregation's ring would take more than half we make its bands smaller.  */
+
+  rings = aggregate_bytes (options, occupancy, files);
+
+  if (!files && options->threads > 1 && rings > budget / 2)
+    {
+      options->band_rows = MAX (1, budget / 2 / (row_buffer_bytes (options, occupancy) * options->threads * 2));
+
+      rings = aggregate_bytes (options, occupancy, files);
+    }
+
+  if (rings >= budget)
+    {
+      fprintf (stderr, "\n\n--max_memory is too small for the aggregation row buffers, try fewer --threads or a smaller\n");
+      fprintf (stderr, "--read_ahead!\n\n");
+      exit (-1);
+    }
+
+
+  /*  The in memory grid only saves reading the CHRTR2 file back in so we don't let it take more than half.  */
+
+  if (options->in_memory && options->grid_type)
+    {
+      grid_bytes = cells * (sizeof (float) + sizeof (uint16_t));
+
+      if (grid_bytes > budget / 2 || grid_bytes + rings > budget)
+        {
+          fprintf (stderr, "Not enough memory for --in_memory, the grid will be read from the CHRTR2 file\n");
+          fflush (stderr);
+          options->in_memory = NVFalse;
+        }
+      else
+        {
+          budget -= grid_bytes;
+        }
+    }
+
+  /*  The inverse distance gridding needs the points twice while it builds its index and then a ring of finished
+      rows for each thread.  */
+
+  if (options->grid_type == 2)
+    {
+      if (occupancy->total * 2 * (int64_t) sizeof (NV_F64_COORD3) +
+          (int64_t) (options->threads * IDW_RING_ROWS * occupancy->width * sizeof (float)) > budget)
+        {
+          fprintf (stderr, "\n\n--max_memory is too small for inverse distance gridding of this PFM!\n\n");
+          exit (-1);
+        }
+
+      return;
+    }
+
+
+  /*  Only MISP is tiled.  */
+
+  if (options->grid_type != 1) return;
+
+
+  window_bytes = cells * MISP_CELL_BYTES + occupancy->total * MISP_POINT_BYTES;
+
+  if (!options->misp_tile && window_bytes <= budget) return;
+
+
+  /*  The tiles waiting to be blended depend on the tile size.  We allow for the ones we'd have without them, which
+      can only be bigger.  */
+
+  core = tile_core (options, occupancy, budget);
+
+  blend = blend_bytes (options, occupancy->width, (options->misp_tile && options->misp_tile <= core) ? options->misp_tile : core);
+
+  if (blend >= budget)
+    {
+      fprintf (stderr, "\n\n--max_memory is too small to blend the MISP tiles!\n\n");
+      exit (-1);
+    }
+
+  core = tile_core (options, occupancy, budget - blend);
+
+  if (!options->misp_tile || options->misp_tile > core)
+    {
+      options->misp_tile = core;
+
+      fprintf (stderr, "Using %d x %d cell MISP tiles to stay within --max_memory\n", core, core);
+      fflush (stderr);
+    }
+}
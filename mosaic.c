@@ -0,0 +1,668 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include <pthread.h>
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    Mosaic of several PFM files (more than one PFM_FILE on the command line).
+
+    All of the PFM files must have the same bin size.  The output grid covers the union of their MBRs on the bin
+    grid of the first file and each file is placed at the nearest whole bin offset from it, so files that were built
+    on the same grid line up exactly.  The occupancy bitmap is built from every file.  Where files overlap, the
+    depth records of all of the files that have data in a cell are combined before averaging, and the bin records
+    are pooled (sounding weighted mean and standard deviation), so an overlapping cell comes out the same as it
+    would if all of the soundings had been loaded into one PFM.
+
+    Each file gets a reader thread that reads its rows (as read_row does) into its own ring of row buffers.  The
+    calling thread takes the matching row from every file that covers the output row, merges them into one row,
+    and reduces and writes it as usual, so every file is read once, in parallel with the others, and the
+    interpolation is run once over the whole grid.  With --threads N the merged rows go into a ring of 2 * N row
+    buffers instead and N worker threads reduce them (the expensive part) while the calling thread keeps merging and
+    writes the reduced rows in order, so the output is the same as with one thread.
+
+*/
+
+
+typedef struct
+{
+  pthread_mutex_t     mutex;
+  pthread_cond_t      cond;
+  OPTIONS             *options;
+  MOSAIC_INPUT        *input;
+  int32_t             slots;
+  ROW_BUFFER          *ring;
+  uint8_t             *ready;                  /*  NVTrue when ring[row % slots] holds a row that has been read  */
+} MOSAIC_READER;
+
+
+#define         ROW_FREE     0
+#define         ROW_MERGED   1
+#define         ROW_REDUCING 2
+#define         ROW_REDUCED  3
+
+
+/*  The merged rows waiting to be reduced by the --threads workers.  */
+
+typedef struct
+{
+  pthread_mutex_t     mutex;
+  pthread_cond_t      cond;
+  OPTIONS             *options;
+  OCCUPANCY           *occupancy;
+  CHRTR2_HEADER       *chrtr2_header;
+  int32_t             height;
+  int32_t             slots;
+  int32_t             next_reduce;             /*  Next merged row for a worker to take  */
+  ROW_BUFFER          *ring;
+  uint8_t             *state;                  /*  ROW_FREE, ROW_MERGED, ROW_REDUCING, or ROW_REDUCED  */
+} MOSAIC_REDUCER;
+
+
+
+/*  Open all of the PFM files and work out where they go in the output grid.  The first file's header is copied to
+    open_args with the MBR and size changed to cover all of them.  */
+
+void open_mosaic (char **pfm_files, int32_t count, MOSAIC *mosaic, PFM_OPEN_ARGS *open_args)
+{
+  MOSAIC_INPUT        *input, *first;
+  int32_t             k, min_row = 0, min_col = 0, max_row = 0, max_col = 0;
+  double              x_bins, y_bins;
+
+
+  mosaic->count = count;
+  mosaic->input = (MOSAIC_INPUT *) calloc (count, sizeof (MOSAIC_INPUT));
+
+  if (mosaic->input == NULL)
+    {
+      perror ("Allocating mosaic inputs in open_mosaic");
+      exit (-1);
+    }
+
+  first = &mosaic->input[0];
+
+  for (k = 0 ; k < count ; k++)
+    {
+      input = &mosaic->input[k];
+
+      if (!strstr (pfm_files[k], ".pfm") || strlen (pfm_files[k]) >= sizeof (input->open_args.list_path))
+        {
+          fprintf (stderr, "\n\n%s is not a PFM file!\n\n", pfm_files[k]);
+          exit (-1);
+        }
+
+      strcpy (input->open_args.list_path, pfm_files[k]);
+      input->open_args.checkpoint = 0;
+
+      input->pfm_handle = open_existing_pfm_file (&input->open_args);
+
+      if (input->pfm_handle < 0) pfm_error_exit (pfm_error);
+
+      if (input->open_args.head.proj_data.projection)
+        {
+          fprintf (stderr, "\n\npfm2chrtr2 does not handle projected data!!!\n\n");
+          exit (-1);
+        }
+
+      if (fabs (input->open_args.head.x_bin_size_degrees - first->open_args.head.x_bin_size_degrees) >
+          first->open_args.head.x_bin_size_degrees * 0.0001 ||
+          fabs (input->open_args.head.y_bin_size_degrees - first->open_args.head.y_bin_size_degrees) >
+          first->open_args.head.y_bin_size_degrees * 0.0001)
+        {
+          fprintf (stderr, "\n\n%s doesn't have the same bin size as %s!\n\n", pfm_files[k], pfm_files[0]);
+          exit (-1);
+        }
+
+
+      /*  Offset from the first file in bins, which will be made relative to the output grid below.  */
+
+      x_bins = (input->open_args.head.mbr.min_x - first->open_args.head.mbr.min_x) /
+        first->open_args.head.x_bin_size_degrees;
+      y_bins = (input->open_args.head.mbr.min_y - first->open_args.head.mbr.min_y) /
+        first->open_args.head.y_bin_size_degrees;
+
+      input->col0 = NINT (x_bins);
+      input->row0 = NINT (y_bins);
+
+      if (fabs (x_bins - input->col0) > 0.01 || fabs (y_bins - input->row0) > 0.01)
+        {
+          fprintf (stderr, "Warning - %s is not on the same bin grid as %s, it will be moved by up to half a bin\n",
+                   pfm_files[k], pfm_files[0]);
+          fflush (stderr);
+        }
+
+      min_col = MIN (min_col, input->col0);
+      min_row = MIN (min_row, input->row0);
+      max_col = MAX (max_col, input->col0 + input->open_args.head.bin_width);
+      max_row = MAX (max_row, input->row0 + input->open_args.head.bin_height);
+    }
+
+
+  for (k = 0 ; k < count ; k++)
+    {
+      mosaic->input[k].col0 -= min_col;
+      mosaic->input[k].row0 -= min_row;
+    }
+
+  *open_args = first->open_args;
+
+  open_args->head.bin_width = max_col - min_col;
+  open_args->head.bin_height = max_row - min_row;
+  open_args->head.mbr.min_x = first->open_args.head.mbr.min_x + min_col * first->open_args.head.x_bin_size_degrees;
+  open_args->head.mbr.min_y = first->open_args.head.mbr.min_y + min_row * first->open_args.head.y_bin_size_degrees;
+  open_args->head.mbr.max_x = open_args->head.mbr.min_x + open_args->head.bin_width *
+    first->open_args.head.x_bin_size_degrees;
+  open_args->head.mbr.max_y = open_args->head.mbr.min_y + open_args->head.bin_height *
+    first->open_args.head.y_bin_size_degrees;
+
+  fprintf (stderr, "Mosaic of %d PFM files, %d x %d bins\n", count, open_args->head.bin_width,
+           open_args->head.bin_height);
+  fflush (stderr);
+}
+
+
+
+/*  Scan each file and combine their bitmaps in the output grid.  */
+
+void build_mosaic_occupancy (MOSAIC *mosaic, int32_t width, int32_t height, OCCUPANCY *occupancy)
+{
+  MOSAIC_INPUT        *input;
+  int32_t             i, j, k;
+
+
+  allocate_occupancy (width, height, occupancy);
+
+  for (k = 0 ; k < mosaic->count ; k++)
+    {
+      input = &mosaic->input[k];
+
+      fprintf (stderr, "%s\n", input->open_args.list_path);
+
+      build_occupancy (input->pfm_handle, 0, 0, input->open_args.head.bin_width, input->open_args.head.bin_height,
+                       &input->occupancy);
+
+      for (i = 0 ; i < input->occupancy.height ; i++)
+        {
+          for (j = next_occupied (&input->occupancy, i, 0) ; j < input->occupancy.width ;
+               j = next_occupied (&input->occupancy, i, j + 1))
+            {
+              if (!is_occupied (occupancy, input->row0 + i, input->col0 + j))
+                set_occupied (occupancy, input->row0 + i, input->col0 + j);
+            }
+        }
+
+
+      /*  A merged row can't hold more soundings than the densest rows of all of the files together.  */
+
+      occupancy->row_soundings += input->occupancy.row_soundings;
+    }
+
+  occupancy->data_bins = occupancy->total;
+
+  fprintf (stderr, "%lld of %lld mosaic bins occupied\n", (long long) occupancy->total, (long long) width * height);
+  fflush (stderr);
+}
+
+
+
+/*  Pool the statistics of a bin from another file into a bin record.  */
+
+static void merge_bin (BIN_RECORD *bin, BIN_RECORD *more)
+{
+  double              n, mean, square;
+
+
+  n = (double) bin->num_soundings + (double) more->num_soundings;
+
+  if (n > 0.0)
+    {
+      mean = ((double) bin->num_soundings * bin->avg_filtered_depth + (double) more->num_soundings *
+              more->avg_filtered_depth) / n;
+
+      square = ((double) bin->num_soundings * ((double) bin->standard_dev * bin->standard_dev +
+                                               (double) bin->avg_filtered_depth * bin->avg_filtered_depth) +
+                (double) more->num_soundings * ((double) more->standard_dev * more->standard_dev +
+                                                (double) more->avg_filtered_depth * more->avg_filtered_depth)) / n;
+
+      bin->avg_filtered_depth = mean;
+      bin->standard_dev = sqrt (MAX (0.0, square - mean * mean));
+    }
+
+  bin->num_soundings += more->num_soundings;
+  bin->min_filtered_depth = MIN (bin->min_filtered_depth, more->min_filtered_depth);
+  bin->max_filtered_depth = MAX (bin->max_filtered_depth, more->max_filtered_depth);
+  bin->validity |= more->validity;
+}
+
+
+
+static void *mosaic_reader (void *arg)
+{
+  MOSAIC_READER       *reader = (MOSAIC_READER *) arg;
+  MOSAIC_INPUT        *input = reader->input;
+  int32_t             i, slot;
+
+
+  for (i = 0 ; i < input->open_args.head.bin_height ; i++)
+    {
+      slot = i % reader->slots;
+
+      pthread_mutex_lock (&reader->mutex);
+      while (reader->ready[slot]) pthread_cond_wait (&reader->cond, &reader->mutex);
+      pthread_mutex_unlock (&reader->mutex);
+
+      read_row (input->pfm_handle, i, reader->options, &input->occupancy, &reader->ring[slot]);
+
+      pthread_mutex_lock (&reader->mutex);
+      reader->ready[slot] = NVTrue;
+      pthread_cond_broadcast (&reader->cond);
+      pthread_mutex_unlock (&reader->mutex);
+    }
+
+  return (NULL);
+}
+
+
+
+static void *mosaic_reducer (void *arg)
+{
+  MOSAIC_REDUCER      *reducer = (MOSAIC_REDUCER *) arg;
+  int32_t             slot;
+
+
+  while (NVTrue)
+    {
+      pthread_mutex_lock (&reducer->mutex);
+
+      while (reducer->next_reduce < reducer->height && reducer->state[reducer->next_reduce % reducer->slots] != ROW_MERGED)
+        pthread_cond_wait (&reducer->cond, &reducer->mutex);
+
+      if (reducer->next_reduce >= reducer->height)
+        {
+          pthread_mutex_unlock (&reducer->mutex);
+          break;
+        }
+
+      slot = reducer->next_reduce % reducer->slots;
+      reducer->state[slot] = ROW_REDUCING;
+      reducer->next_reduce++;
+
+      pthread_mutex_unlock (&reducer->mutex);
+
+
+      reduce_row (reducer->options, reducer->occupancy, reducer->chrtr2_header, &reducer->ring[slot]);
+
+
+      pthread_mutex_lock (&reducer->mutex);
+      reducer->state[slot] = ROW_REDUCED;
+      pthread_cond_broadcast (&reducer->cond);
+      pthread_mutex_unlock (&reducer->mutex);
+    }
+
+  return (NULL);
+}
+
+
+
+/*  Write the next row once it has been reduced.  If wait is NVFalse and it isn't ready, return NVFalse.  */
+
+static uint8_t write_reduced_row (MOSAIC_REDUCER *reducer, OUTPUT *output, int32_t row, uint8_t wait)
+{
+  int32_t             slot;
+
+
+  slot = row % reducer->slots;
+
+  pthread_mutex_lock (&reducer->mutex);
+
+  while (wait && reducer->state[slot] != ROW_REDUCED) pthread_cond_wait (&reducer->cond, &reducer->mutex);
+
+  if (reducer->state[slot] != ROW_REDUCED)
+    {
+      pthread_mutex_unlock (&reducer->mutex);
+      return (NVFalse);
+    }
+
+  pthread_mutex_unlock (&reducer->mutex);
+
+
+  write_row (output, &reducer->ring[slot]);
+
+
+  pthread_mutex_lock (&reducer->mutex);
+  reducer->state[slot] = ROW_FREE;
+  pthread_mutex_unlock (&reducer->mutex);
+
+  return (NVTrue);
+}
+
+
+
+static void mosaic_progress (int32_t row, int32_t height, int32_t *old_percent)
+{
+  int32_t             percent;
+
+
+  percent = ((float) row / (float) height) * 100.0;
+  if (percent != *old_percent)
+    {
+      fprintf (stderr, "Processing - %03d%%\r", percent);
+      fflush (stderr);
+      *old_percent = percent;
+    }
+}
+
+
+
+void aggregate_mosaic (OPTIONS *options, MOSAIC *mosaic, CHRTR2_HEADER *chrtr2_header, OUTPUT *output)
+{
+  MOSAIC_READER       *reader;
+  MOSAIC_REDUCER      reducer;
+  ROW_BUFFER          single, *row, **src;
+  MOSAIC_INPUT        *input;
+  pthread_t           *thread, *worker = NULL;
+  int32_t             i, j, k, r, c, width, height, next_write = 0, old_percent = -1;
+  uint8_t             found;
+
+
+  width = output->occupancy->width;
+  height = output->occupancy->height;
+
+  reader = (MOSAIC_READER *) calloc (mosaic->count, sizeof (MOSAIC_READER));
+  src = (ROW_BUFFER **) calloc (mosaic->count, sizeof (ROW_BUFFER *));
+  thread = (pthread_t *) malloc (mosaic->count * sizeof (pthread_t));
+
+  if (reader == NULL || src == NULL || thread == NULL)
+    {
+      perror ("Allocating mosaic readers in aggregate_mosaic");
+      exit (-1);
+    }
+
+  allocate_row_buffer (&single, width);
+
+
+  /*  Each reader can get --read_ahead rows ahead of the writer (at least one).  */
+
+  for (k = 0 ; k < mosaic->count ; k++)
+    {
+      reader[k].options = options;
+      reader[k].input = &mosaic->input[k];
+      reader[k].slots = MAX (1, options->read_ahead) + 1;
+
+      pthread_mutex_init (&reader[k].mutex, NULL);
+      pthread_cond_init (&reader[k].cond, NULL);
+
+      reader[k].ring = (ROW_BUFFER *) calloc (reader[k].slots, sizeof (ROW_BUFFER));
+      reader[k].ready = (uint8_t *) calloc (reader[k].slots, sizeof (uint8_t));
+
+      if (reader[k].ring == NULL || reader[k].ready == NULL)
+        {
+          perror ("Allocating mosaic buffers in aggregate_mosaic");
+          exit (-1);
+        }
+
+      for (i = 0 ; i < reader[k].slots ; i++)
+        allocate_row_buffer (&reader[k].ring[i], mosaic->input[k].open_args.head.bin_width);
+
+      if (pthread_create (&thread[k], NULL, mosaic_reader, &reader[k]))
+        {
+          perror ("Starting mosaic reader thread");
+          exit (-1);
+        }
+    }
+
+
+  /*  With --threads the merged rows are reduced by the workers.  */
+
+  memset (&reducer, 0, sizeof (MOSAIC_REDUCER));
+
+  if (options->threads > 1)
+    {
+      pthread_mutex_init (&reducer.mutex, NULL);
+      pthread_cond_init (&reducer.cond, NULL);
+
+      reducer.options = options;
+      reducer.occupancy = output->occupancy;
+      reducer.chrtr2_header = chrtr2_header;
+      reducer.height = height;
+      reducer.slots = options->threads * 2;
+
+      reducer.ring = (ROW_BUFFER *) calloc (reducer.slots, sizeof (ROW_BUFFER));
+      reducer.state = (uint8_t *) calloc (reducer.slots, sizeof (uint8_t));
+      worker = (pthread_t *) malloc (options->threads * sizeof (pthread_t));
+
+      if (reducer.ring == NULL || reducer.state == NULL || worker == NULL)
+        {
+          perror ("Allocating mosaic reducers in aggregate_mosaic");
+          exit (-1);
+        }
+
+      for (i = 0 ; i < reducer.slots ; i++) allocate_row_buffer (&reducer.ring[i], width);
+
+      for (i = 0 ; i < options->threads ; i++)
+        {
+          if (pthread_create (&worker[i], NULL, mosaic_reducer, &reducer))
+            {
+              perror ("Starting mosaic aggregation thread");
+              exit (-1);
+            }
+        }
+    }
+
+
+  /*  This thread merges the rows and writes them in order.  */
+
+  for (i = 0 ; i < height ; i++)
+    {
+      row = &single;
+
+      if (reducer.ring != NULL)
+        {
+          /*  Write the reduced rows until there's a free buffer for this one.  */
+
+          while (i - next_write >= reducer.slots)
+            {
+              write_reduced_row (&reducer, output, next_write, NVTrue);
+              mosaic_progress (next_write++, height, &old_percent);
+            }
+
+          row = &reducer.ring[i % reducer.slots];
+        }
+
+
+      /*  Wait for this row from every file that covers it.  */
+
+      for (k = 0 ; k < mosaic->count ; k++)
+        {
+          input = &mosaic->input[k];
+          r = i - input->row0;
+
+          src[k] = NULL;
+
+          if (r < 0 || r >= input->open_args.head.bin_height) continue;
+
+          pthread_mutex_lock (&reader[k].mutex);
+          while (!reader[k].ready[r % reader[k].slots]) pthread_cond_wait (&reader[k].cond, &reader[k].mutex);
+          pthread_mutex_unlock (&reader[k].mutex);
+
+          src[k] = &reader[k].ring[r % reader[k].slots];
+        }
+
+
+      /*  Merge the bins and depth records of every file that has data in each occupied cell.  */
+
+      row->row = i;
+      row->depths.count = 0;
+
+      for (j = next_occupied (output->occupancy, i, 0) ; j < width ; j = next_occupied (output->occupancy, i, j + 1))
+        {
+          row->offset[j] = row->depths.count;
+          row->numrecs[j] = 0;
+
+          found = NVFalse;
+
+          for (k = 0 ; k < mosaic->count ; k++)
+            {
+              if (src[k] == NULL) continue;
+
+              input = &mosaic->input[k];
+
+              c = j - input->col0;
+
+              if (c < 0 || c >= input->open_args.head.bin_width || !is_occupied (&input->occupancy, i - input->row0, c))
+                continue;
+
+              if (found)
+                {
+                  merge_bin (&row->bin_row[j], &src[k]->bin_row[c]);
+                }
+              else
+                {
+                  row->bin_row[j] = src[k]->bin_row[c];
+                  found = NVTrue;
+                }
+
+              if (!options->bin_layer)
+                {
+                  copy_depths (&src[k]->depths, src[k]->offset[c], src[k]->numrecs[c], &row->depths);
+                  row->numrecs[j] += src[k]->numrecs[c];
+                }
+            }
+        }
+
+
+      /*  Give the rows back to the readers.  */
+
+      for (k = 0 ; k < mosaic->count ; k++)
+        {
+          if (src[k] == NULL) continue;
+
+          pthread_mutex_lock (&reader[k].mutex);
+          reader[k].ready[(i - mosaic->input[k].row0) % reader[k].slots] = NVFalse;
+          pthread_cond_broadcast (&reader[k].cond);
+          pthread_mutex_unlock (&reader[k].mutex);
+        }
+
+
+      if (reducer.ring != NULL)
+        {
+          pthread_mutex_lock (&reducer.mutex);
+          reducer.state[i % reducer.slots] = ROW_MERGED;
+          pthread_cond_broadcast (&reducer.cond);
+          pthread_mutex_unlock (&reducer.mutex);
+
+
+          /*  Write whatever has been reduced so far without waiting.  */
+
+          while (next_write <= i && write_reduced_row (&reducer, output, next_write, NVFalse))
+            mosaic_progress (next_write++, height, &old_percent);
+        }
+      else
+        {
+          reduce_row (options, output->occupancy, chrtr2_header, row);
+
+          write_row (output, row);
+
+          mosaic_progress (i, height, &old_percent);
+        }
+    }
+
+
+  if (reducer.ring != NULL)
+    {
+      while (next_write < height)
+        {
+          write_reduced_row (&reducer, output, next_write, NVTrue);
+          mosaic_progress (next_write++, height, &old_percent);
+        }
+
+      for (i = 0 ; i < options->threads ; i++) pthread_join (worker[i], NULL);
+
+      for (i = 0 ; i < reducer.slots ; i++) free_row_buffer (&reducer.ring[i]);
+
+      free (reducer.ring);
+      free (reducer.state);
+      free (worker);
+
+      pthread_mutex_destroy (&reducer.mutex);
+      pthread_cond_destroy (&reducer.cond);
+    }
+
+
+  for (k = 0 ; k < mosaic->count ; k++)
+    {
+      pthread_join (thread[k], NULL);
+
+      for (i = 0 ; i < reader[k].slots ; i++) free_row_buffer (&reader[k].ring[i]);
+
+      free (reader[k].ring);
+      free (reader[k].ready);
+
+      pthread_mutex_destroy (&reader[k].mutex);
+      pthread_cond_destroy (&reader[k].cond);
+    }
+
+  free_row_buffer (&single);
+
+  free (reader);
+  free (src);
+  free (thread);
+}
+
+
+
+void close_mosaic (MOSAIC *mosaic)
+{
+  int32_t             k;
+
+
+  for (k = 0 ; k < mosaic->count ; k++)
+    {
+      close_pfm_file (mosaic->input[k].pfm_handle);
+      free_occupancy (&mosaic->input[k].occupancy);
+    }
+
+  free (mosaic->input);
+
+  mosaic->input = NULL;
+  mosaic->count = 0;
+}
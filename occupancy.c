@@ -0,0 +1,450 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    Bin occupancy bitmap.
+
+    Before aggregation we read the bin records once and set a bit for every bin that has PFM_DATA set (or, when
+    nothing needs the bitmap before then, the aggregation builds it as it goes, see defer_occupancy).  Each row
+    starts on a new 64 bit word so rows can be scanned (and updated by the writer) independently.  We also keep
+    the number of occupied bins in each row and in each OCCUPANCY_TILE x OCCUPANCY_TILE tile so that later stages
+    can skip empty rows, spans, and tiles without looking at the bits.  As rows are written, bins that turned out
+    to have no valid data are cleared so that, after aggregation, the bitmap marks exactly the cells that hold real
+    or hand-drawn data.  The most soundings in any row is kept for plan_memory, which has to allow for the depth
+    buffers of the rows that are being aggregated.
+
+    While we have the bin records we also hash them (FNV-1a) per tile.  The hashes are saved in the run manifest so
+    that --update can tell which tiles have been edited since the last conversion (see update.c).
+
+*/
+
+
+#define         FNV_OFFSET 0xcbf29ce484222325LL
+#define         FNV_PRIME 0x100000001b3LL
+
+
+
+static int32_t count_trailing_zeros (uint64_t word)
+{
+#ifdef __GNUC__
+  return (__builtin_ctzll (word));
+#else
+  int32_t             n = 0;
+
+  while (!(word & 1))
+    {
+      word >>= 1;
+      n++;
+    }
+
+  return (n);
+#endif
+}
+
+
+
+static int32_t count_leading_zeros (uint64_t word)
+{
+#ifdef __GNUC__
+  return (__builtin_clzll (word));
+#else
+  int32_t             n = 0;
+
+  while (!(word & 0x8000000000000000LL))
+    {
+      word <<= 1;
+      n++;
+    }
+
+  return (n);
+#endif
+}
+
+
+
+void set_occupied (OCCUPANCY *occupancy, int32_t row, int32_t col)
+{
+  occupancy->bits[(int64_t) row * occupancy->words_per_row + (col >> 6)] |= ((uint64_t) 1 << (col & 63));
+
+  occupancy->row_count[row]++;
+  occupancy->tile_count[(row / OCCUPANCY_TILE) * occupancy->tiles_x + col / OCCUPANCY_TILE]++;
+  occupancy->total++;
+}
+
+
+
+/*  Allocate an empty bitmap.  */
+
+void allocate_occupancy (int32_t width, int32_t height, OCCUPANCY *occupancy)
+{
+  occupancy->width = width;
+  occupancy->height = height;
+  occupancy->words_per_row = (width + 63) / 64;
+  occupancy->tiles_x = (width + OCCUPANCY_TILE - 1) / OCCUPANCY_TILE;
+  occupancy->tiles_y = (height + OCCUPANCY_TILE - 1) / OCCUPANCY_TILE;
+  occupancy->total = 0;
+  occupancy->tile_hash = NULL;
+  occupancy->row_soundings = 0;
+  occupancy->data_bins = 0;
+  occupancy->deferred = NVFalse;
+
+  occupancy->bits = (uint64_t *) calloc ((int64_t) occupancy->words_per_row * height, sizeof (uint64_t));
+  occupancy->row_count = (int32_t *) calloc (height, sizeof (int32_t));
+  occupancy->tile_count = (int32_t *) calloc ((int64_t) occupancy->tiles_x * occupancy->tiles_y, sizeof (int32_t));
+
+  if (occupancy->bits == NULL || occupancy->row_count == NULL || occupancy->tile_count == NULL)
+    {
+      perror ("Allocating occupancy bitmap in allocate_occupancy");
+      exit (-1);
+    }
+}
+
+
+
+static void hash_bytes (uint64_t *hash, void *data, int32_t size)
+{
+  uint8_t             *bytes = (uint8_t *) data;
+  int32_t             i;
+
+
+  for (i = 0 ; i < size ; i++) *hash = (*hash ^ bytes[i]) * FNV_PRIME;
+}
+
+
+
+/*  Hash the parts of a bin record that change when the bin is edited.  The PFM_MODIFIED and PFM_CHECKED flags are
+    part of the validity.  */
+
+static void hash_bin (uint64_t *hash, BIN_RECORD *bin)
+{
+  hash_bytes (hash, &bin->num_soundings, sizeof (bin->num_soundings));
+  hash_bytes (hash, &bin->standard_dev, sizeof (bin->standard_dev));
+  hash_bytes (hash, &bin->avg_filtered_depth, sizeof (bin->avg_filtered_depth));
+  hash_bytes (hash, &bin->min_filtered_depth, sizeof (bin->min_filtered_depth));
+  hash_bytes (hash, &bin->max_filtered_depth, sizeof (bin->max_filtered_depth));
+  hash_bytes (hash, &bin->validity, sizeof (bin->validity));
+}
+
+
+
+static void allocate_tile_hash (OCCUPANCY *occupancy)
+{
+  int32_t             i;
+
+
+  occupancy->tile_hash = (uint64_t *) malloc ((int64_t) occupancy->tiles_x * occupancy->tiles_y * sizeof (uint64_t));
+
+  if (occupancy->tile_hash == NULL)
+    {
+      perror ("Allocating tile hashes in allocate_tile_hash");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < occupancy->tiles_x * occupancy->tiles_y ; i++) occupancy->tile_hash[i] = FNV_OFFSET;
+}
+
+
+
+/*  Build the occupancy bitmap from the PFM bin records.  The grid starts at row0, col0 in the PFM.  */
+
+void build_occupancy (int32_t pfm_handle, int32_t row0, int32_t col0, int32_t width, int32_t height, OCCUPANCY *occupancy)
+{
+  BIN_RECORD          *bin_row;
+  int64_t             soundings;
+  int32_t             i, j, percent = 0, old_percent = -1;
+
+
+  allocate_occupancy (width, height, occupancy);
+  allocate_tile_hash (occupancy);
+
+  bin_row = (BIN_RECORD *) malloc (width * sizeof (BIN_RECORD));
+
+  if (bin_row == NULL)
+    {
+      perror ("Allocating bin row in build_occupancy");
+      exit (-1);
+    }
+
+
+  for (i = 0 ; i < height ; i++)
+    {
+      count_calls (CALL_READ_BIN_ROW, 1);
+      if (read_bin_row (pfm_handle, width, row0 + i, col0, bin_row)) pfm_error_exit (pfm_error);
+
+      soundings = 0;
+
+      for (j = 0 ; j < width ; j++)
+        {
+          if (bin_row[j].validity & PFM_DATA)
+            {
+              set_occupied (occupancy, i, j);
+              soundings += bin_row[j].num_soundings;
+            }
+
+          hash_bin (&occupancy->tile_hash[(i / OCCUPANCY_TILE) * occupancy->tiles_x + j / OCCUPANCY_TILE], &bin_row[j]);
+        }
+
+      occupancy->row_soundings = MAX (occupancy->row_soundings, soundings);
+
+      percent = ((float) i / (float) height) * 100.0;
+      if (percent != old_percent)
+        {
+          fprintf (stderr, "Scanning bins - %03d%%\r", percent);
+          fflush (stderr);
+          old_percent = percent;
+        }
+    }
+
+  occupancy->data_bins = occupancy->total;
+
+  fprintf (stderr, "Scanning bins - 100%%, %lld of %lld bins occupied\n", (long long) occupancy->total,
+           (long long) width * height);
+  fflush (stderr);
+
+  free (bin_row);
+}
+
+
+
+/*  Start an empty bitmap that write_row fills in from the bin rows that the aggregation reads, so that every bin row
+    is read once instead of once here and again for the aggregation.  Nothing can use the bitmap until the
+    aggregation is done.  The aggregation reads whole rows instead of skipping the empty ones.  */
+
+void defer_occupancy (int32_t width, int32_t height, OCCUPANCY *occupancy)
+{
+  allocate_occupancy (width, height, occupancy);
+  allocate_tile_hash (occupancy);
+
+  occupancy->deferred = NVTrue;
+}
+
+
+
+/*  Add an aggregated row to a deferred bitmap.  The bins that produced a CHRTR2 record (populated) are set, which
+    leaves the bitmap the same as a built one after write_row has cleared the bins that didn't.  The rows have to come
+    in order for the tile hashes to match build_occupancy's.  */
+
+void add_occupancy_row (OCCUPANCY *occupancy, int32_t row, BIN_RECORD *bin_row, uint8_t *populated)
+{
+  int32_t             j;
+
+
+  for (j = 0 ; j < occupancy->width ; j++)
+    {
+      if (bin_row[j].validity & PFM_DATA) occupancy->data_bins++;
+
+      if (populated[j]) set_occupied (occupancy, row, j);
+
+      hash_bin (&occupancy->tile_hash[(row / OCCUPANCY_TILE) * occupancy->tiles_x + j / OCCUPANCY_TILE], &bin_row[j]);
+    }
+}
+
+
+
+void free_occupancy (OCCUPANCY *occupancy)
+{
+  free (occupancy->bits);
+  free (occupancy->row_count);
+  free (occupancy->tile_count);
+  free (occupancy->tile_hash);
+
+  occupancy->bits = NULL;
+  occupancy->row_count = NULL;
+  occupancy->tile_count = NULL;
+  occupancy->tile_hash = NULL;
+}
+
+
+
+uint8_t is_occupied (OCCUPANCY *occupancy, int32_t row, int32_t col)
+{
+  return ((occupancy->bits[(int64_t) row * occupancy->words_per_row + (col >> 6)] >> (col & 63)) & 1);
+}
+
+
+
+/*  Clear a bin that didn't produce a CHRTR2 record.  */
+
+void clear_occupied (OCCUPANCY *occupancy, int32_t row, int32_t col)
+{
+  if (!is_occupied (occupancy, row, col)) return;
+
+  occupancy->bits[(int64_t) row * occupancy->words_per_row + (col >> 6)] &= ~((uint64_t) 1 << (col & 63));
+
+  occupancy->row_count[row]--;
+  occupancy->tile_count[(row / OCCUPANCY_TILE) * occupancy->tiles_x + col / OCCUPANCY_TILE]--;
+  occupancy->total--;
+}
+
+
+
+/*  Return the column of the first occupied bin in row at or after col, or the row width if there isn't one.  */
+
+int32_t next_occupied (OCCUPANCY *occupancy, int32_t row, int32_t col)
+{
+  uint64_t            *bits, word;
+  int32_t             w;
+
+
+  if (col >= occupancy->width) return (occupancy->width);
+
+  bits = &occupancy->bits[(int64_t) row * occupancy->words_per_row];
+
+  w = col >> 6;
+  word = bits[w] & (~(uint64_t) 0 << (col & 63));
+
+  while (!word)
+    {
+      if (++w >= occupancy->words_per_row) return (occupancy->width);
+      word = bits[w];
+    }
+
+  return (MIN ((w << 6) + count_trailing_zeros (word), occupancy->width));
+}
+
+
+
+/*  Return the column of the first empty bin in row at or after col, or the row width if there isn't one.  */
+
+int32_t next_empty (OCCUPANCY *occupancy, int32_t row, int32_t col)
+{
+  uint64_t            *bits, word;
+  int32_t             w;
+
+
+  if (col >= occupancy->width) return (occupancy->width);
+
+  bits = &occupancy->bits[(int64_t) row * occupancy->words_per_row];
+
+  w = col >> 6;
+  word = ~bits[w] & (~(uint64_t) 0 << (col & 63));
+
+  while (!word)
+    {
+      if (++w >= occupancy->words_per_row) return (occupancy->width);
+      word = ~bits[w];
+    }
+
+  return (MIN ((w << 6) + count_trailing_zeros (word), occupancy->width));
+}
+
+
+
+/*  Return the column of the last occupied bin in row, or -1 if the row is empty.  */
+
+int32_t last_occupied (OCCUPANCY *occupancy, int32_t row)
+{
+  uint64_t            *bits;
+  int32_t             w;
+
+
+  if (!occupancy->row_count[row]) return (-1);
+
+  bits = &occupancy->bits[(int64_t) row * occupancy->words_per_row];
+
+  for (w = occupancy->words_per_row - 1 ; w >= 0 ; w--)
+    {
+      if (bits[w]) return ((w << 6) + 63 - count_leading_zeros (bits[w]));
+    }
+
+  return (-1);
+}
+
+
+
+static int32_t count_bits (uint64_t word)
+{
+#ifdef __GNUC__
+  return (__builtin_popcountll (word));
+#else
+  int32_t             n = 0;
+
+  for ( ; word ; n++) word &= word - 1;
+
+  return (n);
+#endif
+}
+
+
+
+/*  Return the number of occupied bins in a rectangle.  */
+
+int64_t count_occupied (OCCUPANCY *occupancy, int32_t row0, int32_t col0, int32_t rows, int32_t cols)
+{
+  uint64_t            *bits, word;
+  int32_t             i, w, first_word, last_word, col1;
+  int64_t             count = 0;
+
+
+  if (rows <= 0 || cols <= 0) return (0);
+
+  col1 = col0 + cols - 1;
+  first_word = col0 >> 6;
+  last_word = col1 >> 6;
+
+  for (i = row0 ; i < row0 + rows ; i++)
+    {
+      if (!occupancy->row_count[i]) continue;
+
+
+      /*  Whole rows are already counted.  */
+
+      if (col0 == 0 && cols == occupancy->width)
+        {
+          count += occupancy->row_count[i];
+          continue;
+        }
+
+      bits = &occupancy->bits[(int64_t) i * occupancy->words_per_row];
+
+      for (w = first_word ; w <= last_word ; w++)
+        {
+          word = bits[w];
+          if (w == first_word) word &= ~(uint64_t) 0 << (col0 & 63);
+          if (w == last_word && (col1 & 63) != 63) word &= ((uint64_t) 1 << ((col1 & 63) + 1)) - 1;
+
+          count += count_bits (word);
+        }
+    }
+
+  return (count);
+}
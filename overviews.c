@@ -0,0 +1,337 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    Overview grids (--overviews).
+
+    Each overview is a CHRTR2 file decimated by an integer factor, written next to the full resolution file with
+    _<factor>x added to the name.  A cell of an overview covers factor x factor cells of the full grid.  As write_row
+    hands over each finished row of the full grid we add its real and hand-drawn cells to one row of sums for every
+    overview and, when the last full row of an overview row has gone by, the overview row is averaged and written.
+    Z and the uncertainties are averaged with each cell weighted by its number of points, so an overview cell is the
+    same as it would be if its soundings had been binned at the coarser size.  Only one row of sums is kept per
+    overview so the overviews cost very little memory and no extra reads of the PFM.  After the full grid has been
+    interpolated each overview is interpolated the same way (see main.c).
+
+*/
+
+
+
+/*  Create the overview CHRTR2 files.  */
+
+void start_overviews (OPTIONS *options, CHRTR2_HEADER *chrtr2_header, OUTPUT *output)
+{
+  OVERVIEW            *overview;
+  int32_t             k, factor;
+
+
+  output->overviews = options->overviews;
+  output->overview = (OVERVIEW *) calloc (options->overviews, sizeof (OVERVIEW));
+
+  if (output->overview == NULL)
+    {
+      perror ("Allocating overviews in start_overviews");
+      exit (-1);
+    }
+
+  for (k = 0 ; k < options->overviews ; k++)
+    {
+      overview = &output->overview[k];
+      factor = overview->factor = options->overview[k];
+
+      if (snprintf (overview->chrtr2_file, sizeof (overview->chrtr2_file), "%.*s_%dx.ch2",
+                    (int) strlen (options->chrtr2_file) - 4, options->chrtr2_file, factor) >=
+          (int) sizeof (overview->chrtr2_file))
+        {
+          fprintf (stderr, "\n\nThe file name %s is too long for the %dx overview!\n\n", options->chrtr2_file, factor);
+          exit (-1);
+        }
+
+
+      /*  CHRTR2 is grid registered so the first overview cell is centered on its block of full resolution cells.  */
+
+      overview->chrtr2_header = *chrtr2_header;
+      overview->chrtr2_header.width = (chrtr2_header->width + factor - 1) / factor;
+      overview->chrtr2_header.height = (chrtr2_header->height + factor - 1) / factor;
+      overview->chrtr2_header.lon_grid_size_degrees = chrtr2_header->lon_grid_size_degrees * factor;
+      overview->chrtr2_header.lat_grid_size_degrees = chrtr2_header->lat_grid_size_degrees * factor;
+      overview->chrtr2_header.mbr.wlon = chrtr2_header->mbr.wlon + (factor - 1) * chrtr2_header->lon_grid_size_degrees / 2.0;
+      overview->chrtr2_header.mbr.slat = chrtr2_header->mbr.slat + (factor - 1) * chrtr2_header->lat_grid_size_degrees / 2.0;
+      overview->chrtr2_header.mbr.elon = overview->chrtr2_header.mbr.wlon + (overview->chrtr2_header.width - 1) *
+        overview->chrtr2_header.lon_grid_size_degrees;
+      overview->chrtr2_header.mbr.nlat = overview->chrtr2_header.mbr.slat + (overview->chrtr2_header.height - 1) *
+        overview->chrtr2_header.lat_grid_size_degrees;
+
+      overview->chrtr2_handle = chrtr2_create_file (overview->chrtr2_file, &overview->chrtr2_header);
+      if (overview->chrtr2_handle < 0)
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+
+      if (chrtr2_read_record_row_col (overview->chrtr2_handle, 0, 0, &overview->null_record))
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+
+      allocate_occupancy (overview->chrtr2_header.width, overview->chrtr2_header.height, &overview->occupancy);
+
+      overview->weight = (double *) calloc (overview->chrtr2_header.width, sizeof (double));
+      overview->z_sum = (double *) calloc (overview->chrtr2_header.width, sizeof (double));
+      overview->u_weight = (double *) calloc (overview->chrtr2_header.width, sizeof (double));
+      overview->u_sum = (double *) calloc (overview->chrtr2_header.width, sizeof (double));
+      overview->h_sum = (double *) calloc (overview->chrtr2_header.width, sizeof (double));
+      overview->v_sum = (double *) calloc (overview->chrtr2_header.width, sizeof (double));
+      overview->points = (int64_t *) calloc (overview->chrtr2_header.width, sizeof (int64_t));
+      overview->status = (uint16_t *) calloc (overview->chrtr2_header.width, sizeof (uint16_t));
+      overview->chrtr2_row = (CHRTR2_RECORD *) malloc (overview->chrtr2_header.width * sizeof (CHRTR2_RECORD));
+
+      if (overview->weight == NULL || overview->z_sum == NULL || overview->u_weight == NULL || overview->u_sum == NULL ||
+          overview->h_sum == NULL || overview->v_sum == NULL || overview->points == NULL || overview->status == NULL ||
+          overview->chrtr2_row == NULL)
+        {
+          perror ("Allocating overview row in start_overviews");
+          exit (-1);
+        }
+
+      overview->min_z = 9999999999.0;
+      overview->max_z = -9999999999.0;
+    }
+}
+
+
+
+/*  Average and write the row of sums for an overview and clear them for the next row.  */
+
+static void flush_overview_row (OVERVIEW *overview, int32_t row)
+{
+  CHRTR2_RECORD       *record;
+  int32_t             j, end_col, width;
+
+
+  width = overview->chrtr2_header.width;
+
+  for (j = 0 ; j < width ; j++)
+    {
+      if (overview->weight[j] == 0.0) continue;
+
+      record = &overview->chrtr2_row[j];
+
+      memset (record, 0, sizeof (CHRTR2_RECORD));
+
+      record->z = overview->z_sum[j] / overview->weight[j];
+      record->number_of_points = MIN (overview->points[j], (int64_t) overview->chrtr2_header.max_number_of_points);
+      record->horizontal_uncertainty = overview->h_sum[j] / overview->weight[j];
+      record->vertical_uncertainty = overview->v_sum[j] / overview->weight[j];
+
+
+      /*  Cells whose uncertainty was out of bounds don't count towards it.  */
+
+      if (overview->u_weight[j] > 0.0)
+        {
+          record->uncertainty = overview->u_sum[j] / overview->u_weight[j];
+        }
+      else
+        {
+          record->uncertainty = CHRTR2_NULL_Z_VALUE;
+        }
+
+      if (overview->status[j] & CHRTR2_REAL)
+        {
+          record->status = CHRTR2_REAL;
+        }
+      else
+        {
+          record->status = CHRTR2_DIGITIZED_CONTOUR;
+        }
+
+      set_occupied (&overview->occupancy, row, j);
+
+      overview->min_z = MIN (record->z, overview->min_z);
+      overview->max_z = MAX (record->z, overview->max_z);
+    }
+
+
+  /*  Write each run of populated cells with one call as write_row does.  */
+
+  for (j = 0 ; j < width ; j = end_col)
+    {
+      if (overview->weight[j] == 0.0)
+        {
+          end_col = j + 1;
+          continue;
+        }
+
+      for (end_col = j + 1 ; end_col < width && overview->weight[end_col] != 0.0 ; end_col++);
+
+      count_calls (CALL_CHRTR2_WRITE_ROW, 1);
+      if (chrtr2_write_row (overview->chrtr2_handle, row, j, end_col - j, &overview->chrtr2_row[j]))
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+    }
+
+  memset (overview->weight, 0, width * sizeof (double));
+  memset (overview->z_sum, 0, width * sizeof (double));
+  memset (overview->u_weight, 0, width * sizeof (double));
+  memset (overview->u_sum, 0, width * sizeof (double));
+  memset (overview->h_sum, 0, width * sizeof (double));
+  memset (overview->v_sum, 0, width * sizeof (double));
+  memset (overview->points, 0, width * sizeof (int64_t));
+  memset (overview->status, 0, width * sizeof (uint16_t));
+}
+
+
+
+/*  Add a finished row of the full grid to every overview.  Rows have to come in order, which they always do from
+    write_row.  */
+
+void add_overview_row (OUTPUT *output, ROW_BUFFER *row)
+{
+  OVERVIEW            *overview;
+  CHRTR2_RECORD       *record;
+  int32_t             j, k, col;
+  double              weight;
+
+
+  for (k = 0 ; k < output->overviews ; k++)
+    {
+      overview = &output->overview[k];
+
+      for (j = 0 ; j < row->width ; j++)
+        {
+          if (!row->populated[j]) continue;
+
+          record = &row->chrtr2_row[j];
+          col = j / overview->factor;
+          weight = (double) MAX (record->number_of_points, 1);
+
+          overview->weight[col] += weight;
+          overview->z_sum[col] += weight * record->z;
+          overview->h_sum[col] += weight * record->horizontal_uncertainty;
+          overview->v_sum[col] += weight * record->vertical_uncertainty;
+          overview->points[col] += record->number_of_points;
+          overview->status[col] |= record->status;
+
+          if (record->uncertainty != CHRTR2_NULL_Z_VALUE)
+            {
+              overview->u_weight[col] += weight;
+              overview->u_sum[col] += weight * record->uncertainty;
+            }
+        }
+
+      if (row->row % overview->factor == overview->factor - 1 || row->row == output->occupancy->height - 1)
+        flush_overview_row (overview, row->row / overview->factor);
+    }
+}
+
+
+
+/*  Set the observed Z range and close and reopen an overview so that it can be interpolated.  */
+
+void reopen_overview (OVERVIEW *overview)
+{
+  overview->chrtr2_header.min_observed_z = overview->min_z;
+  overview->chrtr2_header.max_observed_z = overview->max_z;
+
+  chrtr2_update_header (overview->chrtr2_handle, overview->chrtr2_header);
+
+  chrtr2_close_file (overview->chrtr2_handle);
+
+  overview->chrtr2_handle = chrtr2_open_file (overview->chrtr2_file, &overview->chrtr2_header, CHRTR2_UPDATE);
+
+  if (overview->chrtr2_handle < 0)
+    {
+      fprintf (stderr, "The file %s is not a CHRTR2 structure or there was an error reading the file.\n",
+               overview->chrtr2_file);
+      fprintf (stderr, "The error message returned was: %s\n\n", chrtr2_strerror ());
+      exit (-1);
+    }
+}
+
+
+
+/*  The gridding options for an overview.  Distances given in cells are scaled so that they cover the same ground as
+    they do in the full grid.  */
+
+void overview_options (OPTIONS *options, int32_t factor, OPTIONS *overview_options)
+{
+  *overview_options = *options;
+
+  overview_options->search_radius = MAX (1, options->search_radius / factor);
+
+  if (options->max_fill_distance > 0.0)
+    overview_options->max_fill_distance = MAX (1.0, options->max_fill_distance / (double) factor);
+}
+
+
+
+void free_overviews (OUTPUT *output)
+{
+  OVERVIEW            *overview;
+  int32_t             k;
+
+
+  for (k = 0 ; k < output->overviews ; k++)
+    {
+      overview = &output->overview[k];
+
+      free_occupancy (&overview->occupancy);
+      free (overview->weight);
+      free (overview->z_sum);
+      free (overview->u_weight);
+      free (overview->u_sum);
+      free (overview->h_sum);
+      free (overview->v_sum);
+      free (overview->points);
+      free (overview->status);
+      free (overview->chrtr2_row);
+    }
+
+  free (output->overview);
+
+  output->overview = NULL;
+  output->overviews = 0;
+}
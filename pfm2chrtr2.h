@@ -0,0 +1,561 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+#ifndef __PFM2CHRTR2_H__
+#define __PFM2CHRTR2_H__
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <memory.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "nvutility.h"
+#include "globals.hpp"
+
+#include "pfm.h"
+#include "chrtr2.h"
+#include "chrtr2_shared.h"
+
+
+/*  Default width of the overlap around MISP tiles.  This is twice the MISP search radius.  */
+
+#define         DEFAULT_MISP_HALO 40
+
+
+/*  Default search radius in cells for the inverse distance gridding (--grid_type G).  */
+
+#define         DEFAULT_SEARCH_RADIUS 20
+
+
+/*  Bytes that MISP needs for each cell of the area that it grids and for each data point (including our copy of the
+    point) for --max_memory.  These were measured with bench/misp_memory.sh (20.0 per cell, 24.0 per point, and a
+    fixed 360KB or so that we ignore) against the stand-in MISP in bench/standin since that is the library the
+    checks build with.  Run misp_memory.sh against the real MISP library and put its fit here before trusting
+    --max_memory with it.  */
+
+#define         MISP_CELL_BYTES 20
+#define         MISP_POINT_BYTES 24
+
+
+/*  Target number of bins in a band of rows for the threaded aggregation (see aggregate_threads.c).  */
+
+#define         BAND_BINS 16384
+
+
+/*  Rows in the inverse distance gridding's ring of finished rows per thread (see idw_surface.c).  */
+
+#define         IDW_RING_ROWS 4
+
+
+/*  Stage timers and library call counters (see timing.c).  */
+
+#define         STAGE_CREATE    0
+#define         STAGE_SCAN      1
+#define         STAGE_AGGREGATE 2
+#define         STAGE_REOPEN    3
+#define         STAGE_LOAD      4
+#define         STAGE_SOLVE     5
+#define         STAGE_WRITEBACK 6
+#define         STAGE_FINISH    7
+#define         STAGES          8
+
+#define         CALL_READ_BIN_ROW     0
+#define         CALL_READ_DEPTH_ARRAY 1
+#define         CALL_CHRTR2_READ_ROW  2
+#define         CALL_CHRTR2_WRITE_ROW 3
+#define         CALL_MISP_LOAD        4
+#define         CALL_MISP_PROC        5
+#define         CALL_MISP_RTRV        6
+#define         CALLS                 7
+
+
+typedef struct
+{
+  double          wall;
+  double          cpu;
+} STAGE_MARK;
+
+
+typedef struct
+{
+  double          wall[STAGES];            /*  Seconds  */
+  double          cpu[STAGES];             /*  Seconds  */
+  int64_t         calls[CALLS];
+} STAGE_STATS;
+
+
+/*  What was processed, for the rates.  */
+
+typedef struct
+{
+  int64_t         bins;                    /*  Bins with data  */
+  int64_t         soundings;               /*  Depth records read  */
+  int64_t         rejected;                /*  Depth records read that didn't go into a CHRTR2 record  */
+  int64_t         cells;                   /*  Cells in the grid  */
+} RUN_COUNTS;
+
+
+/*  Part of the PFM to convert (--mbr or --window, see window.c).  */
+
+#define         SUB_AREA_NONE   0
+#define         SUB_AREA_MBR    1
+#define         SUB_AREA_WINDOW 2
+
+
+/*  Most overview grids that can be built in one run (--overviews).  */
+
+#define         MAX_OVERVIEWS 8
+
+
+/*  Another output built from the same bin sums with its own settings (--variant, see variants.c).  */
+
+#define         MAX_VARIANTS 8
+
+typedef struct
+{
+  int32_t         ubound;                  /*  Maximum total uncertainty as a percentage of depth  */
+  int32_t         uncertainty;             /*  NVTrue or NVFalse to store H/V uncertainty, -1 is the same as the main output  */
+  int32_t         grid_type;               /*  0 - none, 1 - MISP, 2 - G, -1 is the same as the main output  */
+  char            chrtr2_file[512];
+} VARIANT_SPEC;
+
+
+/*  Command line options that the processing functions need to see.  */
+
+typedef struct
+{
+  uint8_t         uncertainty;             /*  NVFalse if H/V uncertainty is not being stored (--no_uncertainty)  */
+  int32_t         grid_type;               /*  0 - none, 1 - MISP, 2 - G  */
+  int32_t         ubound;                  /*  Maximum total uncertainty as a percentage of depth  */
+  int32_t         threads;                 /*  Number of aggregation threads (--threads), 1 is serial  */
+  int32_t         read_ahead;              /*  Rows to prefetch in the pipelined mode (--read_ahead), 0 is off  */
+  uint8_t         in_memory;               /*  Keep the aggregated grid in memory for MISP (--in_memory)  */
+  uint8_t         bin_layer;               /*  Build the grid from the bin records only (--bin_layer)  */
+  int32_t         misp_tile;               /*  Core size of the MISP tiles in cells (--misp_tile), 0 is untiled  */
+  int32_t         misp_halo;               /*  Overlap around each MISP tile in cells (--misp_halo)  */
+  int64_t         max_memory;              /*  Memory budget in bytes (--max_memory), 0 is no limit  */
+  double          max_fill_distance;       /*  Only fill cells this many cells from data (--max_fill_distance), 0 is off  */
+  uint8_t         update;                  /*  Only redo the tiles edited since the last run (--update)  */
+  uint8_t         manifest;                /*  Save CHRTR2_FILE.manifest for a later --update (--manifest)  */
+  int32_t         search_radius;           /*  Search radius in cells for --grid_type G (--search_radius)  */
+  int64_t         misp_window;             /*  Largest area in cells that MISP may grid at once, 0 is no limit  */
+  int32_t         band_rows;               /*  Rows per band for the threaded aggregation, 0 is BAND_BINS worth  */
+  int32_t         checkpoint;              /*  Seconds between checkpoints (--checkpoint), 0 is off  */
+  uint8_t         resume;                  /*  Pick up an interrupted conversion (--resume)  */
+  uint8_t         timing;                  /*  Report the stage times and rates (--timing)  */
+  int32_t         sub_area;                /*  SUB_AREA_NONE, SUB_AREA_MBR, or SUB_AREA_WINDOW  */
+  NV_F64_XYMBR    mbr;                     /*  Area to convert in degrees (--mbr)  */
+  int32_t         window[4];               /*  First row, first column, rows, and columns to convert (--window)  */
+  int32_t         margin;                  /*  Cells around the area used for the gridding (--margin), -1 is default  */
+  int32_t         pfm_row0;                /*  PFM row and column of the first bin of the grid  */
+  int32_t         pfm_col0;
+  int32_t         overviews;               /*  Number of overview grids (--overviews), 0 is off  */
+  int32_t         overview[MAX_OVERVIEWS]; /*  Decimation factor of each overview  */
+  int32_t         variants;                /*  Number of --variant outputs, 0 is off  */
+  VARIANT_SPEC    variant[MAX_VARIANTS];
+  uint8_t         sum_uncertainty;         /*  Sum H/V uncertainty for a --variant even if it isn't stored here  */
+  char            stats_file[512];         /*  JSON run report (--stats), empty is off  */
+  char            batch_file[512];         /*  List of conversions to run (--batch), empty is off  */
+  char            stream_file[512];        /*  Raw grid stream (--stream), - is standard output, empty is off  */
+  char            geotiff_file[512];       /*  Cloud Optimized GeoTIFF copy of the output (--geotiff), empty is off  */
+  char            tile_cache[512];         /*  MISP tile cache directory (--tile_cache), empty is off  */
+  char            pfm_file[512];           /*  Input PFM list file  */
+  char            chrtr2_file[512];        /*  Output CHRTR2 file  */
+} OPTIONS;
+
+
+/*  The fields of the depth records that we need, in structure-of-arrays form for the summing kernels.  A row's
+    worth of bins is appended to the same buffers, which are owned by the caller and only ever grow.  */
+
+typedef struct
+{
+  int64_t         size;                    /*  Number of records the buffers can hold  */
+  int64_t         count;                   /*  Number of records in the buffers  */
+  double          *z;
+  float           *v;                      /*  Vertical error  */
+  float           *h;                      /*  Horizontal error  */
+  uint32_t        *validity;
+} DEPTH_SOA;
+
+
+/*  Sums of the valid records in a bin.  */
+
+typedef struct
+{
+  double          sum;                     /*  Sum of Z  */
+  double          v_sum;                   /*  Sum of vertical error  */
+  double          h_sum;                   /*  Sum of horizontal error  */
+  int32_t         count;                   /*  Number of valid records  */
+  uint8_t         drawn;                   /*  NVTrue if any valid record is a hand-drawn contour  */
+} BIN_SUMS;
+
+
+/*  One row of bins on its way from the PFM file to the CHRTR2 file.  */
+
+typedef struct
+{
+  int32_t         row;                     /*  Row number in the PFM/CHRTR2  */
+  int32_t         width;                   /*  Number of bins in the row  */
+  BIN_RECORD      *bin_row;                /*  Bin records read from the PFM  */
+  CHRTR2_RECORD   *chrtr2_row;             /*  Aggregated CHRTR2 records  */
+  uint8_t         *populated;              /*  NVTrue if the matching CHRTR2 record needs to be written  */
+  int64_t         *offset;                 /*  Start of each bin's records in depths  */
+  int32_t         *numrecs;                /*  Number of records read for each bin (0 for empty bins)  */
+  DEPTH_SOA       depths;                  /*  Depth records for the row, read by read_row  */
+  BIN_SUMS        *sums;                   /*  Sums of each occupied bin, kept for the --variant outputs  */
+  int64_t         valid;                   /*  Depth records that went into the CHRTR2 records  */
+  float           min_z;                   /*  Minimum aggregated Z in the row  */
+  float           max_z;                   /*  Maximum aggregated Z in the row  */
+} ROW_BUFFER;
+
+
+/*  Z and status of every cell, kept in memory so that MISP doesn't have to read the CHRTR2 file back in.  */
+
+typedef struct
+{
+  int32_t         width;
+  int32_t         height;
+  float           *z;
+  uint16_t        *status;
+  CHRTR2_RECORD   null_record;             /*  Record that chrtr2_create_file stored in the unwritten cells  */
+} GRID;
+
+
+/*  Bitmap of the bins that have data along with per-row and per-tile counts (see occupancy.c).  */
+
+#define         OCCUPANCY_TILE 64
+
+typedef struct
+{
+  int32_t         width;
+  int32_t         height;
+  int32_t         words_per_row;           /*  Each row starts on a new 64 bit word  */
+  uint64_t        *bits;
+  int32_t         *row_count;              /*  Occupied bins in each row  */
+  int32_t         tiles_x;
+  int32_t         tiles_y;
+  int32_t         *tile_count;             /*  Occupied bins in each OCCUPANCY_TILE square tile  */
+  int64_t         total;                   /*  Total occupied bins  */
+  uint64_t        *tile_hash;              /*  Hash of the bin records in each tile (build_occupancy only)  */
+  int64_t         row_soundings;           /*  Most soundings in any row (an upper bound for a mosaic)  */
+  int64_t         data_bins;               /*  Bins with PFM_DATA set (total is only the ones with records at the end)  */
+  uint8_t         deferred;                /*  NVTrue if write_row builds the bitmap (see defer_occupancy)  */
+} OCCUPANCY;
+
+
+/*  Progress of an interrupted conversion (see checkpoint.c).  */
+
+#define         CHECKPOINT_AGGREGATE   0
+#define         CHECKPOINT_INTERPOLATE 1
+
+#define         PFM_STAMP_FILES        3   /*  List, bin, and index files  */
+
+typedef struct
+{
+  OPTIONS         *options;
+  int32_t         width;
+  int32_t         height;
+  CHRTR2_RECORD   null_record;             /*  Record that chrtr2_create_file stored in the unwritten cells  */
+  int64_t         pfm_stamp[PFM_STAMP_FILES * 2];  /*  Size and modification time of each PFM file  */
+  int32_t         interval;                /*  Seconds between checkpoints (--checkpoint)  */
+  time_t          last;                    /*  Time of the last checkpoint  */
+  int32_t         stage;                   /*  CHECKPOINT_AGGREGATE or CHECKPOINT_INTERPOLATE  */
+  int32_t         rows_done;               /*  Rows aggregated and flushed to the CHRTR2 file  */
+  float           min_z;                   /*  Minimum Z of the rows done  */
+  float           max_z;                   /*  Maximum Z of the rows done  */
+  int32_t         tiles;                   /*  Number of occupancy tiles  */
+  float           *tile_min_z;
+  float           *tile_max_z;
+  int32_t         units;                   /*  Number of units of gridding work (MISP tiles or rows)  */
+  uint8_t         *done;                   /*  NVTrue for each unit that has been stored  */
+} CHECKPOINT;
+
+
+/*  Raw grid stream (see stream.c).  */
+
+typedef struct
+{
+  FILE            *fp;
+  int32_t         width;
+  uint8_t         *buffer;                 /*  One packed row  */
+} STREAM;
+
+
+/*  What the interpolation stages need to read the input data and fill in the NULL cells (see misp_surface.c).  */
+
+typedef struct
+{
+  int32_t         chrtr2_handle;
+  CHRTR2_HEADER   *chrtr2_header;
+  GRID            *grid;                   /*  In-memory grid or NULL to read the CHRTR2 file  */
+  OCCUPANCY       *occupancy;              /*  Marks the real and hand-drawn cells  */
+  CHRTR2_RECORD   null_record;             /*  Record that chrtr2_create_file stored in the unwritten cells  */
+  CHRTR2_RECORD   *chrtr2_row;             /*  Row sized scratch buffer  */
+  uint8_t         *was_null;               /*  Row sized scratch buffer  */
+  OCCUPANCY       *fill_mask;              /*  Cells that may be filled (--max_fill_distance) or NULL for all  */
+  uint8_t         *dirty_tile;             /*  Occupancy tiles changed by --update or NULL for a full run  */
+  CHECKPOINT      *checkpoint;             /*  NULL unless --checkpoint or --resume  */
+  STREAM          *stream;                 /*  NULL unless the rows are streamed as they're filled in  */
+  int32_t         streamed;                /*  Rows that have gone out on the stream  */
+  CHRTR2_RECORD   *stream_row;             /*  Row sized scratch buffers for the stream  */
+  uint8_t         *populated;
+} SURFACE;
+
+
+/*  Key for the MISP tile cache (see tile_cache.c).  */
+
+typedef struct
+{
+  uint64_t        hash[2];
+} TILE_KEY;
+
+
+/*  What was saved about the last conversion for --update (see update.c).  */
+
+typedef struct
+{
+  int32_t         width;
+  int32_t         height;
+  int32_t         tiles_x;
+  int32_t         tiles_y;
+  CHRTR2_RECORD   null_record;             /*  Record that chrtr2_create_file stored in the unwritten cells  */
+  uint64_t        *tile_hash;              /*  Hash of the bin records in each occupancy tile  */
+  int32_t         *tile_count;             /*  Real and hand-drawn cells in each tile  */
+  float           *tile_min_z;
+  float           *tile_max_z;
+} MANIFEST;
+
+
+/*  A decimated copy of the grid that is built as the rows are written (see overviews.c).  */
+
+typedef struct
+{
+  int32_t         factor;
+  char            chrtr2_file[512];
+  int32_t         chrtr2_handle;
+  CHRTR2_HEADER   chrtr2_header;
+  CHRTR2_RECORD   null_record;             /*  Record that chrtr2_create_file stored in the unwritten cells  */
+  OCCUPANCY       occupancy;               /*  Real and hand-drawn overview cells  */
+  double          *weight;                 /*  Sums for one overview row, weighted by number of points  */
+  double          *z_sum;
+  double          *u_weight;               /*  Weight of the cells that had a total uncertainty  */
+  double          *u_sum;
+  double          *h_sum;
+  double          *v_sum;
+  int64_t         *points;
+  uint16_t        *status;
+  CHRTR2_RECORD   *chrtr2_row;
+  float           min_z;
+  float           max_z;
+} OVERVIEW;
+
+
+/*  One of the --variant outputs.  */
+
+typedef struct
+{
+  OPTIONS         options;                 /*  Copy of the options with this variant's settings  */
+  int32_t         chrtr2_handle;
+  CHRTR2_HEADER   chrtr2_header;
+  CHRTR2_RECORD   null_record;             /*  Record that chrtr2_create_file stored in the unwritten cells  */
+  CHRTR2_RECORD   *chrtr2_row;
+  uint8_t         *populated;
+} VARIANT;
+
+
+/*  Where the aggregated rows go.  */
+
+typedef struct
+{
+  int32_t         chrtr2_handle;
+  GRID            *grid;                   /*  NULL unless --in_memory was requested  */
+  OCCUPANCY       *occupancy;              /*  Bins that don't produce a record are cleared as rows are written  */
+  float           min_z;                   /*  Running minimum Z of the written rows  */
+  float           max_z;                   /*  Running maximum Z of the written rows  */
+  float           *tile_min_z;             /*  Minimum Z in each occupancy tile, for the manifest  */
+  float           *tile_max_z;             /*  Maximum Z in each occupancy tile, for the manifest  */
+  int32_t         first_row;               /*  First row to aggregate, non-zero after --resume  */
+  int64_t         soundings;               /*  Depth records read for the written rows  */
+  int64_t         rejected;                /*  Depth records read that didn't go into a CHRTR2 record  */
+  CHECKPOINT      *checkpoint;             /*  NULL unless --checkpoint or --resume  */
+  int32_t         overviews;
+  OVERVIEW        *overview;               /*  NULL unless --overviews  */
+  int32_t         variants;
+  VARIANT         *variant;                /*  NULL unless --variant  */
+  STREAM          *stream;                 /*  NULL unless --stream and the rows are final as they're written  */
+} OUTPUT;
+
+
+/*  Several PFM files being merged into one CHRTR2 file (see mosaic.c).  */
+
+typedef struct
+{
+  PFM_OPEN_ARGS   open_args;
+  int32_t         pfm_handle;
+  int32_t         row0;                    /*  Where the input's first row and column are in the output grid  */
+  int32_t         col0;
+  OCCUPANCY       occupancy;               /*  Bins that have data in the input's own grid  */
+} MOSAIC_INPUT;
+
+
+typedef struct
+{
+  int32_t         count;                   /*  0 unless there is more than one PFM file  */
+  MOSAIC_INPUT    *input;
+} MOSAIC;
+
+
+void allocate_row_buffer (ROW_BUFFER *row, int32_t width);
+void free_row_buffer (ROW_BUFFER *row);
+int64_t read_depths (int32_t pfm_handle, NV_I32_COORD2 coord, DEPTH_SOA *soa, int32_t *numrecs);
+void depth_soa_slice (DEPTH_SOA *soa, int64_t offset, int32_t numrecs, DEPTH_SOA *slice);
+int64_t copy_depths (DEPTH_SOA *from, int64_t offset, int32_t numrecs, DEPTH_SOA *to);
+void sum_depths (DEPTH_SOA *soa, uint8_t uncertainty, BIN_SUMS *sums);
+void free_depth_soa (DEPTH_SOA *soa);
+int32_t bin_sums_record (BIN_SUMS *sums, BIN_RECORD *bin_record, OPTIONS *options, CHRTR2_HEADER *chrtr2_header,
+                         CHRTR2_RECORD *chrtr2_record);
+int32_t aggregate_bin (DEPTH_SOA *depths, BIN_RECORD *bin_record, OPTIONS *options, CHRTR2_HEADER *chrtr2_header,
+                       BIN_SUMS *sums, CHRTR2_RECORD *chrtr2_record);
+void uncertainty_header (uint8_t uncertainty, PFM_OPEN_ARGS *open_args, CHRTR2_HEADER *chrtr2_header);
+void grid_type_header (int32_t grid_type, CHRTR2_HEADER *chrtr2_header);
+int32_t aggregate_bin_record (BIN_RECORD *bin_record, OPTIONS *options, CHRTR2_RECORD *chrtr2_record);
+void read_row (int32_t pfm_handle, int32_t row_num, OPTIONS *options, OCCUPANCY *occupancy, ROW_BUFFER *row);
+void reduce_row (OPTIONS *options, OCCUPANCY *occupancy, CHRTR2_HEADER *chrtr2_header, ROW_BUFFER *row);
+void aggregate_row (int32_t pfm_handle, int32_t row_num, OPTIONS *options, OCCUPANCY *occupancy,
+                    CHRTR2_HEADER *chrtr2_header, ROW_BUFFER *row);
+void write_row (OUTPUT *output, ROW_BUFFER *row);
+void allocate_grid (GRID *grid, int32_t width, int32_t height);
+void free_grid (GRID *grid);
+void aggregate_threaded (OPTIONS *options, PFM_OPEN_ARGS *open_args, CHRTR2_HEADER *chrtr2_header, OUTPUT *output);
+void aggregate_pipelined (OPTIONS *options, int32_t pfm_handle, PFM_OPEN_ARGS *open_args, CHRTR2_HEADER *chrtr2_header,
+                          OUTPUT *output);
+void allocate_occupancy (int32_t width, int32_t height, OCCUPANCY *occupancy);
+void set_occupied (OCCUPANCY *occupancy, int32_t row, int32_t col);
+void build_occupancy (int32_t pfm_handle, int32_t row0, int32_t col0, int32_t width, int32_t height, OCCUPANCY *occupancy);
+void defer_occupancy (int32_t width, int32_t height, OCCUPANCY *occupancy);
+void add_occupancy_row (OCCUPANCY *occupancy, int32_t row, BIN_RECORD *bin_row, uint8_t *populated);
+void free_occupancy (OCCUPANCY *occupancy);
+uint8_t is_occupied (OCCUPANCY *occupancy, int32_t row, int32_t col);
+void clear_occupied (OCCUPANCY *occupancy, int32_t row, int32_t col);
+int32_t next_occupied (OCCUPANCY *occupancy, int32_t row, int32_t col);
+int32_t next_empty (OCCUPANCY *occupancy, int32_t row, int32_t col);
+int32_t last_occupied (OCCUPANCY *occupancy, int32_t row);
+int64_t count_occupied (OCCUPANCY *occupancy, int32_t row0, int32_t col0, int32_t rows, int32_t cols);
+void build_fill_mask (OCCUPANCY *occupancy, double distance, OCCUPANCY *mask);
+void open_surface (SURFACE *surface, int32_t chrtr2_handle, CHRTR2_HEADER *chrtr2_header, GRID *grid, OCCUPANCY *occupancy,
+                   CHRTR2_RECORD *null_record);
+void close_surface (SURFACE *surface);
+int64_t load_surface_points (SURFACE *surface, int32_t row0, int32_t col0, int32_t rows, int32_t cols,
+                             NV_F64_COORD3 **xyz_array);
+uint8_t surface_dirty (SURFACE *surface, int32_t row0, int32_t col0, int32_t rows, int32_t cols, int32_t reach);
+void reset_surface (SURFACE *surface, int32_t row0, int32_t col0, int32_t rows, int32_t cols);
+int64_t fillable_cells (SURFACE *surface, int32_t row0, int32_t col0, int32_t rows, int32_t cols);
+void fill_surface_row (SURFACE *surface, int32_t row, int32_t col0, int32_t cols, float *values);
+void stream_surface (SURFACE *surface, STREAM *stream);
+void stream_surface_rows (SURFACE *surface, int32_t row, int32_t col0, int32_t col1);
+int32_t run_misp (int32_t weight, NV_F64_COORD3 *xyz_array, int64_t count, int32_t rows, int32_t cols, uint8_t verbose,
+                  void (*put_row) (void *data, int32_t row, float *array), void *data);
+void misp_surface (int32_t weight, SURFACE *surface);
+void misp_tiled (OPTIONS *options, int32_t weight, SURFACE *surface);
+void plan_memory (OPTIONS *options, OCCUPANCY *occupancy, int32_t files);
+void idw_surface (OPTIONS *options, SURFACE *surface);
+void start_tile_key (TILE_KEY *key);
+void add_tile_key (TILE_KEY *key, void *data, int64_t size);
+uint8_t read_cached_tile (char *dir, TILE_KEY *key, int32_t rows, int32_t cols, float *result);
+void write_cached_tile (char *dir, TILE_KEY *key, int32_t rows, int32_t cols, float *result);
+void read_manifest (OPTIONS *options, int32_t width, int32_t height, MANIFEST *manifest);
+void free_manifest (MANIFEST *manifest);
+void remove_manifest (char *chrtr2_file);
+void write_manifest (OPTIONS *options, CHRTR2_RECORD *null_record, OUTPUT *output);
+int32_t update_aggregate (OPTIONS *options, int32_t pfm_handle, CHRTR2_HEADER *chrtr2_header, OUTPUT *output,
+                          MANIFEST *manifest, uint8_t *dirty_tile);
+void print_settings (FILE *fp, OPTIONS *options, CHRTR2_RECORD *null_record);
+uint8_t scan_settings (FILE *fp, OPTIONS *options, CHRTR2_RECORD *null_record);
+void start_checkpoint (OPTIONS *options, PFM_OPEN_ARGS *open_args, CHRTR2_RECORD *null_record, CHECKPOINT *checkpoint);
+void read_checkpoint (OPTIONS *options, PFM_OPEN_ARGS *open_args, CHECKPOINT *checkpoint);
+void attach_checkpoint (CHECKPOINT *checkpoint, OUTPUT *output);
+void resume_occupancy (int32_t chrtr2_handle, OCCUPANCY *occupancy, int32_t rows);
+void checkpoint_row (OUTPUT *output, int32_t rows_done);
+void checkpoint_stage (CHECKPOINT *checkpoint, int32_t *chrtr2_handle, float min_z, float max_z);
+void checkpoint_units (CHECKPOINT *checkpoint, int32_t units);
+void checkpoint_unit (CHECKPOINT *checkpoint, int32_t unit, int32_t *chrtr2_handle);
+void remove_checkpoint (CHECKPOINT *checkpoint);
+double stage_clock ();
+double stage_cpu (uint8_t children);
+void start_stage (STAGE_MARK *mark);
+void end_stage (int32_t stage, STAGE_MARK *mark);
+void count_calls (int32_t call, int64_t count);
+void get_stage_stats (STAGE_STATS *copy);
+void stage_stats_since (STAGE_STATS *since);
+void add_stage_stats (STAGE_STATS *more);
+uint8_t io_bytes (int64_t *bytes_read, int64_t *bytes_written);
+uint8_t peak_rss (int64_t *self_kb, int64_t *children_kb);
+void report_stage_times (FILE *fp, RUN_COUNTS *counts, double elapsed);
+void write_stats (OPTIONS *options, RUN_COUNTS *counts, double elapsed);
+int32_t run_batch (OPTIONS *options, char *program);
+int32_t pfm2chrtr2 (int32_t argc, char *argv[]);
+void open_mosaic (char **pfm_files, int32_t count, MOSAIC *mosaic, PFM_OPEN_ARGS *open_args);
+void build_mosaic_occupancy (MOSAIC *mosaic, int32_t width, int32_t height, OCCUPANCY *occupancy);
+void aggregate_mosaic (OPTIONS *options, MOSAIC *mosaic, CHRTR2_HEADER *chrtr2_header, OUTPUT *output);
+void close_mosaic (MOSAIC *mosaic);
+uint8_t plan_sub_area (OPTIONS *options, PFM_OPEN_ARGS *open_args);
+void crop_chrtr2 (OPTIONS *options, char *work_file);
+void start_overviews (OPTIONS *options, CHRTR2_HEADER *chrtr2_header, OUTPUT *output);
+void add_overview_row (OUTPUT *output, ROW_BUFFER *row);
+void reopen_overview (OVERVIEW *overview);
+void overview_options (OPTIONS *options, int32_t factor, OPTIONS *overview_options);
+void free_overviews (OUTPUT *output);
+void write_geotiff (OPTIONS *options);
+int32_t interpolate (OPTIONS *options, int32_t chrtr2_handle, CHRTR2_HEADER *chrtr2_header, GRID *grid,
+                     OCCUPANCY *occupancy, CHRTR2_RECORD *null_record, uint8_t *dirty_tile, CHECKPOINT *checkpoint,
+                     STREAM *stream);
+void start_variants (OPTIONS *options, PFM_OPEN_ARGS *open_args, CHRTR2_HEADER *chrtr2_header, OUTPUT *output);
+void add_variant_row (OUTPUT *output, ROW_BUFFER *row);
+void grid_variants (OPTIONS *options, CHRTR2_HEADER *chrtr2_header, OUTPUT *output, CHRTR2_RECORD *null_record);
+void reserve_stdout ();
+void open_stream (OPTIONS *options, CHRTR2_HEADER *chrtr2_header, STREAM *stream);
+void stream_row (STREAM *stream, CHRTR2_RECORD *chrtr2_row, uint8_t *populated);
+void close_stream (STREAM *stream);
+void stream_chrtr2 (OPTIONS *options);
+
+
+#endif
@@ -1,5 +1,5 @@
 INCLUDEPATH += /c/PFM_ABEv7.0.0_Win64/include
-LIBS += -L /c/PFM_ABEv7.0.0_Win64/lib -lpfm -lchrtr2 -lmisp -lnvutility -lgdal -lxml2 -lpoppler -lm -liconv
+LIBS += -L /c/PFM_ABEv7.0.0_Win64/lib -lpfm -lchrtr2 -lmisp -lnvutility -lgdal -lxml2 -lpoppler -lpthread -lm -liconv
 DEFINES += NVWIN3X
 CONFIG += console
 CONFIG -= qt
@@ -14,5 +14,5 @@ DEPENDPATH += .
 INCLUDEPATH += .
 
 # Input
-HEADERS += version.h
-SOURCES += main.c
+HEADERS += pfm2chrtr2.h version.h
+SOURCES += aggregate.c batch.c bin_sums.c checkpoint.c aggregate_pipeline.c aggregate_threads.c fill_mask.c geotiff.c idw_surface.c main.c misp_surface.c misp_tiles.c mosaic.c occupancy.c overviews.c stats.c stream.c tile_cache.c timing.c update.c variants.c window.c
@@ -0,0 +1,175 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "pfm2chrtr2.h"
+
+#include "version.h"
+
+
+/*
+
+    JSON run report (--stats).
+
+    This is meant to be read by job schedulers and the like so it's one JSON object with fixed key names.  Times are in
+    seconds, sizes in bytes or kilobytes as named.  The phase CPU times are for the whole process (all threads) plus
+    the MISP tile processes, the total CPU time also includes any other finished child processes.  Values that can't
+    be measured on this system are null.
+
+        {
+          "version": "...",
+          "pfm_file": "...",
+          "chrtr2_file": "...",
+          "elapsed": {"wall": 0.0, "cpu": 0.0},
+          "phases": {"create": {"wall": 0.0, "cpu": 0.0}, "scan": ..., "aggregation": ..., "reopen": ...,
+                     "load": ..., "solve": ..., "writeback": ..., "finish": ...},
+          "counts": {"bins": 0, "soundings": 0, "rejected_soundings": 0, "cells": 0},
+          "io": {"bytes_read": 0, "bytes_written": 0},
+          "calls": {"read_bin_row": 0, "read_depth_array_index": 0, "chrtr2_read_row": 0, "chrtr2_write_row": 0,
+                    "misp_load": 0, "misp_proc": 0, "misp_rtrv": 0},
+          "peak_rss_kb": 0,
+          "peak_child_rss_kb": 0
+        }
+
+*/
+
+
+static char         *phase_key[STAGES] = {"create", "scan", "aggregation", "reopen", "load", "solve", "writeback",
+                                          "finish"};
+
+static char         *call_key[CALLS] = {"read_bin_row", "read_depth_array_index", "chrtr2_read_row", "chrtr2_write_row",
+                                        "misp_load", "misp_proc", "misp_rtrv"};
+
+
+
+/*  Write a JSON string, escaping what needs it (Windows paths have backslashes).  */
+
+static void json_string (FILE *fp, char *string)
+{
+  uint8_t             *c;
+
+
+  fprintf (fp, "\"");
+
+  for (c = (uint8_t *) string ; *c ; c++)
+    {
+      if (*c == '"' || *c == '\\')
+        {
+          fprintf (fp, "\\%c", *c);
+        }
+      else if (*c < 0x20)
+        {
+          fprintf (fp, "\\u%04x", *c);
+        }
+      else
+        {
+          fputc (*c, fp);
+        }
+    }
+
+  fprintf (fp, "\"");
+}
+
+
+
+void write_stats (OPTIONS *options, RUN_COUNTS *counts, double elapsed)
+{
+  FILE                *fp;
+  STAGE_STATS         stats;
+  int64_t             bytes_read, bytes_written, self_kb, children_kb;
+  uint8_t             have_io, have_rss;
+  int32_t             i;
+
+
+  if ((fp = fopen (options->stats_file, "w")) == NULL)
+    {
+      perror (options->stats_file);
+      return;
+    }
+
+  get_stage_stats (&stats);
+  have_io = io_bytes (&bytes_read, &bytes_written);
+  have_rss = peak_rss (&self_kb, &children_kb);
+
+
+  fprintf (fp, "{\n  \"version\": ");
+  json_string (fp, VERSION);
+  fprintf (fp, ",\n  \"pfm_file\": ");
+  json_string (fp, options->pfm_file);
+  fprintf (fp, ",\n  \"chrtr2_file\": ");
+  json_string (fp, options->chrtr2_file);
+
+  fprintf (fp, ",\n  \"elapsed\": {\"wall\": %.6f, \"cpu\": %.6f},\n", elapsed, stage_cpu (NVTrue));
+
+  fprintf (fp, "  \"phases\": {");
+  for (i = 0 ; i < STAGES ; i++)
+    fprintf (fp, "%s\n    \"%s\": {\"wall\": %.6f, \"cpu\": %.6f}", i ? "," : "", phase_key[i], stats.wall[i], stats.cpu[i]);
+  fprintf (fp, "\n  },\n");
+
+  fprintf (fp, "  \"counts\": {\"bins\": %lld, \"soundings\": %lld, \"rejected_soundings\": %lld, \"cells\": %lld},\n",
+           (long long) counts->bins, (long long) counts->soundings, (long long) counts->rejected,
+           (long long) counts->cells);
+
+  if (have_io)
+    {
+      fprintf (fp, "  \"io\": {\"bytes_read\": %lld, \"bytes_written\": %lld},\n", (long long) bytes_read,
+               (long long) bytes_written);
+    }
+  else
+    {
+      fprintf (fp, "  \"io\": {\"bytes_read\": null, \"bytes_written\": null},\n");
+    }
+
+  fprintf (fp, "  \"calls\": {");
+  for (i = 0 ; i < CALLS ; i++) fprintf (fp, "%s\"%s\": %lld", i ? ", " : "", call_key[i], (long long) stats.calls[i]);
+  fprintf (fp, "},\n");
+
+  if (have_rss)
+    {
+      fprintf (fp, "  \"peak_rss_kb\": %lld,\n  \"peak_child_rss_kb\": %lld\n", (long long) self_kb,
+               (long long) children_kb);
+    }
+  else
+    {
+      fprintf (fp, "  \"peak_rss_kb\": null,\n  \"peak_child_rss_kb\": null\n");
+    }
+
+  fprintf (fp, "}\n");
+
+  if (fclose (fp)) perror (options->stats_file);
+}
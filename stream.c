@@ -0,0 +1,282 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "pfm2chrtr2.h"
+
+#ifdef NVWIN3X
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+
+/*
+
+    Raw grid stream (--stream).
+
+    The finished grid is written row by row to a file, a named pipe, or (with -) standard output so that contouring
+    and QC tools can read it without opening a CHRTR2 file.  With --grid_type N every row is final as soon as
+    write_row has it.  Otherwise the gridders fill the rows in order and stream_surface_rows (in misp_surface.c)
+    sends each one out as soon as it has been filled, with the real and hand-drawn cells read back from the
+    occupied spans of the CHRTR2 file.  Either way the rows go out while the conversion is still running and the
+    finished file isn't read again.  With a margin to crop, --update, --resume, or --variant the rows aren't final
+    (or aren't all written) in order so they're streamed from the CHRTR2 file once it's finished.  When streaming to standard
+    output anything else that gets printed there is sent to standard error instead so it can't end up in the
+    stream.
+
+    The stream is a STREAM_HEADER_BYTES byte header followed by height rows of width STREAM_RECORD_BYTES byte
+    records.  Everything is in the byte order of the machine that wrote it, which the consumer can check with the
+    byte order mark.  The header is:
+
+    <pre>
+        Offset  Bytes  Type     Contents
+        0       8      char     "CH2GRID1"
+        8       4      uint32   Byte order mark, 0x01020304
+        12      4      int32    Width (columns)
+        16      4      int32    Height (rows)
+        20      4      int32    Record size in bytes (10)
+        24      8      double   Latitude of the centers of the cells in row 0 (south)
+        32      8      double   Longitude of the centers of the cells in column 0 (west)
+        40      8      double   Latitude grid size in degrees
+        48      8      double   Longitude grid size in degrees
+        56      4      float    Null value for Z and uncertainty
+        60      4      int32    Reserved (0)
+    </pre>
+
+    The rows start at the south edge and each record is a float Z, a float total uncertainty, and a uint16 CHRTR2
+    status (0 for a cell with no value, otherwise the CHRTR2_REAL, CHRTR2_DIGITIZED_CONTOUR, and
+    CHRTR2_INTERPOLATED bits), packed with no padding.  Z and uncertainty are the null value in cells with no
+    value, and uncertainty can also be the null value where it was out of bounds.
+
+*/
+
+
+#define         STREAM_HEADER_BYTES 64
+#define         STREAM_RECORD_BYTES 10
+
+
+static int      stdout_fd = -1;
+
+
+
+/*  Keep standard output for the stream and send everything else printed there to standard error.  This has to be
+    done before anything is printed.  */
+
+void reserve_stdout ()
+{
+  fflush (stdout);
+
+#ifdef NVWIN3X
+  stdout_fd = _dup (_fileno (stdout));
+  _dup2 (_fileno (stderr), _fileno (stdout));
+  _setmode (stdout_fd, _O_BINARY);
+#else
+  stdout_fd = dup (STDOUT_FILENO);
+  dup2 (STDERR_FILENO, STDOUT_FILENO);
+#endif
+
+  if (stdout_fd < 0)
+    {
+      perror ("Reserving standard output for the stream");
+      exit (-1);
+    }
+}
+
+
+
+static void write_stream (STREAM *stream, void *data, int32_t bytes)
+{
+  if (fwrite (data, 1, bytes, stream->fp) != (size_t) bytes)
+    {
+      perror ("Writing the grid stream");
+      exit (-1);
+    }
+}
+
+
+
+/*  Open the stream and write the header.  */
+
+void open_stream (OPTIONS *options, CHRTR2_HEADER *chrtr2_header, STREAM *stream)
+{
+  uint8_t             header[STREAM_HEADER_BYTES];
+  uint32_t            byte_order = 0x01020304;
+  int32_t             record_bytes = STREAM_RECORD_BYTES;
+  float               null_z = CHRTR2_NULL_Z_VALUE;
+
+
+  if (!strcmp (options->stream_file, "-"))
+    {
+      stream->fp = fdopen (stdout_fd, "wb");
+    }
+  else
+    {
+      stream->fp = fopen (options->stream_file, "wb");
+    }
+
+  if (stream->fp == NULL)
+    {
+      perror (options->stream_file);
+      exit (-1);
+    }
+
+  stream->width = chrtr2_header->width;
+  stream->buffer = (uint8_t *) malloc ((int64_t) stream->width * STREAM_RECORD_BYTES);
+
+  if (stream->buffer == NULL)
+    {
+      perror ("Allocating stream row in open_stream");
+      exit (-1);
+    }
+
+  memset (header, 0, STREAM_HEADER_BYTES);
+  memcpy (&header[0], "CH2GRID1", 8);
+  memcpy (&header[8], &byte_order, 4);
+  memcpy (&header[12], &chrtr2_header->width, 4);
+  memcpy (&header[16], &chrtr2_header->height, 4);
+  memcpy (&header[20], &record_bytes, 4);
+  memcpy (&header[24], &chrtr2_header->mbr.slat, 8);
+  memcpy (&header[32], &chrtr2_header->mbr.wlon, 8);
+  memcpy (&header[40], &chrtr2_header->lat_grid_size_degrees, 8);
+  memcpy (&header[48], &chrtr2_header->lon_grid_size_degrees, 8);
+  memcpy (&header[56], &null_z, 4);
+
+  write_stream (stream, header, STREAM_HEADER_BYTES);
+}
+
+
+
+/*  Pack and write one row.  If populated isn't NULL only the cells it marks have a record and the rest are
+    written as null.  */
+
+void stream_row (STREAM *stream, CHRTR2_RECORD *chrtr2_row, uint8_t *populated)
+{
+  uint8_t             *cell;
+  float               z, uncertainty;
+  uint16_t            status;
+  int32_t             j;
+
+
+  for (j = 0 ; j < stream->width ; j++)
+    {
+      if ((populated == NULL || populated[j]) &&
+          (chrtr2_row[j].status & (CHRTR2_REAL | CHRTR2_DIGITIZED_CONTOUR | CHRTR2_INTERPOLATED)))
+        {
+          z = chrtr2_row[j].z;
+          uncertainty = MIN (chrtr2_row[j].uncertainty, CHRTR2_NULL_Z_VALUE);
+          status = chrtr2_row[j].status;
+        }
+      else
+        {
+          z = uncertainty = CHRTR2_NULL_Z_VALUE;
+          status = CHRTR2_NULL;
+        }
+
+      cell = &stream->buffer[(int64_t) j * STREAM_RECORD_BYTES];
+      memcpy (&cell[0], &z, 4);
+      memcpy (&cell[4], &uncertainty, 4);
+      memcpy (&cell[8], &status, 2);
+    }
+
+  write_stream (stream, stream->buffer, stream->width * STREAM_RECORD_BYTES);
+}
+
+
+
+void close_stream (STREAM *stream)
+{
+  if (fclose (stream->fp))
+    {
+      perror ("Closing the grid stream");
+      exit (-1);
+    }
+
+  free (stream->buffer);
+  stream->buffer = NULL;
+}
+
+
+
+/*  Stream the finished CHRTR2 file.  */
+
+void stream_chrtr2 (OPTIONS *options)
+{
+  STREAM              stream;
+  CHRTR2_HEADER       chrtr2_header;
+  CHRTR2_RECORD       *chrtr2_row;
+  int32_t             chrtr2_handle, i;
+
+
+  chrtr2_handle = chrtr2_open_file (options->chrtr2_file, &chrtr2_header, CHRTR2_READONLY);
+
+  if (chrtr2_handle < 0)
+    {
+      fprintf (stderr, "The file %s is not a CHRTR2 structure or there was an error reading the file.\n", options->chrtr2_file);
+      fprintf (stderr, "The error message returned was: %s\n\n", chrtr2_strerror ());
+      exit (-1);
+    }
+
+  chrtr2_row = (CHRTR2_RECORD *) malloc (chrtr2_header.width * sizeof (CHRTR2_RECORD));
+  if (chrtr2_row == NULL)
+    {
+      perror ("Allocating row in stream_chrtr2");
+      exit (-1);
+    }
+
+  open_stream (options, &chrtr2_header, &stream);
+
+  for (i = 0 ; i < chrtr2_header.height ; i++)
+    {
+      count_calls (CALL_CHRTR2_READ_ROW, 1);
+      if (chrtr2_read_row (chrtr2_handle, i, 0, chrtr2_header.width, chrtr2_row))
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+
+      stream_row (&stream, chrtr2_row, NULL);
+    }
+
+  close_stream (&stream);
+
+  free (chrtr2_row);
+
+  chrtr2_close_file (chrtr2_handle);
+}
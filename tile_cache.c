@@ -0,0 +1,174 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "pfm2chrtr2.h"
+
+#ifdef NVWIN3X
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+
+/*
+
+    On disk cache of gridded MISP tiles (--tile_cache).
+
+    Each tile's MISP result only depends on the data points in the tile plus its halo, where the core sits in that
+    window, and the gridding settings.  misp_tiled hashes all of that into a 128 bit key (two FNV-1a hashes with
+    different starting values) and, before gridding a tile, looks for a file named by the key in the cache
+    directory.  If it's there the stored result is used, otherwise the tile is gridded and the result saved.  The
+    result is the raw MISP output for the core and its blend band (NaN where MISP returned nothing), so the blending,
+    the NULL cells, and the --max_fill_distance mask are still applied when it is stored.  Nothing is ever removed from the cache.
+
+*/
+
+
+#define         TILE_CACHE_MAGIC 0x50324354
+#define         TILE_CACHE_VERSION 1
+
+#define         FNV_OFFSET 0xcbf29ce484222325LL
+#define         FNV_OFFSET_2 0x84222325cbf29ce4LL
+#define         FNV_PRIME 0x100000001b3LL
+
+
+typedef struct
+{
+  uint32_t        magic;
+  int32_t         version;
+  uint64_t        key[2];
+  int32_t         rows;
+  int32_t         cols;
+} TILE_CACHE_HEADER;
+
+
+
+void start_tile_key (TILE_KEY *key)
+{
+  int32_t             version = TILE_CACHE_VERSION;
+
+
+  key->hash[0] = FNV_OFFSET;
+  key->hash[1] = FNV_OFFSET_2;
+
+  add_tile_key (key, &version, sizeof (version));
+}
+
+
+
+void add_tile_key (TILE_KEY *key, void *data, int64_t size)
+{
+  uint8_t             *bytes = (uint8_t *) data;
+  int64_t             i;
+
+
+  for (i = 0 ; i < size ; i++)
+    {
+      key->hash[0] = (key->hash[0] ^ bytes[i]) * FNV_PRIME;
+      key->hash[1] = (key->hash[1] ^ bytes[i]) * FNV_PRIME;
+    }
+}
+
+
+
+static void tile_file_name (char *dir, TILE_KEY *key, char *name)
+{
+  sprintf (name, "%s/%016llx%016llx.tile", dir, (unsigned long long) key->hash[0], (unsigned long long) key->hash[1]);
+}
+
+
+
+/*  Look for a tile in the cache.  Returns NVTrue and fills in result if we found it.  */
+
+uint8_t read_cached_tile (char *dir, TILE_KEY *key, int32_t rows, int32_t cols, float *result)
+{
+  FILE                *fp;
+  char                name[1024];
+  TILE_CACHE_HEADER   header;
+  uint8_t             found = NVFalse;
+
+
+  tile_file_name (dir, key, name);
+
+  if ((fp = fopen (name, "rb")) == NULL) return (NVFalse);
+
+  if (fread (&header, sizeof (TILE_CACHE_HEADER), 1, fp) == 1 && header.magic == TILE_CACHE_MAGIC &&
+      header.version == TILE_CACHE_VERSION && header.key[0] == key->hash[0] && header.key[1] == key->hash[1] &&
+      header.rows == rows && header.cols == cols &&
+      fread (result, sizeof (float), (int64_t) rows * cols, fp) == (size_t) rows * cols) found = NVTrue;
+
+  fclose (fp);
+
+  return (found);
+}
+
+
+
+/*  Save a tile in the cache.  It's written to a temporary name and renamed so that a cache shared by several runs
+    never has a partial tile in it.  A cache we can't write to isn't fatal, we just don't save the tile.  */
+
+void write_cached_tile (char *dir, TILE_KEY *key, int32_t rows, int32_t cols, float *result)
+{
+  FILE                *fp;
+  char                name[1024], temp_name[1100];
+  TILE_CACHE_HEADER   header;
+  uint8_t             ok;
+
+
+  tile_file_name (dir, key, name);
+  sprintf (temp_name, "%s.%d.tmp", name, (int32_t) getpid ());
+
+  if ((fp = fopen (temp_name, "wb")) == NULL) return;
+
+  memset (&header, 0, sizeof (TILE_CACHE_HEADER));
+  header.magic = TILE_CACHE_MAGIC;
+  header.version = TILE_CACHE_VERSION;
+  header.key[0] = key->hash[0];
+  header.key[1] = key->hash[1];
+  header.rows = rows;
+  header.cols = cols;
+
+  ok = (fwrite (&header, sizeof (TILE_CACHE_HEADER), 1, fp) == 1 &&
+        fwrite (result, sizeof (float), (int64_t) rows * cols, fp) == (size_t) rows * cols);
+
+  if (fclose (fp)) ok = NVFalse;
+
+  if (!ok || rename (temp_name, name)) remove (temp_name);
+}
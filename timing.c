@@ -0,0 +1,310 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#ifdef NVWIN3X
+#include <sys/time.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    Stage timers and library call counters (--timing and --stats).
+
+    Each stage adds the wall clock and CPU time it spends to its timer.  The gridding stages are timed around the
+    MISP calls (misp_load, misp_proc, and misp_rtrv) and around reading the input points and writing the filled
+    cells, so the same names are used for the inverse distance gridding.  The CPU time is for the whole process so
+    it includes any aggregation or gridding threads that were working at the time.  The MISP engine is process wide
+    so these timers are too.  Tile processes started by misp_tiled send their times and counts back with their
+    results, which means that with --threads the gridding times are summed over the processes and can add up to more
+    than the elapsed time.
+
+    The library call counters are bumped from the aggregation threads so they're updated atomically.
+
+*/
+
+
+static STAGE_STATS  stats;
+
+static char         *stage_name[STAGES] = {"Create", "Bin scan", "Aggregation", "Close/reopen", "Gridding load",
+                                           "Gridding solve", "Gridding writeback", "Finish"};
+
+
+
+/*  Return the time in seconds from some arbitrary starting point.  */
+
+double stage_clock ()
+{
+#ifdef NVWIN3X
+  struct timeval      tv;
+
+  gettimeofday (&tv, NULL);
+
+  return ((double) tv.tv_sec + (double) tv.tv_usec / 1000000.0);
+#else
+  struct timespec     ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ((double) ts.tv_sec + (double) ts.tv_nsec / 1000000000.0);
+#endif
+}
+
+
+
+/*  Return the CPU time used by this process (and, if children is set, by its finished child processes).  Windows
+    doesn't give us this through the C library so we use the processor time from clock there.  */
+
+double stage_cpu (uint8_t children)
+{
+#ifdef NVWIN3X
+  return ((double) clock () / (double) CLOCKS_PER_SEC);
+#else
+  struct rusage       usage;
+  double              seconds;
+
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 + usage.ru_stime.tv_sec +
+    usage.ru_stime.tv_usec / 1000000.0;
+
+  if (children)
+    {
+      getrusage (RUSAGE_CHILDREN, &usage);
+
+      seconds += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 + usage.ru_stime.tv_sec +
+        usage.ru_stime.tv_usec / 1000000.0;
+    }
+
+  return (seconds);
+#endif
+}
+
+
+
+void start_stage (STAGE_MARK *mark)
+{
+  mark->wall = stage_clock ();
+  mark->cpu = stage_cpu (NVFalse);
+}
+
+
+
+void end_stage (int32_t stage, STAGE_MARK *mark)
+{
+  stats.wall[stage] += stage_clock () - mark->wall;
+  stats.cpu[stage] += stage_cpu (NVFalse) - mark->cpu;
+}
+
+
+
+void count_calls (int32_t call, int64_t count)
+{
+#ifdef __GNUC__
+  __sync_fetch_and_add (&stats.calls[call], count);
+#else
+  stats.calls[call] += count;
+#endif
+}
+
+
+
+void get_stage_stats (STAGE_STATS *copy)
+{
+  *copy = stats;
+}
+
+
+
+/*  Turn a copy made with get_stage_stats into what has been added since.  */
+
+void stage_stats_since (STAGE_STATS *since)
+{
+  int32_t             i;
+
+
+  for (i = 0 ; i < STAGES ; i++)
+    {
+      since->wall[i] = stats.wall[i] - since->wall[i];
+      since->cpu[i] = stats.cpu[i] - since->cpu[i];
+    }
+
+  for (i = 0 ; i < CALLS ; i++) since->calls[i] = stats.calls[i] - since->calls[i];
+}
+
+
+
+/*  Add the stats sent back by a tile process.  */
+
+void add_stage_stats (STAGE_STATS *more)
+{
+  int32_t             i;
+
+
+  for (i = 0 ; i < STAGES ; i++)
+    {
+      stats.wall[i] += more->wall[i];
+      stats.cpu[i] += more->cpu[i];
+    }
+
+  for (i = 0 ; i < CALLS ; i++) stats.calls[i] += more->calls[i];
+}
+
+
+
+/*  Bytes read and written by this process and its finished children, from /proc on Linux.  Returns NVFalse if we
+    can't tell.  */
+
+uint8_t io_bytes (int64_t *bytes_read, int64_t *bytes_written)
+{
+  FILE                *fp;
+  char                string[256];
+  long long           value;
+  uint8_t             found = 0;
+
+
+  *bytes_read = *bytes_written = 0;
+
+  if ((fp = fopen ("/proc/self/io", "r")) == NULL) return (NVFalse);
+
+  while (fgets (string, sizeof (string), fp) != NULL)
+    {
+      if (sscanf (string, "rchar: %lld", &value) == 1)
+        {
+          *bytes_read = value;
+          found |= 1;
+        }
+      else if (sscanf (string, "wchar: %lld", &value) == 1)
+        {
+          *bytes_written = value;
+          found |= 2;
+        }
+    }
+
+  fclose (fp);
+
+  return (found == 3);
+}
+
+
+
+/*  Peak resident set size in kilobytes of this process and of the largest finished child.  Returns NVFalse if we
+    can't tell.  */
+
+uint8_t peak_rss (int64_t *self_kb, int64_t *children_kb)
+{
+#ifdef NVWIN3X
+  *self_kb = *children_kb = 0;
+
+  return (NVFalse);
+#else
+  struct rusage       usage;
+
+
+  getrusage (RUSAGE_SELF, &usage);
+  *self_kb = usage.ru_maxrss;
+
+  getrusage (RUSAGE_CHILDREN, &usage);
+  *children_kb = usage.ru_maxrss;
+
+  return (NVTrue);
+#endif
+}
+
+
+
+static void print_rate (FILE *fp, char *units, int64_t count, double seconds)
+{
+  if (count && seconds > 0.0) fprintf (fp, "  %14.0f %s/s", (double) count / seconds, units);
+}
+
+
+
+/*  Print the stage times and rates (--timing).  */
+
+void report_stage_times (FILE *fp, RUN_COUNTS *counts, double elapsed)
+{
+  int32_t             i;
+  double              gridding = 0.0;
+
+
+  fprintf (fp, "\n%lld bins with data, %lld soundings read, %lld rejected, %lld cells\n", (long long) counts->bins,
+           (long long) counts->soundings, (long long) counts->rejected, (long long) counts->cells);
+
+  fprintf (fp, "\nStage                     Seconds          CPU\n");
+
+  for (i = 0 ; i < STAGES ; i++)
+    {
+      fprintf (fp, "%-20s %12.3f %12.3f", stage_name[i], stats.wall[i], stats.cpu[i]);
+
+      switch (i)
+        {
+        case STAGE_SCAN:
+          print_rate (fp, "bins", counts->bins, stats.wall[i]);
+          break;
+
+        case STAGE_AGGREGATE:
+          print_rate (fp, "bins", counts->bins, stats.wall[i]);
+          print_rate (fp, "soundings", counts->soundings, stats.wall[i]);
+          break;
+
+        case STAGE_LOAD:
+        case STAGE_SOLVE:
+        case STAGE_WRITEBACK:
+          gridding += stats.wall[i];
+          break;
+        }
+
+      fprintf (fp, "\n");
+    }
+
+  if (gridding > 0.0)
+    {
+      fprintf (fp, "%-20s %12.3f %12s", "Gridding total", gridding, "");
+      print_rate (fp, "cells", counts->cells, gridding);
+      fprintf (fp, "\n");
+    }
+
+  fprintf (fp, "%-20s %12.3f %12.3f\n\n", "Elapsed", elapsed, stage_cpu (NVTrue));
+  fflush (fp);
+}
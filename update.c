@@ -0,0 +1,430 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    Run manifest and incremental update (--update).
+
+    A conversion run with --manifest leaves a small text manifest next to the CHRTR2 file (the CHRTR2 file name
+    with .manifest appended) and every --update keeps it current.  A conversion without --manifest removes any
+    old one since it would no longer match the new file.  It records the settings that affect the output, the
+    MISP window that the tile sizes were planned with, the record that chrtr2_create_file stored in the
+    unwritten cells, and for each OCCUPANCY_TILE x OCCUPANCY_TILE tile the hash of its PFM bin records (see
+    occupancy.c) along with the number of real and hand-drawn cells and their Z range.
+
+    With --update we open the existing CHRTR2 file instead of creating one, hash the bins again, and only the tiles
+    whose hash changed (any edit changes the bin values or sets PFM_MODIFIED) are cleared and aggregated again.  The
+    gridders then only redo the cells whose inputs are within reach of a changed tile (see surface_dirty).  The
+    settings are taken from the manifest so the result matches a full rebuild with the original command line.  For
+    the interpolation to stay local use --misp_tile or --grid_type G, an untiled MISP surface is always redone.
+
+*/
+
+
+#define         MANIFEST_VERSION 2
+
+
+
+static void manifest_name (char *chrtr2_file, char *name)
+{
+  sprintf (name, "%s.manifest", chrtr2_file);
+}
+
+
+
+/*  Write the settings that affect the output and the null record.  These are shared with the checkpoint file.  */
+
+void print_settings (FILE *fp, OPTIONS *options, CHRTR2_RECORD *null_record)
+{
+  fprintf (fp, "options %d %d %d %d %d %d %d %.17g\n", options->uncertainty, options->grid_type, options->ubound,
+           options->bin_layer, options->misp_tile, options->misp_halo, options->search_radius, options->max_fill_distance);
+  fprintf (fp, "null %.9g %u %.9g %.9g %.9g %d\n", null_record->z, null_record->number_of_points, null_record->uncertainty,
+           null_record->horizontal_uncertainty, null_record->vertical_uncertainty, null_record->status);
+}
+
+
+
+/*  Read back what print_settings wrote.  Returns NVFalse if it isn't there.  */
+
+uint8_t scan_settings (FILE *fp, OPTIONS *options, CHRTR2_RECORD *null_record)
+{
+  char                string[1024];
+  int32_t             status;
+
+
+  if (fgets (string, sizeof (string), fp) == NULL ||
+      sscanf (string, "options %hhu %d %d %hhu %d %d %d %lf", &options->uncertainty, &options->grid_type,
+              &options->ubound, &options->bin_layer, &options->misp_tile, &options->misp_halo, &options->search_radius,
+              &options->max_fill_distance) != 8) return (NVFalse);
+
+  if (fgets (string, sizeof (string), fp) == NULL ||
+      sscanf (string, "null %f %u %f %f %f %d", &null_record->z, &null_record->number_of_points,
+              &null_record->uncertainty, &null_record->horizontal_uncertainty, &null_record->vertical_uncertainty,
+              &status) != 6) return (NVFalse);
+
+  null_record->status = status;
+
+  return (NVTrue);
+}
+
+
+
+/*  Read the manifest for the CHRTR2 file and take the settings from it.  */
+
+void read_manifest (OPTIONS *options, int32_t width, int32_t height, MANIFEST *manifest)
+{
+  FILE                *fp;
+  char                name[1024], string[1024];
+  int32_t             i, version, tiles;
+  uint8_t             ok = NVTrue;
+  unsigned long long  hash;
+  long long           window;
+
+
+  memset (manifest, 0, sizeof (MANIFEST));
+
+  manifest_name (options->chrtr2_file, name);
+
+  if ((fp = fopen (name, "r")) == NULL)
+    {
+      perror (name);
+      fprintf (stderr, "\n\n--update needs the manifest from a previous conversion, run without --update first.\n\n");
+      exit (-1);
+    }
+
+  if (fgets (string, sizeof (string), fp) == NULL || sscanf (string, "pfm2chrtr2 manifest %d", &version) != 1 ||
+      version != MANIFEST_VERSION) ok = NVFalse;
+
+  if (ok && (fgets (string, sizeof (string), fp) == NULL ||
+             sscanf (string, "size %d %d %d %d", &manifest->width, &manifest->height, &manifest->tiles_x,
+                     &manifest->tiles_y) != 4)) ok = NVFalse;
+
+  if (ok && !scan_settings (fp, options, &manifest->null_record)) ok = NVFalse;
+
+  if (ok && (fgets (string, sizeof (string), fp) == NULL || sscanf (string, "window %lld", &window) != 1)) ok = NVFalse;
+
+  if (ok && (manifest->width != width || manifest->height != height))
+    {
+      fprintf (stderr, "\n\nThe PFM is %d x %d bins but %s was built from %d x %d bins, run without --update.\n\n", width,
+               height, options->chrtr2_file, manifest->width, manifest->height);
+      exit (-1);
+    }
+
+  if (ok)
+    {
+      tiles = manifest->tiles_x * manifest->tiles_y;
+
+      manifest->tile_hash = (uint64_t *) malloc (tiles * sizeof (uint64_t));
+      manifest->tile_count = (int32_t *) malloc (tiles * sizeof (int32_t));
+      manifest->tile_min_z = (float *) malloc (tiles * sizeof (float));
+      manifest->tile_max_z = (float *) malloc (tiles * sizeof (float));
+
+      if (manifest->tile_hash == NULL || manifest->tile_count == NULL || manifest->tile_min_z == NULL ||
+          manifest->tile_max_z == NULL)
+        {
+          perror ("Allocating tiles in read_manifest");
+          exit (-1);
+        }
+
+      for (i = 0 ; i < tiles ; i++)
+        {
+          if (fgets (string, sizeof (string), fp) == NULL ||
+              sscanf (string, "%llx %d %f %f", &hash, &manifest->tile_count[i], &manifest->tile_min_z[i],
+                      &manifest->tile_max_z[i]) != 4)
+            {
+              ok = NVFalse;
+              break;
+            }
+
+          manifest->tile_hash[i] = hash;
+        }
+    }
+
+  fclose (fp);
+
+  if (!ok)
+    {
+      fprintf (stderr, "\n\nThe manifest %s is not valid, run without --update.\n\n", name);
+      exit (-1);
+    }
+
+
+  /*  Tile sizes from the manifest win over --max_memory and the grid is never kept in memory.  plan_memory isn't run
+      for an update so the MISP window has to be the one the tiles were sized with.  */
+
+  options->misp_window = window;
+  options->in_memory = NVFalse;
+}
+
+
+
+/*  Remove the manifest for a CHRTR2 file that is being built again.  */
+
+void remove_manifest (char *chrtr2_file)
+{
+  char                name[1024];
+
+
+  manifest_name (chrtr2_file, name);
+
+  if (remove (name) && errno != ENOENT)
+    {
+      perror (name);
+      exit (-1);
+    }
+}
+
+
+
+void free_manifest (MANIFEST *manifest)
+{
+  free (manifest->tile_hash);
+  free (manifest->tile_count);
+  free (manifest->tile_min_z);
+  free (manifest->tile_max_z);
+
+  memset (manifest, 0, sizeof (MANIFEST));
+}
+
+
+
+/*  Write the manifest for this run.  It goes to a temporary file first so that a failed run doesn't leave a manifest
+    that doesn't match the CHRTR2 file.  */
+
+void write_manifest (OPTIONS *options, CHRTR2_RECORD *null_record, OUTPUT *output)
+{
+  FILE                *fp;
+  char                name[1024], temp_name[1024];
+  int32_t             i;
+  OCCUPANCY           *occupancy = output->occupancy;
+
+
+  manifest_name (options->chrtr2_file, name);
+  if (snprintf (temp_name, sizeof (temp_name), "%s.tmp", name) >= (int32_t) sizeof (temp_name))
+    {
+      fprintf (stderr, "\nThe manifest file name %s is too long.\n\n", name);
+      exit (-1);
+    }
+
+  if ((fp = fopen (temp_name, "w")) == NULL)
+    {
+      perror (temp_name);
+      exit (-1);
+    }
+
+  fprintf (fp, "pfm2chrtr2 manifest %d\n", MANIFEST_VERSION);
+  fprintf (fp, "size %d %d %d %d\n", occupancy->width, occupancy->height, occupancy->tiles_x, occupancy->tiles_y);
+  print_settings (fp, options, null_record);
+  fprintf (fp, "window %lld\n", (long long) options->misp_window);
+
+  for (i = 0 ; i < occupancy->tiles_x * occupancy->tiles_y ; i++)
+    {
+      fprintf (fp, "%016llx %d %.9g %.9g\n", (unsigned long long) occupancy->tile_hash[i], occupancy->tile_count[i],
+               output->tile_min_z[i], output->tile_max_z[i]);
+    }
+
+  if (fclose (fp) || rename (temp_name, name))
+    {
+      perror (name);
+      exit (-1);
+    }
+}
+
+
+
+/*  Aggregate the edited tiles again.  The dirty_tile array is filled in with the tiles whose bin records changed and
+    the number of them is returned.  On return the occupancy bitmap, the per-tile Z ranges, and the overall Z range
+    in the output are the same as a full run would have produced.  */
+
+int32_t update_aggregate (OPTIONS *options, int32_t pfm_handle, CHRTR2_HEADER *chrtr2_header, OUTPUT *output,
+                          MANIFEST *manifest, uint8_t *dirty_tile)
+{
+  OCCUPANCY           *occupancy = output->occupancy, work;
+  OUTPUT              work_output;
+  ROW_BUFFER          row;
+  CHRTR2_RECORD       null_row[OCCUPANCY_TILE], *chrtr2_row;
+  int32_t             i, j, k, tile, tiles, dirty = 0, row0, col0, rows, cols, percent = 0, old_percent = -1;
+
+
+  tiles = occupancy->tiles_x * occupancy->tiles_y;
+
+  chrtr2_row = (CHRTR2_RECORD *) malloc (OCCUPANCY_TILE * sizeof (CHRTR2_RECORD));
+  if (chrtr2_row == NULL)
+    {
+      perror ("Allocating row buffer in update_aggregate");
+      exit (-1);
+    }
+
+  for (j = 0 ; j < OCCUPANCY_TILE ; j++) null_row[j] = manifest->null_record;
+
+
+  /*  Find the edited tiles.  The clean ones keep the last run's Z range.  A clean tile can have bins with PFM_DATA
+      set that didn't produce a record last time (the count tells us), so we clear those from the CHRTR2 file's
+      status the same way the writer would have.  */
+
+  allocate_occupancy (occupancy->width, occupancy->height, &work);
+
+  for (tile = 0 ; tile < tiles ; tile++)
+    {
+      row0 = (tile / occupancy->tiles_x) * OCCUPANCY_TILE;
+      col0 = (tile % occupancy->tiles_x) * OCCUPANCY_TILE;
+      rows = MIN (OCCUPANCY_TILE, occupancy->height - row0);
+      cols = MIN (OCCUPANCY_TILE, occupancy->width - col0);
+
+      dirty_tile[tile] = (occupancy->tile_hash[tile] != manifest->tile_hash[tile]);
+
+      if (dirty_tile[tile])
+        {
+          dirty++;
+
+          output->tile_min_z[tile] = 9999999999.0;
+          output->tile_max_z[tile] = -9999999999.0;
+
+          for (i = row0 ; i < row0 + rows ; i++)
+            {
+              for (j = next_occupied (occupancy, i, col0) ; j < col0 + cols ; j = next_occupied (occupancy, i, j + 1))
+                set_occupied (&work, i, j);
+            }
+        }
+      else
+        {
+          output->tile_min_z[tile] = manifest->tile_min_z[tile];
+          output->tile_max_z[tile] = manifest->tile_max_z[tile];
+
+          if (occupancy->tile_count[tile] != manifest->tile_count[tile])
+            {
+              for (i = row0 ; i < row0 + rows ; i++)
+                {
+                  count_calls (CALL_CHRTR2_READ_ROW, 1);
+                  if (chrtr2_read_row (output->chrtr2_handle, i, col0, cols, chrtr2_row))
+                    {
+                      chrtr2_perror ();
+                      exit (-1);
+                    }
+
+                  for (j = 0 ; j < cols ; j++)
+                    {
+                      if (!(chrtr2_row[j].status & (CHRTR2_REAL | CHRTR2_DIGITIZED_CONTOUR)))
+                        clear_occupied (occupancy, i, col0 + j);
+                    }
+                }
+            }
+        }
+    }
+
+  fprintf (stderr, "%d of %d tiles changed since the last conversion\n", dirty, tiles);
+  fflush (stderr);
+
+
+  /*  Clear the edited tiles out of the CHRTR2 file and aggregate the bins in them again.  The work bitmap only has
+      the edited tiles in it so that is all that gets read.  */
+
+  memset (&work_output, 0, sizeof (OUTPUT));
+  work_output.chrtr2_handle = output->chrtr2_handle;
+  work_output.occupancy = &work;
+  work_output.min_z = 9999999999.0;
+  work_output.max_z = -9999999999.0;
+  work_output.tile_min_z = output->tile_min_z;
+  work_output.tile_max_z = output->tile_max_z;
+
+  allocate_row_buffer (&row, occupancy->width);
+
+  for (i = 0 ; i < occupancy->height && dirty ; i++)
+    {
+      for (k = 0, j = (i / OCCUPANCY_TILE) * occupancy->tiles_x ; j < (i / OCCUPANCY_TILE + 1) * occupancy->tiles_x ; j++)
+        {
+          if (!dirty_tile[j]) continue;
+
+          col0 = (j % occupancy->tiles_x) * OCCUPANCY_TILE;
+
+          count_calls (CALL_CHRTR2_WRITE_ROW, 1);
+          if (chrtr2_write_row (output->chrtr2_handle, i, col0, MIN (OCCUPANCY_TILE, occupancy->width - col0), null_row))
+            {
+              chrtr2_perror ();
+              exit (-1);
+            }
+
+          k++;
+        }
+
+      if (!k) continue;
+
+      aggregate_row (pfm_handle, i, options, &work, chrtr2_header, &row);
+
+      write_row (&work_output, &row);
+
+
+      /*  Drop the bins that didn't produce a record from the full bitmap too.  */
+
+      for (j = next_occupied (occupancy, i, 0) ; j < occupancy->width ; j = next_occupied (occupancy, i, j + 1))
+        {
+          if (dirty_tile[(i / OCCUPANCY_TILE) * occupancy->tiles_x + j / OCCUPANCY_TILE] && !is_occupied (&work, i, j))
+            clear_occupied (occupancy, i, j);
+        }
+
+      percent = ((float) i / (float) occupancy->height) * 100.0;
+      if (percent != old_percent)
+        {
+          fprintf (stderr, "Updating - %03d%%\r", percent);
+          fflush (stderr);
+          old_percent = percent;
+        }
+    }
+
+  free_row_buffer (&row);
+  free_occupancy (&work);
+  free (chrtr2_row);
+
+
+  /*  The overall Z range comes from the tiles.  */
+
+  for (tile = 0 ; tile < tiles ; tile++)
+    {
+      if (occupancy->tile_count[tile])
+        {
+          output->min_z = MIN (output->tile_min_z[tile], output->min_z);
+          output->max_z = MAX (output->tile_max_z[tile], output->max_z);
+        }
+    }
+
+  return (dirty);
+}
@@ -0,0 +1,404 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "pfm2chrtr2.h"
+
+#ifndef NVWIN3X
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#define         USE_FORK
+#endif
+
+
+#define         SINK_POLL_USEC 2000
+
+
+/*
+
+    Variant outputs (--variant).
+
+    A variant is another CHRTR2 file made from the same PFM with its own uncertainty bound, H/V uncertainty
+    setting, and grid type.  None of those change which soundings go into a bin or what they add up to, so the PFM
+    is read and summed once.  reduce_row keeps the sums of every bin in the row buffer (summing the H/V uncertainty
+    if any output stores it) and, as write_row hands over each finished row, every variant makes its own records
+    from those sums and writes them to its own file.  Once the aggregation is done the main output and the variants
+    are gridded in child processes since the MISP library can only do one surface per process.  As many run at once
+    as there are --threads and the threads are split between them, so that all of them together use no more than
+    --threads processes.  That also keeps them within --max_memory since plan_memory sized the MISP tiles per thread.
+    On Windows they're gridded one after another.
+
+*/
+
+
+
+/*  Create the variant CHRTR2 files.  */
+
+void start_variants (OPTIONS *options, PFM_OPEN_ARGS *open_args, CHRTR2_HEADER *chrtr2_header, OUTPUT *output)
+{
+  VARIANT             *variant;
+  VARIANT_SPEC        *spec;
+  int32_t             k;
+
+
+  output->variants = options->variants;
+  output->variant = (VARIANT *) calloc (options->variants, sizeof (VARIANT));
+
+  if (output->variant == NULL)
+    {
+      perror ("Allocating variants in start_variants");
+      exit (-1);
+    }
+
+  for (k = 0 ; k < options->variants ; k++)
+    {
+      variant = &output->variant[k];
+      spec = &options->variant[k];
+
+
+      /*  The extras (overviews, GeoTIFF, and the reports) only go with the main output.  */
+
+      variant->options = *options;
+      variant->options.variants = 0;
+      variant->options.overviews = 0;
+      variant->options.ubound = spec->ubound;
+      variant->options.uncertainty = spec->uncertainty;
+      variant->options.grid_type = spec->grid_type;
+      strcpy (variant->options.chrtr2_file, spec->chrtr2_file);
+      strcpy (variant->options.geotiff_file, "");
+      strcpy (variant->options.stats_file, "");
+
+      variant->chrtr2_header = *chrtr2_header;
+      uncertainty_header (variant->options.uncertainty, open_args, &variant->chrtr2_header);
+      grid_type_header (variant->options.grid_type, &variant->chrtr2_header);
+
+      variant->chrtr2_handle = chrtr2_create_file (variant->options.chrtr2_file, &variant->chrtr2_header);
+      if (variant->chrtr2_handle < 0)
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+
+      if (chrtr2_read_record_row_col (variant->chrtr2_handle, 0, 0, &variant->null_record))
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+
+      variant->chrtr2_row = (CHRTR2_RECORD *) malloc (chrtr2_header->width * sizeof (CHRTR2_RECORD));
+
+      if (variant->chrtr2_row == NULL)
+        {
+          perror ("Allocating variant row in start_variants");
+          exit (-1);
+        }
+    }
+}
+
+
+
+/*  Make and write every variant's records for a finished row.  The same bins are populated in all of the outputs
+    since the settings only change the values.  */
+
+void add_variant_row (OUTPUT *output, ROW_BUFFER *row)
+{
+  VARIANT             *variant;
+  int32_t             j, k, end_col;
+
+
+  for (k = 0 ; k < output->variants ; k++)
+    {
+      variant = &output->variant[k];
+
+      for (j = 0 ; j < row->width ; j++)
+        {
+          if (!row->populated[j]) continue;
+
+          if (variant->options.bin_layer)
+            {
+              aggregate_bin_record (&row->bin_row[j], &variant->options, &variant->chrtr2_row[j]);
+            }
+          else
+            {
+              bin_sums_record (&row->sums[j], &row->bin_row[j], &variant->options, &variant->chrtr2_header,
+                               &variant->chrtr2_row[j]);
+            }
+        }
+
+
+      /*  Write each run of populated cells with one call as write_row does.  */
+
+      for (j = 0 ; j < row->width ; j = end_col)
+        {
+          if (!row->populated[j])
+            {
+              end_col = j + 1;
+              continue;
+            }
+
+          for (end_col = j + 1 ; end_col < row->width && row->populated[end_col] ; end_col++);
+
+          count_calls (CALL_CHRTR2_WRITE_ROW, 1);
+          if (chrtr2_write_row (variant->chrtr2_handle, row->row, j, end_col - j, &variant->chrtr2_row[j]))
+            {
+              chrtr2_perror ();
+              exit (-1);
+            }
+        }
+    }
+}
+
+
+
+/*  Reopen one output and fill in its NULL cells.  */
+
+static void grid_output (OPTIONS *options, GRID *grid, OCCUPANCY *occupancy, CHRTR2_RECORD *null_record)
+{
+  CHRTR2_HEADER       chrtr2_header;
+  int32_t             chrtr2_handle;
+
+
+  chrtr2_handle = chrtr2_open_file (options->chrtr2_file, &chrtr2_header, CHRTR2_UPDATE);
+
+  if (chrtr2_handle < 0)
+    {
+      fprintf (stderr, "The file %s is not a CHRTR2 structure or there was an error reading the file.\n", options->chrtr2_file);
+      fprintf (stderr, "The error message returned was: %s\n\n", chrtr2_strerror ());
+      exit (-1);
+    }
+
+  chrtr2_handle = interpolate (options, chrtr2_handle, &chrtr2_header, grid, occupancy, null_record, NULL, NULL, NULL);
+
+  chrtr2_close_file (chrtr2_handle);
+}
+
+
+
+#ifdef USE_FORK
+
+/*  Wait for one of the gridding processes to finish and add in its stage times.  */
+
+static void finish_output (OPTIONS *options, OUTPUT *output, pid_t *pid, FILE **fp)
+{
+  OPTIONS             *sink_options;
+  pid_t               done = 0;
+  int                 status;
+  int32_t             k;
+  STAGE_STATS         stats;
+
+
+  while (NVTrue)
+    {
+      for (k = 0 ; k <= output->variants ; k++)
+        {
+          if (!pid[k]) continue;
+
+          done = waitpid (pid[k], &status, WNOHANG);
+
+          if (done < 0)
+            {
+              perror ("Waiting for gridding process");
+              exit (-1);
+            }
+
+          if (done) break;
+        }
+
+      if (k <= output->variants) break;
+
+      usleep (SINK_POLL_USEC);
+    }
+
+  sink_options = k ? &output->variant[k - 1].options : options;
+
+  if (!WIFEXITED (status) || WEXITSTATUS (status))
+    {
+      fprintf (stderr, "\n\nGridding %s failed!\n\n", sink_options->chrtr2_file);
+      exit (-1);
+    }
+
+  rewind (fp[k]);
+  if (fread (&stats, sizeof (STAGE_STATS), 1, fp[k]) == 1) add_stage_stats (&stats);
+
+  fclose (fp[k]);
+
+  pid[k] = 0;
+}
+
+#endif
+
+
+
+/*  Close the main output and the variants and grid them, as many at a time as --threads allows.  Slot 0 is the main
+    output.  */
+
+void grid_variants (OPTIONS *options, CHRTR2_HEADER *chrtr2_header, OUTPUT *output, CHRTR2_RECORD *null_record)
+{
+  VARIANT             *variant;
+  OPTIONS             *sink_options;
+  GRID                *grid;
+  CHRTR2_RECORD       *sink_null;
+  int32_t             k;
+#ifdef USE_FORK
+  pid_t               *pid;
+  FILE                **fp;
+  int32_t             sinks = 0, running = 0, at_once, threads;
+  STAGE_STATS         stats;
+#endif
+
+
+  chrtr2_close_file (output->chrtr2_handle);
+
+  for (k = 0 ; k < output->variants ; k++)
+    {
+      variant = &output->variant[k];
+
+      variant->chrtr2_header.min_observed_z = chrtr2_header->min_observed_z;
+      variant->chrtr2_header.max_observed_z = chrtr2_header->max_observed_z;
+
+      chrtr2_update_header (variant->chrtr2_handle, variant->chrtr2_header);
+
+      chrtr2_close_file (variant->chrtr2_handle);
+
+      free (variant->chrtr2_row);
+    }
+
+
+#ifdef USE_FORK
+  pid = (pid_t *) calloc (output->variants + 1, sizeof (pid_t));
+  fp = (FILE **) calloc (output->variants + 1, sizeof (FILE *));
+
+  if (pid == NULL || fp == NULL)
+    {
+      perror ("Allocating gridding processes in grid_variants");
+      exit (-1);
+    }
+
+
+  /*  Split the threads evenly between the outputs that run at the same time.  */
+
+  if (options->grid_type) sinks++;
+  for (k = 0 ; k < output->variants ; k++) if (output->variant[k].options.grid_type) sinks++;
+
+  at_once = MAX (1, MIN (sinks, options->threads));
+  threads = MAX (1, options->threads / at_once);
+#endif
+
+  for (k = 0 ; k <= output->variants ; k++)
+    {
+      if (k)
+        {
+          sink_options = &output->variant[k - 1].options;
+          sink_null = &output->variant[k - 1].null_record;
+          grid = NULL;
+        }
+      else
+        {
+          sink_options = options;
+          sink_null = null_record;
+          grid = output->grid;
+        }
+
+      if (!sink_options->grid_type) continue;
+
+#ifdef USE_FORK
+      if (running == at_once)
+        {
+          finish_output (options, output, pid, fp);
+          running--;
+        }
+#endif
+
+      fprintf (stderr, "Gridding %s\n", sink_options->chrtr2_file);
+      fflush (stderr);
+
+#ifdef USE_FORK
+      if ((fp[k] = tmpfile ()) == NULL)
+        {
+          perror ("Creating gridding stats file");
+          exit (-1);
+        }
+
+      fflush (stdout);
+
+      pid[k] = fork ();
+
+      if (pid[k] < 0)
+        {
+          perror ("Starting gridding process");
+          exit (-1);
+        }
+
+
+      /*  Child process.  Grid the file with its share of the threads, leave the stage times and call counts in the
+          temporary file, and get out without flushing any of the parent's buffers.  */
+
+      if (!pid[k])
+        {
+          sink_options->threads = threads;
+
+          get_stage_stats (&stats);
+
+          grid_output (sink_options, grid, output->occupancy, sink_null);
+
+          stage_stats_since (&stats);
+
+          if (fwrite (&stats, sizeof (STAGE_STATS), 1, fp[k]) != 1 || fflush (fp[k])) _exit (1);
+
+          _exit (0);
+        }
+
+      running++;
+#else
+      grid_output (sink_options, grid, output->occupancy, sink_null);
+#endif
+    }
+
+
+#ifdef USE_FORK
+  for ( ; running ; running--) finish_output (options, output, pid, fp);
+
+  free (pid);
+  free (fp);
+#endif
+
+  free (output->variant);
+  output->variant = NULL;
+  output->variants = 0;
+}
@@ -39,7 +39,7 @@
 
 #ifndef VERSION
 
-#define     VERSION     "PFM Software - pfm2chrtr2 V3.07 - 07/23/14"
+#define     VERSION     "PFM Software - pfm2chrtr2 V3.32 - 10/16/26"
 
 #endif
 
@@ -163,4 +163,214 @@
     - Switched from using the old NV_INT64 and NV_U_INT32 type definitions to the C99 standard stdint.h and
       inttypes.h sized data types (e.g. int64_t and uint32_t).
 
+
+    Version 3.08
+    PFM Software
+    10/16/26
+
+    - Read, aggregate, and write a full row of bins at a time.  Bin records are read with read_bin_row
+      and populated runs of CHRTR2 records are written with chrtr2_write_row instead of one library call per cell.
+
+
+    Version 3.09
+    PFM Software
+    10/16/26
+
+    - Added --threads option to aggregate bins on multiple threads.  Each thread has its own PFM handle and
+      takes small bands of rows from a shared queue.  The main thread writes the finished rows in order so the
+      output (including min/max Z) is identical to the serial run.
+    - Moved the row aggregation code to aggregate.c and the options to an OPTIONS structure in pfm2chrtr2.h.
+
+
+    Version 3.10
+    PFM Software
+    10/16/26
+
+    - Added --read_ahead option to run the aggregation as a reader/compute/writer pipeline.  The reader prefetches
+      bin rows and depth arrays up to the requested number of rows ahead of the writer.
+    - Split aggregate_row into read_row and reduce_row so the stages can be run separately.
+
+
+    Version 3.11
+    PFM Software
+    10/16/26
+
+    - Added --in_memory option.  The Z and status of every bin are kept in memory during aggregation and MISP is
+      loaded straight from them.  The CHRTR2 file is no longer closed and reopened and only the interpolated NULL
+      cells are written back, a run of cells at a time.
+    - Moved the MISP code to misp_surface.c.  When it does read the CHRTR2 file it now reads a row at a time.
+
+
+    Version 3.12
+    PFM Software
+    10/16/26
+
+    - Added --bin_layer option to build the CHRTR2 from the average filtered depth, standard deviation, and
+      sounding count in the PFM bin records without reading any depth records.
+
+
+    Version 3.13
+    PFM Software
+    10/16/26
+
+    - The per-bin validity filter and sums are now done by gathering the depth record fields into separate arrays
+      and summing them with an AVX2 (x86, chosen at run time), NEON (ARM), or scalar kernel.  All of the kernels
+      give identical results.
+
+
+    Version 3.14
+    PFM Software
+    10/16/26
+
+    - Depth records are now read straight into reusable per-row buffers that only grow when a denser row comes
+      along.  The array allocated by the PFM library is released as soon as it has been copied so we no longer keep
+      a row's worth of library allocated arrays around.
+
+
+    Version 3.15
+    PFM Software
+    10/16/26
+
+    - Added a pass that builds a bitmap of the occupied bins (with per-row and per-tile counts) before aggregation.
+      Empty rows and the empty ends of rows are no longer read and MISP only reads the occupied spans of the CHRTR2
+      file.  The MISP input array is now allocated once at its exact size instead of growing one point at a time and
+      the NULL cells are filled without reading them back in.  Unless a mosaic, --update, --resume, or --max_memory
+      needs the bitmap first, it is built from the bin rows that the aggregation reads so each bin row is only read
+      once (this matters most for --bin_layer, which reads nothing else).
+
+
+    Version 3.16
+    PFM Software
+    10/16/26
+
+    - Added --misp_tile and --misp_halo to grid the MISP surface in overlapping tiles.  With --threads N up to N
+      tiles are gridded at once in child processes.
+    - Neighboring tiles are blended across half the halo either side of their edges so there are no seams.
+
+
+    Version 3.17
+    PFM Software
+    10/16/26
+
+    - Added --max_memory.  The MISP tile size is chosen so that the MISP processes fit in the budget and --in_memory
+      is dropped if the grid won't fit.  The aggregation row buffers are counted and the --threads bands are made
+      smaller if they won't fit.  The MISP bytes per cell and per point come from bench/misp_memory.sh.
+
+
+    Version 3.19
+    PFM Software
+    10/16/26
+
+    - Implemented --grid_type G as a threaded inverse distance quick-look gridder with --search_radius.  It used to
+      be treated as MISP.  Its outputs (and G --variant outputs) have CHRTR2_UNDEFINED as the header grid type.
+
+
+    Version 3.20
+    PFM Software
+    10/16/26
+
+    - Added --max_fill_distance.  Only cells within that distance of real or hand-drawn data are interpolated and
+      MISP only runs over the area that can be filled.
+
+
+    Version 3.21
+    PFM Software
+    10/16/26
+
+    - Added --manifest and --update.  A run with --manifest writes a manifest next to the CHRTR2 file and --update
+      only redoes the tiles whose bins changed since then.  A run without --manifest removes an old manifest.
+
+
+    Version 3.22
+    PFM Software
+    10/16/26
+
+    - Added --tile_cache DIR.  Gridded MISP tiles are saved by a hash of their inputs and reused by later runs.
+
+
+    Version 3.23
+    PFM Software
+    10/16/26
+
+    - Added --checkpoint and --resume so that long conversions can be picked up where they were interrupted.
+    - The CHRTR2 file and the checkpoint are synced to disk at each checkpoint, and --resume refuses to go on if the
+      PFM has changed since the checkpoint.
+
+
+    Version 3.24
+    PFM Software
+    10/16/26
+
+    - Added --timing to report the time spent in each stage and the bin, sounding, and cell rates.
+    - Added the bench directory with pfm_bench_gen, which builds synthetic PFM files, and the run_bench.sh benchmark
+      suite.
+
+
+    Version 3.25
+    PFM Software
+    10/16/26
+
+    - Added --stats JSON_FILE, a JSON report of the wall and CPU time of each phase, bin/sounding/rejected counts,
+      bytes read and written, library call counts, and peak memory use.
+
+
+    Version 3.26
+    PFM Software
+    10/16/26
+
+    - Added --batch BATCH_FILE to run many conversions in parallel child processes, largest first, within a
+      --threads and --max_memory budget, with a log and status for each.
+
+
+    Version 3.27
+    PFM Software
+    10/16/26
+
+    - More than one PFM_FILE now builds a single mosaic CHRTR2 over all of them, with overlapping bins combined and
+      each PFM read once by its own reader thread.  With --threads the merged rows are aggregated by that many
+      threads.
+
+
+    Version 3.28
+    PFM Software
+    10/16/26
+
+    - Added --mbr and --window to convert only part of a PFM, reading only the bins in the area plus a --margin of
+      cells used for the gridding.
+
+
+    Version 3.29
+    PFM Software
+    10/16/26
+
+    - Added --overviews FACTOR,... to build decimated CHRTR2 grids from the same read of the PFM, averaging by
+      number of points, and grid them like the full grid.
+
+
+    Version 3.30
+    PFM Software
+    10/16/26
+
+    - Added --geotiff TIFF_FILE to also write the finished Z, total uncertainty, and status as a tiled, compressed
+      Cloud Optimized GeoTIFF with overviews.
+
+
+    Version 3.31
+    PFM Software
+    10/16/26
+
+    - Added --variant CHRTR2_FILE[,BOUND][,GRID_TYPE][,[no_]uncertainty] to write other versions of the output from
+      the same read of the PFM.  Up to --threads of the outputs are gridded at once and they share the --threads and
+      --max_memory budget.
+
+
+    Version 3.32
+    PFM Software
+    10/16/26
+
+    - Added --stream FILE|- to write the finished grid row by row to a file, named pipe, or standard output in a
+      documented raw format.  With --grid_type N the rows go out as they're aggregated and otherwise as the
+      gridders fill them in, so the CHRTR2 file isn't read back.  With a margin to crop (--mbr or --window),
+      --update, --resume, or --variant the finished file is still read back and streamed.
+
 */
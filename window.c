@@ -0,0 +1,230 @@
+
+/*********************************************************************************************
+
+    This is public domain software that was developed by or for the U.S. Naval Oceanographic
+    Office and/or the U.S. Army Corps of Engineers.
+
+    This is a work of the U.S. Government. In accordance with 17 USC 105, copyright protection
+    is not available for any work of the U.S. Government.
+
+    Neither the United States Government, nor any employees of the United States Government,
+    nor the author, makes any warranty, express or implied, without even the implied warranty
+    of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE, or assumes any liability or
+    responsibility for the accuracy, completeness, or usefulness of any information,
+    apparatus, product, or process disclosed, or represents that its use would not infringe
+    privately-owned rights. Reference herein to any specific commercial products, process,
+    or service by trade name, trademark, manufacturer, or otherwise, does not necessarily
+    constitute or imply its endorsement, recommendation, or favoring by the United States
+    Government. The views and opinions of authors expressed herein do not necessarily state
+    or reflect those of the United States Government, and shall not be used for advertising
+    or product endorsement purposes.
+*********************************************************************************************/
+
+
+/****************************************  IMPORTANT NOTE  **********************************
+
+    Comments in this file that start with / * ! are being used by Doxygen to document the
+    software.  Dashes in these comment blocks are used to create bullet lists.  The lack of
+    blank lines after a block of dash preceeded comments means that the next block of dash
+    preceeded comments is a new, indented bullet list.  I've tried to keep the Doxygen
+    formatting to a minimum but there are some other items (like <br> and <pre>) that need
+    to be left alone.  If you see a comment that starts with / * ! and there is something
+    that looks a bit weird it is probably due to some arcane Doxygen syntax.  Be very
+    careful modifying blocks of Doxygen comments.
+
+*****************************************  IMPORTANT NOTE  **********************************/
+
+
+
+
+#include "pfm2chrtr2.h"
+
+
+/*
+
+    Sub-area extraction (--mbr and --window).
+
+    The requested area is snapped outward to whole bins of the PFM and clipped to it.  We then add --margin cells
+    on every side (clipped to the PFM again) so that the gridding near the edges sees the data just outside the
+    area, and the PFM header is cut down to that working area before anything else looks at it.  From then on the
+    conversion is the usual one on a smaller grid: the bin scan, the aggregation, and the gridding only touch the
+    bins in the working area (the PFM reads are offset by pfm_row0 and pfm_col0).  If there is a margin the CHRTR2
+    file for the working area is written under a temporary name and the requested area is copied out of it at the
+    end, so the time and memory used depend on the size of the area and not on the size of the PFM.
+
+*/
+
+
+
+/*  Work out the working area and cut the PFM header down to it.  Returns NVTrue if the result will have to be
+    cropped out of a larger working file.  */
+
+uint8_t plan_sub_area (OPTIONS *options, PFM_OPEN_ARGS *open_args)
+{
+  PFM_HEADER          *head = &open_args->head;
+  int32_t             row0, col0, row1, col1, margin;
+
+
+  if (options->sub_area == SUB_AREA_MBR)
+    {
+      col0 = (int32_t) floor ((options->mbr.min_x - head->mbr.min_x) / head->x_bin_size_degrees);
+      row0 = (int32_t) floor ((options->mbr.min_y - head->mbr.min_y) / head->y_bin_size_degrees);
+      col1 = (int32_t) ceil ((options->mbr.max_x - head->mbr.min_x) / head->x_bin_size_degrees);
+      row1 = (int32_t) ceil ((options->mbr.max_y - head->mbr.min_y) / head->y_bin_size_degrees);
+    }
+  else
+    {
+      row0 = options->window[0];
+      col0 = options->window[1];
+      row1 = row0 + options->window[2];
+      col1 = col0 + options->window[3];
+    }
+
+  row0 = MAX (row0, 0);
+  col0 = MAX (col0, 0);
+  row1 = MIN (row1, head->bin_height);
+  col1 = MIN (col1, head->bin_width);
+
+  if (row1 <= row0 || col1 <= col0)
+    {
+      fprintf (stderr, "\n\nThe requested area is outside of the PFM!\n\n");
+      exit (-1);
+    }
+
+
+  /*  From here on the window is the snapped area in PFM bins.  */
+
+  options->window[0] = row0;
+  options->window[1] = col0;
+  options->window[2] = row1 - row0;
+  options->window[3] = col1 - col0;
+
+
+  /*  By default the margin is whatever the gridding looks at around a cell.  */
+
+  margin = options->margin;
+
+  if (margin < 0)
+    {
+      switch (options->grid_type)
+        {
+        case 1:
+          margin = options->misp_halo;
+          break;
+
+        case 2:
+          margin = options->search_radius;
+          break;
+
+        default:
+          margin = 0;
+          break;
+        }
+    }
+
+  options->pfm_row0 = MAX (row0 - margin, 0);
+  options->pfm_col0 = MAX (col0 - margin, 0);
+  row1 = MIN (row1 + margin, head->bin_height);
+  col1 = MIN (col1 + margin, head->bin_width);
+
+  fprintf (stderr, "Extracting rows %d-%d and columns %d-%d (%d x %d bins) with a %d cell margin\n", options->window[0],
+           options->window[0] + options->window[2] - 1, options->window[1], options->window[1] + options->window[3] - 1,
+           options->window[3], options->window[2], margin);
+  fflush (stderr);
+
+
+  head->mbr.min_x += options->pfm_col0 * head->x_bin_size_degrees;
+  head->mbr.min_y += options->pfm_row0 * head->y_bin_size_degrees;
+  head->bin_width = col1 - options->pfm_col0;
+  head->bin_height = row1 - options->pfm_row0;
+  head->mbr.max_x = head->mbr.min_x + head->bin_width * head->x_bin_size_degrees;
+  head->mbr.max_y = head->mbr.min_y + head->bin_height * head->y_bin_size_degrees;
+
+  return (head->bin_width != options->window[3] || head->bin_height != options->window[2]);
+}
+
+
+
+/*  Copy the requested area out of the working CHRTR2 file into the output file and remove the working file.  The
+    observed Z range is recomputed from the real and hand-drawn cells that are left.  */
+
+void crop_chrtr2 (OPTIONS *options, char *work_file)
+{
+  CHRTR2_HEADER       work_header, chrtr2_header;
+  CHRTR2_RECORD       *chrtr2_row;
+  int32_t             work_handle, chrtr2_handle, i, j, row0, col0;
+  float               min_z = 9999999999.0, max_z = -9999999999.0;
+
+
+  work_handle = chrtr2_open_file (work_file, &work_header, CHRTR2_READONLY);
+
+  if (work_handle < 0)
+    {
+      fprintf (stderr, "The file %s is not a CHRTR2 structure or there was an error reading the file.\n", work_file);
+      fprintf (stderr, "The error message returned was: %s\n\n", chrtr2_strerror ());
+      exit (-1);
+    }
+
+  row0 = options->window[0] - options->pfm_row0;
+  col0 = options->window[1] - options->pfm_col0;
+
+  chrtr2_header = work_header;
+  chrtr2_header.width = options->window[3];
+  chrtr2_header.height = options->window[2];
+  chrtr2_header.mbr.wlon = work_header.mbr.wlon + col0 * work_header.lon_grid_size_degrees;
+  chrtr2_header.mbr.slat = work_header.mbr.slat + row0 * work_header.lat_grid_size_degrees;
+  chrtr2_header.mbr.elon = chrtr2_header.mbr.wlon + (chrtr2_header.width - 1) * work_header.lon_grid_size_degrees;
+  chrtr2_header.mbr.nlat = chrtr2_header.mbr.slat + (chrtr2_header.height - 1) * work_header.lat_grid_size_degrees;
+
+  chrtr2_handle = chrtr2_create_file (options->chrtr2_file, &chrtr2_header);
+  if (chrtr2_handle < 0)
+    {
+      chrtr2_perror ();
+      exit (-1);
+    }
+
+  chrtr2_row = (CHRTR2_RECORD *) malloc (chrtr2_header.width * sizeof (CHRTR2_RECORD));
+  if (chrtr2_row == NULL)
+    {
+      perror ("Allocating row in crop_chrtr2");
+      exit (-1);
+    }
+
+  for (i = 0 ; i < chrtr2_header.height ; i++)
+    {
+      count_calls (CALL_CHRTR2_READ_ROW, 1);
+      if (chrtr2_read_row (work_handle, row0 + i, col0, chrtr2_header.width, chrtr2_row))
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+
+      for (j = 0 ; j < chrtr2_header.width ; j++)
+        {
+          if (chrtr2_row[j].status & (CHRTR2_REAL | CHRTR2_DIGITIZED_CONTOUR))
+            {
+              min_z = MIN (chrtr2_row[j].z, min_z);
+              max_z = MAX (chrtr2_row[j].z, max_z);
+            }
+        }
+
+      count_calls (CALL_CHRTR2_WRITE_ROW, 1);
+      if (chrtr2_write_row (chrtr2_handle, i, 0, chrtr2_header.width, chrtr2_row))
+        {
+          chrtr2_perror ();
+          exit (-1);
+        }
+    }
+
+  free (chrtr2_row);
+
+  chrtr2_header.min_observed_z = min_z;
+  chrtr2_header.max_observed_z = max_z;
+
+  chrtr2_update_header (chrtr2_handle, chrtr2_header);
+
+  chrtr2_close_file (chrtr2_handle);
+  chrtr2_close_file (work_handle);
+
+  remove (work_file);
+}